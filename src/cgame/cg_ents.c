@@ -1051,7 +1051,7 @@ static void CG_CalcEntityLerpPositions(centity_t *cent) {
         cent->currentState.clientNum != cg.predictedPlayerState.clientNum) {
         cent->currentState.pos.trType = TR_LINEAR_STOP;
         cent->currentState.pos.trTime = cg.snap->serverTime;
-        cent->currentState.pos.trDuration = 1000 / sv_fps.integer;
+        cent->currentState.pos.trDuration = CG_SnapshotMsec();
     }
     // unlagged - timenudge extrapolation
 
@@ -1388,6 +1388,7 @@ extern vmCvar_t cg_debugDelag;
 extern vmCvar_t cg_drawBBox;
 extern vmCvar_t cg_cmdTimeNudge;
 extern vmCvar_t sv_fps;
+extern vmCvar_t sv_snapshotFps;
 extern vmCvar_t cg_projectileNudge;
 extern vmCvar_t cg_optimizePrediction;
 extern vmCvar_t cl_timeNudge;
@@ -1742,6 +1743,7 @@ localEntity_t *CG_MakeExplosion(vec3_t origin, vec3_t dir, qhandle_t hModel,
 // cg_snapshot.c
 //
 void CG_ProcessSnapshots(void);
+int CG_SnapshotMsec(void);
 // unlagged - early transitioning
 void CG_TransitionEntity(centity_t *cent);
 // unlagged - early transitioning
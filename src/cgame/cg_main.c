@@ -195,6 +195,7 @@ vmCvar_t cg_debugDelag;
 vmCvar_t cg_drawBBox;
 vmCvar_t cg_cmdTimeNudge;
 vmCvar_t sv_fps;
+vmCvar_t sv_snapshotFps;
 vmCvar_t cg_projectileNudge;
 vmCvar_t cg_optimizePrediction;
 vmCvar_t cl_timeNudge;
@@ -399,6 +400,8 @@ static cvarTable_t cvarTable[] = {
     {&cg_cmdTimeNudge, "cg_cmdTimeNudge", "0", CVAR_ARCHIVE | CVAR_USERINFO},
     // this will be automagically copied from the server
     {&sv_fps, "sv_fps", "20", 0},
+    // 0 for servers that send a snapshot every game frame
+    {&sv_snapshotFps, "sv_snapshotFps", "0", 0},
     {&cg_projectileNudge, "cg_projectileNudge", "0", CVAR_ARCHIVE},
     {&cg_optimizePrediction, "cg_optimizePrediction", "1", CVAR_ARCHIVE},
     {&cl_timeNudge, "cl_timeNudge", "0", CVAR_ARCHIVE},
@@ -2274,6 +2277,9 @@ void CG_Init(int serverMessageNum, int serverCommandSequence, int clientNum) {
     cg.menuitem = 0;
     trap_Cvar_Set("cl_menu", "0");
 
+    // ask the server for coalesced "csm" configstring commands
+    trap_Cvar_Set("cl_csBatch", "1");
+
     // reset aipointer
     ai_nodepointer = 0;
 
@@ -251,11 +251,8 @@ CG_ConfigStringModified
 
 ================
 */
-static void CG_ConfigStringModified(void) {
+static void CG_ConfigStringModified(int num) {
     const char *str;
-    int num;
-
-    num = atoi(CG_Argv(1));
 
     // get the gamestate from the client system, which will have the
     // new configstring already integrated
@@ -484,6 +481,7 @@ Cmd_Argc() / Cmd_Argv()
 static void CG_ServerCommand(void) {
     const char *cmd;
     char text[MAX_SAY_TEXT];
+    int i;
 
     cmd = CG_Argv(0);
 
@@ -503,7 +501,15 @@ static void CG_ServerCommand(void) {
     }
 
     if (!strcmp(cmd, "cs")) {
-        CG_ConfigStringModified();
+        CG_ConfigStringModified(atoi(CG_Argv(1)));
+        return;
+    }
+
+    // several configstrings at once, the client system leaves the indexes
+    if (!strcmp(cmd, "csm")) {
+        for (i = 1; i < trap_Argc(); i++) {
+            CG_ConfigStringModified(atoi(CG_Argv(i)));
+        }
         return;
     }
 
@@ -249,6 +249,18 @@ static void CG_SetNextSnap(snapshot_t *snap) {
     CG_BuildSolidList(qfalse);
 }
 
+/*
+========================
+CG_SnapshotMsec
+
+Time between two snapshots from the server. sv_fps is the game frame rate,
+snapshots may only be built every few game frames (sv_snapshotFps)
+========================
+*/
+int CG_SnapshotMsec(void) {
+    return BG_SnapshotMsec(sv_fps.integer, sv_snapshotFps.integer);
+}
+
 /*
 ========================
 CG_ReadNextSnapshot
@@ -283,7 +295,7 @@ static snapshot_t *CG_ReadNextSnapshot(void) {
 
             // keep grabbing one snapshot earlier until we get to the right time
             while (dest->serverTime >
-                   time - cg_latentSnaps.integer * (1000 / sv_fps.integer)) {
+                   time - cg_latentSnaps.integer * CG_SnapshotMsec()) {
                 if (!(r = trap_GetSnapshot(cgs.processedSnapshotNum - i,
                                            dest))) {
                     // the snapshot is not valid, so stop here
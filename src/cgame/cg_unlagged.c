@@ -117,10 +117,10 @@ void CG_PredictWeaponEffects( centity_t *cent ) {
 
 						c->currentState.pos.trTime = TR_LINEAR_STOP;
 						c->currentState.pos.trTime = cg.snap->serverTime;
-						c->currentState.pos.trDuration = 1000 / sv_fps.integer;
+						c->currentState.pos.trDuration = CG_SnapshotMsec();
 
 						BG_EvaluateTrajectory( &c->currentState.pos, cg.snap->serverTime, origin1 );
-						BG_EvaluateTrajectory( &c->currentState.pos, cg.snap->serverTime + 1000 / sv_fps.integer, origin2 );
+						BG_EvaluateTrajectory( &c->currentState.pos, cg.snap->serverTime + CG_SnapshotMsec(), origin2 );
 
 						// print some debugging stuff exactly like what the server does
 
@@ -904,7 +904,7 @@ void CG_DrawActiveFrame(int serverTime, stereoFrame_t stereoView,
 
     // unlagged - lag simulation #1
     //  adjust the clock to reflect latent snaps
-    cg.time -= cg_latentSnaps.integer * (1000 / sv_fps.integer);
+    cg.time -= cg_latentSnaps.integer * CG_SnapshotMsec();
 // unlagged - lag simulation #1
 
     cg.demoPlayback = demoPlayback;
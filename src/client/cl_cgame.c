@@ -185,30 +185,30 @@ void CL_AddCgameCommand(const char *cmdName) { Cmd_AddCommand(cmdName, NULL); }
 
 /*
 =====================
-CL_ConfigstringModified
+CL_SetConfigstrings
+
+Builds a new gameState_t with the given strings replaced
 =====================
 */
-void CL_ConfigstringModified(void) {
-    char *old, *s;
-    int i, index;
-    char *dup;
+static void CL_SetConfigstrings(int count, const int *indexes,
+                                char *const *strings) {
+    const char *dups[MAX_CONFIGSTRINGS];
     gameState_t oldGs;
-    int len;
+    qboolean systemInfo;
+    int i, len;
 
-    index = atoi(Cmd_Argv(1));
-    if (index < 0 || index >= MAX_CONFIGSTRINGS) {
-        Com_Error(ERR_DROP, "CL_ConfigstringModified: bad index %i", index);
-    }
-    // get everything after "cs <num>"
-    s = Cmd_ArgsFrom(2);
+    oldGs = cl.gameState;
 
-    old = cl.gameState.stringData + cl.gameState.stringOffsets[index];
-    if (!strcmp(old, s)) {
-        return; // unchanged
+    for (i = 0; i < MAX_CONFIGSTRINGS; i++) {
+        dups[i] = oldGs.stringData + oldGs.stringOffsets[i];
+    }
+    systemInfo = qfalse;
+    for (i = 0; i < count; i++) {
+        dups[indexes[i]] = strings[i];
+        if (indexes[i] == CS_SYSTEMINFO) {
+            systemInfo = qtrue;
+        }
     }
-
-    // build the new gameState_t
-    oldGs = cl.gameState;
 
     Com_Memset(&cl.gameState, 0, sizeof(cl.gameState));
 
@@ -216,16 +216,11 @@ void CL_ConfigstringModified(void) {
     cl.gameState.dataCount = 1;
 
     for (i = 0; i < MAX_CONFIGSTRINGS; i++) {
-        if (i == index) {
-            dup = s;
-        } else {
-            dup = oldGs.stringData + oldGs.stringOffsets[i];
-        }
-        if (!dup[0]) {
+        if (!dups[i][0]) {
             continue; // leave with the default empty string
         }
 
-        len = strlen(dup);
+        len = strlen(dups[i]);
 
         if (len + 1 + cl.gameState.dataCount > MAX_GAMESTATE_CHARS) {
             Com_Error(ERR_DROP, "MAX_GAMESTATE_CHARS exceeded");
@@ -233,17 +228,94 @@ void CL_ConfigstringModified(void) {
 
         // append it to the gameState string buffer
         cl.gameState.stringOffsets[i] = cl.gameState.dataCount;
-        Com_Memcpy(cl.gameState.stringData + cl.gameState.dataCount, dup,
+        Com_Memcpy(cl.gameState.stringData + cl.gameState.dataCount, dups[i],
                    len + 1);
         cl.gameState.dataCount += len + 1;
     }
 
-    if (index == CS_SYSTEMINFO) {
+    if (systemInfo) {
         // parse serverId and other cvars
         CL_SystemInfoChanged();
     }
 }
 
+/*
+=====================
+CL_ConfigstringModified
+=====================
+*/
+void CL_ConfigstringModified(void) {
+    char *old, *s;
+    int index;
+
+    index = atoi(Cmd_Argv(1));
+    if (index < 0 || index >= MAX_CONFIGSTRINGS) {
+        Com_Error(ERR_DROP, "CL_ConfigstringModified: bad index %i", index);
+    }
+    // get everything after "cs <num>"
+    s = Cmd_ArgsFrom(2);
+
+    old = cl.gameState.stringData + cl.gameState.stringOffsets[index];
+    if (!strcmp(old, s)) {
+        return; // unchanged
+    }
+
+    CL_SetConfigstrings(1, &index, &s);
+}
+
+/*
+=====================
+CL_ConfigstringsModified
+
+"csm" carries several configstrings as <index> <keep> <text> triples, each
+new string being the first keep characters of the old one followed by text.
+Leaves "csm <index> <index> ..." tokenized for the cgame.
+=====================
+*/
+static void CL_ConfigstringsModified(void) {
+    static char stringData[MAX_GAMESTATE_CHARS];
+    static char indexList[MAX_STRING_CHARS];
+    int indexes[MAX_STRING_TOKENS / 3];
+    char *strings[MAX_STRING_TOKENS / 3];
+    int i, index, keep, len, count, dataCount;
+    const char *old, *text;
+
+    Q_strncpyz(indexList, "csm", sizeof(indexList));
+    count = dataCount = 0;
+
+    for (i = 1; i + 2 < Cmd_Argc(); i += 3) {
+        index = atoi(Cmd_Argv(i));
+        if (index < 0 || index >= MAX_CONFIGSTRINGS) {
+            Com_Error(ERR_DROP, "CL_ConfigstringsModified: bad index %i",
+                      index);
+        }
+
+        old = cl.gameState.stringData + cl.gameState.stringOffsets[index];
+        keep = atoi(Cmd_Argv(i + 1));
+        if (keep < 0 || keep > (int)strlen(old)) {
+            Com_Error(ERR_DROP, "CL_ConfigstringsModified: bad length %i",
+                      keep);
+        }
+        text = Cmd_Argv(i + 2);
+        len = keep + strlen(text);
+
+        if (dataCount + len + 1 > sizeof(stringData)) {
+            Com_Error(ERR_DROP, "MAX_GAMESTATE_CHARS exceeded");
+        }
+        strings[count] = stringData + dataCount;
+        Com_Memcpy(strings[count], old, keep);
+        Com_Memcpy(strings[count] + keep, text, len - keep + 1);
+        dataCount += len + 1;
+
+        indexes[count++] = index;
+        Q_strcat(indexList, sizeof(indexList), va(" %i", index));
+    }
+
+    CL_SetConfigstrings(count, indexes, strings);
+
+    Cmd_TokenizeString(indexList);
+}
+
 /*
 ===================
 CL_GetServerCommand
@@ -322,6 +394,11 @@ rescan:
         goto rescan;
     }
 
+    if (!strcmp(cmd, "csm")) {
+        CL_ConfigstringsModified();
+        return qtrue;
+    }
+
     if (!strcmp(cmd, "cs")) {
         CL_ConfigstringModified();
         // reparse the string, because CL_ConfigstringModified may have done
@@ -388,6 +465,8 @@ CL_ShutdonwCGame
 void CL_ShutdownCGame(void) {
     Key_SetCatcher(Key_GetCatcher() & ~KEYCATCH_CGAME);
     cls.cgameStarted = qfalse;
+    // the next cgame has to opt in to "csm" again
+    Cvar_Set("cl_csBatch", "0");
     if (!cgvm) {
         return;
     }
@@ -844,6 +923,9 @@ void CL_InitCGame(void) {
     VM_Call(cgvm, CG_INIT, clc.serverMessageSequence,
             clc.lastExecutedServerCommand, clc.clientNum);
 
+    // the clip model and the renderer are done with the map
+    FS_FlushSharedFiles(qfalse);
+
     // reset any CVAR_CHEAT cvars registered by cgame
     if (!clc.demoplaying && !cl_connectedToCheatServer)
         Cvar_SetCheatState();
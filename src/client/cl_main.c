@@ -3211,6 +3211,8 @@ void CL_InitRef(void) {
 
     ri.FS_ReadFile = FS_ReadFile;
     ri.FS_FreeFile = FS_FreeFile;
+    ri.FS_AcquireFile = FS_AcquireFile;
+    ri.FS_ReleaseFile = FS_ReleaseFile;
     ri.FS_WriteFile = FS_WriteFile;
     ri.FS_FreeFileList = FS_FreeFileList;
     ri.FS_ListFiles = FS_ListFiles;
@@ -3527,6 +3529,9 @@ void CL_Init(void) {
              CVAR_ROM | CVAR_USERINFO);
     Cvar_Get("sdk_engine_comment", "", CVAR_ROM);
     Cvar_Get("cl_md5", "", CVAR_ROM | CVAR_USERINFO);
+    // tells the server the cgame understands coalesced "csm" configstring
+    // commands, raised by the cgame itself so older ones still get "cs"
+    Cvar_Get("cl_csBatch", "0", CVAR_ROM | CVAR_USERINFO);
     Sys_BinaryEngineComment();
 
     Cvar_Get("password", "", CVAR_USERINFO);
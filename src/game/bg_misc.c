@@ -2721,6 +2721,30 @@ void BG_PlayerStateToEntityStateExtraPolate(playerState_t *ps, entityState_t *s,
         s->time2 |= (1 << WP_AKIMBO);
 }
 
+/*
+========================
+BG_SnapshotMsec
+
+Time between two snapshots of a server running fps game frames a second and
+building snapshotFps snapshots a second. Snapshots are only built on game
+frames, so this is a whole number of them, like SV_SnapshotTicks.
+========================
+*/
+int BG_SnapshotMsec(int fps, int snapshotFps) {
+    int ticks;
+
+    if (fps < 1) {
+        fps = 20;
+    }
+
+    ticks = 1;
+    if (snapshotFps >= 1 && snapshotFps < fps) {
+        ticks = (fps + snapshotFps - 1) / snapshotFps;
+    }
+
+    return ticks * (1000 / fps);
+}
+
 /*
 ==========================
 BG_AnimLength
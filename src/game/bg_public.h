@@ -1130,6 +1130,7 @@ void BG_PlayerStateToEntityState(playerState_t *ps, entityState_t *s,
                                  qboolean snap);
 void BG_PlayerStateToEntityStateExtraPolate(playerState_t *ps, entityState_t *s,
                                             int time, qboolean snap);
+int BG_SnapshotMsec(int fps, int snapshotFps);
 
 qboolean BG_PlayerTouchesItem(playerState_t *ps, entityState_t *item,
                               int atTime);
@@ -1024,12 +1024,13 @@ void ClientThink_real(gentity_t *ent) {
     //  if the client is adding latency to received snapshots (server-to-client
     //  latency)
     if (client->pers.latentSnaps) {
+        int snapshotMsec =
+            BG_SnapshotMsec(sv_fps.integer, sv_snapshotFps.integer);
+
         // adjust the real ping
-        client->pers.realPing +=
-            client->pers.latentSnaps * (1000 / sv_fps.integer);
+        client->pers.realPing += client->pers.latentSnaps * snapshotMsec;
         // adjust the attack time so backward reconciliation will work
-        client->attackTime -=
-            client->pers.latentSnaps * (1000 / sv_fps.integer);
+        client->attackTime -= client->pers.latentSnaps * snapshotMsec;
     }
     // unlagged - lag simulation #1
 
@@ -1341,7 +1341,23 @@ Returns qtrue if the inflictor can directly damage the target.  Used for
 explosions and melee attacks.
 ============
 */
+static qboolean G_CanDamageTraced(gentity_t *targ, vec3_t origin,
+                                  const trace_t *center);
+
 qboolean CanDamage(gentity_t *targ, vec3_t origin) {
+    return G_CanDamageTraced(targ, origin, NULL);
+}
+
+/*
+============
+G_CanDamageTraced
+
+CanDamage with the trace to the middle of a non-breakable target already
+done by the caller, if center is not NULL
+============
+*/
+static qboolean G_CanDamageTraced(gentity_t *targ, vec3_t origin,
+                                  const trace_t *center) {
     vec3_t dest;
     trace_t tr;
     vec3_t midpoint;
@@ -1374,8 +1390,12 @@ qboolean CanDamage(gentity_t *targ, vec3_t origin) {
             G_BreakablePrepare(targ, shaderNum);
         }
     }
-    trap_Trace(&tr, origin, vec3_origin, vec3_origin, dest, ENTITYNUM_NONE,
-               MASK_SOLID);
+    if (center) {
+        tr = *center;
+    } else {
+        trap_Trace(&tr, origin, vec3_origin, vec3_origin, dest, ENTITYNUM_NONE,
+                   MASK_SOLID);
+    }
 
     if (tr.fraction == 1.0 || tr.entityNum == targ->s.number)
         return qtrue;
@@ -1465,9 +1485,41 @@ qboolean CanDamage(gentity_t *targ, vec3_t origin) {
     return qfalse;
 }
 
+/*
+============
+G_RadiusDistance
+
+Distance from origin to the edge of the bounding box of ent
+============
+*/
+static float G_RadiusDistance(gentity_t *ent, const vec3_t origin) {
+    vec3_t v;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        if (origin[i] < ent->r.absmin[i]) {
+            v[i] = ent->r.absmin[i] - origin[i];
+        } else if (origin[i] > ent->r.absmax[i]) {
+            v[i] = origin[i] - ent->r.absmax[i];
+        } else {
+            v[i] = 0;
+        }
+    }
+
+    return VectorLength(v);
+}
+
+// targets whose CanDamage center trace is batched, the others trace alone
+#define MAX_RADIUS_TRACES 64
+
 /*
 ============
 G_RadiusDamage
+
+The first CanDamage trace of every target goes to the engine in one batch.
+Damage is still dealt target by target, and once something that is not a
+living player was hit or a breakable was relinked, the remaining batched
+results may be wrong and those targets trace again.
 ============
 */
 qboolean G_RadiusDamage(vec3_t origin, gentity_t *attacker, float damage,
@@ -1477,10 +1529,15 @@ qboolean G_RadiusDamage(vec3_t origin, gentity_t *attacker, float damage,
     int entityList[MAX_GENTITIES];
     int numListedEntities;
     vec3_t mins, maxs;
-    vec3_t v;
     vec3_t dir;
     int i, e;
     qboolean hitClient = qfalse;
+    traceRequest_t requests[MAX_RADIUS_TRACES];
+    trace_t results[MAX_RADIUS_TRACES];
+    int requestEntity[MAX_RADIUS_TRACES];
+    int numRequests, nextRequest;
+    const trace_t *center;
+    qboolean tracesStale;
 
     if (radius < 1) {
         radius = 1;
@@ -1494,33 +1551,73 @@ qboolean G_RadiusDamage(vec3_t origin, gentity_t *attacker, float damage,
     numListedEntities =
         trap_EntitiesInBox(mins, maxs, entityList, MAX_GENTITIES);
 
-    for (e = 0; e < numListedEntities; e++) {
+    // trace to the middle of every target at once
+    numRequests = 0;
+    for (e = 0; e < numListedEntities && numRequests < MAX_RADIUS_TRACES;
+         e++) {
         ent = &g_entities[entityList[e]];
 
-        if (ent == ignore)
+        if (ent == ignore || !ent->takedamage ||
+            ent->s.eType == ET_BREAKABLE) {
             continue;
-        if (!ent->takedamage)
+        }
+        if (G_RadiusDistance(ent, origin) >= radius) {
             continue;
+        }
 
-        // find the distance from the edge of the bounding box
-        for (i = 0; i < 3; i++) {
-            if (origin[i] < ent->r.absmin[i]) {
-                v[i] = ent->r.absmin[i] - origin[i];
-            } else if (origin[i] > ent->r.absmax[i]) {
-                v[i] = origin[i] - ent->r.absmax[i];
-            } else {
-                v[i] = 0;
+        VectorCopy(origin, requests[numRequests].start);
+        VectorAdd(ent->r.absmin, ent->r.absmax, requests[numRequests].end);
+        VectorScale(requests[numRequests].end, 0.5,
+                    requests[numRequests].end);
+        VectorClear(requests[numRequests].mins);
+        VectorClear(requests[numRequests].maxs);
+        requests[numRequests].passEntityNum = ENTITYNUM_NONE;
+        requests[numRequests].contentmask = MASK_SOLID;
+        requests[numRequests].capsule = qfalse;
+        requestEntity[numRequests] = e;
+        numRequests++;
+    }
+    G_TraceBatch(results, requests, numRequests);
+
+    nextRequest = 0;
+    tracesStale = qfalse;
+    for (e = 0; e < numListedEntities; e++) {
+        ent = &g_entities[entityList[e]];
+
+        center = NULL;
+        if (nextRequest < numRequests && requestEntity[nextRequest] == e) {
+            center = &results[nextRequest];
+            if (tracesStale) {
+                center = NULL;
             }
+            nextRequest++;
         }
 
-        dist = VectorLength(v);
+        if (ent == ignore)
+            continue;
+        if (!ent->takedamage)
+            continue;
+
+        dist = G_RadiusDistance(ent, origin);
         if (dist >= radius) {
             continue;
         }
 
         points = damage * (1.0 - dist / radius);
 
-        if (CanDamage(ent, origin)) {
+        if (center && ent->s.eType == ET_BREAKABLE) {
+            center = NULL;
+        }
+        if (center) {
+            // the target must still be where it was traced to
+            VectorAdd(ent->r.absmin, ent->r.absmax, dir);
+            VectorScale(dir, 0.5, dir);
+            if (!VectorCompare(dir, requests[nextRequest - 1].end)) {
+                center = NULL;
+            }
+        }
+
+        if (G_CanDamageTraced(ent, origin, center)) {
             if (LogAccuracyHit(ent, attacker)) {
                 hitClient = qtrue;
             }
@@ -1530,6 +1627,13 @@ qboolean G_RadiusDamage(vec3_t origin, gentity_t *attacker, float damage,
             dir[2] += 24;
             G_Damage(ent, NULL, attacker, dir, origin, (int)points,
                      DAMAGE_RADIUS, mod);
+            if (!ent->client || ent->health <= 0) {
+                tracesStale = qtrue;
+            }
+        }
+        if (ent->s.eType == ET_BREAKABLE) {
+            // CanDamage relinks breakables
+            tracesStale = qtrue;
         }
     }
 
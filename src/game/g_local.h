@@ -688,6 +688,8 @@ void G_AddPredictableEvent(gentity_t *ent, int event, int eventParm);
 void G_AddEvent(gentity_t *ent, int event, int eventParm);
 void G_SetOrigin(gentity_t *ent, vec3_t origin);
 qboolean G_IsAnyClientWithinRadius(const vec3_t org, float rad, int ignoreTeam);
+void G_TraceBatch(trace_t *results, const traceRequest_t *requests,
+                  int count);
 
 //
 // g_combat.c
@@ -966,6 +968,8 @@ extern vmCvar_t g_delagHitscan;
 extern vmCvar_t g_truePing;
 // this is for convenience - using "sv_fps.integer" is nice :)
 extern vmCvar_t sv_fps;
+extern vmCvar_t sv_snapshotFps;
+extern vmCvar_t sv_traceBatch;
 // unlagged - server options
 
 // duel cvars
@@ -1101,6 +1105,11 @@ void trap_SetBrushModel(gentity_t *ent, const char *name);
 void trap_Trace(trace_t *results, const vec3_t start, const vec3_t mins,
                 const vec3_t maxs, const vec3_t end, int passEntityNum,
                 int contentmask);
+void trap_TraceCapsule(trace_t *results, const vec3_t start, const vec3_t mins,
+                       const vec3_t maxs, const vec3_t end, int passEntityNum,
+                       int contentmask);
+void trap_TraceBatch(trace_t *results, const traceRequest_t *requests,
+                     int count);
 int trap_PointContents(const vec3_t point, int passEntityNum);
 qboolean trap_InPVS(const vec3_t p1, const vec3_t p2);
 qboolean trap_InPVSIgnorePortals(const vec3_t p1, const vec3_t p2);
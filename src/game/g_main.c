@@ -151,6 +151,8 @@ vmCvar_t g_forcebreakrespawn;
 vmCvar_t g_delagHitscan;
 vmCvar_t g_truePing;
 vmCvar_t sv_fps;
+vmCvar_t sv_snapshotFps;
+vmCvar_t sv_traceBatch;
 // unlagged - server options
 
 vmCvar_t g_redteam;
@@ -291,6 +293,11 @@ static cvarTable_t gameCvarTable[] = {
     // it's CVAR_SYSTEMINFO so the client's sv_fps will be automagically set to
     // its value
     {&sv_fps, "sv_fps", "20", CVAR_SYSTEMINFO | CVAR_ARCHIVE, 0, qfalse},
+    {&sv_snapshotFps, "sv_snapshotFps", "0", CVAR_SYSTEMINFO | CVAR_ARCHIVE, 0,
+     qfalse},
+    // engines that understand G_TRACE_BATCH register it as 1 before the game,
+    // read only so a value left over from a config is forced back to 0
+    {&sv_traceBatch, "sv_traceBatch", "0", CVAR_ROM, 0, qfalse},
     // unlagged - server options
     // Spoon
     {&g_roundtime, "g_roundtime", "4", CVAR_ARCHIVE | CVAR_SERVERINFO, 0,
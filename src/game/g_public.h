@@ -102,6 +102,21 @@ typedef struct {
     entityShared_t r; // shared by both the server system and game
 } sharedEntity_t;
 
+// one trace of a G_TRACE_BATCH call, the arguments of G_TRACE or
+// G_TRACECAPSULE
+typedef struct {
+    vec3_t start;
+    vec3_t end;
+    vec3_t mins;
+    vec3_t maxs;
+    int passEntityNum;
+    int contentmask;
+    qboolean capsule;
+} traceRequest_t;
+
+// most requests a single G_TRACE_BATCH call may carry
+#define MAX_TRACE_BATCH 256
+
 //===============================================================
 
 //
@@ -245,6 +260,11 @@ typedef enum {
     // 1.32
     G_FS_SEEK,
 
+    G_TRACE_BATCH, // ( trace_t *results, const traceRequest_t *requests,
+                   // int count );
+    // runs up to MAX_TRACE_BATCH independent traces in one call, only
+    // present when the sv_traceBatch cvar is set
+
     BOTLIB_SETUP = 200, // ( void );
     BOTLIB_SHUTDOWN,    // ( void );
     BOTLIB_LIBVAR_SET,
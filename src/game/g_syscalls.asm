@@ -46,6 +46,7 @@ equ trap_SnapVector			-43
 equ trap_TraceCapsule		-44
 equ trap_EntityContactCapsule	-45
 equ trap_FS_Seek -46
+equ trap_TraceBatch -47
 
 equ	memset					-101
 equ	memcpy					-102
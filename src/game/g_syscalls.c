@@ -168,6 +168,11 @@ void trap_TraceCapsule(trace_t *results, const vec3_t start, const vec3_t mins,
             contentmask);
 }
 
+void trap_TraceBatch(trace_t *results, const traceRequest_t *requests,
+                     int count) {
+    syscall(G_TRACE_BATCH, results, requests, count);
+}
+
 int trap_PointContents(const vec3_t point, int passEntityNum) {
     return syscall(G_POINT_CONTENTS, point, passEntityNum);
 }
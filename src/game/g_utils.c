@@ -456,6 +456,41 @@ gentity_t *G_TempEntity(vec3_t origin, int event) {
     return e;
 }
 
+/*
+=================
+G_TraceBatch
+
+Runs count independent traces, with as few system calls as the engine allows
+=================
+*/
+void G_TraceBatch(trace_t *results, const traceRequest_t *requests,
+                  int count) {
+    const traceRequest_t *req;
+    int i, n;
+
+    if (sv_traceBatch.integer) {
+        for (i = 0; i < count; i += n) {
+            n = count - i;
+            if (n > MAX_TRACE_BATCH) {
+                n = MAX_TRACE_BATCH;
+            }
+            trap_TraceBatch(results + i, requests + i, n);
+        }
+        return;
+    }
+
+    for (i = 0; i < count; i++) {
+        req = &requests[i];
+        if (req->capsule) {
+            trap_TraceCapsule(&results[i], req->start, req->mins, req->maxs,
+                              req->end, req->passEntityNum, req->contentmask);
+        } else {
+            trap_Trace(&results[i], req->start, req->mins, req->maxs,
+                       req->end, req->passEntityNum, req->contentmask);
+        }
+    }
+}
+
 /*
 ==============================================================================
 
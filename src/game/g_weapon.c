@@ -47,16 +47,12 @@ static void Weapon_Trace_ResetDebug(int passEntityNum) {
     traceNumber = 0;
 }
 
-static int Weapon_Trace(trace_t *results, const vec3_t start, const vec3_t end,
-                        int passEntityNum) {
+static int Weapon_TraceResult(trace_t *results, const vec3_t start) {
     int shaderNum;
     gentity_t *tent;
     vec3_t origin;
     VectorCopy(start, origin);
 
-    // Here is the real trace
-    trap_Trace(results, start, NULL, NULL, end, passEntityNum, MASK_SHOT);
-
     // don't debug weapon trace if not debugging weapon
     if (g_debugWeapon.integer) {
         // Create Temporary entity to show the trace on the client side from
@@ -79,6 +75,14 @@ static int Weapon_Trace(trace_t *results, const vec3_t start, const vec3_t end,
     return shaderNum;
 }
 
+static int Weapon_Trace(trace_t *results, const vec3_t start, const vec3_t end,
+                        int passEntityNum) {
+    // Here is the real trace
+    trap_Trace(results, start, NULL, NULL, end, passEntityNum, MASK_SHOT);
+
+    return Weapon_TraceResult(results, start);
+}
+
 // #define CHECK_ENTITY_BUG
 #ifdef CHECK_ENTITY_BUG
 static void CheckEntityBug(const char *functag, gentity_t *ent) {
@@ -721,7 +725,15 @@ SHOTGUN
 // because client predicts same spreads
 #define DEFAULT_SHOTGUN_DAMAGE 10
 
-qboolean ShotgunPellet(vec3_t start, vec3_t end, gentity_t *ent) {
+// pellets whose first traces go to the engine in one batch
+#define MAX_SHOTGUN_PELLETS 32
+
+// set when a pellet changed what later pellets can hit
+static qboolean pelletTracesStale;
+
+// first is the already traced muzzle to end result, or NULL
+static qboolean ShotgunPellet(vec3_t start, vec3_t end, gentity_t *ent,
+                              const trace_t *first) {
     trace_t tr;
     float damage = bg_weaponlist[ent->client->ps.weapon].damage;
     int passent;
@@ -746,7 +758,13 @@ qboolean ShotgunPellet(vec3_t start, vec3_t end, gentity_t *ent) {
 shotgunfire:
     shootthru = qfalse;
 
-    shaderNum = Weapon_Trace(&tr, tr_start, tr_end, passent);
+    if (first) {
+        tr = *first;
+        shaderNum = Weapon_TraceResult(&tr, tr_start);
+        first = NULL;
+    } else {
+        shaderNum = Weapon_Trace(&tr, tr_start, tr_end, passent);
+    }
 
     // Tequila: Really don't shoot ourself
     if (tr.entityNum == ent->s.number) {
@@ -858,6 +876,7 @@ shotgunfire:
 
                         G_Damage(traceEnt, ent, ent, forward, tr.endpos, damage,
                                  0, ent->client->ps.weapon);
+                        pelletTracesStale = qtrue;
                     }
                     goto wall;
                 }
@@ -901,6 +920,10 @@ shotgunfire:
 
             G_Damage(traceEnt, ent, ent, forward, tr.endpos, damage, 0,
                      ent->client->ps.weapon);
+            if (traceEnt->health <= 0) {
+                // the body changes its box and contents
+                pelletTracesStale = qtrue;
+            }
             CheckBulletDamage(ent, traceEnt,
                               -1); // Look to alert attacker to come closer
             return qtrue;
@@ -911,6 +934,7 @@ shotgunfire:
 
         G_Damage(traceEnt, ent, ent, forward, tr.endpos, damage, 0,
                  ent->client->ps.weapon);
+        pelletTracesStale = qtrue;
 
     wall:
         if (traceEnt->client && traceEnt->client->lasthurt_mod == MOD_BOILER) {
@@ -952,6 +976,47 @@ shotgunfire:
     return qfalse;
 }
 
+/*
+=================
+ShotgunFirePellets
+
+Fires num pellets in order, the first of them being pellet number first of
+the pattern. The first trace of every pellet does not depend on the others,
+so all of them are done in one batch. Once a pellet breaks something or
+kills a player the remaining results may be wrong and those pellets trace
+again on their own.
+Returns the playerhitcount bits of the pellets that hit a player.
+=================
+*/
+static int ShotgunFirePellets(vec3_t origin, vec3_t ends[], int first, int num,
+                              gentity_t *ent) {
+    traceRequest_t requests[MAX_SHOTGUN_PELLETS];
+    trace_t results[MAX_SHOTGUN_PELLETS];
+    int i;
+    int hits = 0;
+
+    for (i = 0; i < num; i++) {
+        VectorCopy(origin, requests[i].start);
+        VectorCopy(ends[i], requests[i].end);
+        VectorClear(requests[i].mins);
+        VectorClear(requests[i].maxs);
+        requests[i].passEntityNum = ENTITYNUM_NONE;
+        requests[i].contentmask = MASK_SHOT;
+        requests[i].capsule = qfalse;
+    }
+    G_TraceBatch(results, requests, num);
+
+    pelletTracesStale = qfalse;
+    for (i = 0; i < num; i++) {
+        if (ShotgunPellet(origin, ends[i], ent,
+                          pelletTracesStale ? NULL : &results[i])) {
+            if ((first + i + 1) < 16)
+                hits |= (1 << (first + i + 1));
+        }
+    }
+    return hits;
+}
+
 // this should match CG_ShotgunPattern
 int ShotgunPattern(vec3_t origin, vec3_t origin2, int seed, gentity_t *ent,
                    qboolean altfire) {
@@ -966,6 +1031,8 @@ int ShotgunPattern(vec3_t origin, vec3_t origin2, int seed, gentity_t *ent,
     int count = bg_weaponlist[ent->client->ps.weapon].count;
     int playerhitcount = 0;
     gentity_t *tent;
+    vec3_t ends[MAX_SHOTGUN_PELLETS];
+    int numEnds = 0, numFired = 0;
 
 #ifdef CHECK_ENTITY_BUG
     CheckEntityBug("ShotgunPattern", ent);
@@ -1063,10 +1130,12 @@ int ShotgunPattern(vec3_t origin, vec3_t origin2, int seed, gentity_t *ent,
             VectorMA(end, r, right, end);
             VectorMA(end, u, up, end);
 
-            if (ShotgunPellet(origin, end, ent)) {
-                if ((i + extra_center_pellet + 1) < 16) {
-                    playerhitcount |= (1 << (i + extra_center_pellet + 1));
-                }
+            VectorCopy(end, ends[numEnds++]);
+            if (numEnds == MAX_SHOTGUN_PELLETS) {
+                playerhitcount |=
+                    ShotgunFirePellets(origin, ends, numFired, numEnds, ent);
+                numFired += numEnds;
+                numEnds = 0;
             }
         }
 
@@ -1084,13 +1153,21 @@ int ShotgunPattern(vec3_t origin, vec3_t origin2, int seed, gentity_t *ent,
             VectorMA(end, r, right, end);
             VectorMA(end, u, up, end);
 
-            if (ShotgunPellet(origin, end, ent)) {
-                if ((i + 1) < 16)
-                    playerhitcount |= (1 << (i + 1));
+            VectorCopy(end, ends[numEnds++]);
+            if (numEnds == MAX_SHOTGUN_PELLETS) {
+                playerhitcount |=
+                    ShotgunFirePellets(origin, ends, numFired, numEnds, ent);
+                numFired += numEnds;
+                numEnds = 0;
             }
         }
     }
 
+    if (numEnds) {
+        playerhitcount |=
+            ShotgunFirePellets(origin, ends, numFired, numEnds, ent);
+    }
+
     if (ent->s.angles2[0] != -1 && (ent->s.eFlags & EF_HIT_MESSAGE)) {
         // send the hit message
         tent = G_TempEntity(vec3_origin, EV_HIT_MESSAGE);
@@ -22,6 +22,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 // cmodel.c -- model loading
 
 #include "cm_local.h"
+#include "cm_patch.h"
 
 #ifdef BSPC
 
@@ -42,11 +43,12 @@ void SetPlaneSignbits(cplane_t *out) {
 #endif // BSPC
 
 // to allow boxes to be treated as brush models, we allocate
-// some extra indexes along with those needed by the map
-#define BOX_BRUSHES 1
-#define BOX_SIDES 6
+// some extra indexes along with those needed by the map, one
+// set for each box slot
+#define BOX_BRUSHES CM_BOX_SLOTS
+#define BOX_SIDES (6 * CM_BOX_SLOTS)
 #define BOX_LEAFS 2
-#define BOX_PLANES 12
+#define BOX_PLANES (12 * CM_BOX_SLOTS)
 
 #define LL(x) x = LittleLong(x)
 
@@ -60,11 +62,19 @@ byte *cmod_base;
 cvar_t *cm_noAreas;
 cvar_t *cm_noCurves;
 cvar_t *cm_playerCurveClip;
+cvar_t *cm_simd;
+cvar_t *cm_fastRay;
+cvar_t *cm_facetTree;
+cvar_t *cm_cache;
 #endif
 
-cmodel_t box_model;
-cplane_t *box_planes;
-cbrush_t *box_brush;
+typedef struct {
+    cmodel_t model;
+    cplane_t *planes;
+    cbrush_t *brush;
+} boxHull_t;
+
+static boxHull_t boxHulls[CM_BOX_SLOTS];
 
 void CM_InitBoxHull(void);
 void CM_FloodAreaConnections(void);
@@ -211,6 +221,50 @@ void CM_BoundBrush(cbrush_t *b) {
     b->bounds[1][2] = b->sides[5].plane->dist;
 }
 
+#if CM_SIMD
+// a padding plane that no trace or position test gets to the front of
+#define SIDE_PLANE_PAD_DIST 1e30f
+
+/*
+=================
+CMod_LoadBrushPlanes
+
+Copies the side planes of every brush into four arrays, normal x, y, z and
+dist, for the trace code to test four sides at once
+=================
+*/
+static void CMod_LoadBrushPlanes(void) {
+    cbrush_t *b;
+    cplane_t *plane;
+    float *out;
+    int i, j, stride, total;
+
+    total = 0;
+    for (i = 0; i < cm.numBrushes; i++) {
+        total += 4 * CM_SidePlaneStride(cm.brushes[i].numsides);
+    }
+    out = Hunk_Alloc(total * sizeof(*out), h_high);
+
+    for (i = 0, b = cm.brushes; i < cm.numBrushes; i++, b++) {
+        stride = CM_SidePlaneStride(b->numsides);
+        b->sidePlanes = out;
+        for (j = 0; j < stride; j++) {
+            if (j < b->numsides) {
+                plane = b->sides[j].plane;
+                out[j] = plane->normal[0];
+                out[stride + j] = plane->normal[1];
+                out[stride * 2 + j] = plane->normal[2];
+                out[stride * 3 + j] = plane->dist;
+            } else {
+                out[j] = out[stride + j] = out[stride * 2 + j] = 0;
+                out[stride * 3 + j] = SIDE_PLANE_PAD_DIST;
+            }
+        }
+        out += stride * 4;
+    }
+}
+#endif
+
 /*
 =================
 CMod_LoadBrushes
@@ -247,6 +301,10 @@ void CMod_LoadBrushes(lump_t *l) {
 
         CM_BoundBrush(out);
     }
+
+#if CM_SIMD
+    CMod_LoadBrushPlanes();
+#endif
 }
 
 /*
@@ -457,21 +515,382 @@ void CMod_LoadVisibility(lump_t *l) {
 
 //==================================================================
 
+/*
+===============================================================================
+
+PATCH COLLISION
+
+Patch collision is the slow part of a map load. It is built on the worker
+threads and saved to a cache file next to the game directory, so the next
+load of the same map reads it back in one go.
+
+===============================================================================
+*/
+
+#define MAX_PATCH_VERTS 1024
+
+#define CM_CACHE_IDENT (('H' << 24) + ('C' << 16) + ('M' << 8) + 'C')
+#define CM_CACHE_VERSION 2 // 1 could hold patches chopped with a shared dot
+
+// followed by an offset into the data for each surface, -1 if it is not a
+// patch, and the stored patches
+typedef struct {
+    int ident;
+    int version;
+    unsigned layout;   // of the structures, a cache of another build differs
+    unsigned checksum; // CM_Checksum of the map
+    int numSurfaces;
+    int dataSize;
+    unsigned dataChecksum;
+} cmCacheHeader_t;
+
+typedef struct {
+    int surface;
+    const drawVert_t *verts;
+    int width, height;
+    byte *collide; // stored, with offsets instead of pointers
+    int size;
+    char *log;
+    char *error;
+    int errorCode;
+} patchBuild_t;
+
+/*
+=================
+CM_CacheLayout
+=================
+*/
+static unsigned CM_CacheLayout(void) {
+    int sizes[5];
+
+    sizes[0] = sizeof(void *);
+    sizes[1] = sizeof(patchCollide_t);
+    sizes[2] = sizeof(patchPlane_t);
+    sizes[3] = sizeof(facet_t);
+    sizes[4] = sizeof(facetNode_t);
+    return Com_BlockChecksum(sizes, sizeof(sizes));
+}
+
+/*
+=================
+CM_CachePath
+=================
+*/
+static void CM_CachePath(const char *name, char *path, int size) {
+    char base[MAX_QPATH];
+
+    COM_StripExtension(name, base, sizeof(base));
+    Com_sprintf(path, size, "%s/cmcache/%s.cm", FS_GetCurrentGameDir(),
+                base);
+}
+
+/*
+=================
+CMod_CopyJobString
+
+The zone can't be used on worker threads
+=================
+*/
+static char *CMod_CopyJobString(const char *in) {
+    char *out;
+
+    out = malloc(strlen(in) + 1);
+    if (out) {
+        strcpy(out, in);
+    }
+    return out;
+}
+
+/*
+=================
+CMod_BuildPatchJob
+
+Runs on a worker thread. An error leaks the windings being chopped, the
+load is dropped right after.
+=================
+*/
+static void CMod_BuildPatchJob(void *data, int index) {
+    patchBuild_t *build;
+#ifndef BSPC
+    jobContext_t job;
+#endif
+    vec3_t points[MAX_PATCH_VERTS];
+    const drawVert_t *dv;
+    int i;
+
+    build = (patchBuild_t *)data + index;
+
+#ifndef BSPC
+    Com_SetJobContext(&job);
+    if (!setjmp(job.abort))
+#endif
+    {
+        dv = build->verts;
+        for (i = 0; i < build->width * build->height; i++, dv++) {
+            points[i][0] = LittleFloat(dv->xyz[0]);
+            points[i][1] = LittleFloat(dv->xyz[1]);
+            points[i][2] = LittleFloat(dv->xyz[2]);
+        }
+
+        build->size =
+            CM_BuildPatchCollide(build->width, build->height, points);
+        build->collide = malloc(build->size);
+        if (!build->collide) {
+            Com_Error(ERR_FATAL, "CMod_BuildPatchJob: out of memory");
+        }
+        CM_StorePatchCollide(build->collide);
+    }
+#ifndef BSPC
+    Com_SetJobContext(NULL);
+
+    if (job.log[0]) {
+        build->log = CMod_CopyJobString(job.log);
+    }
+    if (job.errorCode) {
+        build->errorCode = job.errorCode;
+        build->error = CMod_CopyJobString(job.error);
+    }
+#endif
+}
+
+/*
+=================
+CMod_FreePatchBuilds
+=================
+*/
+static void CMod_FreePatchBuilds(patchBuild_t *builds, int count) {
+    int i;
+
+    for (i = 0; i < count; i++) {
+        free(builds[i].collide);
+        free(builds[i].log);
+        free(builds[i].error);
+    }
+    Z_Free(builds);
+}
+
+/*
+=================
+CMod_WritePatchCache
+
+The patches in data must still be stored, not relocated. Written under a
+temporary name and renamed over the cache, so a server sharing the homepath
+never reads a cache being written.
+=================
+*/
+static void CMod_WritePatchCache(const char *name, unsigned checksum,
+                                 const int *offsets, const byte *data,
+                                 int dataSize) {
+    cmCacheHeader_t header;
+    fileHandle_t f;
+    char path[MAX_OSPATH], temp[MAX_OSPATH];
+
+    CM_CachePath(name, path, sizeof(path));
+    Com_sprintf(temp, sizeof(temp), "%s.%i.tmp", path, Sys_PID());
+    f = FS_SV_FOpenFileWrite(temp);
+    if (!f) {
+        Com_Printf("WARNING: couldn't write %s\n", temp);
+        return;
+    }
+
+    header.ident = CM_CACHE_IDENT;
+    header.version = CM_CACHE_VERSION;
+    header.layout = CM_CacheLayout();
+    header.checksum = checksum;
+    header.numSurfaces = cm.numSurfaces;
+    header.dataSize = dataSize;
+    header.dataChecksum = Com_BlockChecksum(data, dataSize);
+
+    FS_Write(&header, sizeof(header), f);
+    FS_Write(offsets, cm.numSurfaces * sizeof(*offsets), f);
+    FS_Write(data, dataSize, f);
+    FS_FCloseFile(f);
+
+#ifdef _WIN32
+    // rename doesn't replace an existing file there
+    FS_HomeRemove(path + strlen(FS_GetCurrentGameDir()) + 1);
+#endif
+    FS_SV_Rename(temp, path, qfalse);
+}
+
+/*
+=================
+CMod_ReadPatchCache
+
+Copies the collision in the cache file of the map to the hunk and points the
+patches at it, qfalse if there is no valid one. Nothing is allocated before
+the whole cache has been checked.
+=================
+*/
+static qboolean CMod_ReadPatchCache(const char *name, unsigned checksum) {
+    const cmCacheHeader_t *header;
+    const int *offsets;
+    const byte *stored;
+    patchCollide_t pc;
+    fileHandle_t f;
+    char path[MAX_OSPATH];
+    byte *file, *data;
+    qboolean valid;
+    int length, i;
+
+    CM_CachePath(name, path, sizeof(path));
+    length = FS_SV_FOpenFileRead(path, &f);
+    if (!f) {
+        return qfalse;
+    }
+
+    // read, never mapped: another server may replace the file meanwhile
+    file = NULL;
+    if (length > 0) {
+        file = malloc(length);
+        if (file && FS_Read(file, length, f) != length) {
+            free(file);
+            file = NULL;
+        }
+    }
+    FS_FCloseFile(f);
+    if (!file) {
+        return qfalse;
+    }
+
+    header = (const cmCacheHeader_t *)file;
+    offsets = (const int *)(header + 1);
+    stored = (const byte *)(offsets + cm.numSurfaces);
+    valid = length >= sizeof(*header) && header->ident == CM_CACHE_IDENT &&
+            header->version == CM_CACHE_VERSION &&
+            header->layout == CM_CacheLayout() &&
+            header->checksum == checksum &&
+            header->numSurfaces == cm.numSurfaces && header->dataSize >= 0 &&
+            length == sizeof(*header) +
+                          cm.numSurfaces * sizeof(*offsets) +
+                          header->dataSize &&
+            header->dataChecksum ==
+                Com_BlockChecksum(stored, header->dataSize);
+
+    for (i = 0; valid && i < cm.numSurfaces; i++) {
+        if (!cm.surfaces[i]) {
+            valid = offsets[i] == -1;
+            continue;
+        }
+        valid = offsets[i] >= 0 && !(offsets[i] & 7) &&
+                header->dataSize - offsets[i] >= (int)sizeof(pc);
+        if (valid) {
+            Com_Memcpy(&pc, stored + offsets[i], sizeof(pc));
+            valid =
+                CM_PatchCollideFits(&pc, header->dataSize - offsets[i]);
+        }
+    }
+
+    if (valid) {
+        data = Hunk_Alloc(header->dataSize, h_high);
+        Com_Memcpy(data, stored, header->dataSize);
+        for (i = 0; i < cm.numSurfaces; i++) {
+            if (cm.surfaces[i]) {
+                cm.surfaces[i]->pc = (patchCollide_t *)(data + offsets[i]);
+                CM_RelocatePatchCollide(cm.surfaces[i]->pc,
+                                        header->dataSize - offsets[i]);
+            }
+        }
+    }
+    free(file);
+
+    if (!valid) {
+        Com_Printf("Rebuilding outdated %s\n", path);
+    }
+    return valid;
+}
+
+/*
+=================
+CMod_BuildPatches
+
+Builds the collision of every patch on the worker threads, then copies it
+into one hunk block that is also written to the cache
+=================
+*/
+static void CMod_BuildPatches(const char *name, unsigned checksum,
+                              patchBuild_t *builds, int count) {
+    char error[MAXPRINTMSG];
+    int *offsets;
+    byte *data;
+    int i, size, errorCode;
+
+#ifndef BSPC
+    Sys_RunJobs(CMod_BuildPatchJob, builds, count);
+#else
+    for (i = 0; i < count; i++) {
+        CMod_BuildPatchJob(builds, i);
+    }
+#endif
+
+    // report in map order, as if it was built on this thread
+    errorCode = 0;
+    for (i = 0; i < count; i++) {
+        if (builds[i].log) {
+            Com_Printf("%s", builds[i].log);
+        }
+        if (builds[i].errorCode) {
+            errorCode = builds[i].errorCode;
+            Q_strncpyz(error,
+                       builds[i].error ? builds[i].error : "out of memory",
+                       sizeof(error));
+            break;
+        }
+    }
+    if (errorCode) {
+        CMod_FreePatchBuilds(builds, count);
+        Com_Error(errorCode, "%s", error);
+    }
+
+    size = 0;
+    for (i = 0; i < count; i++) {
+        size += builds[i].size;
+    }
+    data = Hunk_Alloc(size, h_high);
+
+    offsets = Z_Malloc(cm.numSurfaces * sizeof(*offsets));
+    for (i = 0; i < cm.numSurfaces; i++) {
+        offsets[i] = -1;
+    }
+    size = 0;
+    for (i = 0; i < count; i++) {
+        offsets[builds[i].surface] = size;
+        Com_Memcpy(data + size, builds[i].collide, builds[i].size);
+        size += builds[i].size;
+    }
+
+#ifndef BSPC
+    if (cm_cache->integer) {
+        CMod_WritePatchCache(name, checksum, offsets, data, size);
+    }
+#endif
+
+    for (i = 0; i < count; i++) {
+        cm.surfaces[builds[i].surface]->pc =
+            (patchCollide_t *)(data + offsets[builds[i].surface]);
+        CM_RelocatePatchCollide(cm.surfaces[builds[i].surface]->pc,
+                                builds[i].size);
+    }
+
+    Z_Free(offsets);
+    CMod_FreePatchBuilds(builds, count);
+}
+
 /*
 =================
 CMod_LoadPatches
 =================
 */
-#define MAX_PATCH_VERTS 1024
-void CMod_LoadPatches(lump_t *surfs, lump_t *verts) {
-    drawVert_t *dv, *dv_p;
+void CMod_LoadPatches(lump_t *surfs, lump_t *verts, const char *name,
+                      unsigned checksum) {
+    drawVert_t *dv;
     dsurface_t *in;
     int count;
-    int i, j;
+    int i;
     int c;
     cPatch_t *patch;
-    vec3_t points[MAX_PATCH_VERTS];
-    int width, height;
+    patchBuild_t *builds;
+    int numBuilds;
     int shaderNum;
 
     in = (void *)(cmod_base + surfs->fileofs);
@@ -484,6 +903,9 @@ void CMod_LoadPatches(lump_t *surfs, lump_t *verts) {
     if (verts->filelen % sizeof(*dv))
         Com_Error(ERR_DROP, "MOD_LoadBmodel: funny lump size");
 
+    builds = Z_Malloc(MAX(count, 1) * sizeof(*builds));
+    numBuilds = 0;
+
     // scan through all the surfaces, but only load patches,
     // not planar faces
     for (i = 0; i < count; i++, in++) {
@@ -494,28 +916,33 @@ void CMod_LoadPatches(lump_t *surfs, lump_t *verts) {
 
         cm.surfaces[i] = patch = Hunk_Alloc(sizeof(*patch), h_high);
 
-        // load the full drawverts onto the stack
-        width = LittleLong(in->patchWidth);
-        height = LittleLong(in->patchHeight);
-        c = width * height;
+        builds[numBuilds].surface = i;
+        builds[numBuilds].width = LittleLong(in->patchWidth);
+        builds[numBuilds].height = LittleLong(in->patchHeight);
+        builds[numBuilds].verts = dv + LittleLong(in->firstVert);
+        c = builds[numBuilds].width * builds[numBuilds].height;
         if (c > MAX_PATCH_VERTS) {
+            Z_Free(builds);
             Com_Error(ERR_DROP, "ParseMesh: MAX_PATCH_VERTS");
         }
-
-        dv_p = dv + LittleLong(in->firstVert);
-        for (j = 0; j < c; j++, dv_p++) {
-            points[j][0] = LittleFloat(dv_p->xyz[0]);
-            points[j][1] = LittleFloat(dv_p->xyz[1]);
-            points[j][2] = LittleFloat(dv_p->xyz[2]);
-        }
+        numBuilds++;
 
         shaderNum = LittleLong(in->shaderNum);
         patch->contents = cm.shaders[shaderNum].contentFlags;
         patch->surfaceFlags = cm.shaders[shaderNum].surfaceFlags;
+    }
 
-        // create the internal facet structure
-        patch->pc = CM_GeneratePatchCollide(width, height, points);
+#ifndef BSPC
+    if (numBuilds && cm_cache->integer &&
+        CMod_ReadPatchCache(name, checksum)) {
+        Com_DPrintf("%i patches from the collision cache\n", numBuilds);
+        Z_Free(builds);
+        return;
     }
+#endif
+
+    // create the internal facet structures
+    CMod_BuildPatches(name, checksum, builds, numBuilds);
 }
 
 //==================================================================
@@ -568,6 +995,10 @@ void CM_LoadMap(const char *name, qboolean clientload, int *checksum) {
     cm_noCurves = Cvar_Get("cm_noCurves", "0", CVAR_CHEAT);
     cm_playerCurveClip =
         Cvar_Get("cm_playerCurveClip", "1", CVAR_ARCHIVE | CVAR_CHEAT);
+    cm_simd = Cvar_Get("cm_simd", "1", 0);
+    cm_fastRay = Cvar_Get("cm_fastRay", "1", 0);
+    cm_facetTree = Cvar_Get("cm_facetTree", "1", 0);
+    cm_cache = Cvar_Get("cm_cache", "1", CVAR_ARCHIVE);
 #endif
     Com_DPrintf("CM_LoadMap( %s, %i )\n", name, clientload);
 
@@ -593,7 +1024,8 @@ void CM_LoadMap(const char *name, qboolean clientload, int *checksum) {
     // load the file
     //
 #ifndef BSPC
-    length = FS_ReadFile(name, &buf.v);
+    // shared with the renderer, which loads the same map next
+    length = FS_AcquireFile(name, &buf.v);
 #else
     length = LoadQuakeFile((quakefile_t *)name, &buf.v);
 #endif
@@ -631,10 +1063,13 @@ void CM_LoadMap(const char *name, qboolean clientload, int *checksum) {
     CMod_LoadEntityString(&header.lumps[LUMP_ENTITIES]);
     CMod_LoadVisibility(&header.lumps[LUMP_VISIBILITY]);
     CMod_LoadPatches(&header.lumps[LUMP_SURFACES],
-                     &header.lumps[LUMP_DRAWVERTS]);
+                     &header.lumps[LUMP_DRAWVERTS], name, CM_Checksum(&header));
 
-    // we are NOT freeing the file, because it is cached for the ref
+#ifndef BSPC
+    FS_ReleaseFile(buf.v);
+#else
     FS_FreeFile(buf.v);
+#endif
 
     CM_InitBoxHull();
 
@@ -668,8 +1103,8 @@ cmodel_t *CM_ClipHandleToModel(clipHandle_t handle) {
     if (handle < cm.numSubModels) {
         return &cm.cmodels[handle];
     }
-    if (handle == BOX_MODEL_HANDLE) {
-        return &box_model;
+    if (CM_IsTempBoxHandle(handle)) {
+        return &boxHulls[CM_BoxSlotForHandle(handle)].model;
     }
     if (handle < MAX_SUBMODELS) {
         Com_Error(ERR_DROP, "CM_ClipHandleToModel: bad handle %i < %i < %i",
@@ -724,84 +1159,113 @@ can just be stored out and get a proper clipping hull structure.
 ===================
 */
 void CM_InitBoxHull(void) {
-    int i;
+    int i, slot;
     int side;
     cplane_t *p;
     cbrushside_t *s;
+    boxHull_t *hull;
+    int firstPlane, firstSide;
+
+    for (slot = 0; slot < CM_BOX_SLOTS; slot++) {
+        hull = &boxHulls[slot];
+        firstPlane = cm.numPlanes + slot * 12;
+        firstSide = cm.numBrushSides + slot * 6;
+
+        hull->planes = &cm.planes[firstPlane];
+
+        hull->brush = &cm.brushes[cm.numBrushes + slot];
+        hull->brush->numsides = 6;
+        hull->brush->sides = cm.brushsides + firstSide;
+        hull->brush->contents = CONTENTS_BODY;
+
+        Com_Memset(&hull->model, 0, sizeof(hull->model));
+        hull->model.leaf.numLeafBrushes = 1;
+        hull->model.leaf.firstLeafBrush = cm.numLeafBrushes + slot;
+        cm.leafbrushes[cm.numLeafBrushes + slot] = cm.numBrushes + slot;
+
+        for (i = 0; i < 6; i++) {
+            side = i & 1;
+
+            // brush sides
+            s = &cm.brushsides[firstSide + i];
+            s->plane = cm.planes + (firstPlane + i * 2 + side);
+            s->surfaceFlags = 0;
+
+            // planes
+            p = &hull->planes[i * 2];
+            p->type = i >> 1;
+            p->signbits = 0;
+            VectorClear(p->normal);
+            p->normal[i >> 1] = 1;
+
+            p = &hull->planes[i * 2 + 1];
+            p->type = 3 + (i >> 1);
+            p->signbits = 0;
+            VectorClear(p->normal);
+            p->normal[i >> 1] = -1;
+
+            SetPlaneSignbits(p);
+        }
+    }
+}
 
-    box_planes = &cm.planes[cm.numPlanes];
-
-    box_brush = &cm.brushes[cm.numBrushes];
-    box_brush->numsides = 6;
-    box_brush->sides = cm.brushsides + cm.numBrushSides;
-    box_brush->contents = CONTENTS_BODY;
-
-    box_model.leaf.numLeafBrushes = 1;
-    //	box_model.leaf.firstLeafBrush = cm.numBrushes;
-    box_model.leaf.firstLeafBrush = cm.numLeafBrushes;
-    cm.leafbrushes[cm.numLeafBrushes] = cm.numBrushes;
+/*
+===================
+CM_TempBoxModelSlot
 
-    for (i = 0; i < 6; i++) {
-        side = i & 1;
+To keep everything totally uniform, bounding boxes are turned into small
+BSP trees instead of being compared directly.
+Capsules are handled differently though.
 
-        // brush sides
-        s = &cm.brushsides[cm.numBrushSides + i];
-        s->plane = cm.planes + (cm.numPlanes + i * 2 + side);
-        s->surfaceFlags = 0;
+The box stays valid until the next call for the same slot, so threads that
+trace at the same time must each use their own slot.
+===================
+*/
+clipHandle_t CM_TempBoxModelSlot(const vec3_t mins, const vec3_t maxs,
+                                 int capsule, int slot) {
+    boxHull_t *hull;
+    cplane_t *planes;
 
-        // planes
-        p = &box_planes[i * 2];
-        p->type = i >> 1;
-        p->signbits = 0;
-        VectorClear(p->normal);
-        p->normal[i >> 1] = 1;
+    if (slot < 0 || slot >= CM_BOX_SLOTS) {
+        Com_Error(ERR_DROP, "CM_TempBoxModelSlot: bad slot %i", slot);
+    }
+    hull = &boxHulls[slot];
 
-        p = &box_planes[i * 2 + 1];
-        p->type = 3 + (i >> 1);
-        p->signbits = 0;
-        VectorClear(p->normal);
-        p->normal[i >> 1] = -1;
+    VectorCopy(mins, hull->model.mins);
+    VectorCopy(maxs, hull->model.maxs);
 
-        SetPlaneSignbits(p);
+    if (capsule) {
+        return CM_CapsuleSlotHandle(slot);
     }
+
+    planes = hull->planes;
+    planes[0].dist = maxs[0];
+    planes[1].dist = -maxs[0];
+    planes[2].dist = mins[0];
+    planes[3].dist = -mins[0];
+    planes[4].dist = maxs[1];
+    planes[5].dist = -maxs[1];
+    planes[6].dist = mins[1];
+    planes[7].dist = -mins[1];
+    planes[8].dist = maxs[2];
+    planes[9].dist = -maxs[2];
+    planes[10].dist = mins[2];
+    planes[11].dist = -mins[2];
+
+    VectorCopy(mins, hull->brush->bounds[0]);
+    VectorCopy(maxs, hull->brush->bounds[1]);
+
+    return CM_BoxSlotHandle(slot);
 }
 
 /*
 ===================
 CM_TempBoxModel
-
-To keep everything totally uniform, bounding boxes are turned into small
-BSP trees instead of being compared directly.
-Capsules are handled differently though.
 ===================
 */
 clipHandle_t CM_TempBoxModel(const vec3_t mins, const vec3_t maxs,
                              int capsule) {
-
-    VectorCopy(mins, box_model.mins);
-    VectorCopy(maxs, box_model.maxs);
-
-    if (capsule) {
-        return CAPSULE_MODEL_HANDLE;
-    }
-
-    box_planes[0].dist = maxs[0];
-    box_planes[1].dist = -maxs[0];
-    box_planes[2].dist = mins[0];
-    box_planes[3].dist = -mins[0];
-    box_planes[4].dist = maxs[1];
-    box_planes[5].dist = -maxs[1];
-    box_planes[6].dist = mins[1];
-    box_planes[7].dist = -mins[1];
-    box_planes[8].dist = maxs[2];
-    box_planes[9].dist = -maxs[2];
-    box_planes[10].dist = mins[2];
-    box_planes[11].dist = -mins[2];
-
-    VectorCopy(mins, box_brush->bounds[0]);
-    VectorCopy(maxs, box_brush->bounds[1]);
-
-    return BOX_MODEL_HANDLE;
+    return CM_TempBoxModelSlot(mins, maxs, capsule, 0);
 }
 
 /*
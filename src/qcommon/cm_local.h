@@ -24,10 +24,34 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "qcommon.h"
 #include "cm_polylib.h"
 
+// brush sides are tested four at a time with SSE where the scalar code does
+// its float math in SSE registers too, so both give the same bits
+#if defined(__SSE_MATH__) || defined(_M_X64)
+#define CM_SIMD 1
+#else
+#define CM_SIMD 0
+#endif
+
 #define MAX_SUBMODELS 256
 #define BOX_MODEL_HANDLE 255
 #define CAPSULE_MODEL_HANDLE 254
 
+// the temporary boxes of slot 0 keep the handles above, the other slots
+// are numbered past the inline models with the capsule on the odd handle
+#define CM_BoxSlotHandle(slot)                                                 \
+    ((slot) ? MAX_SUBMODELS + (slot)*2 : BOX_MODEL_HANDLE)
+#define CM_CapsuleSlotHandle(slot)                                             \
+    ((slot) ? MAX_SUBMODELS + (slot)*2 + 1 : CAPSULE_MODEL_HANDLE)
+#define CM_IsTempBoxHandle(h)                                                  \
+    ((h) == BOX_MODEL_HANDLE || (h) == CAPSULE_MODEL_HANDLE ||                 \
+     ((h) >= MAX_SUBMODELS + 2 && (h) < MAX_SUBMODELS + CM_BOX_SLOTS * 2))
+#define CM_IsBoxHandle(h)                                                      \
+    ((h) == BOX_MODEL_HANDLE || ((h) >= MAX_SUBMODELS && !((h)&1)))
+#define CM_IsCapsuleHandle(h)                                                  \
+    ((h) == CAPSULE_MODEL_HANDLE || ((h) >= MAX_SUBMODELS && ((h)&1)))
+#define CM_BoxSlotForHandle(h)                                                 \
+    ((h) >= MAX_SUBMODELS ? ((h)-MAX_SUBMODELS) / 2 : 0)
+
 typedef struct {
     cplane_t *plane;
     int children[2]; // negative numbers are leafs
@@ -62,8 +86,13 @@ typedef struct {
     int numsides;
     cbrushside_t *sides;
     int checkcount; // to avoid repeated testings
+    float *sidePlanes; // normal x, y, z and dist arrays, NULL if not CM_SIMD
 } cbrush_t;
 
+// floats in each of the four sidePlanes arrays of a brush, padded so four
+// sides can be loaded from any index below numsides
+#define CM_SidePlaneStride(numsides) ((((numsides) + 3) & ~3) + 4)
+
 typedef struct {
     int checkcount; // to avoid repeated testings
     int surfaceFlags;
@@ -135,6 +164,10 @@ extern int c_traces, c_brush_traces, c_patch_traces;
 extern cvar_t *cm_noAreas;
 extern cvar_t *cm_noCurves;
 extern cvar_t *cm_playerCurveClip;
+extern cvar_t *cm_simd;
+extern cvar_t *cm_fastRay;
+extern cvar_t *cm_facetTree;
+extern cvar_t *cm_cache;
 
 // cm_test.c
 
@@ -159,6 +192,7 @@ typedef struct {
     qboolean isPoint;   // optimized case
     trace_t trace;      // returned from trace call
     sphere_t sphere;    // sphere for oriendted capsule collision
+    int checkcount;     // multi-check avoidance stamp owned by this trace
 } traceWork_t;
 
 typedef struct leafList_s {
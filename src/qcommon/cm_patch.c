@@ -79,14 +79,13 @@ away from curve #define	PLANE_TRI_EPSILON	0.1 #define
 WRAP_POINT_EPSILON	0.1
 */
 
-int c_totalPatchBlocks;
-int c_totalPatchSurfaces;
-int c_totalPatchEdges;
-
 static const patchCollide_t *debugPatchCollide;
 static const facet_t *debugFacet;
 static qboolean debugBlock;
 static vec3_t debugBlockPoints[4];
+#ifndef BSPC
+static cvar_t *r_debugSurfaceUpdate;
+#endif // BSPC
 
 /*
 =================
@@ -96,6 +95,11 @@ CM_ClearLevelPatches
 void CM_ClearLevelPatches(void) {
     debugPatchCollide = NULL;
     debugFacet = NULL;
+#ifndef BSPC
+    // registered here rather than lazily so traces never touch the cvar
+    // system, they may be running on worker threads
+    r_debugSurfaceUpdate = Cvar_Get("r_debugSurfaceUpdate", "1", 0);
+#endif // BSPC
 }
 
 /*
@@ -415,11 +419,19 @@ PATCH COLLIDE GENERATION
 ================================================================================
 */
 
-static int numPlanes;
-static patchPlane_t planes[MAX_PATCH_PLANES];
+// patches are built on worker threads, each has its own work space
+static Q_THREAD_LOCAL int numPlanes;
+static Q_THREAD_LOCAL patchPlane_t planes[MAX_PATCH_PLANES];
+
+static Q_THREAD_LOCAL int numFacets;
+static Q_THREAD_LOCAL facet_t facets[MAX_PATCH_PLANES]; // maybe MAX_FACETS ??
+static Q_THREAD_LOCAL vec3_t facetBounds[MAX_FACETS][2];
 
-static int numFacets;
-static facet_t facets[MAX_PATCH_PLANES]; // maybe MAX_FACETS ??
+static Q_THREAD_LOCAL int numFacetNodes;
+static Q_THREAD_LOCAL facetNode_t facetNodes[MAX_FACETS * 2];
+static Q_THREAD_LOCAL short facetOrder[MAX_FACETS];
+
+static Q_THREAD_LOCAL vec3_t patchBounds[2];
 
 #define NORMAL_EPSILON 0.0001
 #define DIST_EPSILON 0.02
@@ -802,9 +814,12 @@ static qboolean CM_ValidateFacet(facet_t *facet) {
 /*
 ==================
 CM_AddFacetBevels
+
+Also returns the bounds of the facet winding, the facet is clipped to them
+by its axial bevels.
 ==================
 */
-void CM_AddFacetBevels(facet_t *facet) {
+void CM_AddFacetBevels(facet_t *facet, vec3_t bounds[2]) {
 
     int i, j, k, l;
     int axis, dir, order, flipped;
@@ -828,10 +843,15 @@ void CM_AddFacetBevels(facet_t *facet) {
         ChopWindingInPlace(&w, plane, plane[3], 0.1f);
     }
     if (!w) {
+        VectorSet(bounds[0], -MAX_MAP_BOUNDS, -MAX_MAP_BOUNDS,
+                  -MAX_MAP_BOUNDS);
+        VectorSet(bounds[1], MAX_MAP_BOUNDS, MAX_MAP_BOUNDS, MAX_MAP_BOUNDS);
         return;
     }
 
     WindingBounds(w, mins, maxs);
+    VectorCopy(mins, bounds[0]);
+    VectorCopy(maxs, bounds[1]);
 
     // add the axial planes
     order = 0;
@@ -967,6 +987,80 @@ void CM_AddFacetBevels(facet_t *facet) {
 #endif // BSPC
 }
 
+/*
+==================
+CM_BuildFacetTree
+
+Splits facetOrder[first] to facetOrder[first + count - 1] at the middle of
+their centers on the longest axis, or in half when that is too lopsided,
+and returns the node.
+==================
+*/
+static int CM_BuildFacetTree(int first, int count) {
+    facetNode_t *node;
+    vec3_t centerBounds[2], center;
+    float split;
+    int nodeNum, axis, i, j, k;
+    short swap;
+
+    nodeNum = numFacetNodes++;
+    node = &facetNodes[nodeNum];
+
+    ClearBounds(node->bounds[0], node->bounds[1]);
+    ClearBounds(centerBounds[0], centerBounds[1]);
+    for (i = first; i < first + count; i++) {
+        k = facetOrder[i];
+        AddPointToBounds(facetBounds[k][0], node->bounds[0], node->bounds[1]);
+        AddPointToBounds(facetBounds[k][1], node->bounds[0], node->bounds[1]);
+        VectorAdd(facetBounds[k][0], facetBounds[k][1], center);
+        AddPointToBounds(center, centerBounds[0], centerBounds[1]);
+    }
+    // expand by one unit for epsilon purposes, like the patch bounds
+    for (i = 0; i < 3; i++) {
+        node->bounds[0][i] -= 1;
+        node->bounds[1][i] += 1;
+    }
+
+    node->firstFacet = first;
+    if (count <= FACETS_PER_NODE) {
+        node->numFacets = count;
+        node->secondChild = 0;
+        return nodeNum;
+    }
+    node->numFacets = 0;
+
+    axis = 0;
+    for (i = 1; i < 3; i++) {
+        if (centerBounds[1][i] - centerBounds[0][i] >
+            centerBounds[1][axis] - centerBounds[0][axis]) {
+            axis = i;
+        }
+    }
+    split = (centerBounds[0][axis] + centerBounds[1][axis]) * 0.5f;
+
+    i = first;
+    j = first + count - 1;
+    while (i <= j) {
+        k = facetOrder[i];
+        if (facetBounds[k][0][axis] + facetBounds[k][1][axis] < split) {
+            i++;
+        } else {
+            swap = facetOrder[i];
+            facetOrder[i] = facetOrder[j];
+            facetOrder[j] = swap;
+            j--;
+        }
+    }
+    i -= first;
+    if (i < count / 4 || i > count - count / 4) {
+        i = count / 2; // keep the tree shallow
+    }
+
+    CM_BuildFacetTree(first, i);
+    node->secondChild = CM_BuildFacetTree(first + i, count - i);
+    return nodeNum;
+}
+
 typedef enum { EN_TOP, EN_RIGHT, EN_BOTTOM, EN_LEFT } edgeName_t;
 
 /*
@@ -974,10 +1068,11 @@ typedef enum { EN_TOP, EN_RIGHT, EN_BOTTOM, EN_LEFT } edgeName_t;
 CM_PatchCollideFromGrid
 ==================
 */
-static void CM_PatchCollideFromGrid(cGrid_t *grid, patchCollide_t *pf) {
+static void CM_PatchCollideFromGrid(cGrid_t *grid) {
     int i, j;
     float *p1, *p2, *p3;
-    int gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2];
+    // too big for the stack of a worker thread
+    static Q_THREAD_LOCAL int gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2];
     facet_t *facet;
     int borders[4];
     int noAdjust[4];
@@ -1070,7 +1165,7 @@ static void CM_PatchCollideFromGrid(cGrid_t *grid, patchCollide_t *pf) {
                 facet->borderNoAdjust[3] = noAdjust[EN_LEFT];
                 CM_SetBorderInward(facet, grid, gridPlanes, i, j, -1);
                 if (CM_ValidateFacet(facet)) {
-                    CM_AddFacetBevels(facet);
+                    CM_AddFacetBevels(facet, facetBounds[numFacets]);
                     numFacets++;
                 }
             } else {
@@ -1091,7 +1186,7 @@ static void CM_PatchCollideFromGrid(cGrid_t *grid, patchCollide_t *pf) {
                 }
                 CM_SetBorderInward(facet, grid, gridPlanes, i, j, 0);
                 if (CM_ValidateFacet(facet)) {
-                    CM_AddFacetBevels(facet);
+                    CM_AddFacetBevels(facet, facetBounds[numFacets]);
                     numFacets++;
                 }
 
@@ -1117,36 +1212,38 @@ static void CM_PatchCollideFromGrid(cGrid_t *grid, patchCollide_t *pf) {
                 }
                 CM_SetBorderInward(facet, grid, gridPlanes, i, j, 1);
                 if (CM_ValidateFacet(facet)) {
-                    CM_AddFacetBevels(facet);
+                    CM_AddFacetBevels(facet, facetBounds[numFacets]);
                     numFacets++;
                 }
             }
         }
     }
 
-    // copy the results out
-    pf->numPlanes = numPlanes;
-    pf->numFacets = numFacets;
-    pf->facets = Hunk_Alloc(numFacets * sizeof(*pf->facets), h_high);
-    Com_Memcpy(pf->facets, facets, numFacets * sizeof(*pf->facets));
-    pf->planes = Hunk_Alloc(numPlanes * sizeof(*pf->planes), h_high);
-    Com_Memcpy(pf->planes, planes, numPlanes * sizeof(*pf->planes));
+    numFacetNodes = 0;
+    if (!numFacets) {
+        return;
+    }
+
+    // build a bounds tree so traces only test the facets they can touch
+    for (i = 0; i < numFacets; i++) {
+        facetOrder[i] = i;
+    }
+    CM_BuildFacetTree(0, numFacets);
 }
 
 /*
 ===================
-CM_GeneratePatchCollide
+CM_BuildPatchCollide
 
-Creates an internal structure that will be used to perform
-collision detection with a patch mesh.
+Builds the collision of a patch mesh in the work space of the calling
+thread, returns the size CM_StorePatchCollide needs for it.
 
 Points is packed as concatenated rows.
 ===================
 */
-struct patchCollide_s *CM_GeneratePatchCollide(int width, int height,
-                                               vec3_t *points) {
-    patchCollide_t *pf;
-    cGrid_t grid;
+int CM_BuildPatchCollide(int width, int height, const vec3_t *points) {
+    // too big for the stack of a worker thread
+    static Q_THREAD_LOCAL cGrid_t grid;
     int i, j;
 
     if (width <= 2 || height <= 2 || !points) {
@@ -1190,28 +1287,174 @@ struct patchCollide_s *CM_GeneratePatchCollide(int width, int height,
     // we now have a grid of points exactly on the curve
     // the aproximate surface defined by these points will be
     // collided against
-    pf = Hunk_Alloc(sizeof(*pf), h_high);
-    ClearBounds(pf->bounds[0], pf->bounds[1]);
+    ClearBounds(patchBounds[0], patchBounds[1]);
     for (i = 0; i < grid.width; i++) {
         for (j = 0; j < grid.height; j++) {
-            AddPointToBounds(grid.points[i][j], pf->bounds[0], pf->bounds[1]);
+            AddPointToBounds(grid.points[i][j], patchBounds[0],
+                             patchBounds[1]);
         }
     }
 
-    c_totalPatchBlocks += (grid.width - 1) * (grid.height - 1);
-
     // generate a bsp tree for the surface
-    CM_PatchCollideFromGrid(&grid, pf);
+    CM_PatchCollideFromGrid(&grid);
 
     // expand by one unit for epsilon purposes
-    pf->bounds[0][0] -= 1;
-    pf->bounds[0][1] -= 1;
-    pf->bounds[0][2] -= 1;
+    patchBounds[0][0] -= 1;
+    patchBounds[0][1] -= 1;
+    patchBounds[0][2] -= 1;
+
+    patchBounds[1][0] += 1;
+    patchBounds[1][1] += 1;
+    patchBounds[1][2] += 1;
+
+    return PATCH_COLLIDE_ALIGN(sizeof(patchCollide_t)) +
+           PATCH_COLLIDE_ALIGN(numPlanes * sizeof(patchPlane_t)) +
+           PATCH_COLLIDE_ALIGN(numFacets * sizeof(facet_t)) +
+           PATCH_COLLIDE_ALIGN(numFacetNodes * sizeof(facetNode_t)) +
+           PATCH_COLLIDE_ALIGN(numFacets * sizeof(short));
+}
 
-    pf->bounds[1][0] += 1;
-    pf->bounds[1][1] += 1;
-    pf->bounds[1][2] += 1;
+/*
+===================
+CM_StoreSection
+===================
+*/
+static void *CM_StoreSection(const patchCollide_t *pc, byte **out,
+                             const void *data, int size) {
+    intptr_t offset;
+
+    if (!size) {
+        return NULL;
+    }
+    offset = *out - (const byte *)pc;
+    Com_Memcpy(*out, data, size);
+    *out += PATCH_COLLIDE_ALIGN(size);
+    return (void *)offset;
+}
+
+/*
+===================
+CM_StorePatchCollide
+
+Writes the last patch built on this thread to buffer in one block, with
+the arrays following the patchCollide_t and pointed to by their offsets
+from it, so the block can be copied and cached as it is. It needs
+CM_RelocatePatchCollide before traces can use it.
+===================
+*/
+void CM_StorePatchCollide(void *buffer) {
+    patchCollide_t *pc;
+    byte *out;
+
+    pc = buffer;
+    Com_Memset(pc, 0, sizeof(*pc));
+    VectorCopy(patchBounds[0], pc->bounds[0]);
+    VectorCopy(patchBounds[1], pc->bounds[1]);
+    pc->numPlanes = numPlanes;
+    pc->numFacets = numFacets;
+    pc->numNodes = numFacetNodes;
+
+    out = (byte *)pc + PATCH_COLLIDE_ALIGN(sizeof(*pc));
+    pc->planes =
+        CM_StoreSection(pc, &out, planes, numPlanes * sizeof(*pc->planes));
+    pc->facets =
+        CM_StoreSection(pc, &out, facets, numFacets * sizeof(*pc->facets));
+    pc->nodes = CM_StoreSection(pc, &out, facetNodes,
+                                numFacetNodes * sizeof(*pc->nodes));
+    pc->facetIndex = CM_StoreSection(pc, &out, facetOrder,
+                                     numFacets * sizeof(*pc->facetIndex));
+}
+
+/*
+===================
+CM_SectionFits
+===================
+*/
+static qboolean CM_SectionFits(const patchCollide_t *pc, int size,
+                               const void *ptr, int count, int maxCount,
+                               int elementSize) {
+    intptr_t offset;
+
+    offset = (intptr_t)ptr;
+    if (count < 0 || count > maxCount) {
+        return qfalse;
+    }
+    if (!count) {
+        return offset == 0;
+    }
+    return offset >= PATCH_COLLIDE_ALIGN(sizeof(*pc)) &&
+           offset + count * elementSize <= size;
+}
+
+/*
+===================
+CM_PatchCollideFits
+
+Whether the offsets of a stored patch fit in the size bytes of its block.
+Only reads the fields of pc, so it can be a copy of the stored header.
+===================
+*/
+qboolean CM_PatchCollideFits(const patchCollide_t *pc, int size) {
+    if (size < PATCH_COLLIDE_ALIGN(sizeof(*pc))) {
+        return qfalse;
+    }
+    return CM_SectionFits(pc, size, pc->planes, pc->numPlanes,
+                          MAX_PATCH_PLANES, sizeof(*pc->planes)) &&
+           CM_SectionFits(pc, size, pc->facets, pc->numFacets, MAX_FACETS,
+                          sizeof(*pc->facets)) &&
+           CM_SectionFits(pc, size, pc->nodes, pc->numNodes, MAX_FACETS * 2,
+                          sizeof(*pc->nodes)) &&
+           CM_SectionFits(pc, size, pc->facetIndex, pc->numFacets, MAX_FACETS,
+                          sizeof(*pc->facetIndex));
+}
+
+/*
+===================
+CM_RelocateSection
+===================
+*/
+static void *CM_RelocateSection(patchCollide_t *pc, void *ptr) {
+    return ptr ? (byte *)pc + (intptr_t)ptr : NULL;
+}
+
+/*
+===================
+CM_RelocatePatchCollide
+
+Turns the offsets of a stored patch into pointers, qfalse if they don't
+fit in the size bytes of its block.
+===================
+*/
+qboolean CM_RelocatePatchCollide(patchCollide_t *pc, int size) {
+    if (!CM_PatchCollideFits(pc, size)) {
+        return qfalse;
+    }
+    pc->planes = CM_RelocateSection(pc, pc->planes);
+    pc->facets = CM_RelocateSection(pc, pc->facets);
+    pc->nodes = CM_RelocateSection(pc, pc->nodes);
+    pc->facetIndex = CM_RelocateSection(pc, pc->facetIndex);
+    return qtrue;
+}
 
+/*
+===================
+CM_GeneratePatchCollide
+
+Creates an internal structure that will be used to perform
+collision detection with a patch mesh.
+
+Points is packed as concatenated rows.
+===================
+*/
+struct patchCollide_s *CM_GeneratePatchCollide(int width, int height,
+                                               vec3_t *points) {
+    patchCollide_t *pf;
+    int size;
+
+    size = CM_BuildPatchCollide(width, height, points);
+    pf = Hunk_Alloc(size, h_high);
+    CM_StorePatchCollide(pf);
+    CM_RelocatePatchCollide(pf, size);
     return pf;
 }
 
@@ -1223,6 +1466,109 @@ TRACE TESTING
 ================================================================================
 */
 
+// bit masks with a bit per facet
+#define FACET_MASK_WORDS (MAX_FACETS / 32)
+
+/*
+====================
+CM_SweepTouchesBounds
+
+Slab test of the swept trace box against the bounds, so long diagonal
+traces don't touch everything their own bounds overlap. The tree bounds
+are padded by a unit, far more than the float error here.
+====================
+*/
+static qboolean CM_SweepTouchesBounds(const traceWork_t *tw,
+                                      const vec3_t invDir,
+                                      const vec3_t bounds[2]) {
+    float enter, leave, t1, t2;
+    int i;
+
+    if (!CM_BoundsIntersect(tw->bounds[0], tw->bounds[1], bounds[0],
+                            bounds[1])) {
+        return qfalse;
+    }
+
+    enter = 0;
+    leave = 1;
+    for (i = 0; i < 3; i++) {
+        if (!invDir[i]) {
+            continue; // inside the slab, or the bounds test caught it
+        }
+        t1 = (bounds[0][i] - tw->size[1][i] - tw->start[i]) * invDir[i];
+        t2 = (bounds[1][i] - tw->size[0][i] - tw->start[i]) * invDir[i];
+        if (t1 > t2) {
+            enter = MAX(enter, t2);
+            leave = MIN(leave, t1);
+        } else {
+            enter = MAX(enter, t1);
+            leave = MIN(leave, t2);
+        }
+        if (enter > leave) {
+            return qfalse;
+        }
+    }
+    return qtrue;
+}
+
+/*
+====================
+CM_TouchedFacets
+
+Sets the bits of the facets in tree leafs the trace touches, or of all the
+facets without the tree. Returns the number of leaf facets found.
+====================
+*/
+static int CM_TouchedFacets(const traceWork_t *tw,
+                            const struct patchCollide_s *pc,
+                            unsigned int *touched) {
+    int stack[64];
+    const facetNode_t *node;
+    vec3_t invDir;
+    int numStack, count, i, k;
+
+#ifndef BSPC
+    if (!pc->nodes || !cm_facetTree->integer) {
+#else
+    if (!pc->nodes) {
+#endif
+        for (i = 0; i < FACET_MASK_WORDS; i++) {
+            touched[i] = ~0u;
+        }
+        return pc->numFacets;
+    }
+
+    Com_Memset(touched, 0, ((pc->numFacets + 31) >> 5) * sizeof(*touched));
+
+    for (i = 0; i < 3; i++) {
+        invDir[i] = tw->end[i] != tw->start[i]
+                        ? 1.0f / (tw->end[i] - tw->start[i])
+                        : 0;
+    }
+
+    count = 0;
+    numStack = 0;
+    stack[numStack++] = 0;
+    while (numStack) {
+        node = &pc->nodes[stack[--numStack]];
+        if (!CM_SweepTouchesBounds(tw, invDir, node->bounds)) {
+            continue;
+        }
+        if (node->numFacets) {
+            for (i = 0; i < node->numFacets; i++) {
+                k = pc->facetIndex[node->firstFacet + i];
+                touched[k >> 5] |= 1u << (k & 31);
+            }
+            count += node->numFacets;
+        } else {
+            // at most a quarter off from halving, the tree is shallow
+            stack[numStack++] = node->secondChild;
+            stack[numStack++] = node - pc->nodes + 1;
+        }
+    }
+    return count;
+}
+
 /*
 ====================
 CM_TracePointThroughPatchCollide
@@ -1235,15 +1581,13 @@ void CM_TracePointThroughPatchCollide(traceWork_t *tw,
                                       const struct patchCollide_s *pc) {
     qboolean frontFacing[MAX_PATCH_PLANES];
     float intersection[MAX_PATCH_PLANES];
+    unsigned int touched[FACET_MASK_WORDS], needed[MAX_PATCH_PLANES / 32];
     float intersect;
     const patchPlane_t *planes;
     const facet_t *facet;
-    int i, j, k;
+    int i, j, k, count;
     float offset;
     float d1, d2;
-#ifndef BSPC
-    static cvar_t *cv;
-#endif // BSPC
 
 #ifndef BSPC
     if (!cm_playerCurveClip->integer || !tw->isPoint) {
@@ -1251,9 +1595,36 @@ void CM_TracePointThroughPatchCollide(traceWork_t *tw,
     }
 #endif
 
+    count = CM_TouchedFacets(tw, pc, touched);
+    if (!count) {
+        return;
+    }
+
+    // only the planes of the touched facets are looked at
+    if (count < pc->numFacets) {
+        Com_Memset(needed, 0, ((pc->numPlanes + 31) >> 5) * sizeof(*needed));
+        for (i = 0; i < pc->numFacets; i++) {
+            if (!(touched[i >> 5] & (1u << (i & 31)))) {
+                continue;
+            }
+            facet = &pc->facets[i];
+            k = facet->surfacePlane;
+            needed[k >> 5] |= 1u << (k & 31);
+            for (j = 0; j < facet->numBorders; j++) {
+                k = facet->borderPlanes[j];
+                needed[k >> 5] |= 1u << (k & 31);
+            }
+        }
+    } else {
+        Com_Memset(needed, 0xff, sizeof(needed));
+    }
+
     // determine the trace's relationship to all planes
     planes = pc->planes;
     for (i = 0; i < pc->numPlanes; i++, planes++) {
+        if (!(needed[i >> 5] & (1u << (i & 31)))) {
+            continue;
+        }
         offset = DotProduct(tw->offsets[planes->signbits], planes->plane);
         d1 = DotProduct(tw->start, planes->plane) - planes->plane[3] + offset;
         d2 = DotProduct(tw->end, planes->plane) - planes->plane[3] + offset;
@@ -1275,6 +1646,9 @@ void CM_TracePointThroughPatchCollide(traceWork_t *tw,
     // see if any of the surface planes are intersected
     facet = pc->facets;
     for (i = 0; i < pc->numFacets; i++, facet++) {
+        if (!(touched[i >> 5] & (1u << (i & 31)))) {
+            continue;
+        }
         if (!frontFacing[facet->surfacePlane]) {
             continue;
         }
@@ -1300,10 +1674,7 @@ void CM_TracePointThroughPatchCollide(traceWork_t *tw,
         if (j == facet->numBorders) {
             // we hit this facet
 #ifndef BSPC
-            if (!cv) {
-                cv = Cvar_Get("r_debugSurfaceUpdate", "1", 0);
-            }
-            if (cv->integer) {
+            if (r_debugSurfaceUpdate && r_debugSurfaceUpdate->integer) {
                 debugPatchCollide = pc;
                 debugFacet = facet;
             }
@@ -1381,15 +1752,13 @@ CM_TraceThroughPatchCollide
 */
 void CM_TraceThroughPatchCollide(traceWork_t *tw,
                                  const struct patchCollide_s *pc) {
+    unsigned int touched[FACET_MASK_WORDS];
     int i, j, hit, hitnum;
     float offset, enterFrac, leaveFrac, t;
     patchPlane_t *planes;
     facet_t *facet;
     float plane[4] = {0, 0, 0, 0}, bestplane[4] = {0, 0, 0, 0};
     vec3_t startp, endp;
-#ifndef BSPC
-    static cvar_t *cv;
-#endif // BSPC
 
     if (!CM_BoundsIntersect(tw->bounds[0], tw->bounds[1], pc->bounds[0],
                             pc->bounds[1])) {
@@ -1401,8 +1770,15 @@ void CM_TraceThroughPatchCollide(traceWork_t *tw,
         return;
     }
 
+    if (!CM_TouchedFacets(tw, pc, touched)) {
+        return;
+    }
+
     facet = pc->facets;
     for (i = 0; i < pc->numFacets; i++, facet++) {
+        if (!(touched[i >> 5] & (1u << (i & 31)))) {
+            continue;
+        }
         enterFrac = -1.0;
         leaveFrac = 1.0;
         hitnum = -1;
@@ -1490,10 +1866,7 @@ void CM_TraceThroughPatchCollide(traceWork_t *tw,
                     enterFrac = 0;
                 }
 #ifndef BSPC
-                if (!cv) {
-                    cv = Cvar_Get("r_debugSurfaceUpdate", "1", 0);
-                }
-                if (cv && cv->integer) {
+                if (r_debugSurfaceUpdate && r_debugSurfaceUpdate->integer) {
                     debugPatchCollide = pc;
                     debugFacet = facet;
                 }
@@ -1522,6 +1895,7 @@ CM_PositionTestInPatchCollide
 */
 qboolean CM_PositionTestInPatchCollide(traceWork_t *tw,
                                        const struct patchCollide_s *pc) {
+    unsigned int touched[FACET_MASK_WORDS];
     int i, j;
     float offset, t;
     patchPlane_t *planes;
@@ -1532,9 +1906,15 @@ qboolean CM_PositionTestInPatchCollide(traceWork_t *tw,
     if (tw->isPoint) {
         return qfalse;
     }
+    if (!CM_TouchedFacets(tw, pc, touched)) {
+        return qfalse;
+    }
     //
     facet = pc->facets;
     for (i = 0; i < pc->numFacets; i++, facet++) {
+        if (!(touched[i >> 5] & (1u << (i & 31)))) {
+            continue;
+        }
         planes = &pc->planes[facet->surfacePlane];
         VectorCopy(planes->plane, plane);
         plane[3] = planes->plane[3];
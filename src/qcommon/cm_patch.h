@@ -78,12 +78,25 @@ typedef struct {
     qboolean borderNoAdjust[4 + 6 + 16];
 } facet_t;
 
+// facets per leaf of the facet tree
+#define FACETS_PER_NODE 4
+
+typedef struct {
+    vec3_t bounds[2];
+    int secondChild; // the first child directly follows its parent
+    int firstFacet;  // into facetIndex
+    int numFacets;   // 0 for inner nodes
+} facetNode_t;
+
 typedef struct patchCollide_s {
     vec3_t bounds[2];
     int numPlanes; // surface planes plus edge planes
     patchPlane_t *planes;
     int numFacets;
     facet_t *facets;
+    int numNodes; // AABB tree over the facets, nodes[0] is the root
+    facetNode_t *nodes;
+    short *facetIndex;
 } patchCollide_t;
 
 #define MAX_GRID_SIZE 129
@@ -101,5 +114,12 @@ typedef struct {
 #define PLANE_TRI_EPSILON 0.1
 #define WRAP_POINT_EPSILON 0.1
 
+// stored patches are padded so the next one in a block stays aligned
+#define PATCH_COLLIDE_ALIGN(x) (((x) + 7) & ~7)
+
 struct patchCollide_s *CM_GeneratePatchCollide(int width, int height,
                                                vec3_t *points);
+int CM_BuildPatchCollide(int width, int height, const vec3_t *points);
+void CM_StorePatchCollide(void *buffer);
+qboolean CM_PatchCollideFits(const patchCollide_t *pc, int size);
+qboolean CM_RelocatePatchCollide(patchCollide_t *pc, int size);
@@ -24,13 +24,6 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include "cm_local.h"
 
-// counters are only bumped when running single threaded,
-// because they are an awful coherence problem
-int c_active_windings;
-int c_peak_windings;
-int c_winding_allocs;
-int c_winding_points;
-
 void pw(winding_t *w) {
     int i;
     for (i = 0; i < w->numpoints; i++)
@@ -46,14 +39,12 @@ winding_t *AllocWinding(int points) {
     winding_t *w;
     int s;
 
-    c_winding_allocs++;
-    c_winding_points += points;
-    c_active_windings++;
-    if (c_active_windings > c_peak_windings)
-        c_peak_windings = c_active_windings;
-
+    // patch collision is built on worker threads, the zone isn't safe there
     s = sizeof(vec_t) * 3 * points + sizeof(int);
-    w = Z_Malloc(s);
+    w = malloc(s);
+    if (!w)
+        Com_Error(ERR_FATAL, "AllocWinding: failed on allocation of %i bytes",
+                  s);
     Com_Memset(w, 0, s);
     return w;
 }
@@ -63,8 +54,7 @@ void FreeWinding(winding_t *w) {
         Com_Error(ERR_FATAL, "FreeWinding: freed a freed winding");
     *(unsigned *)w = 0xdeaddead;
 
-    c_active_windings--;
-    Z_Free(w);
+    free(w);
 }
 
 /*
@@ -286,7 +276,7 @@ void ClipWindingEpsilon(winding_t *in, vec3_t normal, vec_t dist, vec_t epsilon,
     vec_t dists[MAX_POINTS_ON_WINDING + 4] = {0};
     int sides[MAX_POINTS_ON_WINDING + 4] = {0};
     int counts[3];
-    static vec_t dot; // VC 4.2 optimizer bug if not static
+    vec_t dot; // not static, patches are chopped on worker threads
     int i, j;
     vec_t *p1, *p2;
     vec3_t mid;
@@ -389,7 +379,7 @@ void ChopWindingInPlace(winding_t **inout, vec3_t normal, vec_t dist,
     vec_t dists[MAX_POINTS_ON_WINDING + 4] = {0};
     int sides[MAX_POINTS_ON_WINDING + 4] = {0};
     int counts[3];
-    static vec_t dot; // VC 4.2 optimizer bug if not static
+    vec_t dot; // not static, patches are chopped on worker threads
     int i, j;
     vec_t *p1, *p2;
     vec3_t mid;
@@ -27,6 +27,12 @@ void CM_ClearMap(void);
 clipHandle_t CM_InlineModel(int index); // 0 = world, 1 + are bmodels
 clipHandle_t CM_TempBoxModel(const vec3_t mins, const vec3_t maxs, int capsule);
 
+// threads that trace at the same time each need their own temporary box,
+// slot 0 is the one CM_TempBoxModel uses
+#define CM_BOX_SLOTS (MAX_WORKER_THREADS + 2)
+clipHandle_t CM_TempBoxModelSlot(const vec3_t mins, const vec3_t maxs,
+                                 int capsule, int slot);
+
 void CM_ModelBounds(clipHandle_t model, vec3_t mins, vec3_t maxs);
 
 int CM_NumClusters(void);
@@ -46,6 +52,7 @@ void CM_TransformedBoxTrace(trace_t *results, const vec3_t start,
                             clipHandle_t model, int brushmask,
                             const vec3_t origin, const vec3_t angles,
                             int capsule);
+void CM_TraceBench_f(void);
 
 byte *CM_ClusterPVS(int cluster);
 
@@ -286,7 +286,7 @@ int CM_TransformedPointContents(const vec3_t p, clipHandle_t model,
     VectorSubtract(p, origin, p_l);
 
     // rotate start and end into the models frame of reference
-    if (model != BOX_MODEL_HANDLE && (angles[0] || angles[1] || angles[2])) {
+    if (!CM_IsBoxHandle(model) && (angles[0] || angles[1] || angles[2])) {
         AngleVectors(angles, forward, right, up);
 
         VectorCopy(p_l, temp);
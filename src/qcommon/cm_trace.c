@@ -21,6 +21,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 #include "cm_local.h"
 
+#if CM_SIMD
+#include <xmmintrin.h>
+#endif
+
 // always use bbox vs. bbox collision and never capsule vs. bbox or vice versa
 // #define ALWAYS_BBOX_VS_BBOX
 // always use capsule vs. capsule collision and never capsule vs. bbox or vice
@@ -153,6 +157,86 @@ POSITION TESTING
 ===============================================================================
 */
 
+#if CM_SIMD
+/*
+================
+CM_SideDistances
+
+Distances of the corner of the trace box nearest to each of four brush
+sides, the same float operations in the same order as the scalar code
+================
+*/
+static ID_INLINE __m128 CM_SideDistances(const float *sidePlanes, int stride,
+                                         int i, const vec3_t point,
+                                         const vec3_t size[2],
+                                         qboolean isPoint) {
+    __m128 nx, ny, nz, dist, neg, ox, oy, oz, zero;
+
+    nx = _mm_loadu_ps(sidePlanes + i);
+    ny = _mm_loadu_ps(sidePlanes + stride + i);
+    nz = _mm_loadu_ps(sidePlanes + stride * 2 + i);
+    dist = _mm_loadu_ps(sidePlanes + stride * 3 + i);
+    zero = _mm_setzero_ps();
+
+    if (isPoint) {
+        // the offset is zero, subtracting a zero dot product from dist
+        // could only flip the sign of a zero distance, which no test sees
+        return _mm_sub_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(point[0]), nx),
+                                  _mm_mul_ps(_mm_set1_ps(point[1]), ny)),
+                       _mm_mul_ps(_mm_set1_ps(point[2]), nz)),
+            dist);
+    }
+
+    // tw->offsets[plane->signbits]
+    neg = _mm_cmplt_ps(nx, zero);
+    ox = _mm_or_ps(_mm_and_ps(neg, _mm_set1_ps(size[1][0])),
+                   _mm_andnot_ps(neg, _mm_set1_ps(size[0][0])));
+    neg = _mm_cmplt_ps(ny, zero);
+    oy = _mm_or_ps(_mm_and_ps(neg, _mm_set1_ps(size[1][1])),
+                   _mm_andnot_ps(neg, _mm_set1_ps(size[0][1])));
+    neg = _mm_cmplt_ps(nz, zero);
+    oz = _mm_or_ps(_mm_and_ps(neg, _mm_set1_ps(size[1][2])),
+                   _mm_andnot_ps(neg, _mm_set1_ps(size[0][2])));
+
+    // plane->dist - DotProduct(offset, plane->normal)
+    dist = _mm_sub_ps(
+        dist, _mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, nx), _mm_mul_ps(oy, ny)),
+                         _mm_mul_ps(oz, nz)));
+
+    // DotProduct(point, plane->normal) - dist
+    return _mm_sub_ps(
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(point[0]), nx),
+                              _mm_mul_ps(_mm_set1_ps(point[1]), ny)),
+                   _mm_mul_ps(_mm_set1_ps(point[2]), nz)),
+        dist);
+}
+
+/*
+================
+CM_BoxOutsideSides
+
+qtrue if the box at tw->start is in front of one of the non-axial sides
+================
+*/
+static qboolean CM_BoxOutsideSides(const traceWork_t *tw,
+                                   const cbrush_t *brush) {
+    int i, stride;
+    __m128 d1;
+
+    stride = CM_SidePlaneStride(brush->numsides);
+    // the first six planes are the axial planes
+    for (i = 6; i < brush->numsides; i += 4) {
+        d1 = CM_SideDistances(brush->sidePlanes, stride, i, tw->start,
+                              tw->size, qfalse);
+        if (_mm_movemask_ps(_mm_cmpgt_ps(d1, _mm_setzero_ps()))) {
+            return qtrue;
+        }
+    }
+    return qfalse;
+}
+#endif
+
 /*
 ================
 CM_TestBoxInBrush
@@ -203,6 +287,12 @@ void CM_TestBoxInBrush(traceWork_t *tw, cbrush_t *brush) {
                 return;
             }
         }
+#if CM_SIMD
+    } else if (brush->sidePlanes && cm_simd->integer) {
+        if (CM_BoxOutsideSides(tw, brush)) {
+            return;
+        }
+#endif
     } else {
         // the first six planes are the axial planes, so we only
         // need to test the remainder
@@ -244,10 +334,10 @@ void CM_TestInLeaf(traceWork_t *tw, cLeaf_t *leaf) {
     for (k = 0; k < leaf->numLeafBrushes; k++) {
         brushnum = cm.leafbrushes[leaf->firstLeafBrush + k];
         b = &cm.brushes[brushnum];
-        if (b->checkcount == cm.checkcount) {
+        if (b->checkcount == tw->checkcount) {
             continue; // already checked this brush in another leaf
         }
-        b->checkcount = cm.checkcount;
+        b->checkcount = tw->checkcount;
 
         if (!(b->contents & tw->contents)) {
             continue;
@@ -270,10 +360,10 @@ void CM_TestInLeaf(traceWork_t *tw, cLeaf_t *leaf) {
             if (!patch) {
                 continue;
             }
-            if (patch->checkcount == cm.checkcount) {
+            if (patch->checkcount == tw->checkcount) {
                 continue; // already checked this brush in another leaf
             }
-            patch->checkcount = cm.checkcount;
+            patch->checkcount = tw->checkcount;
 
             if (!(patch->contents & tw->contents)) {
                 continue;
@@ -390,7 +480,8 @@ void CM_TestBoundingBoxInCapsule(traceWork_t *tw, clipHandle_t model) {
     VectorSet(tw->sphere.offset, 0, 0, size[1][2] - tw->sphere.radius);
 
     // replace the capsule with the bounding box
-    h = CM_TempBoxModel(tw->size[0], tw->size[1], qfalse);
+    h = CM_TempBoxModelSlot(tw->size[0], tw->size[1], qfalse,
+                            CM_BoxSlotForHandle(model));
     // calculate collision
     cmod = CM_ClipHandleToModel(h);
     CM_TestInLeaf(tw, &cmod->leaf);
@@ -423,11 +514,9 @@ void CM_PositionTest(traceWork_t *tw) {
     ll.lastLeaf = 0;
     ll.overflowed = qfalse;
 
-    cm.checkcount++;
-
     CM_BoxLeafnums_r(&ll, 0);
 
-    cm.checkcount++;
+    tw->checkcount = Sys_AtomicAdd(&cm.checkcount, 1) + 1;
 
     // test the contents of the leafs
     for (i = 0; i < ll.count; i++) {
@@ -467,6 +556,94 @@ void CM_TraceThroughPatch(traceWork_t *tw, cPatch_t *patch) {
     }
 }
 
+#if CM_SIMD
+/*
+================
+CM_ClipToSides
+
+The box trace loop of CM_TraceThroughBrush over four sides at a time.
+Returns qfalse if the trace is completely in front of a side. The enter and
+leave fractions are folded in side order, so ties pick the same side.
+================
+*/
+static qboolean CM_ClipToSides(const traceWork_t *tw, const cbrush_t *brush,
+                               float *enterFrac, float *leaveFrac,
+                               int *leadSide, qboolean *startout,
+                               qboolean *getout) {
+    int i, j, stride, enter, leave;
+    __m128 d1, d2, zero, eps, out1, out2, cross, enters;
+    float enterDist[4], leaveDist[4], delta[4];
+    float f;
+
+    stride = CM_SidePlaneStride(brush->numsides);
+    zero = _mm_setzero_ps();
+    eps = _mm_set1_ps(SURFACE_CLIP_EPSILON);
+
+    for (i = 0; i < brush->numsides; i += 4) {
+        d1 = CM_SideDistances(brush->sidePlanes, stride, i, tw->start,
+                              tw->size, tw->isPoint);
+        d2 = CM_SideDistances(brush->sidePlanes, stride, i, tw->end,
+                              tw->size, tw->isPoint);
+
+        out1 = _mm_cmpgt_ps(d1, zero);
+        out2 = _mm_cmpgt_ps(d2, zero);
+
+        // if completely in front of face, no intersection with the entire
+        // brush
+        if (_mm_movemask_ps(_mm_and_ps(
+                out1, _mm_or_ps(_mm_cmpge_ps(d2, eps), _mm_cmpge_ps(d2, d1))))) {
+            return qfalse;
+        }
+
+        if (_mm_movemask_ps(out2)) {
+            *getout = qtrue; // endpoint is not in solid
+        }
+        if (_mm_movemask_ps(out1)) {
+            *startout = qtrue;
+        }
+
+        // planes the trace doesn't cross aren't relevant
+        cross = _mm_andnot_ps(
+            _mm_and_ps(_mm_cmple_ps(d1, zero), _mm_cmple_ps(d2, zero)),
+            _mm_cmpeq_ps(zero, zero));
+        enters = _mm_cmpgt_ps(d1, d2);
+        enter = _mm_movemask_ps(_mm_and_ps(cross, enters));
+        leave = _mm_movemask_ps(_mm_andnot_ps(enters, cross));
+        if (!enter && !leave) {
+            continue;
+        }
+
+        // the divisions stay scalar, with -ffast-math the compiler turns
+        // divps into an approximation that differs in the last bits
+        _mm_storeu_ps(enterDist, _mm_sub_ps(d1, eps));
+        _mm_storeu_ps(leaveDist, _mm_add_ps(d1, eps));
+        _mm_storeu_ps(delta, _mm_sub_ps(d1, d2));
+
+        for (j = 0; j < 4; j++) {
+            if (enter & (1 << j)) {
+                f = enterDist[j] / delta[j];
+                if (f < 0) {
+                    f = 0;
+                }
+                if (f > *enterFrac) {
+                    *enterFrac = f;
+                    *leadSide = i + j;
+                }
+            } else if (leave & (1 << j)) {
+                f = leaveDist[j] / delta[j];
+                if (f > 1) {
+                    f = 1;
+                }
+                if (f < *leaveFrac) {
+                    *leaveFrac = f;
+                }
+            }
+        }
+    }
+    return qtrue;
+}
+#endif
+
 /*
 ================
 CM_TraceThroughBrush
@@ -565,6 +742,18 @@ void CM_TraceThroughBrush(traceWork_t *tw, cbrush_t *brush) {
                 }
             }
         }
+#if CM_SIMD
+    } else if (brush->sidePlanes && cm_simd->integer) {
+        i = -1;
+        if (!CM_ClipToSides(tw, brush, &enterFrac, &leaveFrac, &i, &startout,
+                            &getout)) {
+            return;
+        }
+        if (i >= 0) {
+            leadside = brush->sides + i;
+            clipplane = leadside->plane;
+        }
+#endif
     } else {
         //
         // compare the trace against all planes of the brush
@@ -670,10 +859,10 @@ void CM_TraceThroughLeaf(traceWork_t *tw, cLeaf_t *leaf) {
         brushnum = cm.leafbrushes[leaf->firstLeafBrush + k];
 
         b = &cm.brushes[brushnum];
-        if (b->checkcount == cm.checkcount) {
+        if (b->checkcount == tw->checkcount) {
             continue; // already checked this brush in another leaf
         }
-        b->checkcount = cm.checkcount;
+        b->checkcount = tw->checkcount;
 
         if (!(b->contents & tw->contents)) {
             continue;
@@ -701,10 +890,10 @@ void CM_TraceThroughLeaf(traceWork_t *tw, cLeaf_t *leaf) {
             if (!patch) {
                 continue;
             }
-            if (patch->checkcount == cm.checkcount) {
+            if (patch->checkcount == tw->checkcount) {
                 continue; // already checked this patch in another leaf
             }
-            patch->checkcount = cm.checkcount;
+            patch->checkcount = tw->checkcount;
 
             if (!(patch->contents & tw->contents)) {
                 continue;
@@ -1018,7 +1207,8 @@ void CM_TraceBoundingBoxThroughCapsule(traceWork_t *tw, clipHandle_t model) {
     VectorSet(tw->sphere.offset, 0, 0, size[1][2] - tw->sphere.radius);
 
     // replace the capsule with the bounding box
-    h = CM_TempBoxModel(tw->size[0], tw->size[1], qfalse);
+    h = CM_TempBoxModelSlot(tw->size[0], tw->size[1], qfalse,
+                            CM_BoxSlotForHandle(model));
     // calculate collision
     cmod = CM_ClipHandleToModel(h);
     CM_TraceThroughLeaf(tw, &cmod->leaf);
@@ -1140,6 +1330,123 @@ void CM_TraceThroughTree(traceWork_t *tw, int num, float p1f, float p2f,
     CM_TraceThroughTree(tw, node->children[side ^ 1], midf, p2f, mid, p2);
 }
 
+// deeper trees finish the ray with the recursive code
+#define MAX_RAY_STACK 128
+
+typedef struct {
+    int num;
+    float p1f, p2f;
+} rayStack_t;
+
+/*
+==================
+CM_TraceRayThroughTree
+
+CM_TraceThroughTree for point traces, without the recursion and the box
+offsets. Every node is split in fractions of the whole ray, using the
+inverse direction for axial planes, instead of lerping the segment end
+points down the tree. Brushes are clipped against tw->start and tw->end
+either way, so only the leafs visited right on a split plane can differ.
+==================
+*/
+static void CM_TraceRayThroughTree(traceWork_t *tw) {
+    rayStack_t stack[MAX_RAY_STACK];
+    rayStack_t *top;
+    cNode_t *node;
+    cplane_t *plane;
+    vec3_t dir, invDir, p1, p2;
+    float ds, dd, t1, t2, idist, nearf, farf, p1f, p2f;
+    int num, side, i;
+
+    VectorSubtract(tw->end, tw->start, dir);
+    for (i = 0; i < 3; i++) {
+        invDir[i] = dir[i] ? 1.0f / dir[i] : 0;
+    }
+
+    top = stack;
+    top->num = 0;
+    top->p1f = 0;
+    top->p2f = 1;
+    top++;
+
+    while (top > stack) {
+        top--;
+        num = top->num;
+        p1f = top->p1f;
+        p2f = top->p2f;
+
+        while (tw->trace.fraction > p1f) {
+            if (num < 0) {
+                CM_TraceThroughLeaf(tw, &cm.leafs[-1 - num]);
+                break;
+            }
+
+            node = cm.nodes + num;
+            plane = node->plane;
+
+            if (plane->type < 3) {
+                ds = tw->start[plane->type] - plane->dist;
+                dd = dir[plane->type];
+                idist = invDir[plane->type];
+            } else {
+                ds = DotProduct(plane->normal, tw->start) - plane->dist;
+                dd = DotProduct(plane->normal, dir);
+                idist = dd ? 1.0f / dd : 0;
+            }
+            t1 = ds + dd * p1f;
+            t2 = ds + dd * p2f;
+
+            if (t1 >= 1 && t2 >= 1) {
+                num = node->children[0];
+                continue;
+            }
+            if (t1 < -1 && t2 < -1) {
+                num = node->children[1];
+                continue;
+            }
+
+            // put the crosspoint SURFACE_CLIP_EPSILON pixels on the near side
+            if (dd > 0) {
+                side = 1;
+                nearf = farf = -(ds + SURFACE_CLIP_EPSILON) * idist;
+            } else if (dd < 0) {
+                side = 0;
+                nearf = -(ds + SURFACE_CLIP_EPSILON) * idist;
+                farf = -(ds - SURFACE_CLIP_EPSILON) * idist;
+            } else {
+                side = 0;
+                nearf = p2f;
+                farf = p1f;
+            }
+
+            nearf = MAX(nearf, p1f);
+            nearf = MIN(nearf, p2f);
+            farf = MAX(farf, p1f);
+            farf = MIN(farf, p2f);
+
+            if (top - stack >= MAX_RAY_STACK) {
+                // out of stack, let the recursion finish this node
+                for (i = 0; i < 3; i++) {
+                    p1[i] = tw->start[i] + p1f * dir[i];
+                    p2[i] = tw->start[i] + p2f * dir[i];
+                }
+                CM_TraceThroughTree(tw, num, p1f, p2f, p1, p2);
+                break;
+            }
+
+            // go past the node after the near side is done
+            top->num = node->children[side ^ 1];
+            top->p1f = farf;
+            top->p2f = p2f;
+            top++;
+
+            // move up to the node
+            num = node->children[side];
+            p2f = nearf;
+        }
+    }
+}
+
 //======================================================================
 
 /*
@@ -1157,12 +1464,13 @@ void CM_Trace(trace_t *results, const vec3_t start, const vec3_t end,
 
     cmod = CM_ClipHandleToModel(model);
 
-    cm.checkcount++; // for multi-check avoidance
-
     c_traces++; // for statistics, may be zeroed
 
     // fill in a default trace
     Com_Memset(&tw, 0, sizeof(tw));
+
+    // every trace gets its own stamp so that traces may run concurrently
+    tw.checkcount = Sys_AtomicAdd(&cm.checkcount, 1) + 1;
     tw.trace.fraction =
         1; // assume it goes the entire distance until shown otherwise
     VectorCopy(origin, tw.modelOrigin);
@@ -1276,16 +1584,16 @@ void CM_Trace(trace_t *results, const vec3_t start, const vec3_t end,
     if (start[0] == end[0] && start[1] == end[1] && start[2] == end[2]) {
         if (model) {
 #ifdef ALWAYS_BBOX_VS_BBOX // FIXME - compile time flag?
-            if (model == BOX_MODEL_HANDLE || model == CAPSULE_MODEL_HANDLE) {
+            if (CM_IsTempBoxHandle(model)) {
                 tw.sphere.use = qfalse;
                 CM_TestInLeaf(&tw, &cmod->leaf);
             } else
 #elif defined(ALWAYS_CAPSULE_VS_CAPSULE)
-            if (model == BOX_MODEL_HANDLE || model == CAPSULE_MODEL_HANDLE) {
+            if (CM_IsTempBoxHandle(model)) {
                 CM_TestCapsuleInCapsule(&tw, model);
             } else
 #endif
-                if (model == CAPSULE_MODEL_HANDLE) {
+                if (CM_IsCapsuleHandle(model)) {
                 if (tw.sphere.use) {
                     CM_TestCapsuleInCapsule(&tw, model);
                 } else {
@@ -1316,16 +1624,16 @@ void CM_Trace(trace_t *results, const vec3_t start, const vec3_t end,
         //
         if (model) {
 #ifdef ALWAYS_BBOX_VS_BBOX
-            if (model == BOX_MODEL_HANDLE || model == CAPSULE_MODEL_HANDLE) {
+            if (CM_IsTempBoxHandle(model)) {
                 tw.sphere.use = qfalse;
                 CM_TraceThroughLeaf(&tw, &cmod->leaf);
             } else
 #elif defined(ALWAYS_CAPSULE_VS_CAPSULE)
-            if (model == BOX_MODEL_HANDLE || model == CAPSULE_MODEL_HANDLE) {
+            if (CM_IsTempBoxHandle(model)) {
                 CM_TraceCapsuleThroughCapsule(&tw, model);
             } else
 #endif
-                if (model == CAPSULE_MODEL_HANDLE) {
+                if (CM_IsCapsuleHandle(model)) {
                 if (tw.sphere.use) {
                     CM_TraceCapsuleThroughCapsule(&tw, model);
                 } else {
@@ -1334,6 +1642,8 @@ void CM_Trace(trace_t *results, const vec3_t start, const vec3_t end,
             } else {
                 CM_TraceThroughLeaf(&tw, &cmod->leaf);
             }
+        } else if (tw.isPoint && !tw.sphere.use && cm_fastRay->integer) {
+            CM_TraceRayThroughTree(&tw);
         } else {
             CM_TraceThroughTree(&tw, 0, 0, 1, tw.start, tw.end);
         }
@@ -1417,7 +1727,7 @@ void CM_TransformedBoxTrace(trace_t *results, const vec3_t start,
     VectorSubtract(end_l, origin, end_l);
 
     // rotate start and end into the models frame of reference
-    if (model != BOX_MODEL_HANDLE && (angles[0] || angles[1] || angles[2])) {
+    if (!CM_IsBoxHandle(model) && (angles[0] || angles[1] || angles[2])) {
         rotated = qtrue;
     } else {
         rotated = qfalse;
@@ -1469,3 +1779,172 @@ void CM_TransformedBoxTrace(trace_t *results, const vec3_t start,
 
     *results = trace;
 }
+
+/*
+===============================================================================
+
+BENCHMARK
+
+===============================================================================
+*/
+
+typedef struct {
+    vec3_t start, end;
+    qboolean box;
+} cmBenchTrace_t;
+
+/*
+================
+CM_BenchTraces
+================
+*/
+static long long CM_BenchTraces(const cmBenchTrace_t *traces, int count,
+                                trace_t *results) {
+    static const vec3_t boxMins = {-15, -15, -24};
+    static const vec3_t boxMaxs = {15, 15, 32};
+    long long start;
+    int i;
+
+    start = Sys_Nanoseconds();
+    for (i = 0; i < count; i++) {
+        if (traces[i].box) {
+            CM_BoxTrace(&results[i], traces[i].start, traces[i].end,
+                        (float *)boxMins, (float *)boxMaxs, 0, CONTENTS_SOLID,
+                        qfalse);
+        } else {
+            CM_BoxTrace(&results[i], traces[i].start, traces[i].end, NULL,
+                        NULL, 0, CONTENTS_SOLID, qfalse);
+        }
+    }
+    return Sys_Nanoseconds() - start;
+}
+
+// traces generated and checked at a time
+#define CM_BENCH_CHUNK 4096
+
+typedef struct {
+    const char *name;
+    const char *simd, *fastRay, *facetTree;
+} cmBenchMode_t;
+
+// the first mode is the reference the others have to match
+static const cmBenchMode_t cmBenchModes[] = {
+    {"scalar", "0", "0", "0"},
+    {"simd", "1", "0", "0"},
+    {"simd+ray", "1", "1", "0"},
+    {"simd+ray+facets", "1", "1", "1"},
+};
+
+#define CM_BENCH_MODES ARRAY_LEN(cmBenchModes)
+
+/*
+================
+CM_TraceBench_f
+
+cmbench [traces]
+
+Runs the same random traces through the loaded map with each of the
+cmBenchModes, and checks all of them give the same bits as the first. Half
+are point traces, across the whole map or short like bullets hitting
+something close, and half player box moves and position tests.
+================
+*/
+void CM_TraceBench_f(void) {
+    cmBenchTrace_t *traces, *t;
+    trace_t *results[CM_BENCH_MODES];
+    vec3_t mins, maxs, size;
+    char oldSimd[MAX_CVAR_VALUE_STRING], oldRay[MAX_CVAR_VALUE_STRING];
+    char oldFacets[MAX_CVAR_VALUE_STRING];
+    int total, done, count, points, seed, i, j, m, mismatches, hits;
+    long long pointTime[CM_BENCH_MODES], boxTime[CM_BENCH_MODES];
+    const cmBenchMode_t *mode;
+
+    if (!cm.numNodes) {
+        Com_Printf("No map loaded.\n");
+        return;
+    }
+
+    total = 1000000;
+    if (Cmd_Argc() > 1) {
+        total = atoi(Cmd_Argv(1));
+    }
+    total = MAX(total, 2);
+
+    traces = Z_Malloc(CM_BENCH_CHUNK * sizeof(*traces));
+    for (m = 0; m < CM_BENCH_MODES; m++) {
+        results[m] = Z_Malloc(CM_BENCH_CHUNK * sizeof(*results[m]));
+        pointTime[m] = boxTime[m] = 0;
+    }
+
+    CM_ModelBounds(0, mins, maxs);
+    VectorSubtract(maxs, mins, size);
+    Q_strncpyz(oldSimd, cm_simd->string, sizeof(oldSimd));
+    Q_strncpyz(oldRay, cm_fastRay->string, sizeof(oldRay));
+    Q_strncpyz(oldFacets, cm_facetTree->string, sizeof(oldFacets));
+
+    seed = 1;
+    mismatches = hits = 0;
+    for (done = 0; done < total; done += count) {
+        count = MIN(total - done, CM_BENCH_CHUNK);
+        points = count / 2;
+
+        // point traces first, then the boxes
+        for (i = 0, t = traces; i < count; i++, t++) {
+            for (j = 0; j < 3; j++) {
+                t->start[j] = mins[j] + Q_random(&seed) * size[j];
+            }
+            t->box = i >= points;
+            if (!t->box && !(i & 1)) {
+                for (j = 0; j < 3; j++) {
+                    t->end[j] = mins[j] + Q_random(&seed) * size[j];
+                }
+            } else if (!t->box || (i & 1)) {
+                for (j = 0; j < 3; j++) {
+                    t->end[j] = t->start[j] + Q_crandom(&seed) * 256;
+                }
+            } else {
+                VectorCopy(t->start, t->end);
+            }
+        }
+
+        for (m = 0, mode = cmBenchModes; m < CM_BENCH_MODES; m++, mode++) {
+            Cvar_Set("cm_simd", mode->simd);
+            Cvar_Set("cm_fastRay", mode->fastRay);
+            Cvar_Set("cm_facetTree", mode->facetTree);
+            pointTime[m] += CM_BenchTraces(traces, points, results[m]);
+            boxTime[m] += CM_BenchTraces(traces + points, count - points,
+                                         results[m] + points);
+        }
+
+        for (i = 0; i < count; i++) {
+            for (m = 1; m < CM_BENCH_MODES; m++) {
+                if (memcmp(&results[0][i], &results[m][i], sizeof(trace_t))) {
+                    mismatches++;
+                    break;
+                }
+            }
+            if (results[0][i].fraction < 1 || results[0][i].startsolid) {
+                hits++;
+            }
+        }
+    }
+    Cvar_Set("cm_simd", oldSimd);
+    Cvar_Set("cm_fastRay", oldRay);
+    Cvar_Set("cm_facetTree", oldFacets);
+
+    points = total / 2;
+    Com_Printf("%i traces, %i brushes, %i surfaces, %i hit or start solid, "
+               "%i mismatches\n",
+               total, cm.numBrushes, cm.numSurfaces, hits, mismatches);
+    Com_Printf("usec/trace      point   box\n");
+    for (m = 0; m < CM_BENCH_MODES; m++) {
+        Com_Printf("%-15s %.3f   %.3f\n", cmBenchModes[m].name,
+                   pointTime[m] / 1000.0 / points,
+                   boxTime[m] / 1000.0 / (total - points));
+    }
+
+    for (m = 0; m < CM_BENCH_MODES; m++) {
+        Z_Free(results[m]);
+    }
+    Z_Free(traces);
+}
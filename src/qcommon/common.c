@@ -95,6 +95,7 @@ cvar_t *com_legacyprotocol;
 cvar_t *com_basegame;
 cvar_t *com_homepath;
 cvar_t *com_busyWait;
+cvar_t *com_frameTimer;
 
 #if idx64
 int (*Q_VMftol)(void);
@@ -127,6 +128,8 @@ static char *rd_buffer;
 static int rd_buffersize;
 static void (*rd_flush)(char *buffer);
 
+static Q_THREAD_LOCAL jobContext_t *com_job;
+
 void Com_BeginRedirect(char *buffer, int buffersize, void (*flush)(char *)) {
     if (!buffer || !buffersize || !flush)
         return;
@@ -147,6 +150,22 @@ void Com_EndRedirect(void) {
     rd_flush = NULL;
 }
 
+/*
+=============
+Com_SetJobContext
+
+Set by a job on the thread that runs it, NULL clears it again
+=============
+*/
+void Com_SetJobContext(jobContext_t *job) {
+    if (job) {
+        job->errorCode = 0;
+        job->error[0] = 0;
+        job->log[0] = 0;
+    }
+    com_job = job;
+}
+
 /*
 =============
 Com_Printf
@@ -167,6 +186,11 @@ void QDECL Com_Printf(const char *fmt, ...) {
     Q_vsnprintf(msg, sizeof(msg), fmt, argptr);
     va_end(argptr);
 
+    if (com_job) {
+        Q_strcat(com_job->log, sizeof(com_job->log), msg);
+        return;
+    }
+
     if (rd_buffer) {
         if ((strlen(msg) + strlen(rd_buffer)) > (rd_buffersize - 1)) {
             rd_flush(rd_buffer);
@@ -260,6 +284,14 @@ void QDECL Com_Error(int code, const char *fmt, ...) {
     static int errorCount;
     int currentTime;
 
+    if (com_job) {
+        va_start(argptr, fmt);
+        Q_vsnprintf(com_job->error, sizeof(com_job->error), fmt, argptr);
+        va_end(argptr);
+        com_job->errorCode = code;
+        longjmp(com_job->abort, 1);
+    }
+
     if (com_errorEntered)
         Sys_Error("recursive error after: %s", com_errorMessage);
 
@@ -299,6 +331,8 @@ void QDECL Com_Error(int code, const char *fmt, ...) {
         VM_Forced_Unload_Done();
         // make sure we can get at our local stuff
         FS_PureServerSetLoadedPaks("", "");
+        // loads that were holding shared files never get to release them
+        FS_FlushSharedFiles(qtrue);
         com_errorEntered = qfalse;
         longjmp(abortframe, -1);
     } else if (code == ERR_DROP) {
@@ -310,6 +344,7 @@ void QDECL Com_Error(int code, const char *fmt, ...) {
         CL_FlushMemory();
         VM_Forced_Unload_Done();
         FS_PureServerSetLoadedPaks("", "");
+        FS_FlushSharedFiles(qtrue);
         com_errorEntered = qfalse;
         longjmp(abortframe, -1);
     } else if (code == ERR_NEED_CD) {
@@ -326,6 +361,7 @@ void QDECL Com_Error(int code, const char *fmt, ...) {
         }
 
         FS_PureServerSetLoadedPaks("", "");
+        FS_FlushSharedFiles(qtrue);
 
         com_errorEntered = qfalse;
         longjmp(abortframe, -1);
@@ -2543,6 +2579,9 @@ void Com_Init(char *commandLine) {
     }
     Cmd_AddCommand("quit", Com_Quit_f);
     Cmd_AddCommand("changeVectors", MSG_ReportChangeVectors_f);
+    Cmd_AddCommand("huffbench", MSG_HuffmanBench_f);
+    Cmd_AddCommand("msgbench", MSG_BitsBench_f);
+    Cmd_AddCommand("tickjitter", Com_TickJitter_f);
     Cmd_AddCommand("writeconfig", Com_WriteConfig_f);
     Cmd_SetCommandCompletionFunc("writeconfig", Cmd_CompleteCfgName);
     Cmd_AddCommand("game_restart", Com_GameRestart_f);
@@ -2598,6 +2637,7 @@ void Com_Init(char *commandLine) {
     com_maxfpsMinimized = Cvar_Get("com_maxfpsMinimized", "0", CVAR_ARCHIVE);
     com_abnormalExit = Cvar_Get("com_abnormalExit", "0", CVAR_ROM);
     com_busyWait = Cvar_Get("com_busyWait", "0", CVAR_ARCHIVE);
+    com_frameTimer = Cvar_Get("com_frameTimer", "1", CVAR_ARCHIVE);
     Cvar_Get("com_errorMessage", "", CVAR_ROM | CVAR_NORESTART);
 
     com_introPlayed = Cvar_Get("com_introplayed", "0", CVAR_ARCHIVE);
@@ -2864,6 +2904,112 @@ int Com_TimeVal(int minMsec) {
     return timeVal;
 }
 
+/*
+=================
+Com_WaitForFrame
+
+Sleeps until Sys_Nanoseconds() reaches deadline, handling packets as they
+arrive and sending queued ones on time. Sys_Nanoseconds shares its origin
+with com_frameTime, so the wait ends right on the millisecond the frame
+belongs to rather than up to a millisecond later like NET_Sleep's timeout.
+=================
+*/
+static void Com_WaitForFrame(long long deadline) {
+    long long wake;
+    int timeValSV;
+
+    do {
+        wake = deadline;
+
+        if (com_sv_running->integer) {
+            timeValSV = SV_SendQueuedPackets();
+
+            if (timeValSV < (deadline - Sys_Nanoseconds()) / 1000000)
+                wake = Sys_Nanoseconds() + (long long)timeValSV * 1000000;
+        }
+
+        NET_SleepUntil(wake);
+    } while (Sys_Nanoseconds() < deadline);
+}
+
+/*
+=================
+Com_RecordTickJitter
+
+Dedicated server frames are due on a game frame boundary, the histogram
+counts how late they actually started
+=================
+*/
+#define TICK_JITTER_BUCKETS 11
+
+static const int tickJitterLimits[TICK_JITTER_BUCKETS - 1] = {
+    10, 25, 50, 100, 250, 500, 1000, 2000, 5000, 10000}; // usec
+
+static struct {
+    int counts[TICK_JITTER_BUCKETS];
+    int ticks;
+    long long total; // nsec
+    long long max;   // nsec
+} tickJitter;
+
+static void Com_RecordTickJitter(long long late) {
+    int i;
+
+    if (late < 0)
+        late = 0;
+
+    for (i = 0; i < TICK_JITTER_BUCKETS - 1; i++) {
+        if (late < tickJitterLimits[i] * 1000LL)
+            break;
+    }
+
+    tickJitter.counts[i]++;
+    tickJitter.ticks++;
+    tickJitter.total += late;
+    if (late > tickJitter.max)
+        tickJitter.max = late;
+}
+
+/*
+=================
+Com_TickJitter_f
+
+tickjitter [reset]
+=================
+*/
+void Com_TickJitter_f(void) {
+    int i, sum;
+
+    if (!Q_stricmp(Cmd_Argv(1), "reset")) {
+        Com_Memset(&tickJitter, 0, sizeof(tickJitter));
+        return;
+    }
+
+    if (!tickJitter.ticks) {
+        Com_Printf("No server frames recorded.\n");
+        return;
+    }
+
+    Com_Printf("%i frames (%s), mean %.1f usec late, worst %.1f usec\n",
+               tickJitter.ticks,
+               com_frameTimer->integer && !com_busyWait->integer
+                   ? "frame timer"
+                   : "millisecond sleep",
+               tickJitter.total / 1000.0 / tickJitter.ticks,
+               tickJitter.max / 1000.0);
+
+    for (i = 0, sum = 0; i < TICK_JITTER_BUCKETS; i++) {
+        sum += tickJitter.counts[i];
+        if (i < TICK_JITTER_BUCKETS - 1)
+            Com_Printf("  < %5i usec", tickJitterLimits[i]);
+        else
+            Com_Printf(" >= %5i usec", tickJitterLimits[i - 1]);
+        Com_Printf(" %8i %6.2f%% %7.2f%%\n", tickJitter.counts[i],
+                   100.0f * tickJitter.counts[i] / tickJitter.ticks,
+                   100.0f * sum / tickJitter.ticks);
+    }
+}
+
 /*
 =================
 Com_Frame
@@ -2874,6 +3020,7 @@ void Com_Frame(void) {
     int msec, minMsec;
     int timeVal, timeValSV;
     static int lastTime = 0, bias = 0;
+    long long deadline;
 
     int timeBeforeFirstEvents;
     int timeBeforeServer;
@@ -2928,22 +3075,32 @@ void Com_Frame(void) {
     } else
         minMsec = 1;
 
-    do {
-        if (com_sv_running->integer) {
-            timeValSV = SV_SendQueuedPackets();
+    deadline = (long long)(com_frameTime + minMsec) * 1000000;
 
-            timeVal = Com_TimeVal(minMsec);
+    if (com_dedicated->integer && com_frameTimer->integer &&
+        !com_busyWait->integer && !com_timedemo->integer) {
+        Com_WaitForFrame(deadline);
+    } else {
+        do {
+            if (com_sv_running->integer) {
+                timeValSV = SV_SendQueuedPackets();
 
-            if (timeValSV < timeVal)
-                timeVal = timeValSV;
-        } else
-            timeVal = Com_TimeVal(minMsec);
+                timeVal = Com_TimeVal(minMsec);
 
-        if (com_busyWait->integer || timeVal < 1)
-            NET_Sleep(0);
-        else
-            NET_Sleep(timeVal - 1);
-    } while (Com_TimeVal(minMsec));
+                if (timeValSV < timeVal)
+                    timeVal = timeValSV;
+            } else
+                timeVal = Com_TimeVal(minMsec);
+
+            if (com_busyWait->integer || timeVal < 1)
+                NET_Sleep(0);
+            else
+                NET_Sleep(timeVal - 1);
+        } while (Com_TimeVal(minMsec));
+    }
+
+    if (com_dedicated->integer && com_sv_running->integer && minMsec > 0)
+        Com_RecordTickJitter(Sys_Nanoseconds() - deadline);
 
     lastTime = com_frameTime;
     com_frameTime = Com_EventLoop();
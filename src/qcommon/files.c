@@ -129,12 +129,10 @@ The filesystem can be safely shutdown and reinitialized with different
 basedir / cddir / game combinations, but all other subsystems that rely on it
 (sound, video) must also be forced to restart.
 
-Because the same files are loaded by both the clip model (CM_) and renderer
-(TR_) subsystems, a simple single-file caching scheme is used.  The CM_
-subsystems will load the file with a request to cache.  Only one file will be
-kept cached at a time, so any models that are going to be referenced by both
-subsystems should alternate between the CM_ load function and the ref load
-function.
+Because the same world map is loaded by both the clip model (CM_) and renderer
+(TR_) subsystems, both acquire it as a shared file (FS_AcquireFile). It is
+mapped or read once, and the last one released is kept until another shared
+file is acquired, so the CM_ load and the following ref load share one copy.
 
 TODO: A qpath that starts with a leading slash will always refer to the base
 game, even if another game is currently active.  This allows character models,
@@ -408,6 +406,34 @@ void FS_ForceFlush(fileHandle_t f) {
     setvbuf(file, NULL, _IONBF, 0);
 }
 
+/*
+================
+FS_MapFile
+================
+*/
+void *FS_MapFile(fileHandle_t f, int *length) {
+    if (f < 1 || f >= MAX_FILE_HANDLES || fsh[f].zipFile ||
+        !fsh[f].handleFiles.file.o) {
+        return NULL;
+    }
+
+    return Sys_MapFile(fsh[f].handleFiles.file.o, length);
+}
+
+/*
+================
+FS_FileModifiedTime
+================
+*/
+int FS_FileModifiedTime(fileHandle_t f) {
+    if (f < 1 || f >= MAX_FILE_HANDLES || fsh[f].zipFile ||
+        !fsh[f].handleFiles.file.o) {
+        return -1;
+    }
+
+    return Sys_FileModifiedTime(fsh[f].handleFiles.file.o);
+}
+
 /*
 ================
 FS_fplength
@@ -1893,6 +1919,172 @@ void FS_FreeFile(void *buffer) {
     }
 }
 
+/*
+=============================================================================
+
+SHARED FILES
+
+The clip model and the renderer both load the world map. A shared file is
+mapped, or read out of its pak once, and handed to every loader that asks for
+it. The last one released stays around until another file is acquired or
+FS_FlushSharedFiles is called, so the renderer gets the map the collision
+loaded a moment before.
+
+=============================================================================
+*/
+
+#define MAX_SHARED_FILES 4
+
+typedef struct {
+    char name[MAX_QPATH];
+    byte *data;
+    int length;
+    int refs;
+    qboolean mapped; // else malloced
+} sharedFile_t;
+
+static sharedFile_t fs_sharedFiles[MAX_SHARED_FILES];
+
+/*
+=============
+FS_DropSharedFile
+=============
+*/
+static void FS_DropSharedFile(sharedFile_t *file) {
+    if (file->mapped) {
+        Sys_UnmapFile(file->data, file->length);
+    } else {
+        free(file->data);
+    }
+    Com_Memset(file, 0, sizeof(*file));
+}
+
+/*
+=============
+FS_FlushSharedFiles
+
+Drops the shared files nothing holds, or all of them after an error
+abandoned the loads holding them
+=============
+*/
+void FS_FlushSharedFiles(qboolean all) {
+    sharedFile_t *file;
+    int i;
+
+    for (i = 0, file = fs_sharedFiles; i < MAX_SHARED_FILES; i++, file++) {
+        if (file->data && (all || !file->refs)) {
+            FS_DropSharedFile(file);
+        }
+    }
+}
+
+/*
+=============
+FS_AcquireFile
+
+Like FS_ReadFile, but the buffer is shared with everyone else who acquired
+the same file and must not be written to. There is no trailing 0.
+=============
+*/
+long FS_AcquireFile(const char *qpath, void **buffer) {
+    sharedFile_t *file, *unused;
+    fileHandle_t h;
+    long len;
+    int i;
+
+    if (!fs_searchpaths) {
+        Com_Error(ERR_FATAL, "Filesystem call made without initialization");
+    }
+
+    if (!qpath || !qpath[0]) {
+        Com_Error(ERR_FATAL, "FS_AcquireFile with empty name");
+    }
+
+    *buffer = NULL;
+
+    for (i = 0, file = fs_sharedFiles; i < MAX_SHARED_FILES; i++, file++) {
+        if (file->data && !Q_stricmp(file->name, qpath)) {
+            file->refs++;
+            *buffer = file->data;
+            return file->length;
+        }
+    }
+
+    // only one file is kept after its last release
+    FS_FlushSharedFiles(qfalse);
+
+    unused = NULL;
+    for (i = 0, file = fs_sharedFiles; i < MAX_SHARED_FILES; i++, file++) {
+        if (!file->data) {
+            unused = file;
+            break;
+        }
+    }
+    if (!unused) {
+        Com_Error(ERR_DROP, "FS_AcquireFile: too many shared files");
+    }
+
+    // also marks the pak as referenced for pure checks
+    len = FS_FOpenFileRead(qpath, &h, qfalse);
+    if (!h) {
+        return -1;
+    }
+
+    unused->data = FS_MapFile(h, &unused->length);
+    unused->mapped = unused->data != NULL;
+    if (unused->mapped && unused->length != len) {
+        Sys_UnmapFile(unused->data, unused->length);
+        unused->data = NULL;
+        unused->mapped = qfalse;
+    }
+
+    // compressed in a pak, inflate it once
+    if (!unused->data && len > 0) {
+        unused->data = malloc(len);
+        unused->length = len;
+        if (unused->data && FS_Read(unused->data, len, h) != len) {
+            free(unused->data);
+            unused->data = NULL;
+        }
+    }
+    FS_FCloseFile(h);
+
+    if (!unused->data) {
+        Com_Memset(unused, 0, sizeof(*unused));
+        return -1;
+    }
+
+    fs_loadCount++;
+
+    Q_strncpyz(unused->name, qpath, sizeof(unused->name));
+    unused->refs = 1;
+    *buffer = unused->data;
+    return unused->length;
+}
+
+/*
+=============
+FS_ReleaseFile
+=============
+*/
+void FS_ReleaseFile(void *buffer) {
+    sharedFile_t *file;
+    int i;
+
+    if (!buffer) {
+        Com_Error(ERR_FATAL, "FS_ReleaseFile( NULL )");
+    }
+
+    for (i = 0, file = fs_sharedFiles; i < MAX_SHARED_FILES; i++, file++) {
+        if (file->data == buffer && file->refs > 0) {
+            file->refs--;
+            return;
+        }
+    }
+
+    Com_Error(ERR_FATAL, "FS_ReleaseFile: not a shared file");
+}
+
 /*
 ============
 FS_WriteFile
@@ -3117,6 +3309,9 @@ void FS_Shutdown(qboolean closemfp) {
         Z_Free(p);
     }
 
+    // a restart may pick the files up from another pak
+    FS_FlushSharedFiles(qtrue);
+
     // any FS_ calls will now be an error until reinitialized
     fs_searchpaths = NULL;
 
@@ -29,14 +29,16 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 static int bloc = 0;
 
+// the writers only touch the caller's offset so that several messages can be
+// encoded at the same time from worker threads
 void Huff_putBit(int bit, byte *fout, int *offset) {
-    bloc = *offset;
-    if ((bloc & 7) == 0) {
-        fout[(bloc >> 3)] = 0;
+    int ofs = *offset;
+
+    if ((ofs & 7) == 0) {
+        fout[(ofs >> 3)] = 0;
     }
-    fout[(bloc >> 3)] |= bit << (bloc & 7);
-    bloc++;
-    *offset = bloc;
+    fout[(ofs >> 3)] |= bit << (ofs & 7);
+    *offset = ofs + 1;
 }
 
 int Huff_getBloc(void) { return bloc; }
@@ -53,12 +55,12 @@ int Huff_getBit(byte *fin, int *offset) {
 }
 
 /* Add a bit to the output file (buffered) */
-static void add_bit(char bit, byte *fout) {
-    if ((bloc & 7) == 0) {
-        fout[(bloc >> 3)] = 0;
+static void add_bit(char bit, byte *fout, int *offset) {
+    if ((*offset & 7) == 0) {
+        fout[(*offset >> 3)] = 0;
     }
-    fout[(bloc >> 3)] |= bit << (bloc & 7);
-    bloc++;
+    fout[(*offset >> 3)] |= bit << (*offset & 7);
+    (*offset)++;
 }
 
 /* Receive one bit from the input file (buffered) */
@@ -294,15 +296,15 @@ void Huff_offsetReceive(node_t *node, int *ch, byte *fin, int *offset) {
 }
 
 /* Send the prefix code for this node */
-static void send(node_t *node, node_t *child, byte *fout) {
+static void send(node_t *node, node_t *child, byte *fout, int *offset) {
     if (node->parent) {
-        send(node->parent, node, fout);
+        send(node->parent, node, fout, offset);
     }
     if (child) {
         if (node->right == child) {
-            add_bit(1, fout);
+            add_bit(1, fout, offset);
         } else {
-            add_bit(0, fout);
+            add_bit(0, fout, offset);
         }
     }
 }
@@ -314,17 +316,126 @@ void Huff_transmit(huff_t *huff, int ch, byte *fout) {
         /* node_t hasn't been transmitted, send a NYT, then the symbol */
         Huff_transmit(huff, NYT, fout);
         for (i = 7; i >= 0; i--) {
-            add_bit((char)((ch >> i) & 0x1), fout);
+            add_bit((char)((ch >> i) & 0x1), fout, &bloc);
         }
     } else {
-        send(huff->loc[ch], NULL, fout);
+        send(huff->loc[ch], NULL, fout, &bloc);
     }
 }
 
 void Huff_offsetTransmit(huff_t *huff, int ch, byte *fout, int *offset) {
-    bloc = *offset;
-    send(huff->loc[ch], NULL, fout);
-    *offset = bloc;
+    send(huff->loc[ch], NULL, fout, offset);
+}
+
+/*
+Static tables
+
+The message tree built from msg_hData never changes after MSG_initHuffman, so
+its codes can be looked up instead of walking the tree one bit at a time. The
+adaptive trees of Huff_Compress and Huff_Decompress change after every symbol
+and keep using the tree.
+*/
+
+void Huff_BuildTable(const huff_t *huff, huffTable_t *table) {
+    const node_t *node;
+    unsigned int code;
+    int ch, len, fill;
+
+    Com_Memset(table, 0, sizeof(*table));
+
+    for (ch = 0; ch <= HMAX; ch++) {
+        if (!huff->loc[ch]) {
+            continue;
+        }
+
+        // walking up gives the bits last to first
+        code = 0;
+        len = 0;
+        for (node = huff->loc[ch]; node->parent; node = node->parent) {
+            if (len == 32) {
+                break;
+            }
+            code = (code << 1) | (node->parent->right == node);
+            len++;
+        }
+        if (node->parent) {
+            continue; // too long, stays on the tree
+        }
+
+        table->code[ch] = code;
+        table->length[ch] = len;
+
+        if (len > HUFF_LOOKUP_BITS) {
+            continue;
+        }
+        for (fill = 0; fill < 1 << (HUFF_LOOKUP_BITS - len); fill++) {
+            table->decode[code | (fill << len)] = ch | (len << 9);
+        }
+    }
+}
+
+/* Get a symbol, fin must be readable for 3 bytes past the offset */
+void Huff_tableReceive(const huffTable_t *table, const node_t *tree, int *ch,
+                       const byte *fin, int *offset) {
+    const byte *p;
+    int ofs, entry;
+
+    ofs = *offset;
+    p = fin + (ofs >> 3);
+    entry = table->decode[((p[0] | (p[1] << 8) | (p[2] << 16)) >> (ofs & 7)) &
+                          ((1 << HUFF_LOOKUP_BITS) - 1)];
+
+    if (entry >> 9) {
+        *ch = entry & 511;
+        *offset = ofs + (entry >> 9);
+        return;
+    }
+
+    // rare symbol with a long code
+    while (tree && tree->symbol == INTERNAL_NODE) {
+        if ((fin[ofs >> 3] >> (ofs & 7)) & 1) {
+            tree = tree->right;
+        } else {
+            tree = tree->left;
+        }
+        ofs++;
+    }
+    if (!tree) {
+        *ch = 0;
+        return;
+    }
+    *ch = tree->symbol;
+    *offset = ofs;
+}
+
+/* Send a symbol */
+void Huff_tableTransmit(huff_t *huff, const huffTable_t *table, int ch,
+                        byte *fout, int *offset) {
+    unsigned int code;
+    int ofs, len, n;
+
+    len = table->length[ch];
+    if (!len) {
+        send(huff->loc[ch], NULL, fout, offset);
+        return;
+    }
+
+    code = table->code[ch];
+    ofs = *offset;
+    while (len > 0) {
+        if ((ofs & 7) == 0) {
+            fout[ofs >> 3] = 0;
+        }
+        n = 8 - (ofs & 7);
+        if (n > len) {
+            n = len;
+        }
+        fout[ofs >> 3] |= (code & ((1 << n) - 1)) << (ofs & 7);
+        code >>= n;
+        len -= n;
+        ofs += n;
+    }
+    *offset = ofs;
 }
 
 void Huff_Decompress(msg_t *mbuf, int offset) {
@@ -23,6 +23,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "qcommon.h"
 
 static huffman_t msgHuff;
+static huffTable_t msgHuffTable;
 
 static qboolean msgInit = qfalse;
 
@@ -99,11 +100,165 @@ bit functions
 
 int overflows;
 
-// negative bit values include signs
-void MSG_WriteBits(msg_t *msg, int value, int bits) {
+/*
+The bitstream (non-oob) writers and readers gather a whole field in a 64 bit
+register and move it to or from the buffer in one unaligned word. The state
+between calls is still only msg->bit, so callers may save and restore it as
+before. Near the end of the buffer, where a word would run past maxsize, the
+original bit at a time code is used.
+*/
+
+// bytes a field may touch past msg->bit: 7 raw bits plus four codes of at
+// most 32 bits, read or written as whole words
+#define MSG_WORD_SLACK 32
+
+// lets msgbench record the fields of a snapshot stream, at the cost of a
+// branch per field in MSG_WriteBits
+// #define MSG_BENCH_RECORD
+
+// replay log for MSG_BitsBench_f
+static int *msgRecordValues;
+static int *msgRecordBits;
+#ifdef MSG_BENCH_RECORD
+static int msgRecordCount, msgRecordMax;
+#endif
+
+static ID_INLINE uint64_t MSG_LoadWord(const byte *p) {
+    uint64_t w;
+#ifdef Q3_BIG_ENDIAN
+    int i;
+
+    w = 0;
+    for (i = 7; i >= 0; i--) {
+        w = (w << 8) | p[i];
+    }
+#else
+    Com_Memcpy(&w, p, sizeof(w));
+#endif
+    return w;
+}
+
+static ID_INLINE void MSG_StoreWord(byte *p, uint64_t w) {
+#ifdef Q3_BIG_ENDIAN
     int i;
-    //	FILE*	fp;
 
+    for (i = 0; i < 8; i++, w >>= 8) {
+        p[i] = (byte)w;
+    }
+#else
+    Com_Memcpy(p, &w, sizeof(w));
+#endif
+}
+
+/*
+Appends the low n (at most 57) bits of acc at msg->bit. Like Huff_putBit the
+bits above the end in the last byte are cleared, the following bytes of the
+word are zeroed as well.
+*/
+static ID_INLINE void MSG_FlushWord(msg_t *msg, uint64_t acc, int n) {
+    byte *p = msg->data + (msg->bit >> 3);
+    int shift = msg->bit & 7;
+
+    MSG_StoreWord(p, (p[0] & ((1 << shift) - 1)) | (acc << shift));
+    msg->bit += n;
+}
+
+static void MSG_WriteHuffBitsSlow(msg_t *msg, unsigned int value, int bits) {
+    int i, nbits;
+
+    nbits = bits & 7;
+    for (i = 0; i < nbits; i++) {
+        Huff_putBit((value & 1), msg->data, &msg->bit);
+        value = (value >> 1);
+    }
+    for (i = nbits; i < bits; i += 8) {
+        Huff_offsetTransmit(&msgHuff.compressor, (value & 0xff), msg->data,
+                            &msg->bit);
+        value = (value >> 8);
+    }
+}
+
+static void MSG_WriteHuffBits(msg_t *msg, unsigned int value, int bits) {
+    uint64_t acc;
+    int i, n, len, nbits;
+
+    nbits = bits & 7;
+    acc = value & ((1 << nbits) - 1);
+    n = nbits;
+    value >>= nbits;
+
+    for (i = nbits; i < bits; i += 8, value >>= 8) {
+        len = msgHuffTable.length[value & 0xff];
+        if (!len || n + len > 57) {
+            MSG_FlushWord(msg, acc, n);
+            acc = 0;
+            n = 0;
+            if (!len) {
+                Huff_tableTransmit(&msgHuff.compressor, &msgHuffTable,
+                                   (value & 0xff), msg->data, &msg->bit);
+                continue;
+            }
+        }
+        acc |= (uint64_t)msgHuffTable.code[value & 0xff] << n;
+        n += len;
+    }
+
+    MSG_FlushWord(msg, acc, n);
+}
+
+static int MSG_ReadHuffBitsSlow(msg_t *msg, int bits) {
+    int i, nbits, get, value;
+
+    value = 0;
+    nbits = bits & 7;
+    for (i = 0; i < nbits; i++) {
+        value |= (Huff_getBit(msg->data, &msg->bit) << i);
+    }
+    for (i = nbits; i < bits; i += 8) {
+        Huff_offsetReceive(msgHuff.decompressor.tree, &get, msg->data,
+                           &msg->bit);
+        value |= (get << i);
+    }
+    return value;
+}
+
+static int MSG_ReadHuffBits(msg_t *msg, int bits) {
+    uint64_t w;
+    int i, nbits, avail, entry, get, value;
+
+    w = MSG_LoadWord(msg->data + (msg->bit >> 3)) >> (msg->bit & 7);
+    avail = 64 - (msg->bit & 7);
+
+    nbits = bits & 7;
+    value = (int)w & ((1 << nbits) - 1);
+    w >>= nbits;
+    avail -= nbits;
+    msg->bit += nbits;
+
+    for (i = nbits; i < bits; i += 8) {
+        if (avail < HUFF_LOOKUP_BITS) {
+            w = MSG_LoadWord(msg->data + (msg->bit >> 3)) >> (msg->bit & 7);
+            avail = 64 - (msg->bit & 7);
+        }
+        entry = msgHuffTable.decode[w & ((1 << HUFF_LOOKUP_BITS) - 1)];
+        if (entry >> 9) {
+            get = entry & 511;
+            w >>= entry >> 9;
+            avail -= entry >> 9;
+            msg->bit += entry >> 9;
+        } else {
+            // long code, walks the tree and leaves the word stale
+            Huff_tableReceive(&msgHuffTable, msgHuff.decompressor.tree, &get,
+                              msg->data, &msg->bit);
+            avail = 0;
+        }
+        value |= (get << i);
+    }
+    return value;
+}
+
+// negative bit values include signs
+void MSG_WriteBits(msg_t *msg, int value, int bits) {
     oldsize += bits;
 
     // this isn't an exact overflow check, but close enough
@@ -116,6 +271,14 @@ void MSG_WriteBits(msg_t *msg, int value, int bits) {
         Com_Error(ERR_DROP, "MSG_WriteBits: bad bits %i", bits);
     }
 
+#ifdef MSG_BENCH_RECORD
+    if (msgRecordValues && msgRecordCount < msgRecordMax) {
+        msgRecordValues[msgRecordCount] = value;
+        msgRecordBits[msgRecordCount] = bits;
+        msgRecordCount++;
+    }
+#endif
+
     // check for overflows
     if (bits != 32) {
         if (bits > 0) {
@@ -153,36 +316,61 @@ void MSG_WriteBits(msg_t *msg, int value, int bits) {
         } else
             Com_Error(ERR_DROP, "can't write %d bits", bits);
     } else {
-        //		fp = fopen("c:\\netchan.bin", "a");
         value &= (0xffffffff >> (32 - bits));
-        if (bits & 7) {
-            int nbits;
-            nbits = bits & 7;
-            for (i = 0; i < nbits; i++) {
-                Huff_putBit((value & 1), msg->data, &msg->bit);
-                value = (value >> 1);
-            }
-            bits = bits - nbits;
-        }
-        if (bits) {
-            for (i = 0; i < bits; i += 8) {
-                //				fwrite(bp, 1, 1, fp);
-                Huff_offsetTransmit(&msgHuff.compressor, (value & 0xff),
-                                    msg->data, &msg->bit);
-                value = (value >> 8);
-            }
+        if (bits == 1) {
+            // flags, the most common field
+            Huff_putBit(value, msg->data, &msg->bit);
+        } else if ((msg->bit >> 3) + MSG_WORD_SLACK <= msg->maxsize) {
+            MSG_WriteHuffBits(msg, value, bits);
+        } else {
+            MSG_WriteHuffBitsSlow(msg, value, bits);
         }
         msg->cursize = (msg->bit >> 3) + 1;
-        //		fclose(fp);
     }
 }
 
+/*
+=================
+MSG_WriteRawBits
+
+Appends a bit string that MSG_WriteBits already encoded into another
+bitstream message, the Huffman codes do not depend on their position.
+=================
+*/
+void MSG_WriteRawBits(msg_t *msg, const byte *data, int bits) {
+    byte *out;
+    int bytes, shift, keep;
+    int i;
+
+    bytes = (bits + 7) >> 3;
+
+    if (msg->maxsize - msg->cursize < bytes + 4) {
+        msg->overflowed = qtrue;
+        return;
+    }
+
+    out = msg->data + (msg->bit >> 3);
+    shift = msg->bit & 7;
+
+    if (!shift) {
+        Com_Memcpy(out, data, bytes);
+    } else {
+        // bits past the end of both strings are always zero
+        keep = *out & ((1 << shift) - 1);
+        for (i = 0; i < bytes; i++) {
+            out[i] = keep | (data[i] << shift);
+            keep = data[i] >> (8 - shift);
+        }
+        out[bytes] = keep;
+    }
+
+    msg->bit += bits;
+    msg->cursize = (msg->bit >> 3) + 1;
+}
+
 int MSG_ReadBits(msg_t *msg, int bits) {
     int value;
-    int get;
     qboolean sgn;
-    int i, nbits;
-    //	FILE*	fp;
 
     value = 0;
 
@@ -212,24 +400,16 @@ int MSG_ReadBits(msg_t *msg, int bits) {
         } else
             Com_Error(ERR_DROP, "can't read %d bits", bits);
     } else {
-        nbits = 0;
-        if (bits & 7) {
-            nbits = bits & 7;
-            for (i = 0; i < nbits; i++) {
-                value |= (Huff_getBit(msg->data, &msg->bit) << i);
-            }
-            bits = bits - nbits;
-        }
-        if (bits) {
-            //			fp = fopen("c:\\netchan.bin", "a");
-            for (i = 0; i < bits; i += 8) {
-                Huff_offsetReceive(msgHuff.decompressor.tree, &get, msg->data,
-                                   &msg->bit);
-                //				fwrite(&get, 1, 1, fp);
-                value |= (get << (i + nbits));
-            }
-            //			fclose(fp);
+        if (bits == 1) {
+            value = (msg->data[msg->bit >> 3] >> (msg->bit & 7)) & 1;
+            msg->bit++;
+        } else if ((msg->bit >> 3) + MSG_WORD_SLACK <= msg->maxsize) {
+            value = MSG_ReadHuffBits(msg, bits);
+        } else {
+            value = MSG_ReadHuffBitsSlow(msg, bits);
         }
+        // the sign has always been taken from the Huffman coded part only
+        bits -= bits & 7;
         msg->readcount = (msg->bit >> 3) + 1;
     }
     if (sgn) {
@@ -266,9 +446,45 @@ void MSG_WriteByte(msg_t *sb, int c) {
 }
 
 void MSG_WriteData(msg_t *buf, const void *data, int length) {
-    int i;
-    for (i = 0; i < length; i++) {
-        MSG_WriteByte(buf, ((byte *)data)[i]);
+    const byte *in = data;
+    uint64_t acc;
+    int i, n, len;
+
+    i = 0;
+#ifdef MSG_BENCH_RECORD
+    if (!buf->oob && !(msgRecordValues && msgRecordCount < msgRecordMax)) {
+#else
+    if (!buf->oob) {
+#endif
+        // the bytes of a bitstream message share one accumulator, the tail
+        // near maxsize goes through MSG_WriteByte with its overflow check
+        acc = 0;
+        n = 0;
+        for (; i < length; i++) {
+            if (((buf->bit + n) >> 3) + MSG_WORD_SLACK > buf->maxsize) {
+                break;
+            }
+            len = msgHuffTable.length[in[i]];
+            if (!len || n + len > 57) {
+                MSG_FlushWord(buf, acc, n);
+                acc = 0;
+                n = 0;
+                if (!len) {
+                    Huff_tableTransmit(&msgHuff.compressor, &msgHuffTable,
+                                       in[i], buf->data, &buf->bit);
+                    continue;
+                }
+            }
+            acc |= (uint64_t)msgHuffTable.code[in[i]] << n;
+            n += len;
+        }
+        MSG_FlushWord(buf, acc, n);
+        oldsize += i * 8;
+        buf->cursize = (buf->bit >> 3) + 1;
+    }
+
+    for (; i < length; i++) {
+        MSG_WriteByte(buf, in[i]);
     }
 }
 
@@ -1681,6 +1897,106 @@ void MSG_initHuffman(void) {
             Huff_addRef(&msgHuff.decompressor, (byte)i); // Do update
         }
     }
+    Huff_BuildTable(&msgHuff.decompressor, &msgHuffTable);
+}
+
+/*
+=================
+MSG_HuffmanBench_f
+
+huffbench [kbytes]
+Times the tree walk against the lookup tables on bytes drawn from the
+msg_hData distribution
+=================
+*/
+void MSG_HuffmanBench_f(void) {
+    byte *data, *tree, *table;
+    int size, total, i, j, ch, seed;
+    int treeBits, tableBits, start, msec[4];
+
+    if (!msgInit) {
+        MSG_initHuffman();
+    }
+
+    size = 256 * 1024;
+    if (Cmd_Argc() > 1) {
+        size = atoi(Cmd_Argv(1)) * 1024;
+    }
+    if (size <= 0) {
+        return;
+    }
+
+    data = Z_Malloc(size);
+    // worst case code length is well under 4 bytes per symbol, plus the
+    // lookahead of the decoder
+    tree = Z_Malloc(size * 4 + 4);
+    table = Z_Malloc(size * 4 + 4);
+
+    total = 0;
+    for (i = 0; i < 256; i++) {
+        total += msg_hData[i];
+    }
+    seed = 0x1234;
+    for (i = 0; i < size; i++) {
+        ch = (Q_rand(&seed) & 0x7fffffff) % total;
+        for (j = 0; ch >= msg_hData[j]; j++) {
+            ch -= msg_hData[j];
+        }
+        data[i] = j;
+    }
+
+    start = Sys_Milliseconds();
+    treeBits = 0;
+    for (i = 0; i < size; i++) {
+        Huff_offsetTransmit(&msgHuff.compressor, data[i], tree, &treeBits);
+    }
+    msec[0] = Sys_Milliseconds() - start;
+
+    start = Sys_Milliseconds();
+    tableBits = 0;
+    for (i = 0; i < size; i++) {
+        Huff_tableTransmit(&msgHuff.compressor, &msgHuffTable, data[i], table,
+                           &tableBits);
+    }
+    msec[1] = Sys_Milliseconds() - start;
+
+    if (treeBits != tableBits || memcmp(tree, table, (treeBits + 7) >> 3)) {
+        Com_Printf("huffbench: encoders disagree\n");
+    }
+
+    start = Sys_Milliseconds();
+    treeBits = 0;
+    for (i = 0; i < size; i++) {
+        Huff_offsetReceive(msgHuff.decompressor.tree, &ch, tree, &treeBits);
+        if (ch != data[i]) {
+            break;
+        }
+    }
+    msec[2] = Sys_Milliseconds() - start;
+
+    start = Sys_Milliseconds();
+    tableBits = 0;
+    for (j = 0; j < size; j++) {
+        Huff_tableReceive(&msgHuffTable, msgHuff.decompressor.tree, &ch, tree,
+                          &tableBits);
+        if (ch != data[j]) {
+            break;
+        }
+    }
+    msec[3] = Sys_Milliseconds() - start;
+
+    if (i != size || j != size) {
+        Com_Printf("huffbench: decoders disagree at %i/%i\n", i, j);
+    }
+
+    Com_Printf("%i KB, %.2f bits per byte\n", size / 1024,
+               (float)treeBits / size);
+    Com_Printf("encode: tree %i msec, table %i msec\n", msec[0], msec[1]);
+    Com_Printf("decode: tree %i msec, table %i msec\n", msec[2], msec[3]);
+
+    Z_Free(table);
+    Z_Free(tree);
+    Z_Free(data);
 }
 
 /*
@@ -1720,3 +2036,245 @@ update
 */
 
 //===========================================================================
+
+/*
+=================
+MSG_BenchWrite
+=================
+*/
+static void MSG_BenchWrite(msg_t *msg, int value, int bits, qboolean slow) {
+    if (!slow) {
+        MSG_WriteBits(msg, value, bits);
+        return;
+    }
+    if (bits < 0) {
+        bits = -bits;
+    }
+    MSG_WriteHuffBitsSlow(msg, value & (0xffffffff >> (32 - bits)), bits);
+    msg->cursize = (msg->bit >> 3) + 1;
+}
+
+#define BENCH_PLAYERS 64
+#define BENCH_FIELDS (1 << 19)
+
+#ifdef MSG_BENCH_RECORD
+/*
+=================
+MSG_BenchSnapshots
+
+Records the fields of every player seeing every other player move, then
+replays them through both writers and readers
+=================
+*/
+static void MSG_BenchSnapshots(byte *fastData, byte *slowData, int size,
+                               int seed) {
+    static entityState_t states[2][BENCH_PLAYERS];
+    static playerState_t ps[2];
+    msg_t fast, slow;
+    int frames, f, i, j, count, start, msec[4];
+    entityState_t *from, *to;
+
+    frames = 2;
+    if (Cmd_Argc() > 1) {
+        frames = atoi(Cmd_Argv(1));
+    }
+
+    for (i = 0; i < BENCH_PLAYERS; i++) {
+        to = &states[0][i];
+        Com_Memset(to, 0, sizeof(*to));
+        to->number = i;
+        to->eType = 1; // ET_PLAYER
+        to->clientNum = i;
+        to->pos.trType = TR_INTERPOLATE;
+        to->apos.trType = TR_INTERPOLATE;
+        to->weapon = 1 + i % 8;
+        to->pos.trBase[0] = Q_crandom(&seed) * 2048;
+        to->pos.trBase[1] = Q_crandom(&seed) * 2048;
+        to->pos.trBase[2] = Q_random(&seed) * 256;
+    }
+
+    msgRecordCount = 0;
+    msgRecordMax = BENCH_FIELDS;
+    MSG_Init(&fast, fastData, size);
+    for (f = 0; f < frames; f++) {
+        for (i = 0; i < BENCH_PLAYERS; i++) {
+            from = &states[f & 1][i];
+            to = &states[(f + 1) & 1][i];
+            *to = *from;
+            to->pos.trDelta[0] = Q_crandom(&seed) * 320;
+            to->pos.trDelta[1] = Q_crandom(&seed) * 320;
+            VectorMA(from->pos.trBase, 0.05f, to->pos.trDelta, to->pos.trBase);
+            to->pos.trTime = f * 50;
+            to->apos.trBase[YAW] = AngleMod(from->apos.trBase[YAW] +
+                                            Q_crandom(&seed) * 30);
+            to->apos.trBase[PITCH] = Q_crandom(&seed) * 45;
+            if (Q_random(&seed) < 0.1f) {
+                to->legsAnim ^= 128; // ANIM_TOGGLEBIT
+                to->torsoAnim = (to->torsoAnim + 1) & 63;
+            }
+            if (Q_random(&seed) < 0.05f) {
+                to->event = (to->event + 1) & 15;
+            }
+        }
+
+        for (i = 0; i < BENCH_PLAYERS; i++) {
+            ps[1] = ps[0];
+            ps[1].commandTime = f * 50;
+            ps[1].clientNum = i;
+            VectorCopy(states[(f + 1) & 1][i].pos.trBase, ps[1].origin);
+            VectorCopy(states[(f + 1) & 1][i].pos.trDelta, ps[1].velocity);
+            MSG_WriteDeltaPlayerstate(&fast, &ps[0], &ps[1]);
+
+            for (j = 0; j < BENCH_PLAYERS; j++) {
+                if (j != i) {
+                    MSG_WriteDeltaEntity(&fast, &states[f & 1][j],
+                                         &states[(f + 1) & 1][j], qfalse);
+                }
+            }
+        }
+    }
+    count = msgRecordCount;
+    msgRecordMax = 0;
+    if (fast.overflowed || count == BENCH_FIELDS) {
+        Com_Printf("msgbench: stream truncated, use fewer frames\n");
+    }
+
+    // replay the stream through both writers and readers
+    start = Sys_Milliseconds();
+    MSG_Init(&fast, fastData, size);
+    for (i = 0; i < count; i++) {
+        MSG_BenchWrite(&fast, msgRecordValues[i], msgRecordBits[i], qfalse);
+    }
+    msec[0] = Sys_Milliseconds() - start;
+
+    start = Sys_Milliseconds();
+    MSG_Init(&slow, slowData, size);
+    for (i = 0; i < count; i++) {
+        MSG_BenchWrite(&slow, msgRecordValues[i], msgRecordBits[i], qtrue);
+    }
+    msec[1] = Sys_Milliseconds() - start;
+
+    if (fast.bit != slow.bit ||
+        memcmp(fastData, slowData, (fast.bit + 7) >> 3)) {
+        Com_Printf("msgbench: writers disagree on the snapshot stream\n");
+    }
+
+    start = Sys_Milliseconds();
+    fast.bit = 0;
+    for (i = 0; i < count; i++) {
+        MSG_ReadBits(&fast, msgRecordBits[i]);
+    }
+    msec[2] = Sys_Milliseconds() - start;
+
+    start = Sys_Milliseconds();
+    slow.bit = 0;
+    for (i = 0; i < count; i++) {
+        MSG_ReadHuffBitsSlow(&slow, abs(msgRecordBits[i]));
+    }
+    msec[3] = Sys_Milliseconds() - start;
+
+    Com_Printf("snapshots: %i players, %i frames, %i fields, %i bytes\n",
+               BENCH_PLAYERS, frames, count, fast.cursize);
+    Com_Printf("write: bit %i msec, word %i msec\n", msec[1], msec[0]);
+    Com_Printf("read: bit %i msec, word %i msec\n", msec[3], msec[2]);
+}
+#endif
+
+/*
+=================
+MSG_BitsBench_f
+
+msgbench [frames]
+Fuzzes the word at a time bit functions against the original bit at a time
+code, then times both on the fields of a synthetic 64 player snapshot stream
+if built with MSG_BENCH_RECORD
+=================
+*/
+void MSG_BitsBench_f(void) {
+    msg_t fast, slow;
+    byte *fastData, *slowData;
+    int size, count, seed, value, errors;
+    int f, i, j;
+
+    if (!msgInit) {
+        MSG_initHuffman();
+    }
+
+    msgRecordValues = Z_Malloc(BENCH_FIELDS * sizeof(int));
+    msgRecordBits = Z_Malloc(BENCH_FIELDS * sizeof(int));
+    size = BENCH_FIELDS * 5 + MSG_WORD_SLACK;
+    fastData = Z_Malloc(size);
+    slowData = Z_Malloc(size);
+
+    // fuzz: random widths and values up to the very end of the buffer so
+    // that the slow fallback gets its share too
+    seed = 0x5eed;
+    for (i = 0; i < BENCH_FIELDS; i++) {
+        msgRecordBits[i] = 1 + (Q_rand(&seed) & 0x7fffffff) % 32;
+        msgRecordValues[i] = Q_rand(&seed);
+        if (msgRecordBits[i] != 32) {
+            msgRecordValues[i] &= (1 << msgRecordBits[i]) - 1;
+        }
+    }
+
+    MSG_Init(&fast, fastData, 64 * 1024);
+    MSG_Init(&slow, slowData, 64 * 1024);
+    for (count = 0; count < BENCH_FIELDS; count++) {
+        MSG_BenchWrite(&fast, msgRecordValues[count], msgRecordBits[count],
+                       qfalse);
+        if (fast.overflowed) {
+            break;
+        }
+        MSG_BenchWrite(&slow, msgRecordValues[count], msgRecordBits[count],
+                       qtrue);
+    }
+
+    errors = 0;
+    if (fast.bit != slow.bit ||
+        memcmp(fastData, slowData, (fast.bit + 7) >> 3)) {
+        Com_Printf("msgbench: writers disagree\n");
+        errors++;
+    }
+
+    fast.bit = slow.bit = 0;
+    for (i = 0; i < count; i++) {
+        value = MSG_ReadBits(&fast, msgRecordBits[i]);
+        if (value != msgRecordValues[i] ||
+            MSG_ReadHuffBitsSlow(&slow, msgRecordBits[i]) != value) {
+            Com_Printf("msgbench: readers disagree at field %i\n", i);
+            errors++;
+            break;
+        }
+    }
+    Com_Printf("fuzz: %i fields, %i bytes, %s\n", count, fast.cursize,
+               errors ? "FAILED" : "ok");
+
+    // byte runs, as downloads write them, again up to the end of the buffer
+    MSG_Init(&fast, fastData, 64 * 1024);
+    MSG_Init(&slow, slowData, 64 * 1024);
+    for (i = 0; !fast.overflowed; i += j) {
+        j = (Q_rand(&seed) & 0x7fffffff) % 2048;
+        MSG_WriteData(&fast, (byte *)msgRecordValues + i, j);
+        for (f = 0; f < j; f++) {
+            MSG_WriteByte(&slow, ((byte *)msgRecordValues)[i + f]);
+        }
+    }
+    if (fast.bit != slow.bit || fast.overflowed != slow.overflowed ||
+        memcmp(fastData, slowData, (fast.bit + 7) >> 3)) {
+        Com_Printf("msgbench: byte run writers disagree\n");
+        errors++;
+    }
+
+#ifdef MSG_BENCH_RECORD
+    MSG_BenchSnapshots(fastData, slowData, size, seed);
+#else
+    Com_Printf("snapshots: build with MSG_BENCH_RECORD to time them\n");
+#endif
+
+    Z_Free(slowData);
+    Z_Free(fastData);
+    Z_Free(msgRecordBits);
+    Z_Free(msgRecordValues);
+    msgRecordValues = NULL;
+    msgRecordBits = NULL;
+}
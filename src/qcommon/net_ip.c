@@ -20,6 +20,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 ===========================================================================
 */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // recvmmsg / sendmmsg
+#endif
+
 #include "../qcommon/q_shared.h"
 #include "../qcommon/qcommon.h"
 
@@ -91,6 +95,13 @@ typedef int ioctlarg_t;
 
 #endif
 
+// Batched datagram I/O: recvmmsg/sendmmsg driven by epoll, see net_batch
+#ifdef __linux__
+#define USE_NET_BATCH
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
+
 static qboolean usingSocks = qfalse;
 static int networkingEnabled = 0;
 
@@ -111,6 +122,10 @@ static cvar_t *net_mcast6iface;
 
 static cvar_t *net_dropsim;
 
+#ifdef USE_NET_BATCH
+static cvar_t *net_batch;
+#endif
+
 static struct sockaddr socksRelayAddr;
 
 static SOCKET ip_socket = INVALID_SOCKET;
@@ -522,6 +537,51 @@ qboolean NET_IsLocalAddress(netadr_t adr) { return adr.type == NA_LOOPBACK; }
 
 //=============================================================================
 
+/*
+==================
+NET_ReceivedFrom
+
+Fills in the sender of a datagram read from sock, stripping the SOCKS UDP
+header if it came in through the relay
+==================
+*/
+static qboolean NET_ReceivedFrom(SOCKET sock, struct sockaddr_storage *from,
+                                 socklen_t fromlen, int ret,
+                                 netadr_t *net_from, msg_t *net_message) {
+    if (sock == ip_socket) {
+        memset(((struct sockaddr_in *)from)->sin_zero, 0, 8);
+
+        if (usingSocks && memcmp(from, &socksRelayAddr, fromlen) == 0) {
+            if (ret < 10 || net_message->data[0] != 0 ||
+                net_message->data[1] != 0 || net_message->data[2] != 0 ||
+                net_message->data[3] != 1) {
+                return qfalse;
+            }
+            net_from->type = NA_IP;
+            net_from->ip[0] = net_message->data[4];
+            net_from->ip[1] = net_message->data[5];
+            net_from->ip[2] = net_message->data[6];
+            net_from->ip[3] = net_message->data[7];
+            net_from->port = *(short *)&net_message->data[8];
+            net_message->readcount = 10;
+        } else {
+            SockadrToNetadr((struct sockaddr *)from, net_from);
+            net_message->readcount = 0;
+        }
+    } else {
+        SockadrToNetadr((struct sockaddr *)from, net_from);
+        net_message->readcount = 0;
+    }
+
+    if (ret >= net_message->maxsize) {
+        Com_Printf("Oversize packet from %s\n", NET_AdrToString(*net_from));
+        return qfalse;
+    }
+
+    net_message->cursize = ret;
+    return qtrue;
+}
+
 /*
 ==================
 NET_GetPacket
@@ -547,35 +607,8 @@ qboolean NET_GetPacket(netadr_t *net_from, msg_t *net_message, fd_set *fdr) {
             if (err != EAGAIN && err != ECONNRESET)
                 Com_Printf("NET_GetPacket: %s\n", NET_ErrorString());
         } else {
-
-            memset(((struct sockaddr_in *)&from)->sin_zero, 0, 8);
-
-            if (usingSocks && memcmp(&from, &socksRelayAddr, fromlen) == 0) {
-                if (ret < 10 || net_message->data[0] != 0 ||
-                    net_message->data[1] != 0 || net_message->data[2] != 0 ||
-                    net_message->data[3] != 1) {
-                    return qfalse;
-                }
-                net_from->type = NA_IP;
-                net_from->ip[0] = net_message->data[4];
-                net_from->ip[1] = net_message->data[5];
-                net_from->ip[2] = net_message->data[6];
-                net_from->ip[3] = net_message->data[7];
-                net_from->port = *(short *)&net_message->data[8];
-                net_message->readcount = 10;
-            } else {
-                SockadrToNetadr((struct sockaddr *)&from, net_from);
-                net_message->readcount = 0;
-            }
-
-            if (ret >= net_message->maxsize) {
-                Com_Printf("Oversize packet from %s\n",
-                           NET_AdrToString(*net_from));
-                return qfalse;
-            }
-
-            net_message->cursize = ret;
-            return qtrue;
+            return NET_ReceivedFrom(ip_socket, &from, fromlen, ret, net_from,
+                                    net_message);
         }
     }
 
@@ -635,6 +668,347 @@ qboolean NET_GetPacket(netadr_t *net_from, msg_t *net_message, fd_set *fdr) {
     return qfalse;
 }
 
+/*
+==================
+NET_DispatchPacket
+
+Hands a received packet to the server or the client
+==================
+*/
+static void NET_DispatchPacket(netadr_t *from, msg_t *netmsg) {
+    if (net_dropsim->value > 0.0f && net_dropsim->value <= 100.0f) {
+        // com_dropsim->value percent of incoming packets get dropped.
+        if (rand() <
+            (int)(((double)RAND_MAX) / 100.0 * (double)net_dropsim->value))
+            return; // drop this packet
+    }
+
+    if (com_sv_running->integer)
+        Com_RunAndTimeServerPacket(from, netmsg);
+    else
+        CL_PacketEvent(*from, netmsg);
+}
+
+//=============================================================================
+
+#ifdef USE_NET_BATCH
+/*
+=============================================================================
+
+BATCHED DATAGRAM I/O
+
+With net_batch enabled NET_Sleep waits on an epoll set instead of select()
+and drains every readable socket with recvmmsg(), up to NET_BATCH_MAX
+datagrams per syscall. The set also holds a timerfd, which NET_SleepUntil
+arms so the wait ends on the nanosecond instead of a whole millisecond.
+Packets sent between NET_BeginSendBatch and NET_FlushSendBatch are queued per
+socket and handed to the kernel with sendmmsg().
+
+=============================================================================
+*/
+
+#define NET_BATCH_MAX 32
+#define NET_BATCH_EVENTS 4
+// anything larger is sent straight away (oob prints, downloads)
+#define NET_BATCH_PACKETLEN 1500
+
+typedef struct {
+    int count;
+    struct mmsghdr msgs[NET_BATCH_MAX];
+    struct iovec iov[NET_BATCH_MAX];
+    struct sockaddr_storage addr[NET_BATCH_MAX];
+    byte data[NET_BATCH_MAX][NET_BATCH_PACKETLEN];
+} netSendBatch_t;
+
+static int epoll_fd = INVALID_SOCKET;
+static int timer_fd = INVALID_SOCKET;
+static qboolean sendBatching = qfalse;
+
+// [0] queues for ip_socket, [1] for ip6_socket
+static netSendBatch_t sendBatch[2];
+
+static struct mmsghdr recvMsgs[NET_BATCH_MAX];
+static struct iovec recvIov[NET_BATCH_MAX];
+static struct sockaddr_storage recvAddr[NET_BATCH_MAX];
+static byte recvData[NET_BATCH_MAX][MAX_MSGLEN + 1];
+
+/*
+==================
+NET_BatchResetRecv
+
+Rearms the recvmmsg() vector, the kernel overwrites the name lengths
+==================
+*/
+static void NET_BatchResetRecv(void) {
+    int i;
+
+    for (i = 0; i < NET_BATCH_MAX; i++) {
+        recvIov[i].iov_base = recvData[i];
+        recvIov[i].iov_len = sizeof(recvData[i]);
+
+        Com_Memset(&recvMsgs[i].msg_hdr, 0, sizeof(recvMsgs[i].msg_hdr));
+        recvMsgs[i].msg_hdr.msg_name = &recvAddr[i];
+        recvMsgs[i].msg_hdr.msg_namelen = sizeof(recvAddr[i]);
+        recvMsgs[i].msg_hdr.msg_iov = &recvIov[i];
+        recvMsgs[i].msg_hdr.msg_iovlen = 1;
+        recvMsgs[i].msg_len = 0;
+    }
+}
+
+/*
+==================
+NET_BatchFlushSocket
+==================
+*/
+static void NET_BatchFlushSocket(netSendBatch_t *batch, SOCKET sock) {
+    int sent = 0;
+    int ret;
+    int err;
+
+    while (sent < batch->count && sock != INVALID_SOCKET) {
+        ret = sendmmsg(sock, &batch->msgs[sent], batch->count - sent, 0);
+
+        if (ret == SOCKET_ERROR) {
+            err = socketError;
+
+            // wouldblock is silent, the remaining packets are dropped like
+            // they would have been by sendto()
+            if (err == EAGAIN)
+                break;
+
+            if (err != EADDRNOTAVAIL)
+                Com_Printf("NET_FlushSendBatch: %s\n", NET_ErrorString());
+
+            // skip the datagram the kernel refused and carry on
+            sent++;
+            continue;
+        }
+
+        sent += ret;
+    }
+
+    batch->count = 0;
+}
+
+/*
+==================
+NET_BatchQueuePacket
+
+Returns qfalse if the packet has to be sent immediately
+==================
+*/
+static qboolean NET_BatchQueuePacket(int index, const void *data, int length,
+                                     const struct sockaddr_storage *addr,
+                                     socklen_t addrlen) {
+    netSendBatch_t *batch = &sendBatch[index];
+    SOCKET sock = index ? ip6_socket : ip_socket;
+    struct mmsghdr *msg;
+
+    if (!sendBatching)
+        return qfalse;
+
+    if (length > NET_BATCH_PACKETLEN) {
+        // keep the per-socket ordering intact
+        NET_BatchFlushSocket(batch, sock);
+        return qfalse;
+    }
+
+    if (batch->count == NET_BATCH_MAX)
+        NET_BatchFlushSocket(batch, sock);
+
+    Com_Memcpy(batch->data[batch->count], data, length);
+    Com_Memcpy(&batch->addr[batch->count], addr, addrlen);
+
+    batch->iov[batch->count].iov_base = batch->data[batch->count];
+    batch->iov[batch->count].iov_len = length;
+
+    msg = &batch->msgs[batch->count];
+    Com_Memset(msg, 0, sizeof(*msg));
+    msg->msg_hdr.msg_name = &batch->addr[batch->count];
+    msg->msg_hdr.msg_namelen = addrlen;
+    msg->msg_hdr.msg_iov = &batch->iov[batch->count];
+    msg->msg_hdr.msg_iovlen = 1;
+
+    batch->count++;
+    return qtrue;
+}
+
+/*
+==================
+NET_BatchWatch
+
+Adds a datagram socket to the epoll set
+==================
+*/
+static qboolean NET_BatchWatch(SOCKET sock) {
+    struct epoll_event ev;
+
+    Com_Memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = sock;
+
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sock, &ev) == SOCKET_ERROR) {
+        Com_Printf("WARNING: NET_BatchWatch: epoll_ctl: %s\n",
+                   NET_ErrorString());
+        return qfalse;
+    }
+
+    return qtrue;
+}
+
+/*
+==================
+NET_BatchOpen
+
+Builds the epoll set for the sockets NET_OpenIP just created
+==================
+*/
+static void NET_BatchOpen(void) {
+    struct epoll_event ev;
+    SOCKET socks[3];
+    int i;
+
+    if (!net_batch->integer)
+        return;
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == INVALID_SOCKET) {
+        Com_Printf("WARNING: NET_BatchOpen: epoll_create1: %s\n",
+                   NET_ErrorString());
+        return;
+    }
+
+    socks[0] = ip_socket;
+    socks[1] = ip6_socket;
+    // a multicast group joined on its own socket, NET_JoinMulticast6 adds
+    // one joined later
+    socks[2] = multicast6_socket != ip6_socket ? multicast6_socket
+                                               : INVALID_SOCKET;
+
+    for (i = 0; i < 3; i++) {
+        if (socks[i] == INVALID_SOCKET)
+            continue;
+
+        if (!NET_BatchWatch(socks[i])) {
+            close(epoll_fd);
+            epoll_fd = INVALID_SOCKET;
+            return;
+        }
+    }
+
+    // without the timer NET_SleepUntil falls back to epoll_wait's
+    // millisecond timeout
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd != INVALID_SOCKET) {
+        Com_Memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = timer_fd;
+
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev) ==
+            SOCKET_ERROR) {
+            close(timer_fd);
+            timer_fd = INVALID_SOCKET;
+        }
+    }
+
+    NET_BatchResetRecv();
+    Com_Printf("Batched network I/O enabled (%i packets per syscall)\n",
+               NET_BATCH_MAX);
+}
+
+/*
+==================
+NET_BatchClose
+==================
+*/
+static void NET_BatchClose(void) {
+    // anything still queued goes out before the sockets disappear
+    NET_FlushSendBatch();
+
+    if (timer_fd != INVALID_SOCKET) {
+        close(timer_fd);
+        timer_fd = INVALID_SOCKET;
+    }
+
+    if (epoll_fd != INVALID_SOCKET) {
+        close(epoll_fd);
+        epoll_fd = INVALID_SOCKET;
+    }
+}
+
+/*
+==================
+NET_BatchEvent
+
+Drains one readable socket, NET_BATCH_MAX datagrams at a time
+==================
+*/
+static void NET_BatchEvent(SOCKET sock) {
+    netadr_t from;
+    msg_t netmsg;
+    int ret;
+    int err;
+    int i;
+
+    while (sock == ip_socket || sock == ip6_socket ||
+           sock == multicast6_socket) {
+        NET_BatchResetRecv();
+
+        ret = recvmmsg(sock, recvMsgs, NET_BATCH_MAX, MSG_DONTWAIT, NULL);
+
+        if (ret == SOCKET_ERROR) {
+            err = socketError;
+
+            if (err != EAGAIN && err != ECONNRESET)
+                Com_Printf("NET_GetPacket: %s\n", NET_ErrorString());
+            return;
+        }
+
+        for (i = 0; i < ret; i++) {
+            MSG_Init(&netmsg, recvData[i], sizeof(recvData[i]));
+
+            if (!NET_ReceivedFrom(sock, &recvAddr[i],
+                                  recvMsgs[i].msg_hdr.msg_namelen,
+                                  recvMsgs[i].msg_len, &from, &netmsg))
+                continue;
+
+            NET_DispatchPacket(&from, &netmsg);
+        }
+
+        if (ret < NET_BATCH_MAX)
+            return;
+    }
+}
+
+#endif
+
+/*
+==================
+NET_BeginSendBatch
+
+Packets sent from now on are queued until NET_FlushSendBatch
+==================
+*/
+void NET_BeginSendBatch(void) {
+#ifdef USE_NET_BATCH
+    if (epoll_fd != INVALID_SOCKET)
+        sendBatching = qtrue;
+#endif
+}
+
+/*
+==================
+NET_FlushSendBatch
+==================
+*/
+void NET_FlushSendBatch(void) {
+#ifdef USE_NET_BATCH
+    NET_BatchFlushSocket(&sendBatch[0], ip_socket);
+    NET_BatchFlushSocket(&sendBatch[1], ip6_socket);
+    sendBatching = qfalse;
+#endif
+}
+
 //=============================================================================
 
 static char socksBuf[4096];
@@ -677,6 +1051,16 @@ void Sys_SendPacket(int length, const void *data, netadr_t to) {
         ret = sendto(ip_socket, socksBuf, length + 10, 0, &socksRelayAddr,
                      sizeof(socksRelayAddr));
     } else {
+#ifdef USE_NET_BATCH
+        if (addr.ss_family == AF_INET &&
+            NET_BatchQueuePacket(0, data, length, &addr,
+                                 sizeof(struct sockaddr_in)))
+            return;
+        if (addr.ss_family == AF_INET6 &&
+            NET_BatchQueuePacket(1, data, length, &addr,
+                                 sizeof(struct sockaddr_in6)))
+            return;
+#endif
         if (addr.ss_family == AF_INET)
             ret = sendto(ip_socket, data, length, 0, (struct sockaddr *)&addr,
                          sizeof(struct sockaddr_in));
@@ -1047,6 +1431,12 @@ void NET_JoinMulticast6(void) {
             return;
         }
     }
+
+#ifdef USE_NET_BATCH
+    // closing the socket takes it out of the set again
+    if (epoll_fd != INVALID_SOCKET && multicast6_socket != ip6_socket)
+        NET_BatchWatch(multicast6_socket);
+#endif
 }
 
 void NET_LeaveMulticast6() {
@@ -1481,6 +1871,12 @@ static qboolean NET_GetCvars(void) {
 
     net_dropsim = Cvar_Get("net_dropsim", "", CVAR_TEMP);
 
+#ifdef USE_NET_BATCH
+    net_batch = Cvar_Get("net_batch", "0", CVAR_LATCH | CVAR_ARCHIVE);
+    modified += net_batch->modified;
+    net_batch->modified = qfalse;
+#endif
+
     return modified ? qtrue : qfalse;
 }
 
@@ -1527,6 +1923,10 @@ void NET_Config(qboolean enableNetworking) {
     }
 
     if (stop) {
+#ifdef USE_NET_BATCH
+        NET_BatchClose();
+#endif
+
         if (ip_socket != INVALID_SOCKET) {
             closesocket(ip_socket);
             ip_socket = INVALID_SOCKET;
@@ -1554,10 +1954,186 @@ void NET_Config(qboolean enableNetworking) {
         if (net_enabled->integer) {
             NET_OpenIP();
             NET_SetMulticast6();
+#ifdef USE_NET_BATCH
+            NET_BatchOpen();
+#endif
+        }
+    }
+}
+
+#ifdef USE_NET_BATCH
+/*
+==================
+NET_BatchBenchRun
+
+Pushes total datagrams of size bytes from tx to rx over loopback in frames of
+NET_BATCH_MAX packets, counting the syscalls spent on each side.
+==================
+*/
+static void NET_BatchBenchRun(SOCKET tx, SOCKET rx, struct sockaddr_in *dst,
+                              int total, int size, qboolean batched) {
+    static byte payload[NET_BATCH_PACKETLEN];
+    struct mmsghdr msgs[NET_BATCH_MAX];
+    struct iovec iov;
+    struct epoll_event ev;
+    struct timeval timeout;
+    fd_set fdr;
+    int ep = INVALID_SOCKET;
+    int syscalls = 0;
+    int frames = 0;
+    int received = 0;
+    int start, msec;
+    int sent, queued, got, ret;
+    int i;
+
+    iov.iov_base = payload;
+    iov.iov_len = size;
+
+    for (i = 0; i < NET_BATCH_MAX; i++) {
+        Com_Memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_name = dst;
+        msgs[i].msg_hdr.msg_namelen = sizeof(*dst);
+        msgs[i].msg_hdr.msg_iov = &iov;
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    if (batched) {
+        ep = epoll_create1(EPOLL_CLOEXEC);
+        if (ep == INVALID_SOCKET) {
+            Com_Printf("net_batchbench: epoll_create1: %s\n",
+                       NET_ErrorString());
+            return;
+        }
+
+        Com_Memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = rx;
+        epoll_ctl(ep, EPOLL_CTL_ADD, rx, &ev);
+    }
+
+    start = Sys_Milliseconds();
+
+    for (sent = 0; sent < total; sent += queued) {
+        queued = MIN(NET_BATCH_MAX, total - sent);
+        frames++;
+
+        // send side
+        if (batched) {
+            for (i = 0; i < queued; i += ret) {
+                ret = sendmmsg(tx, &msgs[i], queued - i, 0);
+                syscalls++;
+                if (ret <= 0)
+                    break;
+            }
+        } else {
+            for (i = 0; i < queued; i++) {
+                sendto(tx, payload, size, 0, (struct sockaddr *)dst,
+                       sizeof(*dst));
+                syscalls++;
+            }
+        }
+
+        // receive side, wait up to 100ms for the frame to arrive
+        for (got = 0; got < queued;) {
+            if (batched) {
+                ret = epoll_wait(ep, &ev, 1, 100);
+            } else {
+                FD_ZERO(&fdr);
+                FD_SET(rx, &fdr);
+                timeout.tv_sec = 0;
+                timeout.tv_usec = 100000;
+                ret = select(rx + 1, &fdr, NULL, NULL, &timeout);
+            }
+            syscalls++;
+
+            if (ret <= 0)
+                break;
+
+            while (got < queued) {
+                if (batched) {
+                    NET_BatchResetRecv();
+                    ret = recvmmsg(rx, recvMsgs, NET_BATCH_MAX, MSG_DONTWAIT,
+                                   NULL);
+                } else {
+                    ret = recvfrom(rx, recvData[0], sizeof(recvData[0]), 0,
+                                   NULL, NULL);
+                    if (ret != SOCKET_ERROR)
+                        ret = 1;
+                }
+                syscalls++;
+
+                if (ret == SOCKET_ERROR)
+                    break;
+                got += ret;
+            }
         }
+
+        received += got;
     }
+
+    msec = Sys_Milliseconds() - start;
+    if (msec < 1)
+        msec = 1;
+
+    if (ep != INVALID_SOCKET)
+        close(ep);
+
+    Com_Printf("%-8s %7i packets in %5i ms: %9.0f packets/sec, "
+               "%5.2f syscalls/frame, %i lost\n",
+               batched ? "batched" : "classic", received, msec,
+               received * 1000.0 / msec, (float)syscalls / frames,
+               total - received);
 }
 
+/*
+==================
+NET_BatchBench_f
+
+net_batchbench [packets] [size]
+Compares per-datagram and batched I/O over the loopback interface
+==================
+*/
+static void NET_BatchBench_f(void) {
+    struct sockaddr_in dst;
+    socklen_t dstlen = sizeof(dst);
+    SOCKET tx, rx;
+    int total = 100000;
+    int size = 1024;
+    int err;
+
+    if (Cmd_Argc() > 1)
+        total = atoi(Cmd_Argv(1));
+    if (Cmd_Argc() > 2)
+        size = atoi(Cmd_Argv(2));
+
+    if (total < NET_BATCH_MAX)
+        total = NET_BATCH_MAX;
+    size = Com_Clamp(1, NET_BATCH_PACKETLEN, size);
+
+    rx = NET_IPSocket("127.0.0.1", PORT_ANY, &err);
+    if (rx == INVALID_SOCKET)
+        return;
+
+    tx = NET_IPSocket("127.0.0.1", PORT_ANY, &err);
+    if (tx == INVALID_SOCKET) {
+        closesocket(rx);
+        return;
+    }
+
+    if (getsockname(rx, (struct sockaddr *)&dst, &dstlen) == SOCKET_ERROR) {
+        Com_Printf("net_batchbench: getsockname: %s\n", NET_ErrorString());
+    } else {
+        Com_Printf("%i packets of %i bytes, %i packets per frame\n", total,
+                   size, NET_BATCH_MAX);
+        NET_BatchBenchRun(tx, rx, &dst, total, size, qfalse);
+        NET_BatchBenchRun(tx, rx, &dst, total, size, qtrue);
+    }
+
+    closesocket(tx);
+    closesocket(rx);
+}
+#endif
+
 /*
 ====================
 NET_Init
@@ -1580,6 +2156,9 @@ void NET_Init(void) {
     NET_Config(qtrue);
 
     Cmd_AddCommand("net_restart", NET_Restart_f);
+#ifdef USE_NET_BATCH
+    Cmd_AddCommand("net_batchbench", NET_BatchBench_f);
+#endif
 }
 
 /*
@@ -1617,38 +2196,74 @@ void NET_Event(fd_set *fdr) {
     while (1) {
         MSG_Init(&netmsg, bufData, sizeof(bufData));
 
-        if (NET_GetPacket(&from, &netmsg, fdr)) {
-            if (net_dropsim->value > 0.0f && net_dropsim->value <= 100.0f) {
-                // com_dropsim->value percent of incoming packets get dropped.
-                if (rand() < (int)(((double)RAND_MAX) / 100.0 *
-                                   (double)net_dropsim->value))
-                    continue; // drop this packet
-            }
-
-            if (com_sv_running->integer)
-                Com_RunAndTimeServerPacket(&from, &netmsg);
-            else
-                CL_PacketEvent(from, &netmsg);
-        } else
+        if (NET_GetPacket(&from, &netmsg, fdr))
+            NET_DispatchPacket(&from, &netmsg);
+        else
             break;
     }
 }
 
 /*
 ====================
-NET_Sleep
+NET_Wait
 
-Sleeps msec or until something happens on the network
+Waits up to timeout nanoseconds for something to happen on the network and
+handles the packets that arrived. Unless precise is set the timeout is rounded
+up to whole milliseconds, otherwise it's kept as exact as the platform allows:
+the timerfd, clock_nanosleep with no sockets open, or select's microseconds.
 ====================
 */
-void NET_Sleep(int msec) {
-    struct timeval timeout;
+static void NET_Wait(long long timeout, qboolean precise) {
+    struct timeval tv;
     fd_set fdr;
     int retval;
     SOCKET highestfd = INVALID_SOCKET;
 
-    if (msec < 0)
-        msec = 0;
+    if (timeout < 0)
+        timeout = 0;
+
+#ifdef USE_NET_BATCH
+    if (epoll_fd != INVALID_SOCKET) {
+        struct epoll_event events[NET_BATCH_EVENTS];
+        struct itimerspec its;
+        uint64_t expirations;
+        int msec;
+        int i;
+
+        msec = (timeout + 999999) / 1000000;
+
+        if (precise && timeout > 0 && timer_fd != INVALID_SOCKET) {
+            // rearming also clears an expiry left over from a wait that
+            // ended on a packet
+            Com_Memset(&its, 0, sizeof(its));
+            its.it_value.tv_sec = timeout / 1000000000;
+            its.it_value.tv_nsec = timeout % 1000000000;
+
+            if (timerfd_settime(timer_fd, 0, &its, NULL) != SOCKET_ERROR)
+                msec = -1;
+        }
+
+        retval = epoll_wait(epoll_fd, events, NET_BATCH_EVENTS, msec);
+
+        if (retval == SOCKET_ERROR) {
+            if (socketError != EINTR)
+                Com_Printf("Warning: epoll_wait() syscall failed: %s\n",
+                           NET_ErrorString());
+            return;
+        }
+
+        for (i = 0; i < retval; i++) {
+            if (events[i].data.fd == timer_fd) {
+                if (read(timer_fd, &expirations, sizeof(expirations)) < 0) {
+                    // nothing to clear, another wait rearmed it
+                }
+                continue;
+            }
+            NET_BatchEvent(events[i].data.fd);
+        }
+        return;
+    }
+#endif
 
     FD_ZERO(&fdr);
 
@@ -1664,18 +2279,30 @@ void NET_Sleep(int msec) {
             highestfd = ip6_socket;
     }
 
-#ifdef _WIN32
     if (highestfd == INVALID_SOCKET) {
+#ifdef _WIN32
         // windows ain't happy when select is called without valid FDs
-        SleepEx(msec, 0);
+        SleepEx((timeout + 999999) / 1000000, 0);
         return;
-    }
+#else
+        if (precise) {
+            Sys_SleepUntil(Sys_Nanoseconds() + timeout);
+            return;
+        }
 #endif
+    }
 
-    timeout.tv_sec = msec / 1000;
-    timeout.tv_usec = (msec % 1000) * 1000;
+    if (!precise)
+        timeout = (timeout + 999999) / 1000000 * 1000000;
+
+    tv.tv_sec = timeout / 1000000000;
+    tv.tv_usec = (timeout % 1000000000 + 999) / 1000;
+    if (tv.tv_usec >= 1000000) {
+        tv.tv_sec++;
+        tv.tv_usec -= 1000000;
+    }
 
-    retval = select(highestfd + 1, &fdr, NULL, NULL, &timeout);
+    retval = select(highestfd + 1, &fdr, NULL, NULL, &tv);
 
     if (retval == SOCKET_ERROR)
         Com_Printf("Warning: select() syscall failed: %s\n", NET_ErrorString());
@@ -1683,6 +2310,27 @@ void NET_Sleep(int msec) {
         NET_Event(&fdr);
 }
 
+/*
+====================
+NET_Sleep
+
+Sleeps msec or until something happens on the network
+====================
+*/
+void NET_Sleep(int msec) { NET_Wait((long long)msec * 1000000, qfalse); }
+
+/*
+====================
+NET_SleepUntil
+
+Sleeps until Sys_Nanoseconds() reaches nsec or something happens on the
+network
+====================
+*/
+void NET_SleepUntil(long long nsec) {
+    NET_Wait(nsec - Sys_Nanoseconds(), qtrue);
+}
+
 /*
 ====================
 NET_Restart_f
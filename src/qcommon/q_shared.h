@@ -129,6 +129,15 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #define UNUSED_VAR
 #endif
 
+// per thread variables, only for code that runs on worker threads
+#if (defined _MSC_VER)
+#define Q_THREAD_LOCAL __declspec(thread)
+#elif (defined __GNUC__)
+#define Q_THREAD_LOCAL __thread
+#else
+#define Q_THREAD_LOCAL
+#endif
+
 #if (defined _MSC_VER)
 #define Q_EXPORT __declspec(dllexport)
 #elif (defined __SUNPRO_C)
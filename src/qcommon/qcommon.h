@@ -26,6 +26,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #define _QCOMMON_H_
 
 #include "../qcommon/cm_public.h"
+#include <setjmp.h>
 
 // Ignore __attribute__ on non-gcc platforms
 #ifndef __GNUC__
@@ -71,6 +72,7 @@ struct entityState_s;
 struct playerState_s;
 
 void MSG_WriteBits(msg_t *msg, int value, int bits);
+void MSG_WriteRawBits(msg_t *msg, const byte *data, int bits);
 
 void MSG_WriteChar(msg_t *sb, int c);
 void MSG_WriteByte(msg_t *sb, int c);
@@ -115,6 +117,8 @@ void MSG_ReadDeltaPlayerstate(msg_t *msg, struct playerState_s *from,
                               struct playerState_s *to);
 
 void MSG_ReportChangeVectors_f(void);
+void MSG_HuffmanBench_f(void);
+void MSG_BitsBench_f(void);
 
 //============================================================================
 
@@ -196,6 +200,9 @@ qboolean NET_GetLoopPacket(netsrc_t sock, netadr_t *net_from,
 void NET_JoinMulticast6(void);
 void NET_LeaveMulticast6(void);
 void NET_Sleep(int msec);
+void NET_SleepUntil(long long nsec);
+void NET_BeginSendBatch(void);
+void NET_FlushSendBatch(void);
 
 #define MAX_MSGLEN                                                             \
     16384 // max length of a message, which may
@@ -373,6 +380,7 @@ intptr_t QDECL VM_Call(vm_t *vm, int callNum, ...);
 void VM_Debug(int level);
 
 void *VM_ArgPtr(intptr_t intValue);
+void *VM_ArgArray(intptr_t intValue, size_t size);
 void *VM_ExplicitArgPtr(vm_t *vm, intptr_t intValue);
 
 #define VMA(x) VM_ArgPtr(args[x])
@@ -685,9 +693,26 @@ long FS_ReadFile(const char *qpath, void **buffer);
 void FS_ForceFlush(fileHandle_t f);
 // forces flush on files we're writing to.
 
+void *FS_MapFile(fileHandle_t f, int *length);
+// maps a whole file opened outside of a pak read-only, NULL if it can't be
+// mapped. The mapping outlives the handle, release it with Sys_UnmapFile.
+
+int FS_FileModifiedTime(fileHandle_t f);
+// modification time of a file opened outside of a pak, -1 if unknown
+
 void FS_FreeFile(void *buffer);
 // frees the memory returned by FS_ReadFile
 
+long FS_AcquireFile(const char *qpath, void **buffer);
+// like FS_ReadFile, but shares one read-only copy of the file between
+// everyone who acquired it, without a trailing 0. -1 length == not present
+
+void FS_ReleaseFile(void *buffer);
+// releases a buffer returned by FS_AcquireFile
+
+void FS_FlushSharedFiles(qboolean all);
+// drops the shared files nothing holds, or every one of them
+
 void FS_WriteFile(const char *qpath, const void *buffer, int size);
 // writes a complete file, creating any subdirectories needed
 
@@ -831,6 +856,20 @@ void Info_Print(const char *s);
 
 void Com_BeginRedirect(char *buffer, int buffersize, void (*flush)(char *));
 void Com_EndRedirect(void);
+
+#define MAX_JOB_LOG 1024
+
+// a job on a worker thread can't print to the console or drop the game,
+// while its context is set Com_Printf appends to log, and Com_Error copies
+// the message to error and longjmps to abort
+typedef struct {
+    jmp_buf abort;
+    int errorCode;
+    char error[MAXPRINTMSG];
+    char log[MAX_JOB_LOG];
+} jobContext_t;
+
+void Com_SetJobContext(jobContext_t *job);
 void QDECL Com_Printf(const char *fmt, ...)
     __attribute__((format(printf, 1, 2)));
 void QDECL Com_DPrintf(const char *fmt, ...)
@@ -976,6 +1015,7 @@ void Com_TouchMemory(void);
 // commandLine should not include the executable name (argv[0])
 void Com_Init(char *commandLine);
 void Com_Frame(void);
+void Com_TickJitter_f(void);
 void Com_Shutdown(void);
 
 /*
@@ -1101,6 +1141,11 @@ void Sys_Print(const char *msg);
 // Sys_Milliseconds should only be used for profiling purposes,
 // any game related timing information should come from event timestamps
 int Sys_Milliseconds(void);
+// monotonic, from the same origin as Sys_Milliseconds
+long long Sys_Nanoseconds(void);
+void Sys_SleepUntil(long long nsec);
+
+int Sys_PID(void);
 
 qboolean Sys_RandomBytes(byte *string, int len);
 
@@ -1120,6 +1165,9 @@ qboolean Sys_IsLANAddress(netadr_t adr);
 void Sys_ShowIP(void);
 
 FILE *Sys_FOpen(const char *ospath, const char *mode);
+void *Sys_MapFile(FILE *f, int *length);
+void Sys_UnmapFile(void *data, int length);
+int Sys_FileModifiedTime(FILE *f);
 qboolean Sys_Mkdir(const char *path);
 FILE *Sys_Mkfifo(const char *ospath);
 char *Sys_Cwd(void);
@@ -1143,6 +1191,20 @@ void Sys_Sleep(int msec);
 
 qboolean Sys_LowPhysicalMemory(void);
 
+// worker threads for data-parallel work, the calling thread joins in and
+// Sys_RunJobs returns once func has run for every index
+#define MAX_WORKER_THREADS 16
+void Sys_SetWorkerThreads(int count);
+int Sys_WorkerThreads(void);
+void Sys_RunJobs(void (*func)(void *data, int index), void *data, int count);
+
+// atomics for data shared by jobs, the adds return the previous value and
+// Sys_AtomicSwapPointer only stores exchange if *pointer is still compare
+int Sys_AtomicAdd(volatile int *value, int add);
+int64_t Sys_AtomicAdd64(volatile int64_t *value, int64_t add);
+qboolean Sys_AtomicSwapPointer(void *volatile *pointer, void *compare,
+                               void *exchange);
+
 void Sys_SetEnv(const char *name, const char *value);
 char *Sys_GetEnv(const char *name);
 
@@ -1199,6 +1261,18 @@ typedef struct {
     huff_t decompressor;
 } huffman_t;
 
+#define HUFF_LOOKUP_BITS 11
+
+// code tables for a tree that no longer adapts, so that whole codes can be
+// read and written at once instead of walking the tree bit by bit
+typedef struct {
+    // indexed by the next HUFF_LOOKUP_BITS bits of the stream, symbol in the
+    // low 9 bits and code length above, 0 length for longer codes
+    unsigned short decode[1 << HUFF_LOOKUP_BITS];
+    unsigned int code[HMAX + 1]; // first bit sent in bit 0
+    byte length[HMAX + 1];       // 0 if the code is longer than 32 bits
+} huffTable_t;
+
 void Huff_Compress(msg_t *buf, int offset);
 void Huff_Decompress(msg_t *buf, int offset);
 void Huff_Init(huffman_t *huff);
@@ -1211,6 +1285,11 @@ void Huff_putBit(int bit, byte *fout, int *offset);
 int Huff_getBit(byte *fout, int *offset);
 
 // don't use if you don't know what you're doing.
+void Huff_BuildTable(const huff_t *huff, huffTable_t *table);
+void Huff_tableReceive(const huffTable_t *table, const node_t *tree, int *ch,
+                       const byte *fin, int *offset);
+void Huff_tableTransmit(huff_t *huff, const huffTable_t *table, int ch,
+                        byte *fout, int *offset);
 int Huff_getBloc(void);
 void Huff_setBloc(int _bloc);
 
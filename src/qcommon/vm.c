@@ -733,6 +733,29 @@ void *VM_ArgPtr(intptr_t intValue) {
     }
 }
 
+/*
+============
+VM_ArgArray
+
+VM_ArgPtr for a block of size bytes, an interpreted or compiled VM may not
+point it past the end of its data segment
+============
+*/
+void *VM_ArgArray(intptr_t intValue, size_t size) {
+    unsigned int dataMask;
+
+    if (intValue && currentVM && !currentVM->entryPoint) {
+        dataMask = currentVM->dataMask;
+        if ((intValue & dataMask) != intValue ||
+            ((intValue + size) & dataMask) != intValue + size) {
+            Com_Error(ERR_DROP, "VM_ArgArray: %s passed a block out of range",
+                      currentVM->name);
+        }
+    }
+
+    return VM_ArgPtr(intValue);
+}
+
 void *VM_ExplicitArgPtr(vm_t *vm, intptr_t intValue) {
     if (!intValue) {
         return NULL;
@@ -1831,13 +1831,14 @@ void R_LoadEntities(lump_t *l) {
     w->lightGridSize[1] = 64;
     w->lightGridSize[2] = 128;
 
-    p = (char *)(fileBase + l->fileofs);
-
-    // store for reference by the cgame
+    // store for reference by the cgame, the shared file isn't terminated
     w->entityString = ri.Hunk_Alloc(l->filelen + 1, h_low);
-    strcpy(w->entityString, p);
+    Com_Memcpy(w->entityString, fileBase + l->fileofs, l->filelen);
+    w->entityString[l->filelen] = 0;
     w->entityParsePoint = w->entityString;
 
+    p = w->entityString;
+
     token = COM_ParseExt(&p, qtrue);
     if (!*token || *token != '{') {
         return;
@@ -1927,7 +1928,7 @@ Called directly from cgame
 */
 void RE_LoadWorldMap(const char *name) {
     int i;
-    dheader_t *header;
+    dheader_t header;
     union {
         byte *b;
         void *v;
@@ -1948,8 +1949,8 @@ void RE_LoadWorldMap(const char *name) {
 
     tr.worldMapLoaded = qtrue;
 
-    // load it
-    ri.FS_ReadFile(name, &buffer.v);
+    // load it, usually sharing the copy the clip model just loaded
+    ri.FS_AcquireFile(name, &buffer.v);
     if (!buffer.b) {
         ri.Error(ERR_DROP, "RE_LoadWorldMap: %s not found", name);
     }
@@ -1969,42 +1970,41 @@ void RE_LoadWorldMap(const char *name) {
     startMarker = ri.Hunk_Alloc(0, h_low);
     c_gridVerts = 0;
 
-    header = (dheader_t *)buffer.b;
-    fileBase = (byte *)header;
+    // the buffer is shared, swap a copy of the header
+    header = *(dheader_t *)buffer.b;
+    fileBase = buffer.b;
+
+    for (i = 0; i < sizeof(dheader_t) / 4; i++) {
+        ((int *)&header)[i] = LittleLong(((int *)&header)[i]);
+    }
 
-    i = LittleLong(header->version);
-    if (i != BSP_VERSION) {
+    if (header.version != BSP_VERSION) {
         ri.Error(
             ERR_DROP,
             "RE_LoadWorldMap: %s has wrong version number (%i should be %i)",
-            name, i, BSP_VERSION);
-    }
-
-    // swap all the lumps
-    for (i = 0; i < sizeof(dheader_t) / 4; i++) {
-        ((int *)header)[i] = LittleLong(((int *)header)[i]);
+            name, header.version, BSP_VERSION);
     }
 
     // load into heap
-    R_LoadShaders(&header->lumps[LUMP_SHADERS]);
-    R_LoadLightmaps(&header->lumps[LUMP_LIGHTMAPS]);
-    R_LoadPlanes(&header->lumps[LUMP_PLANES]);
-    R_LoadFogs(&header->lumps[LUMP_FOGS], &header->lumps[LUMP_BRUSHES],
-               &header->lumps[LUMP_BRUSHSIDES]);
-    R_LoadSurfaces(&header->lumps[LUMP_SURFACES],
-                   &header->lumps[LUMP_DRAWVERTS],
-                   &header->lumps[LUMP_DRAWINDEXES]);
-    R_LoadMarksurfaces(&header->lumps[LUMP_LEAFSURFACES]);
-    R_LoadNodesAndLeafs(&header->lumps[LUMP_NODES], &header->lumps[LUMP_LEAFS]);
-    R_LoadSubmodels(&header->lumps[LUMP_MODELS]);
-    R_LoadVisibility(&header->lumps[LUMP_VISIBILITY]);
-    R_LoadEntities(&header->lumps[LUMP_ENTITIES]);
-    R_LoadLightGrid(&header->lumps[LUMP_LIGHTGRID]);
+    R_LoadShaders(&header.lumps[LUMP_SHADERS]);
+    R_LoadLightmaps(&header.lumps[LUMP_LIGHTMAPS]);
+    R_LoadPlanes(&header.lumps[LUMP_PLANES]);
+    R_LoadFogs(&header.lumps[LUMP_FOGS], &header.lumps[LUMP_BRUSHES],
+               &header.lumps[LUMP_BRUSHSIDES]);
+    R_LoadSurfaces(&header.lumps[LUMP_SURFACES],
+                   &header.lumps[LUMP_DRAWVERTS],
+                   &header.lumps[LUMP_DRAWINDEXES]);
+    R_LoadMarksurfaces(&header.lumps[LUMP_LEAFSURFACES]);
+    R_LoadNodesAndLeafs(&header.lumps[LUMP_NODES], &header.lumps[LUMP_LEAFS]);
+    R_LoadSubmodels(&header.lumps[LUMP_MODELS]);
+    R_LoadVisibility(&header.lumps[LUMP_VISIBILITY]);
+    R_LoadEntities(&header.lumps[LUMP_ENTITIES]);
+    R_LoadLightGrid(&header.lumps[LUMP_LIGHTGRID]);
 
     s_worldData.dataSize = (byte *)ri.Hunk_Alloc(0, h_low) - startMarker;
 
     // only set tr.world now that we know the entire level has loaded properly
     tr.world = &s_worldData;
 
-    ri.FS_FreeFile(buffer.v);
+    ri.FS_ReleaseFile(buffer.v);
 }
@@ -25,7 +25,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include "tr_types.h"
 
-#define REF_API_VERSION 8
+#define REF_API_VERSION 9
 
 //
 // these are the functions exported by the refresh module
@@ -175,6 +175,9 @@ typedef struct {
     int (*FS_FileIsInPAK)(const char *name, int *pCheckSum);
     long (*FS_ReadFile)(const char *name, void **buf);
     void (*FS_FreeFile)(void *buf);
+    // read-only and shared with the clip model
+    long (*FS_AcquireFile)(const char *name, void **buf);
+    void (*FS_ReleaseFile)(void *buf);
     char **(*FS_ListFiles)(const char *name, const char *extension,
                            int *numfilesfound);
     void (*FS_FreeFileList)(char **filelist);
@@ -35,6 +35,11 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #define MAX_ENT_CLUSTERS 16
 
+// the built in HTTP download server needs BSD sockets and pthreads
+#ifndef _WIN32
+#define USE_HTTP_SERVER
+#endif
+
 #ifdef USE_VOIP
 #define VOIP_QUEUE_LENGTH 64
 
@@ -50,15 +55,14 @@ typedef struct voipServerPacket_s {
 #endif
 
 typedef struct svEntity_s {
-    struct worldSector_s *worldSector;
-    struct svEntity_s *nextEntityInWorldSector;
+    struct worldNode_s *worldNode; // leaf in the world tree
 
     entityState_t baseline; // for delta compression of initial sighting
     int numClusters;        // if -1, use headnode instead
     int clusternums[MAX_ENT_CLUSTERS];
     int lastCluster; // if all the clusters don't fit in clusternums
     int areanum, areanum2;
-    int snapshotCounter; // used to prevent double adding from portal views
+    vec3_t linkAbsmin, linkAbsmax; // box the current link was made from
 } svEntity_t;
 
 typedef enum {
@@ -78,8 +82,8 @@ typedef struct {
     // the serverId associated with the current checksumFeed (always <=
     // serverId)
     int checksumFeedServerId;
-    int snapshotCounter; // incremented for each snapshot built
     int timeResidual;    // <= 1000 / sv_frame->value
+    int snapshotTicks;   // game frames run since snapshots were last built
     int nextFrameTime;   // when time > nextFrameTime, process world
     char *configstrings[MAX_CONFIGSTRINGS];
     svEntity_t svEntities[MAX_GENTITIES];
@@ -97,6 +101,20 @@ typedef struct {
 
     int restartTime;
     int time;
+
+    // the configstrings and baselines part of the gamestate message, encoded
+    // once and shared by every client that connects, see SV_WriteGamestate
+    qboolean gamestateCached;
+    int gamestateBits;
+    int gamestateChars; // configstring text in the cached part
+    byte gamestateData[MAX_MSGLEN];
+    qboolean gamestateChanged[MAX_CONFIGSTRINGS]; // since it was cached
+
+    // configstring changes active clients haven't been sent yet, flushed as
+    // one command per client by SV_FlushConfigstrings
+    int numPendingConfigstrings;
+    int pendingConfigstrings[MAX_CONFIGSTRINGS]; // in order of first change
+    char *configstringBase[MAX_CONFIGSTRINGS]; // value clients have, or NULL
 } server_t;
 
 typedef struct {
@@ -121,6 +139,20 @@ typedef enum {
     CS_ACTIVE     // client is fully in game
 } clientState_t;
 
+// A pk3 being downloaded, read into memory once and sent to every client
+// fetching it
+typedef struct {
+    char name[MAX_QPATH];
+    byte *data;
+    int length;
+    int mtime; // with the length, tells a pk3 replaced on disk apart
+    int refs;
+} downloadFile_t;
+
+// Largest download block. Clients take anything up to MAX_MSGLEN, and with
+// message Huffman codes of at most 11 bits a block always fits one.
+#define MAX_DOWNLOAD_SHARED_BLKSIZE 8192
+
 typedef struct netchan_buffer_s {
     msg_t msg;
     byte msgBuffer[MAX_MSGLEN];
@@ -131,6 +163,26 @@ typedef struct netchan_buffer_s {
     struct netchan_buffer_s *next;
 } netchan_buffer_t;
 
+// Per client estimate of what the link carries, see SV_UpdateRateControl
+typedef struct {
+    int rate;            // bytes / second, 0 until the first ack
+    int snapshotMsec;    // interval actually used, >= client->snapshotMsec
+    int entityBudget;    // most entities per snapshot, 0 is no limit
+    int visibleEntities; // before the budget, from the last snapshot built
+    float loss;          // smoothed fraction of snapshots lost
+    float drops;         // smoothed fraction of client packets lost
+    float bytes;         // smoothed size of the acked snapshots
+    float entities;      // smoothed entity count of the acked snapshots
+    float packetMsec;    // smoothed interval between client packets
+    int lastPacket;      // msec time of the last client packet
+    int lastAcked;       // newest server message the client acknowledged
+    int lastAdjust;      // msec time of the last rate change
+    int minPing;         // ping with nothing queued on the way
+    int periodAcked;     // snapshots acked since the last adjustment
+    int periodLost;      // and lost
+    int acked, lost;     // totals, for netstats
+} rateControl_t;
+
 typedef struct client_s {
     clientState_t state;
     char userinfo[MAX_INFO_STRING]; // name, etc
@@ -178,6 +230,10 @@ typedef struct client_s {
     int downloadBlockSize[MAX_DOWNLOAD_WINDOW];
     qboolean downloadEOF; // We have sent the EOF block
     int downloadSendTime; // time we last got an ack from the client
+    downloadFile_t *downloadFile; // blocks come straight from here if set
+    int downloadBlockLength;    // bytes per block for this download
+    int downloadWindow;         // blocks sent ahead of the acks
+    int downloadDeficit;        // bytes the scheduler still owes the client
 
     int deltaMessage;     // frame last client usercmd message
     int nextReliableTime; // svs.time when another reliable command will be
@@ -194,6 +250,7 @@ typedef struct client_s {
     int rate;         // bytes / second
     int snapshotMsec; // requests a snapshot every snapshotMsec unless rate
                       // choked
+    rateControl_t rateControl;
     int pureAuthentic;
     qboolean gotCP; // TTimo - additional flag to distinguish between a bad pure
                     // checksum, and no cp command at all
@@ -216,6 +273,7 @@ typedef struct client_s {
 
     int oldServerTime;
     qboolean csUpdated[MAX_CONFIGSTRINGS];
+    qboolean csBatch; // understands coalesced "csm" configstring commands
 
 #ifdef LEGACY_PROTOCOL
     qboolean compat;
@@ -230,8 +288,10 @@ typedef struct client_s {
 #define MAX_CHALLENGES 2048
 // Allow a certain amount of challenges to have the same IP address
 // to make it a bit harder to DOS one single IP address from connecting
-// while not allowing a single ip to grab all challenge resources
+// while not allowing a single ip to grab all challenge resources.
+// An address asking for more recycles its own oldest challenge.
 #define MAX_CHALLENGES_MULTI (MAX_CHALLENGES / 2)
+#define CHALLENGE_HASH_SIZE 4096
 
 #define AUTHORIZE_TIMEOUT 5000
 
@@ -246,6 +306,22 @@ typedef struct {
     qboolean connected;
 } challenge_t;
 
+// Address and challenge number hash chains and age order over
+// svs.challenges, rebuilt from the slots whenever valid is cleared. Links are
+// slot numbers + 1, 0 is none.
+typedef struct {
+    qboolean valid;
+    int hash[CHALLENGE_HASH_SIZE];
+    int hashNext[MAX_CHALLENGES];
+    int hashOf[MAX_CHALLENGES]; // chain + 1 the slot is linked into
+    int numberHash[CHALLENGE_HASH_SIZE];
+    int numberNext[MAX_CHALLENGES];
+    int numberOf[MAX_CHALLENGES];
+    int older[MAX_CHALLENGES];
+    int newer[MAX_CHALLENGES];
+    int oldest, newest;
+} challengeIndex_t;
+
 // this structure will be cleared only when the game dll changes
 typedef struct {
     qboolean initialized; // sv_init has completed
@@ -261,9 +337,15 @@ typedef struct {
     int nextHeartbeatTime;
     challenge_t
         challenges[MAX_CHALLENGES]; // to prevent invalid IPs from connecting
+    challengeIndex_t challengeIndex;
     netadr_t redirectAddress;       // for rcon return messages
 
     netadr_t authorizeAddress; // for rcon return messages
+
+    // entity delta cache counters, see SV_EmitPacketEntities
+    int64_t deltaCacheHits;
+    int64_t deltaCacheMisses;
+    int64_t deltaCacheBytesSaved;
 } serverStatic_t;
 
 #define SERVER_MAXBANS 1024
@@ -283,6 +365,7 @@ extern server_t sv;        // cleared each map
 extern vm_t *gvm;          // game virtual machine
 
 extern cvar_t *sv_fps;
+extern cvar_t *sv_snapshotFps;
 extern cvar_t *sv_timeout;
 extern cvar_t *sv_zombietime;
 extern cvar_t *sv_rconPassword;
@@ -303,16 +386,27 @@ extern cvar_t *sv_serverid;
 extern cvar_t *sv_minRate;
 extern cvar_t *sv_maxRate;
 extern cvar_t *sv_dlRate;
+extern cvar_t *sv_dlWindow;
+extern cvar_t *sv_dlBlockSize;
+#ifdef USE_HTTP_SERVER
+extern cvar_t *sv_httpPort;
+extern cvar_t *sv_httpConnections;
+#endif
 extern cvar_t *sv_minPing;
 extern cvar_t *sv_maxPing;
 extern cvar_t *sv_gametype;
 extern cvar_t *sv_pure;
 extern cvar_t *sv_floodProtect;
 extern cvar_t *sv_lanForceRate;
+extern cvar_t *sv_adaptiveRate;
+extern cvar_t *sv_entityIndex;
+extern cvar_t *sv_linkCache;
 extern cvar_t *sv_strictAuth;
 extern cvar_t *sv_banFile;
 extern cvar_t *sv_autorecord;
 extern cvar_t *sv_antiwallhack;
+extern cvar_t *sv_threads;
+extern cvar_t *sv_deltaCache;
 
 extern serverBan_t serverBans[SERVER_MAXBANS];
 extern int serverBansCount;
@@ -329,6 +423,7 @@ extern cvar_t *sv_voip;
 typedef struct leakyBucket_s leakyBucket_t;
 struct leakyBucket_s {
     netadrtype_t type;
+    int bits; // leading address bits covered, less than all for a network
 
     union {
         byte _4[4];
@@ -336,17 +431,17 @@ struct leakyBucket_s {
     } ipv;
 
     int lastTime;
+    int period; // of the last limit it was charged against, for expiry
     signed char burst;
-
-    long hash;
-
-    leakyBucket_t *prev, *next;
 };
 
 extern leakyBucket_t outboundLeakyBucket;
 
 qboolean SVC_RateLimit(leakyBucket_t *bucket, int burst, int period);
 qboolean SVC_RateLimitAddress(netadr_t from, int burst, int period);
+void SV_QueryResponsesChanged(void);
+void SV_FloodBench_f(void);
+void SV_RateSim_f(void);
 
 void SV_FinalMessage(char *message);
 void QDECL SV_SendServerCommand(client_t *cl, const char *fmt, ...)
@@ -357,6 +452,9 @@ void SV_RemoveOperatorCommands(void);
 
 void SV_MasterShutdown(void);
 int SV_RateMsec(client_t *client);
+void SV_UpdateRateControl(client_t *client, int now);
+int SV_SnapshotMsec(client_t *client);
+int SV_SnapshotTicks(void);
 
 //
 // sv_init.c
@@ -364,6 +462,8 @@ int SV_RateMsec(client_t *client);
 void SV_SetConfigstring(int index, const char *val);
 void SV_GetConfigstring(int index, char *buffer, int bufferSize);
 void SV_UpdateConfigstrings(client_t *client);
+void SV_FlushConfigstrings(void);
+void SV_WriteGamestate(msg_t *msg);
 
 void SV_SetUserinfo(int index, const char *val);
 void SV_GetUserinfo(int index, char *buffer, int bufferSize);
@@ -387,11 +487,15 @@ void SV_ClientEnterWorld(client_t *client, usercmd_t *cmd);
 void SV_FreeClient(client_t *client);
 void SV_DropClient(client_t *drop, const char *reason);
 
+void SV_BansChanged(void);
+qboolean SV_IsBanned(netadr_t *from, qboolean isexception);
+
 void SV_ExecuteClientCommand(client_t *cl, const char *s, qboolean clientOK);
 void SV_ClientThink(client_t *cl, usercmd_t *cmd);
 
 int SV_WriteDownloadToClient(client_t *cl, msg_t *msg);
 int SV_SendDownloadMessages(void);
+void SV_DownloadBench_f(void);
 int SV_SendQueuedMessages(void);
 
 //
@@ -402,6 +506,15 @@ void SVCL_WriteDemoMessage(client_t *cl, msg_t *msg, int headerBytes);
 void CL_Record(client_t *cl, char *s);
 void CL_StopRecord(client_t *cl);
 
+//
+// sv_http.c
+//
+#ifdef USE_HTTP_SERVER
+void SV_HTTPUpdateFiles(void);
+void SV_HTTPFrame(void);
+void SV_HTTPShutdown(void);
+#endif
+
 //
 // sv_snapshot.c
 //
@@ -410,8 +523,11 @@ void SV_UpdateServerCommandsToClient(client_t *client, msg_t *msg,
                                      msg_t *msg_demo);
 void SV_WriteFrameToClient(client_t *client, msg_t *msg);
 void SV_SendMessageToClient(msg_t *msg, client_t *client);
-void SV_SendClientMessages(void);
+void SV_SendClientMessages(qboolean snapshotFrame);
 void SV_SendClientSnapshot(client_t *client);
+void SV_FreeSnapshotJobs(void);
+void SV_FreeEntityIndex(void);
+void SV_SnapshotBench_f(void);
 
 //
 // sv_game.c
@@ -438,8 +554,8 @@ int SV_BotLibSetup(void);
 int SV_BotLibShutdown(void);
 int SV_BotGetSnapshotEntity(int client, int ent);
 int SV_BotGetConsoleMessage(int client, char *buf, int size);
-qboolean SV_IsPlayerVisibleFromPoint(vec3_t origin, clientSnapshot_t *frame,
-                                     sharedEntity_t *ent, vec3_t diff);
+void SV_UpdatePlayerVisibility(void);
+qboolean SV_PlayerVisible(int viewer, int entnum);
 
 int BotImport_DebugPolygonCreate(int color, int numPoints, vec3_t *points);
 void BotImport_DebugPolygonDelete(int id);
@@ -464,10 +580,18 @@ void SV_LinkEntity(sharedEntity_t *ent);
 // sets ent->r.absmin and ent->r.absmax
 // sets ent->leafnums[] for pvs determination even if the entity
 // is not solid
+// keeps the existing link if the absolute box has not changed
+
+void SV_LinkStatsFrame(void);
+// called after every game frame to record how many relinks were skipped
 
 clipHandle_t SV_ClipHandleForEntity(const sharedEntity_t *ent);
+clipHandle_t SV_ClipHandleForEntitySlot(const sharedEntity_t *ent, int slot);
 
 void SV_SectorList_f(void);
+void SV_LinkStats_f(void);
+void SV_AreaBench_f(void);
+void SV_TraceBench_f(void);
 
 int SV_AreaEntities(const vec3_t mins, const vec3_t maxs, int *entityList,
                     int maxcount);
@@ -496,11 +620,21 @@ void SV_Trace(trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs,
 // passEntityNum is explicitly excluded from clipping checks (normally
 // ENTITYNUM_NONE)
 
+void SV_TraceBatch(trace_t *results, const traceRequest_t *requests,
+                   int count);
+// runs every request as SV_Trace would, spread over the worker threads when
+// the batch is big enough
+
 void SV_ClipToEntity(trace_t *trace, const vec3_t start, const vec3_t mins,
                      const vec3_t maxs, const vec3_t end, int entityNum,
                      int contentmask, int capsule);
 // clip to a specific entity
 
+qboolean SV_LineOfSight(const vec3_t start, const vec3_t end,
+                        int passEntityNum, int goalEntityNum, int contentmask);
+// qtrue if nothing in contentmask blocks a point trace from start to end,
+// safe to call from worker threads
+
 //
 // sv_net_chan.c
 //
@@ -61,6 +61,7 @@ int SV_BotAllocateClient(void) {
     cl->gentity = SV_GentityNum(i);
     cl->gentity->s.number = i;
     cl->state = CS_ACTIVE;
+    SV_QueryResponsesChanged();
     cl->lastPacketTime = svs.time;
     cl->netchan.remoteAddress.type = NA_BOT;
     cl->rate = 16384;
@@ -81,6 +82,7 @@ void SV_BotFreeClient(int clientNum) {
     }
     cl = &svs.clients[clientNum];
     cl->state = CS_FREE;
+    SV_QueryResponsesChanged();
     cl->name[0] = 0;
     if (cl->gentity) {
         cl->gentity->r.svFlags &= ~SVF_BOT;
@@ -738,207 +740,365 @@ qboolean InFieldOfVision(vec3_t viewangles, float fov, vec3_t angles,
     return qtrue;
 }
 
-const int MEMORY = 210;
-#define offsetrandom(MIN, MAX)                                                 \
-    (((double)(rand() + 0.5) / ((double)RAND_MAX + 1)) * ((MAX) - (MIN)) +     \
-     (MIN))
-/*
- * Tests whether the player entity ent is visible from the point origin.
- */
-qboolean SV_IsPlayerVisibleFromPoint(vec3_t origin, clientSnapshot_t *frame,
-                                     sharedEntity_t *ent, vec3_t diff) {
-    int i, contents_mask, goal_ent, viewer_clnum, ent_clnum, tries;
-    trace_t tr;
-    vec3_t start, end, dir, entangles, angles, temp, forward;
-    sharedEntity_t *viewer_ent;
-    client_t *viewer_cl;
-    //	client_t *ent_cl;
-    playerState_t *viewer_ps, *ent_ps;
+/*
+==============================================================================
+
+PLAYER VISIBILITY
+
+With sv_antiwallhack 1 players are only sent to the clients that can actually
+see them. Instead of tracing every viewer/player pair while the snapshots are
+built, SV_UpdatePlayerVisibility does all the line of sight tests once per
+server frame, spreads them over the worker threads and stores the answers in
+a bit matrix that the snapshot code reads with SV_PlayerVisible.
+
+==============================================================================
+*/
+
+#define VISIBILITY_MEMORY 210 // msec a player stays visible once seen
+#define MAX_VISIBILITY_TESTS (MAX_CLIENTS * MAX_CLIENTS)
+
+typedef struct {
+    int viewer;       // client doing the looking
+    int target;       // entity being looked at
+    int targetClient; // s.clientNum of the target
+    int tries;        // random points on the body to try after the head
+    int seed;
+    vec3_t start;     // eye of the viewer
+    vec3_t head;      // head of the target
+    vec3_t last;      // last point of the target that was visible
+    vec3_t origin;    // target bounds for the random points
+    vec3_t mins, maxs;
+
+    // filled in by the worker
+    qboolean visible;
+    qboolean newOffset; // offset should replace the client's lasttrace
+    vec3_t offset;
+} visibilityTest_t;
+
+static byte playerVisibility[MAX_CLIENTS][MAX_GENTITIES / 8];
+static int playerVisibilityTime = -1;
+
+static visibilityTest_t visibilityTests[MAX_VISIBILITY_TESTS];
+static int numVisibilityTests;
+
+/*
+==================
+SV_ViewerEye
+
+Camera origin of a player (according to \cg_drawdebug 1)
+==================
+*/
+static void SV_ViewerEye(const vec3_t origin, const vec3_t viewangles,
+                         vec3_t eye) {
+    vec3_t angles, forward;
     float pitch;
 
-    viewer_clnum = frame->ps.clientNum; // get the client number of the viewer
-    ent_clnum = ent->s.clientNum; // get the client number of the other player
+    VectorCopy(viewangles, angles);
+    AnglesNormalize180(angles);
+    pitch = angles[PITCH];
+    angles[PITCH] = 0;
+    angles[ROLL] = 0;
+    AngleVectors(angles, forward, NULL, NULL);
+    VectorMA(origin, pitch / 3.5f, forward, eye);
+}
+
+/*
+==================
+SV_EntityInPVS
+
+The same area and cluster checks SV_AddEntitiesVisibleFromPoint does
+==================
+*/
+static qboolean SV_EntityInPVS(int clientarea, const byte *clientpvs,
+                               const svEntity_t *svEnt) {
+    int i, l;
 
-    if (viewer_clnum == ent_clnum) { // in case the viewer is the player entity
-        return qtrue;                // we don't need to hide us from ourselves
+    if (!svEnt->numClusters) {
+        return qfalse;
+    }
+
+    if (!CM_AreasConnected(clientarea, svEnt->areanum) &&
+        !CM_AreasConnected(clientarea, svEnt->areanum2)) {
+        return qfalse;
     }
 
-    viewer_ps = &frame->ps;
-    ent_ps = SV_GameClientNum(ent_clnum);
+    for (i = 0; i < svEnt->numClusters; i++) {
+        l = svEnt->clusternums[i];
+        if (clientpvs[l >> 3] & (1 << (l & 7))) {
+            return qtrue;
+        }
+    }
+
+    if (svEnt->lastCluster) {
+        for (l = svEnt->clusternums[svEnt->numClusters - 1];
+             l < svEnt->lastCluster; l++) {
+            if (clientpvs[l >> 3] & (1 << (l & 7))) {
+                return qtrue;
+            }
+        }
+    }
+
+    return qfalse;
+}
+
+/*
+==================
+SV_PlayerVisibilityJob
+
+Runs on the worker threads, only reads the world
+==================
+*/
+static void SV_PlayerVisibilityJob(void *data, int index) {
+    visibilityTest_t *test = (visibilityTest_t *)data + index;
+    vec3_t end;
+    int i, seed;
+
+    test->visible = qtrue;
+    test->newOffset = qfalse;
+
+    // aim straight at the head of the entity from our eyes
+    if (SV_LineOfSight(test->start, test->head, test->viewer, test->target,
+                       CONTENTS_SOLID)) {
+        return;
+    }
+
+    // check the last good offset
+    if (SV_LineOfSight(test->start, test->last, test->viewer, test->target,
+                       CONTENTS_SOLID)) {
+        return;
+    }
+
+    // even if the head is not visible, other body parts might be, so check a
+    // few randomly selected points
+    seed = test->seed;
+    test->newOffset = qtrue;
+    for (i = 0; i < test->tries; i++) {
+        end[0] = test->mins[0] + Q_random(&seed) * (test->maxs[0] - test->mins[0]);
+        end[1] = test->mins[1] + Q_random(&seed) * (test->maxs[1] - test->mins[1]);
+        end[2] = test->mins[2] + Q_random(&seed) * (test->maxs[2] - test->mins[2]);
+        VectorAdd(test->origin, end, end);
+
+        if (SV_LineOfSight(test->start, end, test->viewer, test->target,
+                           CONTENTS_SOLID)) {
+            VectorSubtract(end, test->origin, test->offset);
+            return;
+        }
+    }
+
+    // try another spot first next time
+    test->offset[0] = test->mins[0] + Q_random(&seed) * (test->maxs[0] - test->mins[0]);
+    test->offset[1] = test->mins[1] + Q_random(&seed) * (test->maxs[1] - test->mins[1]);
+    test->offset[2] = test->mins[2] + Q_random(&seed) * (test->maxs[2] - test->mins[2]);
+    test->visible = qfalse;
+}
+
+/*
+==================
+SV_QueueVisibilityTest
+
+Decides whether viewer needs a line of sight test against ent. Returns qfalse
+if the player is known to be hidden without one.
+==================
+*/
+static qboolean SV_QueueVisibilityTest(int viewer, const vec3_t eye,
+                                       playerState_t *ps, int clientarea,
+                                       const byte *clientpvs,
+                                       sharedEntity_t *ent) {
+    client_t *cl;
+    playerState_t *ent_ps;
+    visibilityTest_t *test;
+    vec3_t dir, entangles;
+    int clnum;
+
+    clnum = ent->s.clientNum;
+    if (clnum == viewer || clnum < 0 || clnum >= sv_maxclients->integer) {
+        return qtrue; // we don't need to hide us from ourselves
+    }
 
-    if (viewer_ps->pm_type !=
-        PM_NORMAL) {  // if the viewer is dead or spectating
-        return qtrue; // let every entity be visible
+    // dead, spectating or unarmed players are always visible
+    ent_ps = SV_GameClientNum(clnum);
+    if (ent_ps->pm_type != PM_NORMAL || ent->s.weapon == WP_NONE) {
+        return qtrue;
     }
 
-    if (ent_ps->pm_type != PM_NORMAL ||
-        (ent->s.weapon ==
-         WP_NONE)) { // if the player entity is dead or spectating
+    cl = svs.clients + viewer;
+    if (cl->tracetimer[clnum] > sv.time + VISIBILITY_MEMORY + 10) {
+        // sv.time has been reset
+        cl->tracetimer[clnum] = sv.time;
+    } else if (cl->tracetimer[clnum] > sv.time + VISIBILITY_MEMORY - 10) {
+        // if we have recently seen this entity, we are lazy and assume it is
+        // still visible
         return qtrue;
     }
 
-    viewer_cl = svs.clients + viewer_clnum; // get the client of the viewer
-    //	ent_cl = svs.clients+ent_clnum; // get the client of the other player
+    // entities outside the PVS are never sent, so don't bother tracing
+    if (!SV_EntityInPVS(clientarea, clientpvs, SV_SvEntityForGentity(ent))) {
+        return qfalse;
+    }
 
-    //	if (viewer_clnum > ent_clnum) { // if viewer_clnum > ent_clnum, we have
-    //already tested whether ent_clnum is able to see viewer_clnum. 		if
-    //(ent_cl->tracetimer[viewer_clnum] > sv.time) return qtrue; // and we could
-    //assume symmetry of SV_IsPlayerVisibleFromPoint
-    //	}
+    // if it is not within close range (x,y-wise, not z-wise) and behind the
+    // viewer, transmit it anyway so it can be heard
+    VectorSubtract(ent->r.currentOrigin, eye, dir);
+    vectoangles(dir, entangles);
+    dir[2] = 0;
+    if (VectorLength(dir) > 1024 &&
+        !InFieldOfVision(ps->viewangles, 60.f, entangles, clnum)) {
+        return qtrue;
+    }
 
-    if (viewer_cl->tracetimer[ent_clnum] >
-        sv.time + MEMORY + 10) { // if the sv.time has been reset
-        viewer_cl->tracetimer[ent_clnum] = sv.time; // reset the tracetimer
-    } else if (viewer_cl->tracetimer[ent_clnum] >
-               (sv.time + MEMORY -
-                10)) { // if we have recently seen this entity, we are lazy and
-                       // assume it is still visible
-        // Com_Printf(va("client: %i, seen: %i\n", ent_clnum,
-        // viewer_cl->tracetimer[ent_clnum]));
+    if (numVisibilityTests == MAX_VISIBILITY_TESTS) {
         return qtrue;
     }
 
-    goal_ent =
-        SV_NumForGentity(ent); // this might always be the same as ent_clnum
-    viewer_ent = SV_GentityNum(viewer_clnum);
-    contents_mask =
-        CONTENTS_SOLID; // |CONTENTS_BODY will work for doors, but also for
-                        // windows
-                        // |CONTENTS_PLAYERCLIP|CONTENTS_SOLID|CONTENTS_MOVER|CONTENTS_PLAYERCLIP
+    test = &visibilityTests[numVisibilityTests];
+    test->viewer = viewer;
+    test->target = ent->s.number;
+    test->targetClient = clnum;
+    // if we have seen an entity recently, we try hard to locate it again
+    test->tries = (cl->tracetimer[clnum] + VISIBILITY_MEMORY * 20 > sv.time)
+                      ? 8
+                      : 2;
+    test->seed = svs.time + viewer * MAX_GENTITIES + ent->s.number;
+    VectorCopy(eye, test->start);
+
+    // "+3.0f" doesn't do it, "+ent->r.maxs[2]" is at the top of the BBox
+    VectorCopy(ent->r.currentOrigin, dir);
+    dir[2] += ent->r.maxs[2];
+    SV_ViewerEye(dir, ent_ps->viewangles, test->head);
+
+    VectorCopy(ent->r.currentOrigin, test->origin);
+    VectorAdd(test->origin, cl->lasttrace[clnum], test->last);
+    VectorCopy(ent->r.mins, test->mins);
+    VectorCopy(ent->r.maxs, test->maxs);
+    test->maxs[2] += 3.f;
+
+    numVisibilityTests++;
+    return qtrue;
+}
 
-    //	if (seen->v.movetype == MOVETYPE_PUSH ) { //don't cull doors and plats
-    //:( 		return false;
-    //	}
+/*
+==================
+SV_UpdatePlayerVisibility
 
-    //	if (sv_antiwallhack.value == 1)    //1 only check player models, 2 =
-    //check all ents 	if (strcmp(pr_strings + seen->v.classname, "player"))
-    //	return qfalse;
+Fills in the visibility matrix for the current frame. Only does any work once
+per frame, and only with sv_antiwallhack 1.
+==================
+*/
+void SV_UpdatePlayerVisibility(void) {
+    qboolean followed[MAX_CLIENTS];
+    client_t *cl;
+    playerState_t *ps;
+    sharedEntity_t *ent;
+    visibilityTest_t *test;
+    vec3_t org, eye;
+    int leafnum, clientarea;
+    byte *clientpvs;
+    int i, e, maxclients;
+
+    if (sv_antiwallhack->integer != 1 || !sv.state) {
+        return;
+    }
+    if (playerVisibilityTime == svs.time) {
+        return;
+    }
+    playerVisibilityTime = svs.time;
 
-    // get camera origin (according to \cg_drawdebug 1)
-    start[0] = origin[0];
-    start[1] = origin[1];
-    start[2] = origin[2] + 3.0f;
-    VectorCopy(viewer_ps->viewangles, angles);
-    AnglesNormalize180(angles);
-    pitch = angles[PITCH];
-    angles[PITCH] = 0;
-    angles[ROLL] = 0;
-    AngleVectors(angles, forward, NULL, NULL);
-    VectorScale(forward, (pitch / 3.5f), temp);
-    VectorAdd(start, temp, start);
-
-    // if there is sufficient distance between viewer and player entity, check
-    // if player entity is within viewer's field of vision
-    VectorSubtract(ent->r.currentOrigin, start, dir);
-    //	VectorAdd(ent->r.currentOrigin,dir,diff);// fill diff
-    VectorCopy(viewer_ent->s.pos.trBase, diff); // fill diff
-    vectoangles(dir, entangles);
-    dir[2] = 0; // pretend, players are on the same level (the height should no
-                // be taken into account)
-    if (VectorLength(dir) >
-        1024) { // if it is not within close range (x,y-wise, not z-wise)
-        if (!InFieldOfVision(viewer_ps->viewangles, 60.f, entangles,
-                             ent_clnum)) { // If the player entity is not in the
-                                           // field of vision of the viewer
-            //			 Com_Printf( va("behind: %i  vorg: %f,%f,%f
-            //vang: %f,%f,%f  eorg: %f,%f,%f  dir: %f,%f,%f  eang: %f,%f,%f ent:
-            //%i\n",
-            //viewer_clnum,origin[0],origin[1],origin[2],viewer_ps->viewangles[0],viewer_ps->viewangles[1],viewer_ps->viewangles[2],ent->r.currentOrigin[0],ent->r.currentOrigin[1],ent->r.currentOrigin[2],dir[0],dir[1],dir[2],entangles[0],entangles[1],entangles[2],ent_clnum));
-            return qtrue; // if the player entity is behind the viewer, abstain
-                          // from any computations (and transmit the entity to
-                          // hear sounds)
-                          //		} else {
-                          //			 Com_Printf( va("front: %i  vorg: %f,%f,%f vang:
-            //%f,%f,%f  eorg: %f,%f,%f  dir: %f,%f,%f  eang: %f,%f,%f  ent:
-            //%i\n",
-            //viewer_clnum,origin[0],origin[1],origin[2],viewer_ps->viewangles[0],viewer_ps->viewangles[1],viewer_ps->viewangles[2],ent->r.currentOrigin[0],ent->r.currentOrigin[1],ent->r.currentOrigin[2],dir[0],dir[1],dir[2],entangles[0],entangles[1],entangles[2],ent_clnum));
+    // everything is visible unless a test says otherwise
+    Com_Memset(playerVisibility, 0xff, sizeof(playerVisibility));
+    numVisibilityTests = 0;
+
+    maxclients = sv_maxclients->integer;
+    if (maxclients > MAX_CLIENTS) {
+        maxclients = MAX_CLIENTS;
+    }
+
+    // bots don't need a row of their own, unless a human is spectating
+    // through their eyes
+    Com_Memset(followed, 0, sizeof(followed));
+    for (i = 0, cl = svs.clients; i < maxclients; i++, cl++) {
+        if (cl->state != CS_ACTIVE || !cl->gentity ||
+            cl->netchan.remoteAddress.type == NA_BOT) {
+            continue;
+        }
+        ps = SV_GameClientNum(i);
+        if (ps->clientNum >= 0 && ps->clientNum < maxclients) {
+            followed[ps->clientNum] = qtrue;
         }
     }
 
-    // aim straight at the head of the entity from our eyes
-    end[0] = ent->r.currentOrigin[0];
-    end[1] = ent->r.currentOrigin[1];
-    end[2] = ent->r.currentOrigin[2] +
-             ent->r.maxs[2]; // "+3.0f" doesn't do it. "+ent->r.maxs[2]" is at
-                             // the top of the BBox
-    VectorCopy(ent_ps->viewangles, angles);
-    AnglesNormalize180(angles);
-    pitch = angles[PITCH];
-    angles[PITCH] = 0;
-    angles[ROLL] = 0;
-    AngleVectors(angles, forward, NULL, NULL);
-    VectorScale(forward, (pitch / 3.5f), temp);
-    VectorAdd(end, temp, end);
-
-    memset(&tr, 0, sizeof(tr));
-    tr.fraction = 1;
-
-    // check the head
-    SV_Trace(&tr, start, NULL, NULL, end, viewer_clnum, contents_mask, qfalse);
-    // Com_Printf(va("client: %i, trace: %f\n", ent->s.clientNum, tr.fraction));
-    if (tr.fraction == 1 ||
-        tr.entityNum == goal_ent) { // tr.fraction == 1 || if there is a line of
-                                    // sight to the entity
-        viewer_cl->tracetimer[ent_clnum] =
-            sv.time + MEMORY; // update the trace timer so the entity will be
-                              // visible the next 200 time units
-        return qtrue;         // and signal the entity is visible
-    }
-    // Com_Printf(va("origin(%f %f %f) min(%f %f %f) max(%f %f %f)\n", start[0],
-    // start[1], start[2], mins[0],mins[1],mins[2],maxs[0],maxs[1],maxs[2]));
+    for (i = 0, cl = svs.clients; i < maxclients; i++, cl++) {
+        if (cl->state != CS_ACTIVE || !cl->gentity ||
+            (cl->netchan.remoteAddress.type == NA_BOT && !followed[i])) {
+            continue;
+        }
 
-    // check the last good offset
-    VectorAdd(ent->r.currentOrigin, viewer_cl->lasttrace[ent_clnum], end);
-    SV_Trace(&tr, start, NULL, NULL, end, viewer_clnum, contents_mask, qfalse);
-    // Com_Printf(va("client: %i, trace: %f\n", ent->s.clientNum, tr.fraction));
-    if (tr.fraction == 1 ||
-        tr.entityNum == goal_ent) { // tr.fraction == 1 || if there is a line of
-                                    // sight to the entity
-        viewer_cl->tracetimer[ent_clnum] =
-            sv.time + MEMORY; // update the trace timer so the entity will be
-                              // visible the next 200 time units
-        return qtrue;         // and signal the entity is visible
-    }
-
-    // random
-    tries = (viewer_cl->tracetimer[ent_clnum] + (MEMORY * 20) > sv.time)
-                ? 8
-                : 2; // if we have seen an entity recently, we try hard to
-                     // locate it again
-    for (i = 0; i < tries;
-         i++) { // Even if the head is not visible, other body parts might be.
-                // Let's check a few randomly selected points
-        end[0] = ent->r.currentOrigin[0] +
-                 offsetrandom(ent->r.mins[0], ent->r.maxs[0]);
-        end[1] = ent->r.currentOrigin[1] +
-                 offsetrandom(ent->r.mins[1], ent->r.maxs[1]);
-        end[2] = ent->r.currentOrigin[2] +
-                 offsetrandom(ent->r.mins[2], ent->r.maxs[2] + 3.f);
-
-        SV_Trace(&tr, start, NULL, NULL, end, viewer_clnum, contents_mask,
-                 qfalse);
-        if (tr.fraction == 1 ||
-            tr.entityNum ==
-                goal_ent) { //  if there is a line of sight to the entity
-            // Com_Printf(va("found ent in %i hits\n", i));
-            viewer_cl->tracetimer[ent_clnum] =
-                sv.time + MEMORY; // update the trace timer so the entity will
-                                  // be visible the next 200 time units
-            VectorSubtract(
-                end, ent->r.currentOrigin,
-                viewer_cl->lasttrace[ent_clnum]); // remember the offset
-            return qtrue; // and signal the entity is visible
+        // followers look through the row of the player they follow, and
+        // viewers that are dead or spectating see everything
+        ps = SV_GameClientNum(i);
+        if (ps->clientNum != i || ps->pm_type != PM_NORMAL) {
+            continue;
+        }
+
+        VectorCopy(ps->origin, org);
+        org[2] += ps->viewheight;
+
+        leafnum = CM_PointLeafnum(org);
+        clientarea = CM_LeafArea(leafnum);
+        clientpvs = CM_ClusterPVS(CM_LeafCluster(leafnum));
+
+        eye[0] = org[0];
+        eye[1] = org[1];
+        eye[2] = org[2] + 3.0f;
+        SV_ViewerEye(eye, ps->viewangles, eye);
+
+        for (e = 0; e < sv.num_entities; e++) {
+            ent = SV_GentityNum(e);
+            if (!ent->r.linked || ent->s.eType != ET_PLAYER ||
+                (ent->r.svFlags & SVF_NOCLIENT)) {
+                continue;
+            }
+
+            if (!SV_QueueVisibilityTest(i, eye, ps, clientarea, clientpvs,
+                                        ent)) {
+                playerVisibility[i][e >> 3] &= ~(1 << (e & 7));
+            }
         }
     }
 
-    viewer_cl->lasttrace[ent_clnum][0] =
-        offsetrandom(ent->r.mins[0], ent->r.maxs[0]);
-    viewer_cl->lasttrace[ent_clnum][1] =
-        offsetrandom(ent->r.mins[1], ent->r.maxs[1]);
-    viewer_cl->lasttrace[ent_clnum][2] =
-        offsetrandom(ent->r.mins[2], ent->r.maxs[2] + 3.f);
+    Sys_RunJobs(SV_PlayerVisibilityJob, visibilityTests, numVisibilityTests);
 
-    return (viewer_cl->tracetimer[ent_clnum] >
-            sv.time); // returns true if the entity was visible within the last
-                      // 200 time units
+    for (i = 0, test = visibilityTests; i < numVisibilityTests; i++, test++) {
+        cl = svs.clients + test->viewer;
+
+        if (test->newOffset) {
+            VectorCopy(test->offset, cl->lasttrace[test->targetClient]);
+        }
+
+        if (test->visible) {
+            // the entity will be visible the next VISIBILITY_MEMORY msec
+            cl->tracetimer[test->targetClient] = sv.time + VISIBILITY_MEMORY;
+            continue;
+        }
+
+        // still visible if it was seen within the last VISIBILITY_MEMORY msec
+        if (cl->tracetimer[test->targetClient] <= sv.time) {
+            playerVisibility[test->viewer][test->target >> 3] &=
+                ~(1 << (test->target & 7));
+        }
+    }
+}
+
+/*
+==================
+SV_PlayerVisible
+
+Whether the player entity entnum should be sent to viewer, as decided by the
+last SV_UpdatePlayerVisibility
+==================
+*/
+qboolean SV_PlayerVisible(int viewer, int entnum) {
+    if (viewer < 0 || viewer >= MAX_CLIENTS) {
+        return qtrue;
+    }
+    return (playerVisibility[viewer][entnum >> 3] & (1 << (entnum & 7))) != 0;
 }
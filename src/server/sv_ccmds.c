@@ -680,6 +680,7 @@ static void SV_RehashBans_f(void) {
     }
 
     serverBansCount = 0;
+    SV_BansChanged();
 
     if (!sv_banFile->string || !*sv_banFile->string)
         return;
@@ -792,6 +793,8 @@ Remove a ban or an exception from the list.
 */
 
 static qboolean SV_DelBanEntryFromList(int index) {
+    SV_BansChanged();
+
     if (index == serverBansCount - 1)
         serverBansCount--;
     else if (index < ARRAY_LEN(serverBans) - 1) {
@@ -967,6 +970,7 @@ static void SV_AddBanToList(qboolean isexception) {
     serverBans[serverBansCount].isexception = isexception;
 
     serverBansCount++;
+    SV_BansChanged();
 
     SV_WriteBans();
 
@@ -1108,6 +1112,7 @@ static void SV_FlushBans_f(void) {
     }
 
     serverBansCount = 0;
+    SV_BansChanged();
 
     // empty the ban file.
     SV_WriteBans();
@@ -1210,6 +1215,42 @@ static void SV_Status_f(void) {
     Com_Printf("\n");
 }
 
+/*
+================
+SV_NetStats_f
+
+What the rate control thinks of each client's link
+================
+*/
+static void SV_NetStats_f(void) {
+    int i;
+    client_t *cl;
+    rateControl_t *rc;
+
+    // make sure server is running
+    if (!com_sv_running->integer) {
+        Com_Printf("Server is not running.\n");
+        return;
+    }
+
+    Com_Printf("cl ping  rate estimate snaps  used budget visible  loss   "
+               "size  acked   lost name\n");
+    Com_Printf("-- ---- ----- -------- ----- ----- ------ ------- ----- "
+               "------ ------ ------ ---------------\n");
+    for (i = 0, cl = svs.clients; i < sv_maxclients->integer; i++, cl++) {
+        if (cl->state != CS_ACTIVE || cl->netchan.remoteAddress.type == NA_BOT)
+            continue;
+        rc = &cl->rateControl;
+        Com_Printf("%2i %4i %5i %8i %5i %5i %6i %7i %4.1f%% %6i %6i %6i "
+                   "%s^7\n",
+                   i, cl->ping < 9999 ? cl->ping : 9999, cl->rate, rc->rate,
+                   1000 / cl->snapshotMsec, 1000 / SV_SnapshotMsec(cl),
+                   rc->entityBudget, rc->visibleEntities, rc->loss * 100,
+                   (int)rc->bytes, rc->acked, rc->lost, cl->name);
+    }
+    Com_Printf("\n");
+}
+
 /*
 ====================
 SV_ClientID_f
@@ -1442,6 +1483,40 @@ static void SV_Systeminfo_f(void) {
     Info_Print(Cvar_InfoString_Big(CVAR_SYSTEMINFO));
 }
 
+/*
+===========
+SV_DeltaCache_f
+
+Show how much the entity delta cache saved since the server started
+===========
+*/
+static void SV_DeltaCache_f(void) {
+    double lookups;
+
+    // make sure server is running
+    if (!com_sv_running->integer) {
+        Com_Printf("Server is not running.\n");
+        return;
+    }
+
+    if (Cmd_Argc() > 1 && !Q_stricmp(Cmd_Argv(1), "reset")) {
+        svs.deltaCacheHits = 0;
+        svs.deltaCacheMisses = 0;
+        svs.deltaCacheBytesSaved = 0;
+        return;
+    }
+
+    lookups = (double)(svs.deltaCacheHits + svs.deltaCacheMisses);
+
+    Com_Printf("entity delta cache: %s\n",
+               sv_deltaCache->integer ? "enabled" : "disabled");
+    Com_Printf("%.0f hits, %.0f misses, %.1f%% hit rate\n",
+               (double)svs.deltaCacheHits, (double)svs.deltaCacheMisses,
+               lookups ? 100.0 * svs.deltaCacheHits / lookups : 0.0);
+    Com_Printf("%.0f bytes spliced without re-encoding\n",
+               (double)svs.deltaCacheBytesSaved);
+}
+
 /*
 ===========
 SV_DumpUser_f
@@ -1608,10 +1683,7 @@ void CL_Record(client_t *cl, char *s) {
     char name_zip[MAX_OSPATH];
     byte bufData[MAX_MSGLEN];
     msg_t buf;
-    int i;
     int len;
-    entityState_t *ent;
-    entityState_t nullstate;
     int clientnum;
     char *guid;
     char prefix[MAX_OSPATH];
@@ -1692,6 +1764,9 @@ void CL_Record(client_t *cl, char *s) {
 
     Q_strncpyz(cl->demoName, name, sizeof(cl->demoName));
 
+    // the gamestate must already hold the pending configstrings
+    SV_FlushConfigstrings();
+
     // write out the gamestate message
     MSG_Init(&buf, bufData, sizeof(bufData));
     MSG_Bitstream(&buf);
@@ -1702,25 +1777,8 @@ void CL_Record(client_t *cl, char *s) {
     MSG_WriteByte(&buf, svc_gamestate);        // 000B
     MSG_WriteLong(&buf, cl->reliableSequence); // 000C - 000F
 
-    // write the configstrings
-    for (i = 0; i < MAX_CONFIGSTRINGS; i++) {
-        if (sv.configstrings[i][0]) {
-            MSG_WriteByte(&buf, svc_configstring);
-            MSG_WriteShort(&buf, i);
-            MSG_WriteBigString(&buf, sv.configstrings[i]);
-        }
-    }
-
-    // write the baselines
-    Com_Memset(&nullstate, 0, sizeof(nullstate));
-    for (i = 0; i < MAX_GENTITIES; i++) {
-        ent = &sv.svEntities[i].baseline;
-        if (!ent->number) {
-            continue;
-        }
-        MSG_WriteByte(&buf, svc_baseline);
-        MSG_WriteDeltaEntity(&buf, &nullstate, ent, qtrue);
-    }
+    // write the configstrings and baselines
+    SV_WriteGamestate(&buf);
 
     MSG_WriteByte(&buf, svc_EOF);
 
@@ -1852,6 +1910,16 @@ void SV_AddOperatorCommands(void) {
     Cmd_AddCommand("dumpuser", SV_DumpUser_f);
     Cmd_AddCommand("map_restart", SV_MapRestart_f);
     Cmd_AddCommand("sectorlist", SV_SectorList_f);
+    Cmd_AddCommand("linkstats", SV_LinkStats_f);
+    Cmd_AddCommand("areabench", SV_AreaBench_f);
+    Cmd_AddCommand("tracebench", SV_TraceBench_f);
+    Cmd_AddCommand("cmbench", CM_TraceBench_f);
+    Cmd_AddCommand("deltacache", SV_DeltaCache_f);
+    Cmd_AddCommand("floodbench", SV_FloodBench_f);
+    Cmd_AddCommand("netstats", SV_NetStats_f);
+    Cmd_AddCommand("ratesim", SV_RateSim_f);
+    Cmd_AddCommand("snapbench", SV_SnapshotBench_f);
+    Cmd_AddCommand("dlbench", SV_DownloadBench_f);
     Cmd_AddCommand("map", SV_Map_f);
     Cmd_SetCommandCompletionFunc("map", SV_CompleteMapName);
 #ifndef PRE_RELEASE_DEMO
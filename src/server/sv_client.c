@@ -26,6 +26,303 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 static void SV_CloseDownload(client_t *cl);
 
+/*
+==============================================================================
+
+CHALLENGE INDEX
+
+svs.challenges is reached through address and challenge number hash chains,
+and recycled in the order the slots were handed out, so a getchallenge or connect flood costs
+the same per packet however full the table is.
+
+==============================================================================
+*/
+
+/*
+=================
+SV_ChallengeHash
+
+Covers exactly what NET_CompareAdr compares
+=================
+*/
+static int SV_ChallengeHash(const netadr_t *adr) {
+    unsigned int hash = 2166136261u ^ adr->type;
+    const byte *ip = NULL;
+    int i, size = 0;
+
+    if (adr->type == NA_IP) {
+        ip = adr->ip;
+        size = 4;
+    } else if (adr->type == NA_IP6) {
+        ip = adr->ip6;
+        size = 16;
+    }
+
+    for (i = 0; i < size; i++) {
+        hash = (hash ^ ip[i]) * 16777619u;
+    }
+    if (size) {
+        hash = (hash ^ adr->port) * 16777619u;
+    }
+
+    return (hash ^ (hash >> 16)) & (CHALLENGE_HASH_SIZE - 1);
+}
+
+/*
+=================
+SV_ChallengeNumberHash
+=================
+*/
+static int SV_ChallengeNumberHash(int number) {
+    unsigned int hash = (unsigned int)number * 2654435761u;
+
+    return (hash ^ (hash >> 16)) & (CHALLENGE_HASH_SIZE - 1);
+}
+
+/*
+=================
+SV_UnlinkChallengeChain
+=================
+*/
+static void SV_UnlinkChallengeChain(int *heads, int *next, int *of,
+                                    int slot) {
+    int *link;
+
+    if (!of[slot]) {
+        return;
+    }
+    link = &heads[of[slot] - 1];
+    while (*link != slot + 1) {
+        link = &next[*link - 1];
+    }
+    *link = next[slot];
+    next[slot] = 0;
+    of[slot] = 0;
+}
+
+/*
+=================
+SV_UnlinkChallenge
+=================
+*/
+static void SV_UnlinkChallenge(int slot) {
+    challengeIndex_t *index = &svs.challengeIndex;
+
+    SV_UnlinkChallengeChain(index->hash, index->hashNext, index->hashOf,
+                            slot);
+    SV_UnlinkChallengeChain(index->numberHash, index->numberNext,
+                            index->numberOf, slot);
+
+    if (index->older[slot]) {
+        index->newer[index->older[slot] - 1] = index->newer[slot];
+    } else if (index->oldest == slot + 1) {
+        index->oldest = index->newer[slot];
+    }
+    if (index->newer[slot]) {
+        index->older[index->newer[slot] - 1] = index->older[slot];
+    } else if (index->newest == slot + 1) {
+        index->newest = index->older[slot];
+    }
+    index->older[slot] = index->newer[slot] = 0;
+}
+
+/*
+=================
+SV_LinkChallenge
+
+Puts a slot at the young or the old end of the age order, and into the
+chains of its address and number if it is in use
+=================
+*/
+static void SV_LinkChallenge(int slot, qboolean newest) {
+    challengeIndex_t *index = &svs.challengeIndex;
+    challenge_t *challenge = &svs.challenges[slot];
+    int hash;
+
+    if (challenge->adr.type != NA_BAD) {
+        hash = SV_ChallengeHash(&challenge->adr);
+        index->hashNext[slot] = index->hash[hash];
+        index->hash[hash] = slot + 1;
+        index->hashOf[slot] = hash + 1;
+
+        hash = SV_ChallengeNumberHash(challenge->challenge);
+        index->numberNext[slot] = index->numberHash[hash];
+        index->numberHash[hash] = slot + 1;
+        index->numberOf[slot] = hash + 1;
+    }
+
+    if (newest) {
+        index->older[slot] = index->newest;
+        if (index->newest) {
+            index->newer[index->newest - 1] = slot + 1;
+        } else {
+            index->oldest = slot + 1;
+        }
+        index->newest = slot + 1;
+    } else {
+        index->newer[slot] = index->oldest;
+        if (index->oldest) {
+            index->older[index->oldest - 1] = slot + 1;
+        } else {
+            index->newest = slot + 1;
+        }
+        index->oldest = slot + 1;
+    }
+}
+
+static int QDECL SV_CompareChallengeAge(const void *a, const void *b) {
+    const challenge_t *ca = &svs.challenges[*(const int *)a];
+    const challenge_t *cb = &svs.challenges[*(const int *)b];
+
+    if (ca->time != cb->time) {
+        return ca->time < cb->time ? -1 : 1;
+    }
+    return *(const int *)a - *(const int *)b;
+}
+
+/*
+=================
+SV_ValidateChallengeIndex
+
+Rebuilds the index after svs has been cleared
+=================
+*/
+static void SV_ValidateChallengeIndex(void) {
+    int order[MAX_CHALLENGES];
+    int i;
+
+    if (svs.challengeIndex.valid) {
+        return;
+    }
+
+    Com_Memset(&svs.challengeIndex, 0, sizeof(svs.challengeIndex));
+    for (i = 0; i < MAX_CHALLENGES; i++) {
+        order[i] = i;
+    }
+    qsort(order, MAX_CHALLENGES, sizeof(order[0]), SV_CompareChallengeAge);
+    for (i = 0; i < MAX_CHALLENGES; i++) {
+        SV_LinkChallenge(order[i], qtrue);
+    }
+
+    svs.challengeIndex.valid = qtrue;
+}
+
+/*
+=================
+SV_FindChallenge
+
+Returns the newest challenge handed to an address, or the one with the
+given number if checkNumber is set
+=================
+*/
+static challenge_t *SV_FindChallenge(netadr_t from, qboolean checkNumber,
+                                     int number) {
+    challengeIndex_t *index = &svs.challengeIndex;
+    challenge_t *challenge;
+    int link;
+
+    SV_ValidateChallengeIndex();
+
+    for (link = index->hash[SV_ChallengeHash(&from)]; link;
+         link = index->hashNext[link - 1]) {
+        challenge = &svs.challenges[link - 1];
+        if (NET_CompareAdr(from, challenge->adr) &&
+            (!checkNumber || challenge->challenge == number)) {
+            return challenge;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+=================
+SV_FindChallengeNumber
+
+Returns the newest challenge in use with the given number, whatever its
+address
+=================
+*/
+static challenge_t *SV_FindChallengeNumber(int number) {
+    challengeIndex_t *index = &svs.challengeIndex;
+    int link;
+
+    SV_ValidateChallengeIndex();
+
+    for (link = index->numberHash[SV_ChallengeNumberHash(number)]; link;
+         link = index->numberNext[link - 1]) {
+        if (svs.challenges[link - 1].challenge == number) {
+            return &svs.challenges[link - 1];
+        }
+    }
+
+    return NULL;
+}
+
+/*
+=================
+SV_AllocChallenge
+
+Hands the challenge number to an address in the oldest slot, or the oldest
+one of the address itself once it holds MAX_CHALLENGES_MULTI pending
+challenges. oldestTime is set to when the oldest challenge still pending
+for the address was handed out.
+=================
+*/
+static challenge_t *SV_AllocChallenge(netadr_t from, int number,
+                                      int *oldestTime) {
+    challengeIndex_t *index = &svs.challengeIndex;
+    challenge_t *challenge;
+    int link, slot, count;
+
+    SV_ValidateChallengeIndex();
+
+    slot = index->oldest - 1;
+    count = 0;
+    *oldestTime = 0x7fffffff;
+
+    // chains are kept newest first
+    for (link = index->hash[SV_ChallengeHash(&from)]; link;
+         link = index->hashNext[link - 1]) {
+        challenge = &svs.challenges[link - 1];
+        if (!challenge->connected && NET_CompareAdr(from, challenge->adr)) {
+            if (challenge->time < *oldestTime) {
+                *oldestTime = challenge->time;
+            }
+            if (++count >= MAX_CHALLENGES_MULTI) {
+                slot = link - 1;
+                break;
+            }
+        }
+    }
+
+    SV_UnlinkChallenge(slot);
+    challenge = &svs.challenges[slot];
+    Com_Memset(challenge, 0, sizeof(*challenge));
+    challenge->adr = from;
+    challenge->challenge = number;
+    SV_LinkChallenge(slot, qtrue);
+
+    return challenge;
+}
+
+/*
+=================
+SV_FreeChallenge
+
+Clears a challenge so it won't timeout and let them through, and makes
+its slot the first to be reused
+=================
+*/
+static void SV_FreeChallenge(challenge_t *challenge) {
+    int slot = challenge - svs.challenges;
+
+    SV_ValidateChallengeIndex();
+    SV_UnlinkChallenge(slot);
+    Com_Memset(challenge, 0, sizeof(*challenge));
+    SV_LinkChallenge(slot, qfalse);
+}
+
 /*
 =================
 SV_GetChallenge
@@ -52,13 +349,9 @@ v4-only auth server for these new types of connections.
 =================
 */
 void SV_GetChallenge(netadr_t from) {
-    int i;
-    int oldest;
-    int oldestTime;
     int oldestClientTime;
     int clientChallenge;
     challenge_t *challenge;
-    qboolean wasfound = qfalse;
     char *gameName;
     qboolean gameMismatch;
 
@@ -103,44 +396,16 @@ void SV_GetChallenge(netadr_t from) {
         return;
     }
 
-    oldest = 0;
-    oldestClientTime = oldestTime = 0x7fffffff;
-
-    // see if we already have a challenge for this ip
-    challenge = &svs.challenges[0];
+    // every request gets a fresh slot, earlier challenges stay valid
+    // until they are recycled
     clientChallenge = atoi(Cmd_Argv(1));
 
-    for (i = 0; i < MAX_CHALLENGES; i++, challenge++) {
-        if (!challenge->connected && NET_CompareAdr(from, challenge->adr)) {
-            wasfound = qtrue;
-
-            if (challenge->time < oldestClientTime)
-                oldestClientTime = challenge->time;
-        }
-
-        if (wasfound && i >= MAX_CHALLENGES_MULTI) {
-            i = MAX_CHALLENGES;
-            break;
-        }
-
-        if (challenge->time < oldestTime) {
-            oldestTime = challenge->time;
-            oldest = i;
-        }
-    }
-
-    if (i == MAX_CHALLENGES) {
-        // this is the first time this client has asked for a challenge
-        challenge = &svs.challenges[oldest];
-        challenge->clientChallenge = clientChallenge;
-        challenge->adr = from;
-        challenge->firstTime = svs.time;
-        challenge->connected = qfalse;
-    }
-
     // always generate a new challenge number, so the client cannot circumvent
     // sv_maxping
-    challenge->challenge = ((rand() << 16) ^ rand()) ^ svs.time;
+    challenge = SV_AllocChallenge(from, ((rand() << 16) ^ rand()) ^ svs.time,
+                                  &oldestClientTime);
+    challenge->clientChallenge = clientChallenge;
+    challenge->firstTime = svs.time;
     challenge->wasrefused = qfalse;
     challenge->time = svs.time;
 
@@ -257,7 +522,6 @@ challengeResponse to it
 */
 void SV_AuthorizeIpPacket(netadr_t from) {
     int challenge;
-    int i;
     char *s;
     char *r;
     challenge_t *challengeptr;
@@ -269,18 +533,12 @@ void SV_AuthorizeIpPacket(netadr_t from) {
 
     challenge = atoi(Cmd_Argv(1));
 
-    for (i = 0; i < MAX_CHALLENGES; i++) {
-        if (svs.challenges[i].challenge == challenge) {
-            break;
-        }
-    }
-    if (i == MAX_CHALLENGES) {
+    challengeptr = SV_FindChallengeNumber(challenge);
+    if (!challengeptr) {
         Com_Printf("SV_AuthorizeIpPacket: challenge not found\n");
         return;
     }
 
-    challengeptr = &svs.challenges[i];
-
     // send a packet back to the original client
     challengeptr->pingTime = svs.time;
     s = Cmd_Argv(2);
@@ -301,7 +559,7 @@ void SV_AuthorizeIpPacket(netadr_t from) {
             NET_OutOfBandPrint(NS_SERVER, challengeptr->adr, "print\n%s\n", r);
         }
         // clear the challenge record so it won't timeout and let them through
-        Com_Memset(challengeptr, 0, sizeof(*challengeptr));
+        SV_FreeChallenge(challengeptr);
         return;
     }
 
@@ -314,38 +572,176 @@ void SV_AuthorizeIpPacket(netadr_t from) {
     }
 
     // clear the challenge record so it won't timeout and let them through
-    Com_Memset(challengeptr, 0, sizeof(*challengeptr));
+    SV_FreeChallenge(challengeptr);
 }
 
+/*
+==============================================================================
+
+BAN LOOKUP
+
+The ban list is mirrored into one binary trie per address family, keyed on
+the address bits, so a lookup walks at most 32 or 128 nodes however many bans
+there are. The trie is rebuilt on the first lookup after the list changes.
+
+==============================================================================
+*/
+
+#define BAN_FLAG_BAN 1
+#define BAN_FLAG_EXCEPTION 2
+
+typedef struct {
+    int child[2]; // 0 when there is none, node 0 is never linked
+    int flags;
+} banNode_t;
+
+static banNode_t *banNodes;
+static int banNodeCount;
+static int banRoots[2]; // NA_IP, NA_IP6
+static int banLoopbackFlags;
+static qboolean banTreeValid;
+
 /*
 ==================
-SV_IsBanned
+SV_BansChanged
 
-Check whether a certain address is banned
+Called whenever serverBans is modified
 ==================
 */
+void SV_BansChanged(void) { banTreeValid = qfalse; }
 
-static qboolean SV_IsBanned(netadr_t *from, qboolean isexception) {
-    int index;
-    serverBan_t *curban;
+/*
+==================
+SV_BanAddressBits
 
-    if (!isexception) {
-        // If this is a query for a ban, first check whether the client is
-        // excepted
-        if (SV_IsBanned(from, qtrue))
-            return qfalse;
+Returns the address bytes and sets the trie root for IP addresses
+==================
+*/
+static const byte *SV_BanAddressBits(const netadr_t *adr, int *root,
+                                     int *bits) {
+    switch (adr->type) {
+    case NA_IP:
+        *root = banRoots[0];
+        *bits = 32;
+        return adr->ip;
+    case NA_IP6:
+        *root = banRoots[1];
+        *bits = 128;
+        return adr->ip6;
+    default:
+        return NULL;
+    }
+}
+
+/*
+==================
+SV_BuildBanTree
+==================
+*/
+static void SV_BuildBanTree(void) {
+    serverBan_t *ban;
+    const byte *addr;
+    int i, bit, bits, node, root, side, flag, total;
+
+    total = 3;
+    for (i = 0; i < serverBansCount; i++) {
+        total += serverBans[i].ip.type == NA_IP6 ? 128 : 32;
+    }
+
+    if (banNodes) {
+        Z_Free(banNodes);
     }
+    banNodes = Z_Malloc(total * sizeof(*banNodes));
+    banNodeCount = 1;
+    banRoots[0] = banNodeCount++;
+    banRoots[1] = banNodeCount++;
+    banLoopbackFlags = 0;
+
+    for (i = 0; i < serverBansCount; i++) {
+        ban = &serverBans[i];
+        flag = ban->isexception ? BAN_FLAG_EXCEPTION : BAN_FLAG_BAN;
 
-    for (index = 0; index < serverBansCount; index++) {
-        curban = &serverBans[index];
+        if (ban->ip.type == NA_LOOPBACK) {
+            banLoopbackFlags |= flag;
+            continue;
+        }
 
-        if (curban->isexception == isexception) {
-            if (NET_CompareBaseAdrMask(curban->ip, *from, curban->subnet))
-                return qtrue;
+        addr = SV_BanAddressBits(&ban->ip, &root, &bits);
+        if (!addr) {
+            continue;
         }
+
+        // same clamping as NET_CompareBaseAdrMask
+        if (ban->subnet >= 0 && ban->subnet < bits) {
+            bits = ban->subnet;
+        }
+
+        node = root;
+        for (bit = 0; bit < bits; bit++) {
+            side = (addr[bit >> 3] >> (7 - (bit & 7))) & 1;
+            if (!banNodes[node].child[side]) {
+                banNodes[node].child[side] = banNodeCount++;
+            }
+            node = banNodes[node].child[side];
+        }
+        banNodes[node].flags |= flag;
     }
 
-    return qfalse;
+    banTreeValid = qtrue;
+}
+
+/*
+==================
+SV_BanFlags
+
+Collects the flags of every ban and exception covering an address
+==================
+*/
+static int SV_BanFlags(netadr_t *from) {
+    const byte *addr;
+    int bit, bits, node, flags;
+
+    if (!banTreeValid) {
+        SV_BuildBanTree();
+    }
+
+    if (from->type == NA_LOOPBACK) {
+        return banLoopbackFlags;
+    }
+
+    addr = SV_BanAddressBits(from, &node, &bits);
+    if (!addr) {
+        return 0;
+    }
+
+    flags = banNodes[node].flags;
+    for (bit = 0; bit < bits; bit++) {
+        node = banNodes[node].child[(addr[bit >> 3] >> (7 - (bit & 7))) & 1];
+        if (!node) {
+            break;
+        }
+        flags |= banNodes[node].flags;
+    }
+
+    return flags;
+}
+
+/*
+==================
+SV_IsBanned
+
+Check whether a certain address is banned
+==================
+*/
+qboolean SV_IsBanned(netadr_t *from, qboolean isexception) {
+    int flags = SV_BanFlags(from);
+
+    if (isexception) {
+        return (flags & BAN_FLAG_EXCEPTION) != 0;
+    }
+
+    // an exception overrides any ban
+    return flags == BAN_FLAG_BAN;
 }
 
 /*
@@ -443,22 +839,14 @@ void SV_DirectConnect(netadr_t from) {
         int ping;
         challenge_t *challengeptr;
 
-        for (i = 0; i < MAX_CHALLENGES; i++) {
-            if (NET_CompareAdr(from, svs.challenges[i].adr)) {
-                if (challenge == svs.challenges[i].challenge)
-                    break;
-            }
-        }
-
-        if (i == MAX_CHALLENGES) {
+        challengeptr = SV_FindChallenge(from, qtrue, challenge);
+        if (!challengeptr) {
             NET_OutOfBandPrint(
                 NS_SERVER, from,
                 "print\nNo or bad challenge for your address.\n");
             return;
         }
 
-        challengeptr = &svs.challenges[i];
-
         if (challengeptr->wasrefused) {
             // Return silently, so that error messages written by the server
             // keep being displayed.
@@ -472,20 +860,23 @@ void SV_DirectConnect(netadr_t from) {
             if (sv_minPing->value && ping < sv_minPing->value) {
                 NET_OutOfBandPrint(NS_SERVER, from,
                                    "print\nServer is for high pings only\n");
-                Com_DPrintf("Client %i rejected on a too low ping\n", i);
+                Com_DPrintf("Client %i rejected on a too low ping\n",
+                            (int)(challengeptr - svs.challenges));
                 challengeptr->wasrefused = qtrue;
                 return;
             }
             if (sv_maxPing->value && ping > sv_maxPing->value) {
                 NET_OutOfBandPrint(NS_SERVER, from,
                                    "print\nServer is for low pings only\n");
-                Com_DPrintf("Client %i rejected on a too high ping\n", i);
+                Com_DPrintf("Client %i rejected on a too high ping\n",
+                            (int)(challengeptr - svs.challenges));
                 challengeptr->wasrefused = qtrue;
                 return;
             }
         }
 
-        Com_Printf("Client %i connecting with %i challenge ping\n", i, ping);
+        Com_Printf("Client %i connecting with %i challenge ping\n",
+                   (int)(challengeptr - svs.challenges), ping);
         challengeptr->connected = qtrue;
     }
 
@@ -629,6 +1020,7 @@ gotnewcl:
     Com_DPrintf("Going from CS_FREE to CS_CONNECTED for %s\n", newcl->name);
 
     newcl->state = CS_CONNECTED;
+    SV_QueryResponsesChanged();
     newcl->lastSnapshotTime = 0;
     newcl->lastPacketTime = svs.time;
     newcl->lastConnectTime = svs.time;
@@ -696,13 +1088,9 @@ void SV_DropClient(client_t *drop, const char *reason) {
 
     if (!isBot) {
         // see if we already have a challenge for this ip
-        challenge = &svs.challenges[0];
-
-        for (i = 0; i < MAX_CHALLENGES; i++, challenge++) {
-            if (NET_CompareAdr(drop->netchan.remoteAddress, challenge->adr)) {
-                Com_Memset(challenge, 0, sizeof(*challenge));
-                break;
-            }
+        challenge = SV_FindChallenge(drop->netchan.remoteAddress, qfalse, 0);
+        if (challenge) {
+            SV_FreeChallenge(challenge);
         }
     }
 
@@ -734,6 +1122,7 @@ void SV_DropClient(client_t *drop, const char *reason) {
         Com_DPrintf("Going to CS_ZOMBIE for %s\n", drop->name);
         drop->state = CS_ZOMBIE; // become free in a few seconds
     }
+    SV_QueryResponsesChanged();
 
     // if this was the last client on the server, send a heartbeat
     // to the master so it is known the server is empty
@@ -761,8 +1150,6 @@ the wrong gamestate.
 ================
 */
 static void SV_SendClientGameState(client_t *client) {
-    int start;
-    entityState_t *base, nullstate;
     msg_t msg;
     byte msgBuffer[MAX_MSGLEN];
     msg_t msg_fake;
@@ -796,25 +1183,8 @@ static void SV_SendClientGameState(client_t *client) {
     MSG_WriteByte(&msg, svc_gamestate);
     MSG_WriteLong(&msg, client->reliableSequence);
 
-    // write the configstrings
-    for (start = 0; start < MAX_CONFIGSTRINGS; start++) {
-        if (sv.configstrings[start][0]) {
-            MSG_WriteByte(&msg, svc_configstring);
-            MSG_WriteShort(&msg, start);
-            MSG_WriteBigString(&msg, sv.configstrings[start]);
-        }
-    }
-
-    // write the baselines
-    Com_Memset(&nullstate, 0, sizeof(nullstate));
-    for (start = 0; start < MAX_GENTITIES; start++) {
-        base = &sv.svEntities[start].baseline;
-        if (!base->number) {
-            continue;
-        }
-        MSG_WriteByte(&msg, svc_baseline);
-        MSG_WriteDeltaEntity(&msg, &nullstate, base, qtrue);
-    }
+    // write the configstrings and baselines
+    SV_WriteGamestate(&msg);
 
     MSG_WriteByte(&msg, svc_EOF);
 
@@ -837,6 +1207,8 @@ void SV_ClientEnterWorld(client_t *client, usercmd_t *cmd) {
     sharedEntity_t *ent;
 
     Com_DPrintf("Going from CS_PRIMED to CS_ACTIVE for %s\n", client->name);
+    // the pending changes are relative to what the others have
+    SV_FlushConfigstrings();
     client->state = CS_ACTIVE;
 
     // resend all configstrings using the cs commands since these are
@@ -874,6 +1246,78 @@ CLIENT COMMAND EXECUTION
 ============================================================
 */
 
+/*
+==================
+SV_LoadDownload
+
+Returns the shared copy of a file opened for download, reading it in if no
+other client is downloading it. The file size and modification time must
+match, so a pk3 that changed on disk since is read again. The file is copied
+rather than mapped: an admin replacing a pk3 in place would otherwise crash
+the server on the next block sent from the mapping.
+==================
+*/
+#define MAX_DOWNLOAD_FILES 16
+
+static downloadFile_t downloadFiles[MAX_DOWNLOAD_FILES];
+
+static downloadFile_t *SV_LoadDownload(const char *name, fileHandle_t f,
+                                       int size) {
+    downloadFile_t *file, *unused = NULL;
+    int i, mtime;
+
+    mtime = FS_FileModifiedTime(f);
+
+    for (i = 0, file = downloadFiles; i < MAX_DOWNLOAD_FILES; i++, file++) {
+        if (!file->refs) {
+            if (!unused) {
+                unused = file;
+            }
+        } else if (file->length == size && file->mtime == mtime &&
+                   mtime != -1 && !Q_stricmp(file->name, name)) {
+            file->refs++;
+            return file;
+        }
+    }
+
+    if (!unused || size <= 0) {
+        return NULL;
+    }
+
+    unused->data = malloc(size);
+    if (!unused->data) {
+        return NULL;
+    }
+    if (FS_Read(unused->data, size, f) != size) {
+        free(unused->data);
+        unused->data = NULL;
+        // the caller falls back to reading it block by block
+        FS_Seek(f, 0, FS_SEEK_SET);
+        return NULL;
+    }
+
+    Q_strncpyz(unused->name, name, sizeof(unused->name));
+    unused->length = size;
+    unused->mtime = mtime;
+    unused->refs = 1;
+
+    return unused;
+}
+
+/*
+==================
+SV_ReleaseDownload
+==================
+*/
+static void SV_ReleaseDownload(downloadFile_t *file) {
+    if (--file->refs > 0) {
+        return;
+    }
+
+    free(file->data);
+    Com_Memset(file, 0, sizeof(*file));
+}
+
 /*
 ==================
 SV_CloseDownload
@@ -889,6 +1333,10 @@ static void SV_CloseDownload(client_t *cl) {
         FS_FCloseFile(cl->download);
     }
     cl->download = 0;
+    if (cl->downloadFile) {
+        SV_ReleaseDownload(cl->downloadFile);
+        cl->downloadFile = NULL;
+    }
     *cl->downloadName = 0;
 
     // Free the temporary buffer space
@@ -981,6 +1429,36 @@ static void SV_BeginDownload_f(client_t *cl) {
     Q_strncpyz(cl->downloadName, Cmd_Argv(1), sizeof(cl->downloadName));
 }
 
+/*
+==================
+SV_StartDownload
+
+Sets up the transfer of a file just opened into cl->download. Shared files
+are sent from one copy in memory in larger blocks, the rest is read block by
+block into the client's window buffers.
+==================
+*/
+static void SV_StartDownload(client_t *cl, qboolean share) {
+    cl->downloadFile = share ? SV_LoadDownload(cl->downloadName, cl->download,
+                                               cl->downloadSize)
+                             : NULL;
+
+    if (cl->downloadFile) {
+        FS_FCloseFile(cl->download);
+        cl->download = 0;
+        cl->downloadBlockLength = sv_dlBlockSize->integer;
+    } else {
+        cl->downloadBlockLength = MAX_DOWNLOAD_BLKSIZE;
+    }
+    cl->downloadWindow = sv_dlWindow->integer;
+
+    cl->downloadCurrentBlock = cl->downloadClientBlock =
+        cl->downloadXmitBlock = 0;
+    cl->downloadCount = 0;
+    cl->downloadEOF = qfalse;
+    cl->downloadDeficit = 0;
+}
+
 /*
 ==================
 SV_WriteDownloadToClient
@@ -999,7 +1477,7 @@ int SV_WriteDownloadToClient(client_t *cl, msg_t *msg) {
     if (!*cl->downloadName)
         return 0; // Nothing being downloaded
 
-    if (!cl->download) {
+    if (!cl->download && !cl->downloadFile) {
         qboolean idPack = qfalse;
 
         // Chop off filename extension.
@@ -1112,20 +1590,26 @@ int SV_WriteDownloadToClient(client_t *cl, msg_t *msg) {
         Com_Printf("clientDownload: %d : beginning \"%s\"\n",
                    (int)(cl - svs.clients), cl->downloadName);
 
-        // Init
-        cl->downloadCurrentBlock = cl->downloadClientBlock =
-            cl->downloadXmitBlock = 0;
-        cl->downloadCount = 0;
-        cl->downloadEOF = qfalse;
+        SV_StartDownload(cl, qtrue);
     }
 
     // Perform any reads that we need to
     while (cl->downloadCurrentBlock - cl->downloadClientBlock <
-               MAX_DOWNLOAD_WINDOW &&
+               cl->downloadWindow &&
            cl->downloadSize != cl->downloadCount) {
 
         curindex = (cl->downloadCurrentBlock % MAX_DOWNLOAD_WINDOW);
 
+        if (cl->downloadFile) {
+            // nothing to read, the block is sent from the shared copy
+            cl->downloadBlockSize[curindex] =
+                MIN(cl->downloadBlockLength,
+                    cl->downloadSize - cl->downloadCount);
+            cl->downloadCount += cl->downloadBlockSize[curindex];
+            cl->downloadCurrentBlock++;
+            continue;
+        }
+
         if (!cl->downloadBlocks[curindex])
             cl->downloadBlocks[curindex] = Z_Malloc(MAX_DOWNLOAD_BLKSIZE);
 
@@ -1147,7 +1631,7 @@ int SV_WriteDownloadToClient(client_t *cl, msg_t *msg) {
     // Check to see if we have eof condition and add the EOF block
     if (cl->downloadCount == cl->downloadSize && !cl->downloadEOF &&
         cl->downloadCurrentBlock - cl->downloadClientBlock <
-            MAX_DOWNLOAD_WINDOW) {
+            cl->downloadWindow) {
 
         cl->downloadBlockSize[cl->downloadCurrentBlock % MAX_DOWNLOAD_WINDOW] =
             0;
@@ -1182,7 +1666,12 @@ int SV_WriteDownloadToClient(client_t *cl, msg_t *msg) {
     MSG_WriteShort(msg, cl->downloadBlockSize[curindex]);
 
     // Write the block
-    if (cl->downloadBlockSize[curindex])
+    if (cl->downloadBlockSize[curindex] && cl->downloadFile)
+        MSG_WriteData(msg,
+                      cl->downloadFile->data +
+                          cl->downloadXmitBlock * cl->downloadBlockLength,
+                      cl->downloadBlockSize[curindex]);
+    else if (cl->downloadBlockSize[curindex])
         MSG_WriteData(msg, cl->downloadBlocks[curindex],
                       cl->downloadBlockSize[curindex]);
 
@@ -1227,38 +1716,179 @@ int SV_SendQueuedMessages(void) {
     return retval;
 }
 
+/*
+==================
+SV_WriteDownloadBlocks
+
+Puts as many blocks into msg as the client is owed bytes this round. Deficit
+round robin: every downloader is owed the same amount each round, whatever
+its block size, and a client that can't take its share doesn't bank it.
+Returns the number of blocks written.
+==================
+*/
+static int SV_WriteDownloadBlocks(client_t *cl, msg_t *msg) {
+    int blocks = 0, cursize;
+
+    cl->downloadDeficit += MAX_DOWNLOAD_SHARED_BLKSIZE;
+
+    while (cl->downloadDeficit > 0 && *cl->downloadName &&
+           msg->cursize + MAX_DOWNLOAD_SHARED_BLKSIZE + 64 <= msg->maxsize) {
+        cursize = msg->cursize;
+        if (!SV_WriteDownloadToClient(cl, msg)) {
+            break;
+        }
+        cl->downloadDeficit -= msg->cursize - cursize;
+        blocks++;
+    }
+
+    if (cl->downloadDeficit > 0) {
+        cl->downloadDeficit = 0;
+    }
+
+    return blocks;
+}
+
 /*
 ==================
 SV_SendDownloadMessages
 
-Send one round of download messages to all clients
+Send one round of download messages to all clients, starting with a
+different client every round. Returns the number of bytes sent.
 ==================
 */
 
 int SV_SendDownloadMessages(void) {
-    int i, numDLs = 0, retval;
+    static int firstClient;
+    int i, n, bytes = 0;
     client_t *cl;
     msg_t msg;
     byte msgBuffer[MAX_MSGLEN];
 
-    for (i = 0; i < sv_maxclients->integer; i++) {
+    for (n = 0; n < sv_maxclients->integer; n++) {
+        i = (firstClient + n) % sv_maxclients->integer;
         cl = &svs.clients[i];
 
         if (cl->state && *cl->downloadName) {
             MSG_Init(&msg, msgBuffer, sizeof(msgBuffer));
             MSG_WriteLong(&msg, cl->lastClientCommand);
 
-            retval = SV_WriteDownloadToClient(cl, &msg);
-
-            if (retval) {
+            if (SV_WriteDownloadBlocks(cl, &msg)) {
                 MSG_WriteByte(&msg, svc_EOF);
                 SV_Netchan_Transmit(cl, &msg);
-                numDLs += retval;
+                bytes += msg.cursize;
+            }
+        }
+    }
+    firstClient++;
+
+    return bytes;
+}
+
+/*
+==================
+SV_DownloadBench_f
+
+dlbench [clients] [kbytes]
+Serves a scratch file to up to 32 simulated clients that acknowledge
+every block at once, first reading it block by block, then from the shared
+copy in memory, and prints the throughput of each
+==================
+*/
+#define DLBENCH_MAX_KBYTES (256 * 1024)
+
+void SV_DownloadBench_f(void) {
+    char name[MAX_QPATH];
+    client_t *clients, *cl;
+    fileHandle_t f;
+    msg_t msg;
+    byte msgBuffer[MAX_MSGLEN];
+    byte *data;
+    int numClients, size, i, mode, active, start, msec;
+    int bytes, blocks, block, seed;
+    int64_t delivered;
+
+    numClients = 16;
+    size = 16 * 1024 * 1024;
+    if (Cmd_Argc() > 1) {
+        numClients = atoi(Cmd_Argv(1));
+    }
+    if (Cmd_Argc() > 2) {
+        size = MIN(atoi(Cmd_Argv(2)), DLBENCH_MAX_KBYTES) * 1024;
+    }
+    if (numClients <= 0 || size <= 0) {
+        return;
+    }
+    // every simulated client holds a file handle while reading
+    numClients = MIN(numClients, MAX_FILE_HANDLES / 2);
+
+    // download names are relative to the homepath, like gamedir/map.pk3
+    Com_sprintf(name, sizeof(name), "%s/dlbench.tmp", FS_GetCurrentGameDir());
+    f = FS_SV_FOpenFileWrite(name);
+    if (!f) {
+        Com_Printf("dlbench: can't write %s\n", name);
+        return;
+    }
+    data = Z_Malloc(64 * 1024);
+    seed = 0x1234;
+    for (i = 0; i < size; i += 64 * 1024) {
+        for (bytes = 0; bytes < 64 * 1024; bytes++) {
+            data[bytes] = Q_rand(&seed);
+        }
+        FS_Write(data, MIN(64 * 1024, size - i), f);
+    }
+    FS_FCloseFile(f);
+    Z_Free(data);
+
+    clients = Z_Malloc(numClients * sizeof(*clients));
+
+    for (mode = 0; mode < 2; mode++) {
+        for (i = 0, cl = clients; i < numClients; i++, cl++) {
+            Q_strncpyz(cl->downloadName, name, sizeof(cl->downloadName));
+            cl->downloadSize = FS_SV_FOpenFileRead(name, &cl->download);
+            SV_StartDownload(cl, mode);
+        }
+
+        bytes = blocks = delivered = 0;
+        start = Sys_Milliseconds();
+        do {
+            active = 0;
+            for (i = 0, cl = clients; i < numClients; i++, cl++) {
+                if (!*cl->downloadName) {
+                    continue;
+                }
+                active++;
+
+                MSG_Init(&msg, msgBuffer, sizeof(msgBuffer));
+                MSG_WriteLong(&msg, 0);
+                blocks += SV_WriteDownloadBlocks(cl, &msg);
+                bytes += msg.cursize;
+
+                // acknowledge everything sent, as SV_NextDownload_f would
+                while (cl->downloadClientBlock < cl->downloadXmitBlock) {
+                    block = cl->downloadBlockSize[cl->downloadClientBlock %
+                                                  MAX_DOWNLOAD_WINDOW];
+                    if (!block) {
+                        SV_CloseDownload(cl);
+                        break;
+                    }
+                    delivered += block;
+                    cl->downloadClientBlock++;
+                }
             }
+        } while (active);
+        msec = Sys_Milliseconds() - start;
+
+        Com_Printf("%s: %i clients, %i blocks, %i KB in %i msec, %.1f MB/s\n",
+                   mode ? "shared" : "read", numClients, blocks, bytes / 1024,
+                   msec, bytes / 1048576.0 / (msec ? msec / 1000.0 : 0.001));
+        if (delivered != (int64_t)numClients * size) {
+            Com_Printf("dlbench: %lld bytes delivered, expected %lld\n",
+                       (long long)delivered, (long long)numClients * size);
         }
     }
 
-    return numDLs;
+    Z_Free(clients);
+    FS_HomeRemove("dlbench.tmp");
 }
 
 /*
@@ -1463,6 +2093,7 @@ void SV_UserinfoChanged(client_t *cl) {
     // name for C code
     Q_strncpyz(cl->name, Info_ValueForKey(cl->userinfo, "name"),
                sizeof(cl->name));
+    SV_QueryResponsesChanged();
 
     // rate command
 
@@ -1515,6 +2146,13 @@ void SV_UserinfoChanged(client_t *cl) {
         cl->snapshotMsec = i;
     }
 
+#ifdef LEGACY_PROTOCOL
+    if (cl->compat)
+        cl->csBatch = qfalse;
+    else
+#endif
+        cl->csBatch = atoi(Info_ValueForKey(cl->userinfo, "cl_csBatch")) > 0;
+
 #ifdef USE_VOIP
 #ifdef LEGACY_PROTOCOL
     if (cl->compat)
@@ -1774,6 +2412,8 @@ static void SV_UserMove(client_t *cl, msg_t *msg, qboolean delta) {
     // save time for ping calculation
     cl->frames[cl->messageAcknowledge & PACKET_MASK].messageAcked = svs.time;
 
+    SV_UpdateRateControl(cl, Sys_Milliseconds());
+
     // TTimo
     // catch the no-cp-yet situation before SV_ClientEnterWorld
     // if CS_ACTIVE, then it's time to trigger a new gamestate emission
@@ -358,6 +358,15 @@ intptr_t SV_GameSystemCalls(intptr_t *args) {
         SV_Trace(VMA(1), VMA(2), VMA(3), VMA(4), VMA(5), args[6], args[7],
                  /*int capsule*/ qtrue);
         return 0;
+    case G_TRACE_BATCH:
+        if (args[3] < 0 || args[3] > MAX_TRACE_BATCH) {
+            Com_Error(ERR_DROP, "SV_GameSystemCalls: bad trace batch size %i",
+                      (int)args[3]);
+        }
+        SV_TraceBatch(VM_ArgArray(args[1], args[3] * sizeof(trace_t)),
+                      VM_ArgArray(args[2], args[3] * sizeof(traceRequest_t)),
+                      args[3]);
+        return 0;
     case G_POINT_CONTENTS:
         return SV_PointContents(VMA(1), args[2]);
     case G_SET_BRUSH_MODEL:
@@ -0,0 +1,957 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+Copyright (C) 2005-2012 Smokin' Guns
+
+This file is part of Smokin' Guns.
+
+Smokin' Guns is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Smokin' Guns is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Smokin' Guns; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// sv_http.c -- built in HTTP server for sv_dlURL downloads
+
+#include "server.h"
+
+/*
+=============================================================================
+
+HTTP DOWNLOADS
+
+With sv_httpPort set the server answers HTTP/1.1 GET and HEAD requests for
+the pk3s clients may download, so sv_dlURL can point at the game server
+itself instead of a separate web server. Requests are served by one thread
+polling non-blocking sockets. The bodies go out with sendfile where there
+is one, or are read from the pk3 a chunk at a time. The pk3s are never
+mapped, an admin may replace one in place while it is being sent.
+
+The thread never touches the filesystem or any other engine state. The main
+thread opens the downloadable pk3s when a map is loaded and publishes them
+under httpMutex, which is only held for list and reference count updates.
+
+The listening socket follows net_enabled: dual stack IPv6 when both protocols
+are enabled, otherwise the one that is. Windows has no HTTP server yet.
+
+=============================================================================
+*/
+
+#ifdef USE_HTTP_SERVER
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define MAX_HTTP_CONNECTIONS 64
+#define HTTP_REQUEST_SIZE 4096
+#define HTTP_HEADER_SIZE 512
+#define HTTP_TIMEOUT 30000        // msec without progress
+#define HTTP_SEND_CHUNK (1 << 20) // bytes handed to the kernel per call
+#define HTTP_READ_CHUNK (64 * 1024) // without sendfile
+
+typedef struct httpFile_s {
+    char path[MAX_QPATH]; // gamedir/name.pk3, as in the request
+    FILE *file;
+    int length;
+    int refs; // responses sending it, guarded by httpMutex
+    struct httpFile_s *next;
+} httpFile_t;
+
+typedef struct {
+    int socket; // -1 when free
+    int lastActive;
+
+    char request[HTTP_REQUEST_SIZE];
+    int requestLength;
+
+    char header[HTTP_HEADER_SIZE];
+    int headerLength;
+    int headerSent;
+
+    httpFile_t *file; // body being sent, holds a reference
+    int offset;       // next body byte
+    int end;          // one past the last body byte
+    qboolean keepAlive;
+} httpConnection_t;
+
+static pthread_t httpThread;
+static pthread_mutex_t httpMutex = PTHREAD_MUTEX_INITIALIZER;
+static qboolean httpRunning;
+static volatile qboolean httpQuit;
+static int httpWakePipe[2];
+static int httpListenSocket;
+static int httpMaxConnections;
+
+static httpFile_t *httpFiles;   // served, guarded by httpMutex
+static httpFile_t *httpRetired; // still referenced, guarded by httpMutex
+static httpConnection_t httpConnections[MAX_HTTP_CONNECTIONS];
+
+/*
+==================
+SV_HTTPCloseFile
+==================
+*/
+static void SV_HTTPCloseFile(httpFile_t *file) {
+    fclose(file->file);
+    Z_Free(file);
+}
+
+/*
+==================
+SV_HTTPOpenFile
+
+Looks for a pk3 where FS_SV_FOpenFileRead would
+==================
+*/
+static httpFile_t *SV_HTTPOpenFile(const char *path) {
+    const char *bases[2];
+    httpFile_t *file;
+    char *ospath;
+    FILE *f = NULL;
+    int i;
+
+    bases[0] = Cvar_VariableString("fs_homepath");
+    bases[1] = Cvar_VariableString("fs_basepath");
+
+    for (i = 0; i < 2 && !f; i++) {
+        ospath = FS_BuildOSPath(bases[i], path, "");
+        ospath[strlen(ospath) - 1] = '\0';
+        f = Sys_FOpen(ospath, "rb");
+    }
+    if (!f) {
+        return NULL;
+    }
+
+    file = Z_Malloc(sizeof(*file));
+    Q_strncpyz(file->path, path, sizeof(file->path));
+    file->file = f;
+
+    fseek(f, 0, SEEK_END);
+    file->length = ftell(f);
+    if (file->length <= 0) {
+        Z_Free(file);
+        fclose(f);
+        return NULL;
+    }
+
+    return file;
+}
+
+/*
+==================
+SV_HTTPFreeRetired
+
+Closes the files no longer served once the last response using them is done
+==================
+*/
+static void SV_HTTPFreeRetired(void) {
+    httpFile_t **link, *file;
+
+    pthread_mutex_lock(&httpMutex);
+    for (link = &httpRetired; (file = *link) != NULL;) {
+        if (file->refs) {
+            link = &file->next;
+            continue;
+        }
+        *link = file->next;
+        SV_HTTPCloseFile(file);
+    }
+    pthread_mutex_unlock(&httpMutex);
+}
+
+/*
+==================
+SV_HTTPFindFile
+
+Takes a reference, called from the HTTP thread
+==================
+*/
+static httpFile_t *SV_HTTPFindFile(const char *path) {
+    httpFile_t *file;
+
+    pthread_mutex_lock(&httpMutex);
+    for (file = httpFiles; file; file = file->next) {
+        if (!Q_stricmp(file->path, path)) {
+            file->refs++;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&httpMutex);
+
+    return file;
+}
+
+/*
+==================
+SV_HTTPReleaseFile
+==================
+*/
+static void SV_HTTPReleaseFile(httpFile_t *file) {
+    pthread_mutex_lock(&httpMutex);
+    file->refs--;
+    pthread_mutex_unlock(&httpMutex);
+}
+
+/*
+==================
+SV_HTTPCloseConnection
+==================
+*/
+static void SV_HTTPCloseConnection(httpConnection_t *conn) {
+    if (conn->file) {
+        SV_HTTPReleaseFile(conn->file);
+        conn->file = NULL;
+    }
+    close(conn->socket);
+    conn->socket = -1;
+}
+
+/*
+==================
+SV_HTTPAccept
+==================
+*/
+static void SV_HTTPAccept(int now) {
+    httpConnection_t *conn;
+    int s, i, one = 1;
+
+    // when full, the rest wait in the listen backlog
+
+    for (i = 0; i < httpMaxConnections; i++) {
+        if (httpConnections[i].socket >= 0) {
+            continue;
+        }
+        s = accept(httpListenSocket, NULL, NULL);
+        if (s < 0) {
+            break;
+        }
+
+        fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+        setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+        (void)one;
+
+        conn = &httpConnections[i];
+        Com_Memset(conn, 0, sizeof(*conn));
+        conn->socket = s;
+        conn->lastActive = now;
+    }
+}
+
+/*
+==================
+SV_HTTPHexDigit
+==================
+*/
+static int SV_HTTPHexDigit(int c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/*
+==================
+SV_HTTPDecodePath
+
+Turns the request target into a file path, NULL if it is malformed
+==================
+*/
+static char *SV_HTTPDecodePath(char *target) {
+    char *in, *out;
+    int hi, lo;
+
+    if (*target != '/') {
+        return NULL;
+    }
+
+    for (in = out = target + 1; *in && *in != '?' && *in != '#'; in++) {
+        if (*in == '%') {
+            hi = SV_HTTPHexDigit(in[1]);
+            lo = hi < 0 ? -1 : SV_HTTPHexDigit(in[2]);
+            if (lo < 0) {
+                return NULL;
+            }
+            *out++ = hi << 4 | lo;
+            in += 2;
+        } else {
+            *out++ = *in;
+        }
+    }
+    *out = '\0';
+
+    return target + 1;
+}
+
+/*
+==================
+SV_HTTPParseRange
+
+Handles a single "bytes=first-last", "bytes=first-" or "bytes=-suffix".
+Returns qfalse when the header should be ignored, and sets *first past the
+end of the file when the range can't be satisfied.
+==================
+*/
+static qboolean SV_HTTPParseRange(const char *value, int length, int *first,
+                                  int *last) {
+    char *end;
+    long a, b;
+
+    while (*value == ' ') {
+        value++;
+    }
+    if (Q_stricmpn(value, "bytes=", 6) || strchr(value, ',')) {
+        return qfalse;
+    }
+    value += 6;
+
+    if (*value == '-') {
+        b = strtol(value + 1, &end, 10);
+        if (end == value + 1 || b < 0) {
+            return qfalse;
+        }
+        if (b == 0) {
+            *first = length;
+            return qtrue;
+        }
+        *first = b < length ? length - b : 0;
+        *last = length - 1;
+        return qtrue;
+    }
+
+    a = strtol(value, &end, 10);
+    if (end == value || *end != '-' || a < 0) {
+        return qfalse;
+    }
+    value = end + 1;
+    b = length - 1;
+    if (*value >= '0' && *value <= '9') {
+        b = strtol(value, &end, 10);
+        if (b < a) {
+            return qfalse;
+        }
+    }
+
+    *first = a < length ? a : length;
+    *last = b < length ? b : length - 1;
+    return qtrue;
+}
+
+/*
+==================
+SV_HTTPRespond
+
+Parses the complete request at the start of conn->request and sets up the
+header and body to send
+==================
+*/
+static void SV_HTTPRespond(httpConnection_t *conn, int requestEnd) {
+    char *line, *next, *value, *method, *target, *version, *path;
+    const char *status, *connection;
+    int first = 0, last = 0, length;
+    qboolean head, ranged;
+    char range[128], extra[128];
+
+    conn->request[requestEnd - 2] = '\0';
+    line = conn->request;
+    next = strstr(line, "\r\n");
+    if (next) {
+        *next = '\0';
+        next += 2;
+    }
+
+    // request line
+    method = line;
+    target = strchr(method, ' ');
+    version = target ? strchr(target + 1, ' ') : NULL;
+    if (!version) {
+        method = NULL;
+    } else {
+        *target++ = '\0';
+        *version++ = '\0';
+    }
+
+    conn->keepAlive = version && !Q_stricmp(version, "HTTP/1.1");
+    ranged = qfalse;
+    range[0] = '\0';
+
+    for (line = next; line && *line; line = next) {
+        next = strstr(line, "\r\n");
+        if (next) {
+            *next = '\0';
+            next += 2;
+        }
+        value = strchr(line, ':');
+        if (!value) {
+            continue;
+        }
+        *value++ = '\0';
+        while (*value == ' ') {
+            value++;
+        }
+
+        if (!Q_stricmp(line, "Connection")) {
+            if (Q_stristr(value, "close")) {
+                conn->keepAlive = qfalse;
+            } else if (Q_stristr(value, "keep-alive")) {
+                conn->keepAlive = qtrue;
+            }
+        } else if (!Q_stricmp(line, "Range")) {
+            Q_strncpyz(range, value, sizeof(range));
+        }
+    }
+
+    head = method && !strcmp(method, "HEAD");
+    path = method ? SV_HTTPDecodePath(target) : NULL;
+    length = 0;
+
+    if (!method || !path || Q_strncmp(version, "HTTP/1.", 7)) {
+        status = "400 Bad Request";
+        conn->keepAlive = qfalse;
+    } else if (strcmp(method, "GET") && !head) {
+        status = "405 Method Not Allowed";
+    } else if (!(conn->file = SV_HTTPFindFile(path))) {
+        status = "404 Not Found";
+    } else {
+        length = conn->file->length;
+        first = 0;
+        last = length - 1;
+        status = "200 OK";
+
+        if (range[0] && SV_HTTPParseRange(range, length, &first, &last)) {
+            if (first >= length) {
+                status = "416 Range Not Satisfiable";
+            } else {
+                status = "206 Partial Content";
+                ranged = qtrue;
+            }
+        }
+    }
+
+    connection = conn->keepAlive ? "keep-alive" : "close";
+
+    if (!conn->file || status[0] == '4') {
+        if (conn->file) {
+            SV_HTTPReleaseFile(conn->file);
+            conn->file = NULL;
+        }
+        // va() is not safe to use from this thread
+        extra[0] = '\0';
+        if (length) {
+            Com_sprintf(extra, sizeof(extra), "Content-Range: bytes */%i\r\n",
+                        length);
+        }
+        Com_sprintf(conn->header, sizeof(conn->header),
+                    "HTTP/1.1 %s\r\n"
+                    "%s"
+                    "Content-Length: 0\r\n"
+                    "Connection: %s\r\n\r\n",
+                    status, extra, connection);
+    } else {
+        extra[0] = '\0';
+        if (ranged) {
+            Com_sprintf(extra, sizeof(extra),
+                        "Content-Range: bytes %i-%i/%i\r\n", first, last,
+                        length);
+        }
+        Com_sprintf(conn->header, sizeof(conn->header),
+                    "HTTP/1.1 %s\r\n"
+                    "Content-Type: application/octet-stream\r\n"
+                    "Content-Length: %i\r\n"
+                    "Accept-Ranges: bytes\r\n"
+                    "%s"
+                    "Connection: %s\r\n\r\n",
+                    status, last - first + 1, extra, connection);
+        conn->offset = first;
+        conn->end = head ? first : last + 1;
+    }
+
+    conn->headerLength = strlen(conn->header);
+    conn->headerSent = 0;
+
+    // keep anything pipelined after this request
+    conn->requestLength -= requestEnd;
+    memmove(conn->request, conn->request + requestEnd, conn->requestLength);
+}
+
+/*
+==================
+SV_HTTPCheckRequest
+
+Starts a response if a whole request has arrived
+==================
+*/
+static void SV_HTTPCheckRequest(httpConnection_t *conn) {
+    char *end;
+
+    conn->request[conn->requestLength] = '\0';
+    end = strstr(conn->request, "\r\n\r\n");
+    if (end) {
+        SV_HTTPRespond(conn, end + 4 - conn->request);
+    } else if (conn->requestLength >= HTTP_REQUEST_SIZE - 1) {
+        // headers this long are not from a download client
+        SV_HTTPCloseConnection(conn);
+    }
+}
+
+/*
+==================
+SV_HTTPRead
+==================
+*/
+static void SV_HTTPRead(httpConnection_t *conn) {
+    int n;
+
+    n = recv(conn->socket, conn->request + conn->requestLength,
+             HTTP_REQUEST_SIZE - 1 - conn->requestLength, 0);
+    if (n <= 0) {
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK &&
+                       errno != EINTR)) {
+            SV_HTTPCloseConnection(conn);
+        }
+        return;
+    }
+
+    conn->requestLength += n;
+    SV_HTTPCheckRequest(conn);
+}
+
+/*
+==================
+SV_HTTPWrite
+==================
+*/
+static void SV_HTTPWrite(httpConnection_t *conn) {
+    int n, chunk;
+
+    if (conn->headerSent < conn->headerLength) {
+        n = send(conn->socket, conn->header + conn->headerSent,
+                 conn->headerLength - conn->headerSent, MSG_NOSIGNAL);
+    } else {
+        chunk = conn->end - conn->offset;
+        if (chunk > HTTP_SEND_CHUNK) {
+            chunk = HTTP_SEND_CHUNK;
+        }
+#ifdef __linux__
+        {
+            off_t offset = conn->offset;
+
+            n = sendfile(conn->socket, fileno(conn->file->file), &offset,
+                         chunk);
+        }
+#else
+        {
+            static byte buffer[HTTP_READ_CHUNK];
+
+            n = pread(fileno(conn->file->file), buffer,
+                      MIN(chunk, sizeof(buffer)), conn->offset);
+            if (n > 0) {
+                n = send(conn->socket, buffer, n, MSG_NOSIGNAL);
+            }
+        }
+#endif
+    }
+
+    if (n < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            SV_HTTPCloseConnection(conn);
+        }
+        return;
+    }
+
+    // the end of a pk3 truncated since it was published, the response can't
+    // be completed
+    if (!n && conn->headerSent == conn->headerLength) {
+        SV_HTTPCloseConnection(conn);
+        return;
+    }
+
+    if (conn->headerSent < conn->headerLength) {
+        conn->headerSent += n;
+    } else {
+        conn->offset += n;
+    }
+
+    if (conn->headerSent < conn->headerLength || conn->offset < conn->end) {
+        return;
+    }
+
+    // response complete
+    if (conn->file) {
+        SV_HTTPReleaseFile(conn->file);
+        conn->file = NULL;
+    }
+    conn->headerLength = conn->headerSent = 0;
+    conn->offset = conn->end = 0;
+
+    if (!conn->keepAlive) {
+        SV_HTTPCloseConnection(conn);
+        return;
+    }
+    SV_HTTPCheckRequest(conn);
+}
+
+/*
+==================
+SV_HTTPThread
+==================
+*/
+static void *SV_HTTPThread(void *arg) {
+    struct pollfd fds[MAX_HTTP_CONNECTIONS + 2];
+    int slots[MAX_HTTP_CONNECTIONS + 2];
+    httpConnection_t *conn;
+    sigset_t mask;
+    char drain[16];
+    int i, n, now;
+
+    // a client closing early must not kill the server through sendfile
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    while (!httpQuit) {
+        fds[0].fd = httpWakePipe[0];
+        fds[0].events = POLLIN;
+        fds[1].fd = httpListenSocket;
+        fds[1].events = 0;
+        n = 2;
+
+        for (i = 0; i < httpMaxConnections; i++) {
+            conn = &httpConnections[i];
+            if (conn->socket < 0) {
+                fds[1].events = POLLIN;
+                continue;
+            }
+            fds[n].fd = conn->socket;
+            fds[n].events = conn->headerLength ? POLLOUT : POLLIN;
+            slots[n] = i;
+            n++;
+        }
+
+        if (poll(fds, n, 1000) < 0 && errno != EINTR) {
+            break;
+        }
+        now = Sys_Milliseconds();
+
+        if (fds[0].revents & POLLIN) {
+            while (read(httpWakePipe[0], drain, sizeof(drain)) > 0) {
+            }
+        }
+        if (fds[1].revents & POLLIN) {
+            SV_HTTPAccept(now);
+        }
+
+        for (i = 2; i < n; i++) {
+            if (!fds[i].revents) {
+                continue;
+            }
+            conn = &httpConnections[slots[i]];
+            conn->lastActive = now;
+
+            if (fds[i].revents & (POLLERR | POLLNVAL)) {
+                SV_HTTPCloseConnection(conn);
+            } else if (fds[i].revents & POLLOUT) {
+                SV_HTTPWrite(conn);
+            } else if (fds[i].revents & (POLLIN | POLLHUP)) {
+                SV_HTTPRead(conn);
+            }
+        }
+
+        for (i = 0; i < httpMaxConnections; i++) {
+            conn = &httpConnections[i];
+            if (conn->socket >= 0 && now - conn->lastActive > HTTP_TIMEOUT) {
+                SV_HTTPCloseConnection(conn);
+            }
+        }
+    }
+
+    for (i = 0; i < httpMaxConnections; i++) {
+        if (httpConnections[i].socket >= 0) {
+            SV_HTTPCloseConnection(&httpConnections[i]);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+==================
+SV_HTTPStop
+==================
+*/
+static void SV_HTTPStop(void) {
+    httpFile_t *file;
+
+    if (!httpRunning) {
+        return;
+    }
+
+    httpQuit = qtrue;
+    if (write(httpWakePipe[1], "", 1) < 0) {
+        // the thread still notices within a second
+    }
+    pthread_join(httpThread, NULL);
+    httpRunning = qfalse;
+
+    close(httpListenSocket);
+    close(httpWakePipe[0]);
+    close(httpWakePipe[1]);
+
+    while ((file = httpFiles) != NULL) {
+        httpFiles = file->next;
+        SV_HTTPCloseFile(file);
+    }
+    SV_HTTPFreeRetired();
+
+    Com_Printf("HTTP download server stopped\n");
+}
+
+/*
+==================
+SV_HTTPListen
+
+Opens the listening socket, IPv6 if it is enabled and also accepting IPv4
+when that is enabled too
+==================
+*/
+static int SV_HTTPListen(int port) {
+    struct sockaddr_in addr;
+    struct sockaddr_in6 addr6;
+    int s, enabled, v6only, one = 1;
+
+    enabled = Cvar_VariableIntegerValue("net_enabled");
+
+    if (enabled & NET_ENABLEV6) {
+        s = socket(AF_INET6, SOCK_STREAM, 0);
+        if (s >= 0) {
+            setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            v6only = !(enabled & NET_ENABLEV4);
+            setsockopt(s, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only));
+
+            Com_Memset(&addr6, 0, sizeof(addr6));
+            addr6.sin6_family = AF_INET6;
+            addr6.sin6_addr = in6addr_any;
+            addr6.sin6_port = htons(port);
+
+            if (!bind(s, (struct sockaddr *)&addr6, sizeof(addr6)) &&
+                !listen(s, 64)) {
+                return s;
+            }
+            Com_Printf("WARNING: SV_HTTPListen: IPv6 port %i: %s\n", port,
+                       strerror(errno));
+            close(s);
+        }
+    }
+
+    if (!(enabled & NET_ENABLEV4)) {
+        return -1;
+    }
+
+    s = socket(AF_INET, SOCK_STREAM, 0);
+    if (s < 0) {
+        Com_Printf("WARNING: SV_HTTPListen: socket: %s\n", strerror(errno));
+        return -1;
+    }
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    Com_Memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+
+    if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) || listen(s, 64)) {
+        Com_Printf("WARNING: SV_HTTPListen: port %i: %s\n", port,
+                   strerror(errno));
+        close(s);
+        return -1;
+    }
+
+    return s;
+}
+
+/*
+==================
+SV_HTTPStart
+==================
+*/
+static void SV_HTTPStart(int port) {
+    int i;
+
+    httpListenSocket = SV_HTTPListen(port);
+    if (httpListenSocket < 0) {
+        return;
+    }
+
+    if (pipe(httpWakePipe)) {
+        Com_Printf("WARNING: SV_HTTPStart: pipe: %s\n", strerror(errno));
+        close(httpListenSocket);
+        return;
+    }
+    fcntl(httpListenSocket, F_SETFL,
+          fcntl(httpListenSocket, F_GETFL) | O_NONBLOCK);
+    fcntl(httpWakePipe[0], F_SETFL,
+          fcntl(httpWakePipe[0], F_GETFL) | O_NONBLOCK);
+
+    httpMaxConnections = sv_httpConnections->integer;
+    for (i = 0; i < MAX_HTTP_CONNECTIONS; i++) {
+        httpConnections[i].socket = -1;
+    }
+
+    httpQuit = qfalse;
+    if (pthread_create(&httpThread, NULL, SV_HTTPThread, NULL)) {
+        Com_Printf("WARNING: SV_HTTPStart: pthread_create: %s\n",
+                   strerror(errno));
+        close(httpListenSocket);
+        close(httpWakePipe[0]);
+        close(httpWakePipe[1]);
+        return;
+    }
+
+    httpRunning = qtrue;
+    Com_Printf("HTTP download server listening on port %i\n", port);
+}
+
+/*
+==================
+SV_HTTPUpdateFiles
+
+Publishes the pk3s clients may download for the current map, the same ones
+SV_WriteDownloadToClient would send
+==================
+*/
+void SV_HTTPUpdateFiles(void) {
+    httpFile_t *served = NULL, *file, **link;
+    const char *s;
+    char name[MAX_QPATH];
+    int len;
+
+    if (!httpRunning) {
+        return;
+    }
+
+    if ((sv_allowDownload->integer & DLF_ENABLE) &&
+        !(sv_allowDownload->integer & DLF_NO_REDIRECT)) {
+        for (s = FS_ReferencedPakNames(); *s;) {
+            while (*s == ' ') {
+                s++;
+            }
+            for (len = 0; s[len] && s[len] != ' '; len++) {
+            }
+            if (!len) {
+                break;
+            }
+            Q_strncpyz(name, s, MIN(len + 1, (int)sizeof(name) - 4));
+            s += len;
+
+            if (FS_idPak(name, BASEGAME, NUM_ID_PAKS)) {
+                continue;
+            }
+            Q_strcat(name, sizeof(name), ".pk3");
+
+            // keep files that were already served
+            pthread_mutex_lock(&httpMutex);
+            for (link = &httpFiles; (file = *link) != NULL;
+                 link = &file->next) {
+                if (!Q_stricmp(file->path, name)) {
+                    *link = file->next;
+                    break;
+                }
+            }
+            pthread_mutex_unlock(&httpMutex);
+
+            if (!file) {
+                file = SV_HTTPOpenFile(name);
+            }
+            if (file) {
+                file->next = served;
+                served = file;
+            }
+        }
+    }
+
+    pthread_mutex_lock(&httpMutex);
+    while ((file = httpFiles) != NULL) {
+        httpFiles = file->next;
+        file->next = httpRetired;
+        httpRetired = file;
+    }
+    httpFiles = served;
+    pthread_mutex_unlock(&httpMutex);
+
+    SV_HTTPFreeRetired();
+}
+
+/*
+==================
+SV_HTTPFrame
+
+Starts, stops or restarts the HTTP server as sv_httpPort asks
+==================
+*/
+void SV_HTTPFrame(void) {
+    static int lastFree;
+
+    if (sv_httpPort->modified || sv_httpConnections->modified) {
+        sv_httpPort->modified = qfalse;
+        sv_httpConnections->modified = qfalse;
+        SV_HTTPStop();
+
+        if (sv_httpPort->integer > 0) {
+            SV_HTTPStart(sv_httpPort->integer);
+            SV_HTTPUpdateFiles();
+        }
+    }
+
+    if (sv_allowDownload->modified) {
+        sv_allowDownload->modified = qfalse;
+        SV_HTTPUpdateFiles();
+    }
+
+    if (httpRunning && svs.time - lastFree > 1000) {
+        lastFree = svs.time;
+        SV_HTTPFreeRetired();
+    }
+}
+
+/*
+==================
+SV_HTTPShutdown
+==================
+*/
+void SV_HTTPShutdown(void) {
+    SV_HTTPStop();
+
+    // start again with the next map
+    sv_httpPort->modified = qtrue;
+}
+
+#endif
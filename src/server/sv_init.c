@@ -65,6 +65,78 @@ static void SV_SendConfigstring(client_t *client, int index) {
     }
 }
 
+/*
+===============
+SV_SendConfigstrings
+
+Sends the given configstrings to a client, packed into as few "csm" commands
+as fit when it understands them. Each entry is the index, the number of
+leading characters kept from the string the client has, given by bases, and
+the rest of the new string.
+===============
+*/
+static void SV_SendConfigstrings(client_t *client, const int *indexes,
+                                 char *const *bases, int count) {
+    int maxBatchSize = MAX_STRING_CHARS - 24;
+    char batch[MAX_STRING_CHARS];
+    char entry[MAX_STRING_CHARS];
+    const char *base, *val;
+    int i, index, keep, len, entryLen;
+
+    len = 0;
+    for (i = 0; i < count; i++) {
+        index = indexes[i];
+        val = sv.configstrings[index];
+        base = bases ? bases[i] : "";
+
+        // changed back before it was sent
+        if (bases && !strcmp(base, val)) {
+            continue;
+        }
+
+        // do not always send server info to all clients
+        if (index == CS_SERVERINFO && client->gentity &&
+            (client->gentity->r.svFlags & SVF_NOSERVERINFO)) {
+            continue;
+        }
+
+        if (!client->csBatch) {
+            SV_SendConfigstring(client, index);
+            continue;
+        }
+
+        for (keep = 0; val[keep] && val[keep] == base[keep]; keep++) {
+        }
+
+        if (strlen(val + keep) + 32 >= maxBatchSize) {
+            // too big for a batch, fall back to bcs chunks
+            if (len) {
+                SV_SendServerCommand(client, "%s\n", batch);
+                len = 0;
+            }
+            SV_SendConfigstring(client, index);
+            continue;
+        }
+
+        entryLen = Com_sprintf(entry, sizeof(entry), " %i %i \"%s\"", index,
+                               keep, val + keep);
+        if (len && len + entryLen >= maxBatchSize) {
+            SV_SendServerCommand(client, "%s\n", batch);
+            len = 0;
+        }
+
+        if (!len) {
+            len = Com_sprintf(batch, sizeof(batch), "csm");
+        }
+        Com_Memcpy(batch + len, entry, entryLen + 1);
+        len += entryLen;
+    }
+
+    if (len) {
+        SV_SendServerCommand(client, "%s\n", batch);
+    }
+}
+
 /*
 ===============
 SV_UpdateConfigstrings
@@ -74,21 +146,61 @@ Configstring indexes that have changed while the client was in CS_PRIMED
 ===============
 */
 void SV_UpdateConfigstrings(client_t *client) {
-    int index;
+    int indexes[MAX_CONFIGSTRINGS];
+    int index, count;
 
+    count = 0;
     for (index = 0; index < MAX_CONFIGSTRINGS; index++) {
         // if the CS hasn't changed since we went to CS_PRIMED, ignore
         if (!client->csUpdated[index])
             continue;
 
-        // do not always send server info to all clients
-        if (index == CS_SERVERINFO && client->gentity &&
-            (client->gentity->r.svFlags & SVF_NOSERVERINFO)) {
-            continue;
-        }
-        SV_SendConfigstring(client, index);
+        indexes[count++] = index;
         client->csUpdated[index] = qfalse;
     }
+
+    SV_SendConfigstrings(client, indexes, NULL, count);
+}
+
+/*
+===============
+SV_FlushConfigstrings
+
+Sends the configstrings changed since the last flush to the active clients.
+Called before any other server command is queued so the clients see
+everything in the order the server did, and before snapshots go out.
+===============
+*/
+void SV_FlushConfigstrings(void) {
+    int indexes[MAX_CONFIGSTRINGS];
+    char *bases[MAX_CONFIGSTRINGS];
+    client_t *client;
+    int i, count;
+
+    count = sv.numPendingConfigstrings;
+    if (!count) {
+        return;
+    }
+
+    // anything set while sending, by a dropped client for instance, starts
+    // the next batch
+    for (i = 0; i < count; i++) {
+        indexes[i] = sv.pendingConfigstrings[i];
+        bases[i] = sv.configstringBase[indexes[i]];
+        sv.configstringBase[indexes[i]] = NULL;
+    }
+    sv.numPendingConfigstrings = 0;
+
+    for (i = 0, client = svs.clients; i < sv_maxclients->integer;
+         i++, client++) {
+        if (client->state == CS_ACTIVE) {
+            SV_SendConfigstrings(client, indexes, bases, count);
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        Z_Free(bases[i]);
+    }
 }
 
 /*
@@ -114,31 +226,32 @@ void SV_SetConfigstring(int index, const char *val) {
         return;
     }
 
-    // change the string in sv
-    Z_Free(sv.configstrings[index]);
-    sv.configstrings[index] = CopyString(val);
-
     // send it to all the clients if we aren't
     // spawning a new server
     if (sv.state == SS_GAME || sv.restarting) {
 
-        // send the data to all relevent clients
+        // clients still loading get it when they enter the world
         for (i = 0, client = svs.clients; i < sv_maxclients->integer;
              i++, client++) {
-            if (client->state < CS_ACTIVE) {
-                if (client->state == CS_PRIMED)
-                    client->csUpdated[index] = qtrue;
-                continue;
-            }
-            // do not always send server info to all clients
-            if (index == CS_SERVERINFO && client->gentity &&
-                (client->gentity->r.svFlags & SVF_NOSERVERINFO)) {
-                continue;
-            }
+            if (client->state == CS_PRIMED)
+                client->csUpdated[index] = qtrue;
+        }
 
-            SV_SendConfigstring(client, index);
+        // active clients get it with the other changes of the frame, keep
+        // what they have now to send only the difference
+        if (!sv.configstringBase[index]) {
+            sv.configstringBase[index] = sv.configstrings[index];
+            sv.pendingConfigstrings[sv.numPendingConfigstrings++] = index;
+            sv.configstrings[index] = NULL;
         }
     }
+
+    // change the string in sv
+    if (sv.configstrings[index]) {
+        Z_Free(sv.configstrings[index]);
+    }
+    sv.configstrings[index] = CopyString(val);
+    sv.gamestateChanged[index] = qtrue;
 }
 
 /*
@@ -162,6 +275,110 @@ void SV_GetConfigstring(int index, char *buffer, int bufferSize) {
     Q_strncpyz(buffer, sv.configstrings[index], bufferSize);
 }
 
+/*
+===============
+SV_WriteGamestateEntries
+===============
+*/
+static void SV_WriteGamestateEntries(msg_t *msg) {
+    entityState_t *base, nullstate;
+    int start;
+
+    // write the configstrings
+    for (start = 0; start < MAX_CONFIGSTRINGS; start++) {
+        if (sv.configstrings[start][0]) {
+            MSG_WriteByte(msg, svc_configstring);
+            MSG_WriteShort(msg, start);
+            MSG_WriteBigString(msg, sv.configstrings[start]);
+        }
+    }
+
+    // write the baselines
+    Com_Memset(&nullstate, 0, sizeof(nullstate));
+    for (start = 0; start < MAX_GENTITIES; start++) {
+        base = &sv.svEntities[start].baseline;
+        if (!base->number) {
+            continue;
+        }
+        MSG_WriteByte(msg, svc_baseline);
+        MSG_WriteDeltaEntity(msg, &nullstate, base, qtrue);
+    }
+}
+
+/*
+===============
+SV_CacheGamestate
+===============
+*/
+static void SV_CacheGamestate(void) {
+    msg_t msg;
+    int i;
+
+    MSG_Init(&msg, sv.gamestateData, sizeof(sv.gamestateData));
+    SV_WriteGamestateEntries(&msg);
+
+    sv.gamestateCached = !msg.overflowed;
+    sv.gamestateBits = msg.bit;
+    sv.gamestateChars = 0;
+    for (i = 0; i < MAX_CONFIGSTRINGS; i++) {
+        if (sv.configstrings[i][0]) {
+            sv.gamestateChars += strlen(sv.configstrings[i]) + 1;
+        }
+    }
+    Com_Memset(sv.gamestateChanged, 0, sizeof(sv.gamestateChanged));
+}
+
+/*
+===============
+SV_WriteGamestate
+
+Writes the configstrings and baselines of a gamestate message. The encoded
+bits are kept from the first client that connects to a map, the configstrings
+that changed since then are appended as a patch that the client applies on
+top, it simply keeps the last string it reads for an index. The patch leaves
+the replaced strings in the client's gamestate buffer, so once it grows large
+the cache is rebuilt.
+===============
+*/
+#define GAMESTATE_PATCH_CHARS 1024
+
+void SV_WriteGamestate(msg_t *msg) {
+    int i, patchChars;
+
+    if (sv.gamestateCached) {
+        patchChars = 0;
+        for (i = 0; i < MAX_CONFIGSTRINGS; i++) {
+            if (sv.gamestateChanged[i]) {
+                patchChars += strlen(sv.configstrings[i]) + 1;
+            }
+        }
+        // the client starts its buffer with an empty string
+        if (patchChars > GAMESTATE_PATCH_CHARS ||
+            1 + sv.gamestateChars + patchChars > MAX_GAMESTATE_CHARS) {
+            sv.gamestateCached = qfalse;
+        }
+    }
+
+    if (!sv.gamestateCached) {
+        SV_CacheGamestate();
+        if (!sv.gamestateCached) {
+            // doesn't fit, let the message overflow the way it always did
+            SV_WriteGamestateEntries(msg);
+            return;
+        }
+    }
+
+    MSG_WriteRawBits(msg, sv.gamestateData, sv.gamestateBits);
+
+    for (i = 0; i < MAX_CONFIGSTRINGS; i++) {
+        if (sv.gamestateChanged[i]) {
+            MSG_WriteByte(msg, svc_configstring);
+            MSG_WriteShort(msg, i);
+            MSG_WriteBigString(msg, sv.configstrings[i]);
+        }
+    }
+}
+
 /*
 ===============
 SV_SetUserinfo
@@ -224,6 +441,8 @@ static void SV_CreateBaseline(void) {
         //
         sv.svEntities[entnum].baseline = svent->s;
     }
+
+    sv.gamestateCached = qfalse;
 }
 
 /*
@@ -363,6 +582,9 @@ static void SV_ClearServer(void) {
         if (sv.configstrings[i]) {
             Z_Free(sv.configstrings[i]);
         }
+        if (sv.configstringBase[i]) {
+            Z_Free(sv.configstringBase[i]);
+        }
     }
     Com_Memset(&sv, 0, sizeof(sv));
 }
@@ -468,8 +690,19 @@ void SV_SpawnServer(char *server, qboolean killBots) {
     sv.checksumFeed = (((int)rand() << 16) ^ rand()) ^ Com_Milliseconds();
     FS_Restart(sv.checksumFeed);
 
+    // the patch collision of the map is built on the workers
+    if (sv_threads->modified) {
+        Sys_SetWorkerThreads(sv_threads->integer);
+        sv_threads->modified = qfalse;
+    }
+
     CM_LoadMap(va("maps/%s.bsp", server), qfalse, &checksum);
 
+    // a local client keeps the map for the renderer
+    if (com_dedicated->integer) {
+        FS_FlushSharedFiles(qfalse);
+    }
+
     // set serverinfo visible name
     Cvar_Set("mapname", server);
 
@@ -588,6 +821,9 @@ void SV_SpawnServer(char *server, qboolean killBots) {
     Cvar_Set("sv_referencedPaks", p);
     p = FS_ReferencedPakNames();
     Cvar_Set("sv_referencedPakNames", p);
+#ifdef USE_HTTP_SERVER
+    SV_HTTPUpdateFiles();
+#endif
 
     // save systeminfo and serverinfo strings
     Q_strncpyz(systemInfo, Cvar_InfoString_Big(CVAR_SYSTEMINFO),
@@ -596,6 +832,7 @@ void SV_SpawnServer(char *server, qboolean killBots) {
     SV_SetConfigstring(CS_SYSTEMINFO, systemInfo);
 
     SV_SetConfigstring(CS_SERVERINFO, Cvar_InfoString(CVAR_SERVERINFO));
+    SV_QueryResponsesChanged();
     cvar_modifiedFlags &= ~CVAR_SERVERINFO;
 
     // any media configstring setting now should issue a warning
@@ -645,10 +882,26 @@ void SV_Init(void) {
         Cvar_Get("sv_maxclients", "8", CVAR_SERVERINFO | CVAR_LATCH);
     sv_autorecord = Cvar_Get("sv_autorecord", "0", CVAR_ARCHIVE);
     sv_antiwallhack = Cvar_Get("sv_antiwallhack", "0", CVAR_ARCHIVE);
+    sv_threads = Cvar_Get("sv_threads", "0", CVAR_ARCHIVE);
+    Cvar_CheckRange(sv_threads, 0, MAX_WORKER_THREADS, qtrue);
+    sv_deltaCache = Cvar_Get("sv_deltaCache", "1", CVAR_ARCHIVE);
 
     sv_minRate = Cvar_Get("sv_minRate", "0", CVAR_ARCHIVE | CVAR_SERVERINFO);
     sv_maxRate = Cvar_Get("sv_maxRate", "0", CVAR_ARCHIVE | CVAR_SERVERINFO);
     sv_dlRate = Cvar_Get("sv_dlRate", "100", CVAR_ARCHIVE | CVAR_SERVERINFO);
+    sv_dlWindow = Cvar_Get("sv_dlWindow", va("%i", MAX_DOWNLOAD_WINDOW),
+                           CVAR_ARCHIVE);
+    Cvar_CheckRange(sv_dlWindow, 1, MAX_DOWNLOAD_WINDOW, qtrue);
+    sv_dlBlockSize = Cvar_Get("sv_dlBlockSize",
+                              va("%i", MAX_DOWNLOAD_SHARED_BLKSIZE), CVAR_ARCHIVE);
+    Cvar_CheckRange(sv_dlBlockSize, MAX_DOWNLOAD_BLKSIZE,
+                    MAX_DOWNLOAD_SHARED_BLKSIZE, qtrue);
+#ifdef USE_HTTP_SERVER
+    sv_httpPort = Cvar_Get("sv_httpPort", "0", CVAR_ARCHIVE);
+    Cvar_CheckRange(sv_httpPort, 0, 65535, qtrue);
+    sv_httpConnections = Cvar_Get("sv_httpConnections", "32", CVAR_ARCHIVE);
+    Cvar_CheckRange(sv_httpConnections, 1, 64, qtrue);
+#endif
     sv_minPing = Cvar_Get("sv_minPing", "0", CVAR_ARCHIVE | CVAR_SERVERINFO);
     sv_maxPing = Cvar_Get("sv_maxPing", "0", CVAR_ARCHIVE | CVAR_SERVERINFO);
     sv_floodProtect =
@@ -671,6 +924,9 @@ void SV_Init(void) {
     sv_rconPassword = Cvar_Get("rconPassword", "", CVAR_TEMP);
     sv_privatePassword = Cvar_Get("sv_privatePassword", "", CVAR_TEMP);
     sv_fps = Cvar_Get("sv_fps", "20", CVAR_TEMP);
+    sv_snapshotFps =
+        Cvar_Get("sv_snapshotFps", "0", CVAR_SYSTEMINFO | CVAR_ARCHIVE);
+    Cvar_CheckRange(sv_snapshotFps, 0, 1000, qtrue);
     sv_timeout = Cvar_Get("sv_timeout", "200", CVAR_TEMP);
     sv_zombietime = Cvar_Get("sv_zombietime", "2", CVAR_TEMP);
     Cvar_Get("nextmap", "", CVAR_TEMP);
@@ -690,6 +946,12 @@ void SV_Init(void) {
     sv_killserver = Cvar_Get("sv_killserver", "0", 0);
     sv_mapChecksum = Cvar_Get("sv_mapChecksum", "", CVAR_ROM);
     sv_lanForceRate = Cvar_Get("sv_lanForceRate", "1", CVAR_ARCHIVE);
+    sv_adaptiveRate = Cvar_Get("sv_adaptiveRate", "1", CVAR_ARCHIVE);
+    sv_entityIndex = Cvar_Get("sv_entityIndex", "1", CVAR_ARCHIVE);
+    sv_linkCache = Cvar_Get("sv_linkCache", "1", CVAR_ARCHIVE);
+    // tells the game module that G_TRACE_BATCH is there, read only so a
+    // saved value can't reach an engine without the trap
+    Cvar_Get("sv_traceBatch", "1", CVAR_ROM);
     sv_strictAuth = Cvar_Get("sv_strictAuth", "1", CVAR_ARCHIVE);
     sv_banFile = Cvar_Get("sv_banFile", "serverbans.dat", CVAR_ARCHIVE);
 
@@ -773,6 +1035,9 @@ void SV_Shutdown(char *finalmsg) {
 
     SV_RemoveOperatorCommands();
     SV_MasterShutdown();
+#ifdef USE_HTTP_SERVER
+    SV_HTTPShutdown();
+#endif
     SV_ShutdownGameProgs();
 
     // free current level
@@ -787,6 +1052,8 @@ void SV_Shutdown(char *finalmsg) {
 
         Z_Free(svs.clients);
     }
+    SV_FreeSnapshotJobs();
+    SV_FreeEntityIndex();
     Com_Memset(&svs, 0, sizeof(svs));
 
     Cvar_Set("sv_running", "0");
@@ -32,6 +32,7 @@ server_t sv;        // local server
 vm_t *gvm = NULL;   // game virtual machine
 
 cvar_t *sv_fps = NULL;      // time rate for running non-clients
+cvar_t *sv_snapshotFps;     // rate snapshots are built at, <= sv_fps
 cvar_t *sv_timeout;         // seconds without any message
 cvar_t *sv_zombietime;      // seconds to sink messages after disconnect
 cvar_t *sv_rconPassword;    // password for remote server commands
@@ -53,6 +54,12 @@ cvar_t *sv_serverid;
 cvar_t *sv_minRate;
 cvar_t *sv_maxRate;
 cvar_t *sv_dlRate;
+cvar_t *sv_dlWindow;    // download blocks in flight per client
+cvar_t *sv_dlBlockSize; // bytes per block of shared downloads
+#ifdef USE_HTTP_SERVER
+cvar_t *sv_httpPort; // TCP port of the built in HTTP server, 0 is off
+cvar_t *sv_httpConnections;
+#endif
 cvar_t *sv_minPing;
 cvar_t *sv_maxPing;
 cvar_t *sv_gametype;
@@ -60,9 +67,14 @@ cvar_t *sv_pure;
 cvar_t *sv_floodProtect;
 cvar_t *sv_lanForceRate; // dedicated 1 (LAN) server forces local client rates
                          // to 99999 (bug #491)
+cvar_t *sv_adaptiveRate; // adapt snapshot rate and size to each client's link
+cvar_t *sv_entityIndex;  // index entities by cluster for snapshots
+cvar_t *sv_linkCache;    // keep the link of entities that did not move
 cvar_t *sv_strictAuth;
 cvar_t *sv_banFile;
 cvar_t *sv_antiwallhack; // TheDoctor: anti-wallhack
+cvar_t *sv_threads;      // worker threads for snapshots
+cvar_t *sv_deltaCache;   // share encoded entity deltas between clients
 
 serverBan_t serverBans[SERVER_MAXBANS];
 int serverBansCount = 0;
@@ -150,6 +162,11 @@ void SV_AddServerCommand(client_t *client, const char *cmd) {
     //		return;
     //	}
 
+    // configstrings changed before this command must get there first
+    if (sv.numPendingConfigstrings) {
+        SV_FlushConfigstrings();
+    }
+
     // do not send commands until the gamestate has been sent
     if (client->state < CS_PRIMED)
         return;
@@ -363,10 +380,16 @@ CONNECTIONLESS COMMANDS
 
 // This is deliberately quite large to make it more of an effort to DoS
 #define MAX_BUCKETS 16384
-#define MAX_HASHES 1024
+#define MAX_BUCKET_PROBES 32
+
+// Every address is also charged to the bucket of its /24 or /64 network,
+// which allows a few times the burst of a single address, so a flood spread
+// over a whole network can't get a fresh bucket per source address
+#define NETWORK_BITS_IP 24
+#define NETWORK_BITS_IP6 64
+#define NETWORK_BURST_SCALE 4
 
 static leakyBucket_t buckets[MAX_BUCKETS];
-static leakyBucket_t *bucketHashes[MAX_HASHES];
 leakyBucket_t outboundLeakyBucket;
 
 /*
@@ -374,122 +397,101 @@ leakyBucket_t outboundLeakyBucket;
 SVC_HashForAddress
 ================
 */
-static long SVC_HashForAddress(netadr_t address) {
-    byte *ip = NULL;
-    size_t size = 0;
+static unsigned int SVC_HashForAddress(const byte *ip, int size, int bits) {
+    unsigned int hash = 2166136261u;
     int i;
-    long hash = 0;
-
-    switch (address.type) {
-    case NA_IP:
-        ip = address.ip;
-        size = 4;
-        break;
-    case NA_IP6:
-        ip = address.ip6;
-        size = 16;
-        break;
-    default:
-        break;
-    }
 
     for (i = 0; i < size; i++) {
-        hash += (long)(ip[i]) * (i + 119);
+        hash = (hash ^ ip[i]) * 16777619u;
     }
+    hash = (hash ^ bits) * 16777619u;
 
-    hash = (hash ^ (hash >> 10) ^ (hash >> 20));
-    hash &= (MAX_HASHES - 1);
-
-    return hash;
+    return hash ^ (hash >> 15);
 }
 
 /*
 ================
 SVC_BucketForAddress
 
-Find or allocate a bucket for an address
+Find or allocate the bucket for the first bits of an address.
+
+The table is open addressed. Slots are never emptied again, a bucket that
+has fully drained is just reused by the next address that probes past it,
+so a lookup can stop at the first slot that was never used.
 ================
 */
-static leakyBucket_t *SVC_BucketForAddress(netadr_t address, int burst,
+static leakyBucket_t *SVC_BucketForAddress(netadr_t address, int bits,
                                            int period) {
-    leakyBucket_t *bucket = NULL;
-    int i;
-    long hash = SVC_HashForAddress(address);
+    leakyBucket_t *bucket, *reuse = NULL;
+    byte ip[16];
+    int i, size, interval;
+    unsigned int hash;
     int now = Sys_Milliseconds();
 
-    for (bucket = bucketHashes[hash]; bucket; bucket = bucket->next) {
-        switch (bucket->type) {
-        case NA_IP:
-            if (memcmp(bucket->ipv._4, address.ip, 4) == 0) {
-                return bucket;
-            }
-            break;
-
-        case NA_IP6:
-            if (memcmp(bucket->ipv._6, address.ip6, 16) == 0) {
-                return bucket;
-            }
-            break;
+    switch (address.type) {
+    case NA_IP:
+        size = 4;
+        Com_Memcpy(ip, address.ip, 4);
+        break;
+    case NA_IP6:
+        size = 16;
+        Com_Memcpy(ip, address.ip6, 16);
+        break;
+    default:
+        // one bucket for every address of the type
+        size = 0;
+        break;
+    }
 
-        default:
-            break;
+    // clear the host part
+    for (i = 0; i < size; i++) {
+        if (bits <= i * 8) {
+            ip[i] = 0;
+        } else if (bits < i * 8 + 8) {
+            ip[i] &= 0xff << (i * 8 + 8 - bits);
         }
     }
 
-    for (i = 0; i < MAX_BUCKETS; i++) {
-        int interval;
-
-        bucket = &buckets[i];
-        interval = now - bucket->lastTime;
+    hash = SVC_HashForAddress(ip, size, bits);
 
-        // Reclaim expired buckets
-        if (bucket->lastTime > 0 &&
-            (interval > (burst * period) || interval < 0)) {
-            if (bucket->prev != NULL) {
-                bucket->prev->next = bucket->next;
-            } else {
-                bucketHashes[bucket->hash] = bucket->next;
-            }
-
-            if (bucket->next != NULL) {
-                bucket->next->prev = bucket->prev;
-            }
-
-            Com_Memset(bucket, 0, sizeof(leakyBucket_t));
-        }
+    for (i = 0; i < MAX_BUCKET_PROBES; i++) {
+        bucket = &buckets[(hash + i) & (MAX_BUCKETS - 1)];
 
         if (bucket->type == NA_BAD) {
-            bucket->type = address.type;
-            switch (address.type) {
-            case NA_IP:
-                Com_Memcpy(bucket->ipv._4, address.ip, 4);
-                break;
-            case NA_IP6:
-                Com_Memcpy(bucket->ipv._6, address.ip6, 16);
-                break;
-            default:
-                break;
-            }
-
-            bucket->lastTime = now;
-            bucket->burst = 0;
-            bucket->hash = hash;
-
-            // Add to the head of the relevant hash chain
-            bucket->next = bucketHashes[hash];
-            if (bucketHashes[hash] != NULL) {
-                bucketHashes[hash]->prev = bucket;
+            if (!reuse) {
+                reuse = bucket;
             }
+            break;
+        }
 
-            bucket->prev = NULL;
-            bucketHashes[hash] = bucket;
-
+        if (bucket->type == address.type && bucket->bits == bits &&
+            memcmp(bucket->ipv._6, ip, size) == 0) {
+            bucket->period = period;
             return bucket;
         }
+
+        // Reclaim expired buckets, by the limit they were charged against
+        interval = now - bucket->lastTime;
+        if (!reuse &&
+            (interval > bucket->burst * bucket->period || interval < 0)) {
+            reuse = bucket;
+        }
     }
 
     // Couldn't allocate a bucket for this address
-    return NULL;
+    if (!reuse) {
+        return NULL;
+    }
+
+    Com_Memset(reuse, 0, sizeof(*reuse));
+    reuse->type = address.type;
+    reuse->bits = bits;
+    Com_Memcpy(reuse->ipv._6, ip, size);
+    reuse->lastTime = now;
+    reuse->period = period;
+    reuse->burst = 0;
+
+    return reuse;
 }
 
 /*
@@ -530,9 +532,355 @@ Rate limit for a particular address
 ================
 */
 qboolean SVC_RateLimitAddress(netadr_t from, int burst, int period) {
-    leakyBucket_t *bucket = SVC_BucketForAddress(from, burst, period);
+    leakyBucket_t *bucket;
+    int networkBurst;
+
+    // other address types share one bucket per type, and have no network
+    if (from.type != NA_IP && from.type != NA_IP6) {
+        bucket = SVC_BucketForAddress(from, 0, period);
+        return SVC_RateLimit(bucket, burst, period);
+    }
+
+    bucket = SVC_BucketForAddress(from, from.type == NA_IP ? 32 : 128, period);
+    if (SVC_RateLimit(bucket, burst, period)) {
+        return qtrue;
+    }
+
+    networkBurst = burst * NETWORK_BURST_SCALE;
+    if (networkBurst > 127) {
+        networkBurst = 127;
+    }
+
+    bucket = SVC_BucketForAddress(
+        from, from.type == NA_IP ? NETWORK_BITS_IP : NETWORK_BITS_IP6, period);
+
+    return SVC_RateLimit(bucket, networkBurst, period);
+}
+
+/*
+================
+SVC_RandomFloodAddress
+
+Half of the packets come from a handful of networks, as a spoofed flood
+would, the rest from anywhere
+================
+*/
+static void SVC_RandomFloodAddress(netadr_t *adr, int *seed) {
+    int i, r;
+
+    Com_Memset(adr, 0, sizeof(*adr));
+    r = Q_rand(seed);
+
+    if (r & 1) {
+        adr->type = NA_IP;
+        for (i = 0; i < 4; i++) {
+            adr->ip[i] = Q_rand(seed);
+        }
+        if (r & 2) {
+            adr->ip[0] = 10;
+            adr->ip[1] = (r >> 8) & 3;
+            adr->ip[2] = 0;
+        }
+    } else {
+        adr->type = NA_IP6;
+        for (i = 0; i < 16; i++) {
+            adr->ip6[i] = Q_rand(seed);
+        }
+        if (r & 2) {
+            Com_Memset(adr->ip6, 0, 7);
+            adr->ip6[0] = 0x20;
+            adr->ip6[7] = (r >> 8) & 3;
+        }
+    }
+}
+
+#define BENCH_BAN_LOOKUPS 65536
+
+/*
+================
+SV_FloodBench_f
+
+floodbench [packets]
+Feeds connectionless packets from random addresses through the rate limiter
+and a list of 1024 random bans, and checks the ban lookups against a plain
+scan of the list
+================
+*/
+void SV_FloodBench_f(void) {
+    leakyBucket_t *savedBuckets;
+    serverBan_t *savedBans;
+    int savedBansCount;
+    netadr_t adr, *addresses;
+    qboolean *results;
+    int packets, i, j, seed, start, msec;
+    int limited, banned, mismatches;
+    qboolean scanned, excepted;
+
+    packets = 1 << 20;
+    if (Cmd_Argc() > 1) {
+        packets = atoi(Cmd_Argv(1));
+    }
+    if (packets <= 0) {
+        return;
+    }
+
+    savedBuckets = Z_Malloc(sizeof(buckets));
+    Com_Memcpy(savedBuckets, buckets, sizeof(buckets));
+    savedBans = Z_Malloc(sizeof(serverBans));
+    Com_Memcpy(savedBans, serverBans, sizeof(serverBans));
+    savedBansCount = serverBansCount;
+
+    seed = 0x5eed;
+    for (i = 0; i < SERVER_MAXBANS; i++) {
+        SVC_RandomFloodAddress(&serverBans[i].ip, &seed);
+        if (serverBans[i].ip.type == NA_IP) {
+            serverBans[i].subnet = 8 + (Q_rand(&seed) & 0x7fff) % 25;
+        } else {
+            serverBans[i].subnet = 16 + (Q_rand(&seed) & 0x7fff) % 113;
+        }
+        serverBans[i].isexception = (i & 7) == 0;
+    }
+    serverBansCount = SERVER_MAXBANS;
+    SV_BansChanged();
+
+    addresses = Z_Malloc(BENCH_BAN_LOOKUPS * sizeof(*addresses));
+    results = Z_Malloc(BENCH_BAN_LOOKUPS * sizeof(*results));
+    for (i = 0; i < BENCH_BAN_LOOKUPS; i++) {
+        SVC_RandomFloodAddress(&addresses[i], &seed);
+    }
+
+    start = Sys_Milliseconds();
+    for (i = 0; i < BENCH_BAN_LOOKUPS; i++) {
+        scanned = excepted = qfalse;
+        for (j = 0; j < serverBansCount; j++) {
+            if (NET_CompareBaseAdrMask(serverBans[j].ip, addresses[i],
+                                       serverBans[j].subnet)) {
+                if (serverBans[j].isexception) {
+                    excepted = qtrue;
+                } else {
+                    scanned = qtrue;
+                }
+            }
+        }
+        results[i] = scanned && !excepted;
+    }
+    msec = Sys_Milliseconds() - start;
+
+    SV_IsBanned(&addresses[0], qfalse); // build the trie outside the timing
+    mismatches = 0;
+    start = Sys_Milliseconds();
+    for (i = 0; i < BENCH_BAN_LOOKUPS; i++) {
+        if (SV_IsBanned(&addresses[i], qfalse) != results[i]) {
+            mismatches++;
+        }
+    }
+    Com_Printf("%i ban lookups: list %i msec, trie %i msec\n",
+               BENCH_BAN_LOOKUPS, msec, Sys_Milliseconds() - start);
+    if (mismatches) {
+        Com_Printf("floodbench: %i ban lookups disagree with the list\n",
+                   mismatches);
+    }
+
+    Z_Free(results);
+    Z_Free(addresses);
+
+    Com_Memset(buckets, 0, sizeof(buckets));
+    limited = banned = 0;
+    start = Sys_Milliseconds();
+    for (i = 0; i < packets; i++) {
+        SVC_RandomFloodAddress(&adr, &seed);
+        if (SVC_RateLimitAddress(adr, 10, 1000)) {
+            limited++;
+        } else if (SV_IsBanned(&adr, qfalse)) {
+            banned++;
+        }
+    }
+    msec = Sys_Milliseconds() - start;
+
+    Com_Printf("%i packets in %i msec, %.0f packets/sec\n", packets, msec,
+               packets * 1000.0 / (msec ? msec : 1));
+    Com_Printf("%i rate limited, %i banned\n", limited, banned);
+
+    Com_Memcpy(buckets, savedBuckets, sizeof(buckets));
+    Com_Memcpy(serverBans, savedBans, sizeof(serverBans));
+    serverBansCount = savedBansCount;
+    SV_BansChanged();
+
+    Z_Free(savedBans);
+    Z_Free(savedBuckets);
+}
+
+/*
+==============================================================================
+
+Query responses
+
+getinfo and getstatus are answered from strings that are only rebuilt when
+something they show has changed: a serverinfo cvar, a client connecting,
+leaving or renaming, or a score or ping, which are compared once per frame.
+Only the challenge is added per query.
+
+==============================================================================
+*/
+
+static struct {
+    qboolean dirty;
+    qboolean valid;
+    int time; // svs.time the clients were last compared
+
+    char info[MAX_INFO_STRING];       // infoResponse without the challenge
+    char serverinfo[MAX_INFO_STRING]; // statusResponse without the challenge
+    char players[MAX_MSGLEN];
+
+    qboolean connected[MAX_CLIENTS];
+    int scores[MAX_CLIENTS];
+    int pings[MAX_CLIENTS];
+} queryCache;
+
+/*
+================
+SV_QueryResponsesChanged
+
+Called when something getinfo or getstatus shows may have changed
+================
+*/
+void SV_QueryResponsesChanged(void) { queryCache.dirty = qtrue; }
+
+/*
+================
+SVC_BuildInfoString
+================
+*/
+static void SVC_BuildInfoString(char *infostring, const char *challenge) {
+    int i, count, humans;
+    char *gamedir;
+
+    // don't count privateclients
+    count = humans = 0;
+    for (i = sv_privateClients->integer; i < sv_maxclients->integer; i++) {
+        if (svs.clients[i].state >= CS_CONNECTED) {
+            count++;
+            if (svs.clients[i].netchan.remoteAddress.type != NA_BOT) {
+                humans++;
+            }
+        }
+    }
+
+    infostring[0] = 0;
+
+    // echo back the parameter to status. so servers can use it as a challenge
+    // to prevent timed spoofed reply packets that add ghost servers
+    Info_SetValueForKey(infostring, "challenge", challenge);
+
+    Info_SetValueForKey(infostring, "gamename", com_gamename->string);
+
+#ifdef LEGACY_PROTOCOL
+    if (com_legacyprotocol->integer > 0)
+        Info_SetValueForKey(infostring, "protocol",
+                            va("%i", com_legacyprotocol->integer));
+    else
+#endif
+        Info_SetValueForKey(infostring, "protocol",
+                            va("%i", com_protocol->integer));
+
+    Info_SetValueForKey(infostring, "hostname", sv_hostname->string);
+    Info_SetValueForKey(infostring, "mapname", sv_mapname->string);
+    Info_SetValueForKey(infostring, "clients", va("%i", count));
+    Info_SetValueForKey(infostring, "g_humanplayers", va("%i", humans));
+    Info_SetValueForKey(
+        infostring, "sv_maxclients",
+        va("%i", sv_maxclients->integer - sv_privateClients->integer));
+    Info_SetValueForKey(infostring, "gametype", va("%i", sv_gametype->integer));
+    Info_SetValueForKey(infostring, "pure", va("%i", sv_pure->integer));
+    Info_SetValueForKey(infostring, "g_needpass",
+                        va("%d", Cvar_VariableIntegerValue("g_needpass")));
+
+#ifdef USE_VOIP
+    if (sv_voip->integer) {
+        Info_SetValueForKey(infostring, "voip", va("%i", sv_voip->integer));
+    }
+#endif
+
+    if (sv_minPing->integer) {
+        Info_SetValueForKey(infostring, "minPing",
+                            va("%i", sv_minPing->integer));
+    }
+    if (sv_maxPing->integer) {
+        Info_SetValueForKey(infostring, "maxPing",
+                            va("%i", sv_maxPing->integer));
+    }
+    gamedir = Cvar_VariableString("fs_game");
+    if (*gamedir) {
+        Info_SetValueForKey(infostring, "game", gamedir);
+    }
+}
+
+/*
+================
+SVC_UpdateQueryCache
+================
+*/
+static void SVC_UpdateQueryCache(void) {
+    char player[1024];
+    int i, maxclients;
+    int statusLength, playerLength;
+    client_t *cl;
+    qboolean connected;
+    int score;
+
+    if (cvar_modifiedFlags & CVAR_SERVERINFO) {
+        queryCache.dirty = qtrue;
+    }
+
+    maxclients = sv_maxclients->integer;
+    if (maxclients > MAX_CLIENTS) {
+        maxclients = MAX_CLIENTS;
+    }
+
+    if (queryCache.time != svs.time || !queryCache.valid) {
+        queryCache.time = svs.time;
+        for (i = 0, cl = svs.clients; i < maxclients; i++, cl++) {
+            connected = cl->state >= CS_CONNECTED;
+            score = connected ? SV_GameClientNum(i)->persistant[PERS_SCORE] : 0;
+            if (connected != queryCache.connected[i] ||
+                score != queryCache.scores[i] ||
+                (connected && cl->ping != queryCache.pings[i])) {
+                queryCache.connected[i] = connected;
+                queryCache.scores[i] = score;
+                queryCache.pings[i] = cl->ping;
+                queryCache.dirty = qtrue;
+            }
+        }
+    }
 
-    return SVC_RateLimit(bucket, burst, period);
+    if (!queryCache.dirty && queryCache.valid) {
+        return;
+    }
+    queryCache.dirty = qfalse;
+    queryCache.valid = qtrue;
+
+    SVC_BuildInfoString(queryCache.info, "");
+
+    Q_strncpyz(queryCache.serverinfo, Cvar_InfoString(CVAR_SERVERINFO),
+               sizeof(queryCache.serverinfo));
+    Info_RemoveKey(queryCache.serverinfo, "challenge");
+
+    queryCache.players[0] = 0;
+    statusLength = 0;
+
+    for (i = 0, cl = svs.clients; i < sv_maxclients->integer; i++, cl++) {
+        if (cl->state >= CS_CONNECTED) {
+            Com_sprintf(player, sizeof(player), "%i %i \"%s\"\n",
+                        SV_GameClientNum(i)->persistant[PERS_SCORE], cl->ping,
+                        cl->name);
+            playerLength = strlen(player);
+            if (statusLength + playerLength >= sizeof(queryCache.players)) {
+                break; // can't hold any more
+            }
+            strcpy(queryCache.players + statusLength, player);
+            statusLength += playerLength;
+        }
+    }
 }
 
 /*
@@ -545,13 +893,7 @@ the simple info query.
 ================
 */
 static void SVC_Status(netadr_t from) {
-    char player[1024];
-    char status[MAX_MSGLEN];
-    int i;
-    client_t *cl;
-    playerState_t *ps;
-    int statusLength;
-    int playerLength;
+    char challenge[MAX_INFO_STRING];
     char infostring[MAX_INFO_STRING];
 
     // ignore if we are in single player
@@ -579,32 +921,25 @@ static void SVC_Status(netadr_t from) {
     if (strlen(Cmd_Argv(1)) > 128)
         return;
 
-    strcpy(infostring, Cvar_InfoString(CVAR_SERVERINFO));
+    SVC_UpdateQueryCache();
 
     // echo back the parameter to status. so master servers can use it as a
     // challenge to prevent timed spoofed reply packets that add ghost servers
-    Info_SetValueForKey(infostring, "challenge", Cmd_Argv(1));
+    challenge[0] = 0;
+    Info_SetValueForKey(challenge, "challenge", Cmd_Argv(1));
 
-    status[0] = 0;
-    statusLength = 0;
-
-    for (i = 0; i < sv_maxclients->integer; i++) {
-        cl = &svs.clients[i];
-        if (cl->state >= CS_CONNECTED) {
-            ps = SV_GameClientNum(i);
-            Com_sprintf(player, sizeof(player), "%i %i \"%s\"\n",
-                        ps->persistant[PERS_SCORE], cl->ping, cl->name);
-            playerLength = strlen(player);
-            if (statusLength + playerLength >= sizeof(status)) {
-                break; // can't hold any more
-            }
-            strcpy(status + statusLength, player);
-            statusLength += playerLength;
-        }
+    if (strlen(challenge) + strlen(queryCache.serverinfo) < MAX_INFO_STRING) {
+        NET_OutOfBandPrint(NS_SERVER, from, "statusResponse\n%s%s\n%s",
+                           challenge, queryCache.serverinfo,
+                           queryCache.players);
+        return;
     }
 
+    // let Info_SetValueForKey complain about the length
+    strcpy(infostring, queryCache.serverinfo);
+    Info_SetValueForKey(infostring, "challenge", Cmd_Argv(1));
     NET_OutOfBandPrint(NS_SERVER, from, "statusResponse\n%s\n%s", infostring,
-                       status);
+                       queryCache.players);
 }
 
 /*
@@ -616,8 +951,7 @@ if a user is interested in a server to do a full status
 ================
 */
 void SVC_Info(netadr_t from) {
-    int i, count, humans;
-    char *gamedir;
+    char challenge[MAX_INFO_STRING];
     char infostring[MAX_INFO_STRING];
 
     // ignore if we are in single player
@@ -650,65 +984,21 @@ void SVC_Info(netadr_t from) {
     if (strlen(Cmd_Argv(1)) > 128)
         return;
 
-    // don't count privateclients
-    count = humans = 0;
-    for (i = sv_privateClients->integer; i < sv_maxclients->integer; i++) {
-        if (svs.clients[i].state >= CS_CONNECTED) {
-            count++;
-            if (svs.clients[i].netchan.remoteAddress.type != NA_BOT) {
-                humans++;
-            }
-        }
-    }
+    SVC_UpdateQueryCache();
 
-    infostring[0] = 0;
+    // Info_SetValueForKey puts new keys in front, so the challenge that is
+    // set first ends up last
+    challenge[0] = 0;
+    Info_SetValueForKey(challenge, "challenge", Cmd_Argv(1));
 
-    // echo back the parameter to status. so servers can use it as a challenge
-    // to prevent timed spoofed reply packets that add ghost servers
-    Info_SetValueForKey(infostring, "challenge", Cmd_Argv(1));
-
-    Info_SetValueForKey(infostring, "gamename", com_gamename->string);
-
-#ifdef LEGACY_PROTOCOL
-    if (com_legacyprotocol->integer > 0)
-        Info_SetValueForKey(infostring, "protocol",
-                            va("%i", com_legacyprotocol->integer));
-    else
-#endif
-        Info_SetValueForKey(infostring, "protocol",
-                            va("%i", com_protocol->integer));
-
-    Info_SetValueForKey(infostring, "hostname", sv_hostname->string);
-    Info_SetValueForKey(infostring, "mapname", sv_mapname->string);
-    Info_SetValueForKey(infostring, "clients", va("%i", count));
-    Info_SetValueForKey(infostring, "g_humanplayers", va("%i", humans));
-    Info_SetValueForKey(
-        infostring, "sv_maxclients",
-        va("%i", sv_maxclients->integer - sv_privateClients->integer));
-    Info_SetValueForKey(infostring, "gametype", va("%i", sv_gametype->integer));
-    Info_SetValueForKey(infostring, "pure", va("%i", sv_pure->integer));
-    Info_SetValueForKey(infostring, "g_needpass",
-                        va("%d", Cvar_VariableIntegerValue("g_needpass")));
-
-#ifdef USE_VOIP
-    if (sv_voip->integer) {
-        Info_SetValueForKey(infostring, "voip", va("%i", sv_voip->integer));
-    }
-#endif
-
-    if (sv_minPing->integer) {
-        Info_SetValueForKey(infostring, "minPing",
-                            va("%i", sv_minPing->integer));
-    }
-    if (sv_maxPing->integer) {
-        Info_SetValueForKey(infostring, "maxPing",
-                            va("%i", sv_maxPing->integer));
-    }
-    gamedir = Cvar_VariableString("fs_game");
-    if (*gamedir) {
-        Info_SetValueForKey(infostring, "game", gamedir);
+    if (strlen(queryCache.info) + strlen(challenge) < MAX_INFO_STRING) {
+        NET_OutOfBandPrint(NS_SERVER, from, "infoResponse\n%s%s",
+                           queryCache.info, challenge);
+        return;
     }
 
+    // too long to just append, some keys may have to give way
+    SVC_BuildInfoString(infostring, Cmd_Argv(1));
     NET_OutOfBandPrint(NS_SERVER, from, "infoResponse\n%s", infostring);
 }
 
@@ -1066,6 +1356,26 @@ int SV_FrameMsec() {
         return 1;
 }
 
+/*
+==================
+SV_SnapshotTicks
+
+Number of game frames between two snapshot frames. The interval is rounded up
+to whole game frames, so the rate never exceeds sv_snapshotFps; 0 builds
+snapshots every game frame, the default.
+==================
+*/
+int SV_SnapshotTicks(void) {
+    int fps;
+
+    fps = sv_snapshotFps->integer;
+    if (fps < 1 || fps >= sv_fps->integer) {
+        return 1;
+    }
+
+    return (sv_fps->integer + fps - 1) / fps;
+}
+
 /*
 ==================
 SV_Frame
@@ -1077,6 +1387,7 @@ happen before SV_Frame is called
 void SV_Frame(int msec) {
     int frameMsec;
     int startTime;
+    int ticks;
 
     // the menu kills the server with this cvar
     if (sv_killserver->integer) {
@@ -1095,6 +1406,10 @@ void SV_Frame(int msec) {
         return;
     }
 
+#ifdef USE_HTTP_SERVER
+    SV_HTTPFrame();
+#endif
+
     // allow pause if only the local client is connected
     if (SV_CheckPaused()) {
         return;
@@ -1143,6 +1458,7 @@ void SV_Frame(int msec) {
     // update infostrings if anything has been changed
     if (cvar_modifiedFlags & CVAR_SERVERINFO) {
         SV_SetConfigstring(CS_SERVERINFO, Cvar_InfoString(CVAR_SERVERINFO));
+        SV_QueryResponsesChanged();
         cvar_modifiedFlags &= ~CVAR_SERVERINFO;
     }
     if (cvar_modifiedFlags & CVAR_SYSTEMINFO) {
@@ -1163,6 +1479,7 @@ void SV_Frame(int msec) {
         SV_BotFrame(sv.time);
 
     // run the game simulation in chunks
+    ticks = 0;
     while (sv.timeResidual >= frameMsec) {
         sv.timeResidual -= frameMsec;
         svs.time += frameMsec;
@@ -1170,6 +1487,8 @@ void SV_Frame(int msec) {
 
         // let everything in the world think and move
         VM_Call(gvm, GAME_RUN_FRAME, sv.time);
+        SV_LinkStatsFrame();
+        ticks++;
     }
 
     if (com_speeds->integer) {
@@ -1179,8 +1498,15 @@ void SV_Frame(int msec) {
     // check timeouts
     SV_CheckTimeouts();
 
-    // send messages back to the clients
-    SV_SendClientMessages();
+    // send messages back to the clients, snapshots only go out every
+    // SV_SnapshotTicks game frames
+    sv.snapshotTicks += ticks;
+    if (ticks && sv.snapshotTicks >= SV_SnapshotTicks()) {
+        sv.snapshotTicks = 0;
+        SV_SendClientMessages(qtrue);
+    } else {
+        SV_SendClientMessages(qfalse);
+    }
 
     // send a heartbeat to the master if needed
     SV_MasterHeartbeat(HEARTBEAT_FOR_MASTER);
@@ -1198,11 +1524,16 @@ a client based on its rate settings
 #define UDPIP_HEADER_SIZE 28
 #define UDPIP6_HEADER_SIZE 48
 
-int SV_RateMsec(client_t *client) {
-    int rate, rateMsec;
-    int messageSize;
+/*
+====================
+SV_ClientRate
+
+The rate the client asked for, within sv_minRate and sv_maxRate
+====================
+*/
+static int SV_ClientRate(client_t *client) {
+    int rate;
 
-    messageSize = client->netchan.lastSentSize;
     rate = client->rate;
 
     if (sv_maxRate->integer) {
@@ -1219,6 +1550,22 @@ int SV_RateMsec(client_t *client) {
             rate = sv_minRate->integer;
     }
 
+    return rate;
+}
+
+int SV_RateMsec(client_t *client) {
+    int rate, rateMsec;
+    int messageSize;
+
+    messageSize = client->netchan.lastSentSize;
+    rate = SV_ClientRate(client);
+
+    // never more than the link was found to carry
+    if (sv_adaptiveRate->integer && client->rateControl.rate &&
+        client->rateControl.rate < rate) {
+        rate = client->rateControl.rate;
+    }
+
     if (client->netchan.remoteAddress.type == NA_IP6)
         messageSize += UDPIP6_HEADER_SIZE;
     else
@@ -1233,6 +1580,338 @@ int SV_RateMsec(client_t *client) {
         return rateMsec - rate;
 }
 
+/*
+==============================================================================
+
+ADAPTIVE RATE
+
+Each client's link is estimated from what it acknowledges. The server
+messages skipped between two acks count as lost when the client sends faster
+than it gets snapshots, and a ping above the lowest one seen means packets
+are queueing somewhere. The client packets the netchan saw dropped are
+averaged for netstats.
+
+Loss alone says little, wireless and long routes drop packets at any rate,
+so the rate is only cut by a quarter when packets queue up, or get lost while
+the queue grows, or most of them are lost. It creeps back up to the client's
+own rate while the link is clean.
+
+The snapshot interval is then stretched until the snapshots fit in that
+rate. If even the slowest interval is not enough, the entity count is
+capped and the farthest entities are left out.
+
+==============================================================================
+*/
+
+#define RATE_CONTROL_MIN 2000        // bytes / second
+#define RATE_CONTROL_PERIOD 250      // msec between adjustments, at least
+#define RATE_CONTROL_LOSS_SPAN 64.0f // samples the loss averages span
+#define RATE_CONTROL_SIZE_SPAN 16.0f // samples the size averages span
+#define RATE_CONTROL_LOSS_HIGH 0.05f // congestion when the queue grows too
+#define RATE_CONTROL_LOSS_MAX 0.25f  // congestion anyway
+#define RATE_CONTROL_LOSS_LOW 0.02f  // raise the rate below this
+#define RATE_CONTROL_QUEUE_MSEC 100  // congestion above minPing + this
+#define RATE_CONTROL_MAX_MSEC 100    // slowest snapshot interval picked
+#define RATE_CONTROL_MIN_ENTITIES 32 // smallest entity budget
+
+/*
+====================
+SV_RateControlSample
+====================
+*/
+static void SV_RateControlSample(float *average, float sample, float span) {
+    *average += (sample - *average) / span;
+}
+
+/*
+====================
+SV_UpdateRateControl
+
+Called for each usercmd packet, after client->messageAcknowledge and the
+netchan drop count are known
+====================
+*/
+void SV_UpdateRateControl(client_t *client, int now) {
+    rateControl_t *rc = &client->rateControl;
+    clientSnapshot_t *frame;
+    int ack, i, lost, cap, snapshotMsec, perSnapshot, queued;
+    qboolean congested;
+    float fullBytes, periodLoss;
+
+    ack = client->messageAcknowledge;
+    cap = SV_ClientRate(client);
+
+    if (!rc->rate) {
+        rc->rate = cap;
+        rc->snapshotMsec = client->snapshotMsec;
+        rc->lastPacket = rc->lastAdjust = now;
+        rc->lastAcked = ack;
+        rc->packetMsec = client->snapshotMsec;
+        return;
+    }
+
+    SV_RateControlSample(&rc->packetMsec, now - rc->lastPacket,
+                         RATE_CONTROL_SIZE_SPAN);
+    rc->lastPacket = now;
+
+    // client packets lost on the way here
+    for (i = 0; i < client->netchan.dropped && i < PACKET_BACKUP; i++) {
+        SV_RateControlSample(&rc->drops, 1.0f, RATE_CONTROL_LOSS_SPAN);
+    }
+    SV_RateControlSample(&rc->drops, 0.0f, RATE_CONTROL_LOSS_SPAN);
+
+    if (ack > rc->lastAcked && ack < client->netchan.outgoingSequence &&
+        ack >= client->netchan.outgoingSequence - PACKET_BACKUP) {
+        // with fewer client packets than snapshots, a gap only means the acks
+        // were merged
+        lost = 0;
+        if (rc->packetMsec * 4 < rc->snapshotMsec * 3) {
+            lost = ack - rc->lastAcked - 1;
+            if (lost > PACKET_BACKUP) {
+                lost = PACKET_BACKUP;
+            }
+        }
+        for (i = 0; i < lost; i++) {
+            SV_RateControlSample(&rc->loss, 1.0f, RATE_CONTROL_LOSS_SPAN);
+        }
+        SV_RateControlSample(&rc->loss, 0.0f, RATE_CONTROL_LOSS_SPAN);
+        rc->lost += lost;
+        rc->acked++;
+        rc->periodLost += lost;
+        rc->periodAcked++;
+        rc->lastAcked = ack;
+
+        frame = &client->frames[ack & PACKET_MASK];
+        SV_RateControlSample(&rc->bytes, frame->messageSize + UDPIP_HEADER_SIZE,
+                             RATE_CONTROL_SIZE_SPAN);
+        SV_RateControlSample(&rc->entities, frame->num_entities,
+                             RATE_CONTROL_SIZE_SPAN);
+    }
+
+    if (now - rc->lastAdjust < RATE_CONTROL_PERIOD ||
+        now - rc->lastAdjust < client->ping * 2) {
+        return;
+    }
+    rc->lastAdjust = now;
+
+    // clients SV_SendClientMessages doesn't rate limit
+    if (client->netchan.remoteAddress.type == NA_LOOPBACK ||
+        (sv_lanForceRate->integer &&
+         Sys_IsLANAddress(client->netchan.remoteAddress))) {
+        rc->snapshotMsec = client->snapshotMsec;
+        rc->entityBudget = 0;
+        return;
+    }
+
+    // the lowest ping drifts up so that a new route is picked up
+    if (client->ping > 0) {
+        if (!rc->minPing || client->ping < rc->minPing) {
+            rc->minPing = client->ping;
+        } else {
+            rc->minPing++;
+        }
+    }
+
+    // the averages span many periods at low snapshot rates, so act on what
+    // happened since the last adjustment too, or the rate would keep falling
+    // long after the loss stopped
+    periodLoss = 0;
+    if (rc->periodAcked + rc->periodLost) {
+        periodLoss = (float)rc->periodLost / (rc->periodAcked + rc->periodLost);
+    }
+    rc->periodAcked = rc->periodLost = 0;
+
+    queued = rc->minPing ? client->ping - rc->minPing : 0;
+    if (periodLoss > RATE_CONTROL_LOSS_MAX &&
+        rc->loss > RATE_CONTROL_LOSS_MAX) {
+        congested = qtrue;
+    } else if (periodLoss > RATE_CONTROL_LOSS_HIGH &&
+               rc->loss > RATE_CONTROL_LOSS_HIGH) {
+        congested = queued > RATE_CONTROL_QUEUE_MSEC / 2;
+    } else {
+        congested = queued > RATE_CONTROL_QUEUE_MSEC;
+    }
+
+    if (congested) {
+        rc->rate -= rc->rate / 4;
+    } else if (queued < RATE_CONTROL_QUEUE_MSEC / 2 &&
+               (periodLoss < RATE_CONTROL_LOSS_LOW ||
+                periodLoss <= rc->loss)) {
+        rc->rate += MAX(rc->rate / 16, 1000);
+    }
+    rc->rate = MAX(rc->rate, MIN(RATE_CONTROL_MIN, cap));
+    rc->rate = MIN(rc->rate, cap);
+
+    // slow the snapshots down until they fit
+    snapshotMsec = client->snapshotMsec;
+    if (rc->bytes * 1000 > (float)rc->rate * snapshotMsec) {
+        snapshotMsec = rc->bytes * 1000 / rc->rate;
+        snapshotMsec = MIN(snapshotMsec, RATE_CONTROL_MAX_MSEC);
+        snapshotMsec = MAX(snapshotMsec, client->snapshotMsec);
+    }
+    rc->snapshotMsec = snapshotMsec;
+
+    // and leave entities out when that is not enough, assuming the size
+    // grows with their number
+    rc->entityBudget = 0;
+    if (rc->entities >= 1.0f && rc->visibleEntities > rc->entities) {
+        fullBytes = rc->bytes * rc->visibleEntities / rc->entities;
+    } else {
+        fullBytes = rc->bytes;
+    }
+    perSnapshot = rc->rate * snapshotMsec / 1000;
+    if (fullBytes > perSnapshot && rc->visibleEntities) {
+        rc->entityBudget = rc->visibleEntities * perSnapshot / fullBytes;
+        rc->entityBudget = MAX(rc->entityBudget, RATE_CONTROL_MIN_ENTITIES);
+    }
+}
+
+/*
+====================
+SV_SnapshotMsec
+
+The interval snapshots are sent to the client at
+====================
+*/
+int SV_SnapshotMsec(client_t *client) {
+    if (sv_adaptiveRate->integer && client->rateControl.rate) {
+        return client->rateControl.snapshotMsec;
+    }
+    return client->snapshotMsec;
+}
+
+/*
+====================
+SV_RateSim_f
+
+Runs the rate control of a fake client over a simulated link, to see how it
+settles. The link carries kbytes per second with oneway msec of latency, a
+queue of 200 msec and loss percent random drops in each direction, and its
+capacity halves half way through.
+====================
+*/
+void SV_RateSim_f(void) {
+    typedef struct {
+        int arrival;
+        int sequence;
+        int size;
+    } simPacket_t;
+    static simPacket_t queue[1024];
+    static client_t client;
+    rateControl_t *rc = &client.rateControl;
+    clientSnapshot_t *frame;
+    int capacity, oneway, loss, seconds, visible, entities;
+    int now, head, tail, busyUntil, size, newest, nextCmd, lastSnapshot;
+    int second, sentBytes, gotBytes, gotSnapshots;
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("usage: ratesim <kbytes/sec> [loss %%] [oneway msec] "
+                   "[seconds]\n");
+        return;
+    }
+    capacity = atoi(Cmd_Argv(1)) * 1024;
+    loss = Cmd_Argc() > 2 ? atoi(Cmd_Argv(2)) : 0;
+    oneway = Cmd_Argc() > 3 ? atoi(Cmd_Argv(3)) : 40;
+    seconds = Cmd_Argc() > 4 ? atoi(Cmd_Argv(4)) : 20;
+    if (capacity <= 0 || seconds <= 0) {
+        return;
+    }
+
+    Com_Memset(&client, 0, sizeof(client));
+    client.rate = 25000;
+    client.snapshotMsec = 50;
+    client.ping = oneway * 2;
+    client.netchan.outgoingSequence = 1;
+    visible = 120;
+
+    head = tail = 0;
+    busyUntil = newest = nextCmd = lastSnapshot = 0;
+    sentBytes = gotBytes = gotSnapshots = 0;
+    srand(0);
+
+    Com_Printf("sv_adaptiveRate %i, client rate %i snaps %i, link %i B/s "
+               "%i%% loss %i msec\n",
+               sv_adaptiveRate->integer, client.rate,
+               1000 / client.snapshotMsec, capacity, loss, oneway);
+    Com_Printf(" sec   link  estimate  msec  budget  loss   sent/s   got/s  "
+               "snaps/s\n");
+
+    for (now = 1; now <= seconds * 1000; now++) {
+        if (now == seconds * 500) {
+            capacity /= 2;
+        }
+
+        // snapshots, gated like SV_SendClientMessages does
+        if (now - lastSnapshot >= SV_SnapshotMsec(&client) &&
+            now - client.netchan.lastSentTime >=
+                (client.netchan.lastSentSize + UDPIP_HEADER_SIZE) * 1000 /
+                    MIN(client.rate, sv_adaptiveRate->integer && rc->rate
+                                         ? rc->rate
+                                         : client.rate)) {
+            entities = visible;
+            if (sv_adaptiveRate->integer && rc->entityBudget) {
+                entities = MIN(entities, rc->entityBudget);
+            }
+            rc->visibleEntities = visible;
+            size = 120 + 12 * entities + rand() % 64;
+
+            frame = &client.frames[client.netchan.outgoingSequence &
+                                   PACKET_MASK];
+            frame->messageSize = size;
+            frame->num_entities = entities;
+            frame->messageSent = now;
+            frame->messageAcked = -1;
+            client.netchan.lastSentSize = size;
+            client.netchan.lastSentTime = now;
+            lastSnapshot = now;
+            sentBytes += size + UDPIP_HEADER_SIZE;
+
+            // tail drop once the bottleneck queue is 200 msec deep
+            if (busyUntil - now < 200 && (tail + 1) % 1024 != head &&
+                rand() % 100 >= loss) {
+                busyUntil = MAX(busyUntil, now) +
+                            (size + UDPIP_HEADER_SIZE) * 1000 / capacity;
+                queue[tail].arrival = busyUntil + oneway;
+                queue[tail].sequence = client.netchan.outgoingSequence;
+                queue[tail].size = size + UDPIP_HEADER_SIZE;
+                tail = (tail + 1) % 1024;
+            }
+            client.netchan.outgoingSequence++;
+        }
+
+        while (head != tail && queue[head].arrival <= now) {
+            newest = queue[head].sequence;
+            frame = &client.frames[newest & PACKET_MASK];
+            client.ping +=
+                (now + oneway - frame->messageSent - client.ping) / 8;
+            gotBytes += queue[head].size;
+            gotSnapshots++;
+            head = (head + 1) % 1024;
+        }
+
+        // usercmds at cl_maxpackets 30, seen oneway msec later
+        if (now >= nextCmd) {
+            nextCmd = now + 33;
+            if (rand() % 100 >= loss) {
+                client.messageAcknowledge = newest;
+                SV_UpdateRateControl(&client, now + oneway);
+                client.netchan.dropped = 0;
+            } else {
+                client.netchan.dropped++;
+            }
+        }
+
+        if (now % 1000 == 0) {
+            second = now / 1000;
+            Com_Printf("%4i %6i %9i %5i %7i %4.1f%% %8i %7i %8i\n", second,
+                       capacity, rc->rate, SV_SnapshotMsec(&client),
+                       rc->entityBudget, rc->loss * 100, sentBytes, gotBytes,
+                       gotSnapshots);
+            sentBytes = gotBytes = gotSnapshots = 0;
+        }
+    }
+}
+
 /*
 ====================
 SV_SendQueuedPackets
@@ -1244,7 +1923,7 @@ Return the time in msec until we expect to be called next
 */
 
 int SV_SendQueuedPackets() {
-    int numBlocks;
+    int dlBytes;
     int dlStart, deltaT, delayT;
     static int dlNextRound = 0;
     int timeVal = INT_MAX;
@@ -1264,23 +1943,22 @@ int SV_SendQueuedPackets() {
             if (deltaT < timeVal)
                 timeVal = deltaT + 1;
         } else {
-            numBlocks = SV_SendDownloadMessages();
+            dlBytes = SV_SendDownloadMessages();
 
-            if (numBlocks) {
+            if (dlBytes) {
                 // There are active downloads
                 deltaT = Sys_Milliseconds() - dlStart;
 
-                delayT = 1000 * numBlocks * MAX_DOWNLOAD_BLKSIZE;
-                delayT /= sv_dlRate->integer * 1024;
+                delayT = (int)(1000.0 * dlBytes / (sv_dlRate->integer * 1024));
 
                 if (delayT <= deltaT + 1) {
                     // Sending the last round of download messages
                     // took too long for given rate, don't wait for
                     // next round, but always enforce a 1ms delay
                     // between DL message rounds so we don't hog
-                    // all of the bandwidth. This will result in an
-                    // effective maximum rate of 1MB/s per user, but the
-                    // low download window size limits this anyways.
+                    // all of the bandwidth. Each client gets at most
+                    // MAX_DOWNLOAD_SHARED_BLKSIZE bytes per round, and the
+                    // download window limits this anyways.
                     if (timeVal > 2)
                         timeVal = 2;
 
@@ -45,6 +45,161 @@ A normal server packet will look like:
 =============================================================================
 */
 
+/*
+=============================================================================
+
+Entity delta cache
+
+Clients that acked the same frame need the same entity deltas. During
+SV_SendClientMessages every encoded delta is kept with the states it was
+made from, and later snapshots splice the bits straight into their message.
+Entries are only ever added, with a compare-and-swap on the list head, so
+snapshot workers can share the cache without locking.
+
+=============================================================================
+*/
+
+#define DELTA_CACHE_ENTRIES 2048
+#define DELTA_CACHE_DATA (256 * 1024)
+// longest delta MSG_WriteDeltaEntity can produce, with room to spare
+#define DELTA_CACHE_MAXBYTES 1024
+
+typedef struct deltaCacheEntry_s {
+    struct deltaCacheEntry_s *next;
+    entityState_t from;
+    entityState_t to;
+    qboolean force;
+    int bits;
+    byte *data;
+} deltaCacheEntry_t;
+
+typedef struct {
+    qboolean active;
+    deltaCacheEntry_t *heads[MAX_GENTITIES];
+    deltaCacheEntry_t entries[DELTA_CACHE_ENTRIES];
+    int numEntries;
+    byte data[DELTA_CACHE_DATA];
+    int dataUsed;
+} deltaCache_t;
+
+typedef struct {
+    int hits;
+    int misses;
+    int bytesSaved;
+} deltaCacheStats_t;
+
+static deltaCache_t deltaCache;
+
+/*
+=============
+SV_BeginDeltaCache
+=============
+*/
+static void SV_BeginDeltaCache(void) {
+    deltaCache.active = sv_deltaCache->integer ? qtrue : qfalse;
+    if (!deltaCache.active) {
+        return;
+    }
+
+    Com_Memset(deltaCache.heads, 0, sizeof(deltaCache.heads));
+    deltaCache.numEntries = 0;
+    deltaCache.dataUsed = 0;
+}
+
+/*
+=============
+SV_EndDeltaCache
+
+Snapshots sent outside of SV_SendClientMessages don't use the cache
+=============
+*/
+static void SV_EndDeltaCache(void) { deltaCache.active = qfalse; }
+
+/*
+=============
+SV_AddDeltaCacheEntry
+=============
+*/
+static void SV_AddDeltaCacheEntry(entityState_t *from, entityState_t *to,
+                                  qboolean force, const byte *data, int bits) {
+    deltaCacheEntry_t *e;
+    deltaCacheEntry_t **head;
+    int bytes = (bits + 7) >> 3;
+    int index, ofs;
+
+    index = Sys_AtomicAdd(&deltaCache.numEntries, 1);
+    if (index >= DELTA_CACHE_ENTRIES) {
+        return;
+    }
+
+    ofs = Sys_AtomicAdd(&deltaCache.dataUsed, bytes);
+    if (ofs + bytes > DELTA_CACHE_DATA) {
+        return;
+    }
+
+    e = &deltaCache.entries[index];
+    e->from = *from;
+    e->to = *to;
+    e->force = force;
+    e->bits = bits;
+    e->data = deltaCache.data + ofs;
+    Com_Memcpy(e->data, data, bytes);
+
+    head = &deltaCache.heads[to->number];
+    do {
+        e->next = *head;
+    } while (!Sys_AtomicSwapPointer((void *volatile *)head, e->next, e));
+}
+
+/*
+=============
+SV_WriteDeltaEntity
+
+MSG_WriteDeltaEntity through the frame's delta cache
+=============
+*/
+static void SV_WriteDeltaEntity(msg_t *msg, entityState_t *from,
+                                entityState_t *to, qboolean force,
+                                deltaCacheStats_t *stats) {
+    deltaCacheEntry_t *e;
+    byte buf[DELTA_CACHE_MAXBYTES];
+    msg_t delta;
+
+    if (!deltaCache.active || to->number < 0 || to->number >= MAX_GENTITIES) {
+        MSG_WriteDeltaEntity(msg, from, to, force);
+        return;
+    }
+
+    // most entities don't change from frame to frame and send nothing
+    if (!force && !memcmp(from, to, sizeof(*to))) {
+        return;
+    }
+
+    // close to the end of the message, let MSG_WriteDeltaEntity decide how
+    // much still fits
+    if (msg->maxsize - msg->cursize < DELTA_CACHE_MAXBYTES) {
+        MSG_WriteDeltaEntity(msg, from, to, force);
+        return;
+    }
+
+    for (e = deltaCache.heads[to->number]; e; e = e->next) {
+        if (e->force == force && !memcmp(&e->to, to, sizeof(*to)) &&
+            !memcmp(&e->from, from, sizeof(*from))) {
+            MSG_WriteRawBits(msg, e->data, e->bits);
+            stats->hits++;
+            stats->bytesSaved += (e->bits + 7) >> 3;
+            return;
+        }
+    }
+
+    MSG_Init(&delta, buf, sizeof(buf));
+    MSG_WriteDeltaEntity(&delta, from, to, force);
+    MSG_WriteRawBits(msg, buf, delta.bit);
+    stats->misses++;
+
+    SV_AddDeltaCacheEntry(from, to, force, buf, delta.bit);
+}
+
 /*
 =============
 SV_EmitPacketEntities
@@ -58,6 +213,7 @@ static void SV_EmitPacketEntities(clientSnapshot_t *from, clientSnapshot_t *to,
     int oldindex, newindex;
     int oldnum, newnum;
     int from_num_entities;
+    deltaCacheStats_t stats;
 
     // generate the delta update
     if (!from) {
@@ -66,6 +222,8 @@ static void SV_EmitPacketEntities(clientSnapshot_t *from, clientSnapshot_t *to,
         from_num_entities = from->num_entities;
     }
 
+    Com_Memset(&stats, 0, sizeof(stats));
+
     newent = NULL;
     oldent = NULL;
     newindex = 0;
@@ -91,7 +249,7 @@ static void SV_EmitPacketEntities(clientSnapshot_t *from, clientSnapshot_t *to,
             // delta update from old position
             // because the force parm is qfalse, this will not result
             // in any bytes being emited if the entity has not changed at all
-            MSG_WriteDeltaEntity(msg, oldent, newent, qfalse);
+            SV_WriteDeltaEntity(msg, oldent, newent, qfalse, &stats);
             oldindex++;
             newindex++;
             continue;
@@ -99,8 +257,8 @@ static void SV_EmitPacketEntities(clientSnapshot_t *from, clientSnapshot_t *to,
 
         if (newnum < oldnum) {
             // this is a new entity, send it from the baseline
-            MSG_WriteDeltaEntity(msg, &sv.svEntities[newnum].baseline, newent,
-                                 qtrue);
+            SV_WriteDeltaEntity(msg, &sv.svEntities[newnum].baseline, newent,
+                                qtrue, &stats);
             newindex++;
             continue;
         }
@@ -115,51 +273,76 @@ static void SV_EmitPacketEntities(clientSnapshot_t *from, clientSnapshot_t *to,
 
     MSG_WriteBits(msg, (MAX_GENTITIES - 1),
                   GENTITYNUM_BITS); // end of packetentities
+
+    if (stats.hits || stats.misses) {
+        Sys_AtomicAdd64(&svs.deltaCacheHits, stats.hits);
+        Sys_AtomicAdd64(&svs.deltaCacheMisses, stats.misses);
+        Sys_AtomicAdd64(&svs.deltaCacheBytesSaved, stats.bytesSaved);
+    }
 }
 
 /*
 ==================
-SV_WriteSnapshotToClient
+SV_SnapshotDeltaFrame
+
+Picks the previous frame to delta compress the new snapshot against, NULL for
+a full snapshot. nextSnapshotEntities is the entity ring position right after
+the new frame was stored.
 ==================
 */
-static void SV_WriteSnapshotToClient(client_t *client, msg_t *msg,
-                                     msg_t *msg_demo) {
-    clientSnapshot_t *frame, *oldframe;
-    int lastframe, lastdemoframe;
-    int i;
-    int snapFlags;
+static clientSnapshot_t *SV_SnapshotDeltaFrame(client_t *client,
+                                               int nextSnapshotEntities,
+                                               int *lastframe,
+                                               const char **reason) {
+    clientSnapshot_t *oldframe;
 
-    // this is the snapshot we are creating
-    frame = &client->frames[client->netchan.outgoingSequence & PACKET_MASK];
+    *lastframe = 0;
+    *reason = NULL;
 
     // try to use a previous frame as the source for delta compressing the
     // snapshot
     if (client->deltaMessage <= 0 || client->state != CS_ACTIVE) {
         // client is asking for a retransmit
-        oldframe = NULL;
-        lastframe = 0;
-    } else if (client->netchan.outgoingSequence - client->deltaMessage >=
-               (PACKET_BACKUP - 3)) {
+        return NULL;
+    }
+
+    if (client->netchan.outgoingSequence - client->deltaMessage >=
+        (PACKET_BACKUP - 3)) {
         // client hasn't gotten a good message through in a long time
-        Com_DPrintf("%s: Delta request from out of date packet.\n",
-                    client->name);
-        oldframe = NULL;
-        lastframe = 0;
-    } else {
-        // we have a valid snapshot to delta from
-        oldframe = &client->frames[client->deltaMessage & PACKET_MASK];
-        lastframe = client->netchan.outgoingSequence - client->deltaMessage;
+        *reason = "Delta request from out of date packet.";
+        return NULL;
+    }
 
-        // the snapshot's entities may still have rolled off the buffer, though
-        if (oldframe->first_entity <=
-            svs.nextSnapshotEntities - svs.numSnapshotEntities) {
-            Com_DPrintf("%s: Delta request from out of date entities.\n",
-                        client->name);
-            oldframe = NULL;
-            lastframe = 0;
-        }
+    // we have a valid snapshot to delta from
+    oldframe = &client->frames[client->deltaMessage & PACKET_MASK];
+
+    // the snapshot's entities may still have rolled off the buffer, though
+    if (oldframe->first_entity <=
+        nextSnapshotEntities - svs.numSnapshotEntities) {
+        *reason = "Delta request from out of date entities.";
+        return NULL;
     }
 
+    *lastframe = client->netchan.outgoingSequence - client->deltaMessage;
+    return oldframe;
+}
+
+/*
+==================
+SV_WriteSnapshotToClient
+==================
+*/
+static void SV_WriteSnapshotToClient(client_t *client,
+                                     clientSnapshot_t *oldframe, int lastframe,
+                                     msg_t *msg, msg_t *msg_demo) {
+    clientSnapshot_t *frame;
+    int lastdemoframe;
+    int i;
+    int snapFlags;
+
+    // this is the snapshot we are creating
+    frame = &client->frames[client->netchan.outgoingSequence & PACKET_MASK];
+
     lastdemoframe = 1; // default assumption: we delta from the previous frame
     if (client->demorecording && client->demowaiting) {
         lastdemoframe = 0;
@@ -284,6 +467,8 @@ Build a client snapshot structure
 typedef struct {
     int numSnapshotEntities;
     int snapshotEntities[MAX_SNAPSHOT_ENTITIES];
+    byte added[MAX_GENTITIES / 8]; // prevents double adding from portal views
+    const char *error; // raised by the caller once the entities are gathered
 } snapshotEntityNumbers_t;
 
 /*
@@ -297,10 +482,7 @@ static int QDECL SV_QsortEntityNumbers(const void *a, const void *b) {
     ea = (int *)a;
     eb = (int *)b;
 
-    if (*ea == *eb) {
-        Com_Error(ERR_DROP, "SV_QsortEntityStates: duplicated entity");
-    }
-
+    // no duplicates to catch here, the added bits already rule them out
     if (*ea < *eb) {
         return -1;
     }
@@ -313,13 +495,15 @@ static int QDECL SV_QsortEntityNumbers(const void *a, const void *b) {
 SV_AddEntToSnapshot
 ===============
 */
-static void SV_AddEntToSnapshot(svEntity_t *svEnt, sharedEntity_t *gEnt,
+static void SV_AddEntToSnapshot(sharedEntity_t *gEnt,
                                 snapshotEntityNumbers_t *eNums) {
+    int e = gEnt->s.number;
+
     // if we have already added this entity to this snapshot, don't add again
-    if (svEnt->snapshotCounter == sv.snapshotCounter) {
+    if (eNums->added[e >> 3] & (1 << (e & 7))) {
         return;
     }
-    svEnt->snapshotCounter = sv.snapshotCounter;
+    eNums->added[e >> 3] |= 1 << (e & 7);
 
     // if we are full, silently discard entities
     if (eNums->numSnapshotEntities == MAX_SNAPSHOT_ENTITIES) {
@@ -330,18 +514,265 @@ static void SV_AddEntToSnapshot(svEntity_t *svEnt, sharedEntity_t *gEnt,
     eNums->numSnapshotEntities++;
 }
 
+/*
+=============================================================================
+
+ENTITY CLUSTER INDEX
+
+Nothing moves while a batch of snapshots is built, so SV_SendClientMessages
+indexes the linked entities by the clusters they touch once for the whole
+batch. SV_AddEntitiesVisibleFromPoint then ANDs the viewer's PVS with the set
+of occupied clusters 64 clusters at a time and only looks at the entities
+listed under the visible ones. Entities whose visibility doesn't only come
+from their cluster list (broadcast, client mask and overflowing ones) are
+always looked at. The candidates are still tested in entity number order by
+the same code as before, so the snapshots are identical.
+
+=============================================================================
+*/
+
+typedef struct {
+    qboolean valid;
+    int numClusters;
+    int clusterWords;  // 64 bit words in a cluster set
+    uint64_t *occupied; // clusters with at least one entity listed
+    int *clusterStart;  // numClusters + 1 offsets into entities
+    int *clusterFill;
+    short entities[MAX_GENTITIES * MAX_ENT_CLUSTERS];
+    uint64_t always[MAX_GENTITIES / 64]; // looked at whatever the PVS
+} entityIndex_t;
+
+static entityIndex_t entityIndex;
+
+/*
+=======================
+SV_FreeEntityIndex
+=======================
+*/
+void SV_FreeEntityIndex(void) {
+    if (entityIndex.occupied) {
+        Z_Free(entityIndex.occupied);
+        Z_Free(entityIndex.clusterStart);
+        Z_Free(entityIndex.clusterFill);
+    }
+    Com_Memset(&entityIndex, 0, sizeof(entityIndex));
+}
+
+/*
+=======================
+SV_BuildEntityIndex
+
+Only valid until SV_InvalidateEntityIndex, the next game frame or
+client command may move anything
+=======================
+*/
+static void SV_BuildEntityIndex(void) {
+    sharedEntity_t *ent;
+    svEntity_t *svEnt;
+    int numClusters, e, i, c, total;
+
+    entityIndex.valid = qfalse;
+
+    if (!sv.state || !sv_entityIndex->integer) {
+        return;
+    }
+
+    numClusters = CM_NumClusters();
+    if (numClusters < 1) {
+        return;
+    }
+
+    if (numClusters != entityIndex.numClusters) {
+        SV_FreeEntityIndex();
+        entityIndex.numClusters = numClusters;
+        entityIndex.clusterWords = (numClusters + 63) / 64;
+        entityIndex.occupied =
+            Z_Malloc(entityIndex.clusterWords * sizeof(uint64_t));
+        entityIndex.clusterStart = Z_Malloc((numClusters + 1) * sizeof(int));
+        entityIndex.clusterFill = Z_Malloc(numClusters * sizeof(int));
+    }
+
+    Com_Memset(entityIndex.occupied, 0,
+               entityIndex.clusterWords * sizeof(uint64_t));
+    Com_Memset(entityIndex.clusterStart, 0, (numClusters + 1) * sizeof(int));
+    Com_Memset(entityIndex.always, 0, sizeof(entityIndex.always));
+
+    // count the entities listed under each cluster
+    for (e = 0; e < sv.num_entities; e++) {
+        ent = SV_GentityNum(e);
+        if (!ent->r.linked) {
+            continue;
+        }
+
+        // the full walk fixes these up for every linked entity
+        if (ent->s.number != e) {
+            Com_DPrintf("FIXING ENT->S.NUMBER!!!\n");
+            ent->s.number = e;
+        }
+
+        svEnt = &sv.svEntities[e];
+
+        if ((ent->r.svFlags & (SVF_BROADCAST | SVF_CLIENTMASK)) ||
+            svEnt->lastCluster) {
+            entityIndex.always[e >> 6] |= 1ULL << (e & 63);
+            continue;
+        }
+
+        for (i = 0; i < svEnt->numClusters; i++) {
+            entityIndex.clusterStart[svEnt->clusternums[i] + 1]++;
+        }
+    }
+
+    for (c = 0, total = 0; c < numClusters; c++) {
+        if (entityIndex.clusterStart[c + 1]) {
+            entityIndex.occupied[c >> 6] |= 1ULL << (c & 63);
+        }
+        total += entityIndex.clusterStart[c + 1];
+        entityIndex.clusterStart[c + 1] = total;
+        entityIndex.clusterFill[c] = entityIndex.clusterStart[c];
+    }
+
+    // and fill the lists in
+    for (e = 0; e < sv.num_entities; e++) {
+        ent = SV_GentityNum(e);
+        if (!ent->r.linked ||
+            (entityIndex.always[e >> 6] & (1ULL << (e & 63)))) {
+            continue;
+        }
+
+        svEnt = &sv.svEntities[e];
+        for (i = 0; i < svEnt->numClusters; i++) {
+            c = svEnt->clusternums[i];
+            entityIndex.entities[entityIndex.clusterFill[c]++] = e;
+        }
+    }
+
+    entityIndex.valid = qtrue;
+}
+
+/*
+=======================
+SV_InvalidateEntityIndex
+=======================
+*/
+static void SV_InvalidateEntityIndex(void) { entityIndex.valid = qfalse; }
+
+/*
+=======================
+SV_LowestBit
+=======================
+*/
+static ID_INLINE int SV_LowestBit(uint64_t bits) {
+#ifdef __GNUC__
+    return __builtin_ctzll(bits);
+#else
+    int n;
+
+    for (n = 0; !(bits & 1); n++) {
+        bits >>= 1;
+    }
+    return n;
+#endif
+}
+
+/*
+=======================
+SV_LoadClusterWord
+
+Up to 64 clusters of a PVS row, cluster n in bit n. Rows aren't aligned and
+the last one may end mid word.
+=======================
+*/
+static ID_INLINE uint64_t SV_LoadClusterWord(const byte *pvs, int bytes) {
+    uint64_t word = 0;
+
+    bytes = MIN(bytes, 8);
+#ifdef Q3_LITTLE_ENDIAN
+    Com_Memcpy(&word, pvs, bytes);
+#else
+    while (bytes--) {
+        word |= (uint64_t)pvs[bytes] << (bytes * 8);
+    }
+#endif
+    return word;
+}
+
+/*
+=======================
+SV_EntityCandidates
+
+Sets the bits of the entities listed under a cluster of pvs, and of the ones
+that always have to be looked at
+=======================
+*/
+static void SV_EntityCandidates(const byte *pvs, uint64_t *candidates) {
+    uint64_t visible;
+    int pvsBytes, w, c, i, end;
+
+    Com_Memcpy(candidates, entityIndex.always, sizeof(entityIndex.always));
+
+    pvsBytes = (entityIndex.numClusters + 7) >> 3;
+
+    for (w = 0; w < entityIndex.clusterWords; w++) {
+        if (!entityIndex.occupied[w]) {
+            continue;
+        }
+
+        visible = SV_LoadClusterWord(pvs + w * 8, pvsBytes - w * 8) &
+                  entityIndex.occupied[w];
+
+        while (visible) {
+            c = w * 64 + SV_LowestBit(visible);
+            visible &= visible - 1;
+
+            end = entityIndex.clusterStart[c + 1];
+            for (i = entityIndex.clusterStart[c]; i < end; i++) {
+                candidates[entityIndex.entities[i] >> 6] |=
+                    1ULL << (entityIndex.entities[i] & 63);
+            }
+        }
+    }
+}
+
+/*
+=======================
+SV_NextEntity
+
+The first entity from e on to look at, every one without candidates
+=======================
+*/
+static int SV_NextEntity(const uint64_t *candidates, int e) {
+    uint64_t bits;
+    int w;
+
+    if (!candidates) {
+        return e;
+    }
+
+    w = e >> 6;
+    if (w >= MAX_GENTITIES / 64) {
+        return MAX_GENTITIES;
+    }
+
+    bits = candidates[w] & (~0ULL << (e & 63));
+    while (!bits) {
+        if (++w == MAX_GENTITIES / 64) {
+            return MAX_GENTITIES;
+        }
+        bits = candidates[w];
+    }
+
+    return w * 64 + SV_LowestBit(bits);
+}
+
 // TheDoctor: Anti-wallhack
+// a reset sv.time is dealt with in SV_UpdatePlayerVisibility, this only reads
+// so that snapshots can be gathered on several threads
 static qboolean recentlySeen(client_t *viewer_cl, int ent_clnum) {
-    if (viewer_cl->tracetimer[ent_clnum] >
-        sv.time + 210 + 10) { // if the sv.time has been reset
-        viewer_cl->tracetimer[ent_clnum] = sv.time; // reset the tracetimer
-    } else if (viewer_cl->tracetimer[ent_clnum] >
-               (sv.time + 210 -
-                10)) { // if we have recently seen this entity, we are lazy and
-                       // assume it is still visible
-        return qtrue;
-    }
-    return qfalse;
+    // if we have recently seen this entity, we are lazy and assume it is
+    // still visible
+    return viewer_cl->tracetimer[ent_clnum] > sv.time + 210 - 10 &&
+           viewer_cl->tracetimer[ent_clnum] <= sv.time + 210 + 10;
 }
 
 #define offsetrandom2(MIN, MAX)                                                \
@@ -365,7 +796,8 @@ static void SV_AddEntitiesVisibleFromPoint(vec3_t origin,
     byte *clientpvs;
     byte *bitvector;
     client_t *cl;
-    vec3_t diff;
+    uint64_t candidates[MAX_GENTITIES / 64];
+    uint64_t *next;
 
     // during an error shutdown message we may need to transmit
     // the shutdown message after the server has shutdown, so
@@ -383,7 +815,15 @@ static void SV_AddEntitiesVisibleFromPoint(vec3_t origin,
 
     clientpvs = CM_ClusterPVS(clientcluster);
 
-    for (e = 0; e < sv.num_entities; e++) {
+    // with the index only the entities that can be visible are looked at
+    next = NULL;
+    if (entityIndex.valid) {
+        SV_EntityCandidates(clientpvs, candidates);
+        next = candidates;
+    }
+
+    for (e = SV_NextEntity(next, 0); e < sv.num_entities;
+         e = SV_NextEntity(next, e + 1)) {
         ent = SV_GentityNum(e);
 
         // never send entities that aren't linked in
@@ -415,8 +855,10 @@ static void SV_AddEntitiesVisibleFromPoint(vec3_t origin,
         }
         // entities can be flagged to be sent to a given mask of clients
         if (ent->r.svFlags & SVF_CLIENTMASK) {
-            if (frame->ps.clientNum >= 32)
-                Com_Error(ERR_DROP, "SVF_CLIENTMASK: clientNum >= 32");
+            if (frame->ps.clientNum >= 32) {
+                eNums->error = "SVF_CLIENTMASK: clientNum >= 32";
+                return;
+            }
             if (~ent->r.singleClient & (1 << frame->ps.clientNum))
                 continue;
         }
@@ -424,7 +866,7 @@ static void SV_AddEntitiesVisibleFromPoint(vec3_t origin,
         svEnt = SV_SvEntityForGentity(ent);
 
         // don't double add an entity through portals
-        if (svEnt->snapshotCounter == sv.snapshotCounter) {
+        if (eNums->added[e >> 3] & (1 << (e & 7))) {
             continue;
         }
 
@@ -436,7 +878,7 @@ static void SV_AddEntitiesVisibleFromPoint(vec3_t origin,
         if (ent->r.svFlags & SVF_BROADCAST &&
             (ent->s.eType != ET_PLAYER || sv_antiwallhack->integer == 0 ||
              recentlySeen(cl, ent->s.clientNum))) {
-            SV_AddEntToSnapshot(svEnt, ent, eNums);
+            SV_AddEntToSnapshot(ent, eNums);
             continue;
         }
 
@@ -481,16 +923,18 @@ static void SV_AddEntitiesVisibleFromPoint(vec3_t origin,
             }
         }
 
-        if (sv_antiwallhack->integer == 1 &&
+        // players seen through portals are not culled, the visibility
+        // matrix only knows about the view from the eye
+        if (sv_antiwallhack->integer == 1 && !portal &&
             (cl->netchan.remoteAddress.type != NA_BOT) &&
             ent->s.eType == ET_PLAYER) {
-            if (!SV_IsPlayerVisibleFromPoint(origin, frame, ent, diff)) {
+            if (!SV_PlayerVisible(frame->ps.clientNum, e)) {
                 continue;
             }
         }
 
         // add it
-        SV_AddEntToSnapshot(svEnt, ent, eNums);
+        SV_AddEntToSnapshot(ent, eNums);
         // reset ps.pm_type?
 
         // if it's a portal entity, add everything visible from its camera
@@ -509,9 +953,68 @@ static void SV_AddEntitiesVisibleFromPoint(vec3_t origin,
     }
 }
 
+typedef struct {
+    float distance;
+    int number;
+} entityDistance_t;
+
+/*
+=======================
+SV_QsortEntityDistances
+=======================
+*/
+static int QDECL SV_QsortEntityDistances(const void *a, const void *b) {
+    const entityDistance_t *ea = a, *eb = b;
+
+    if (ea->distance != eb->distance) {
+        return ea->distance < eb->distance ? -1 : 1;
+    }
+    return ea->number - eb->number;
+}
+
+/*
+=============
+SV_LimitSnapshotEntities
+
+Keeps the budget nearest entities to the viewer, events and broadcast
+entities first
+=============
+*/
+static void SV_LimitSnapshotEntities(const vec3_t org,
+                                     snapshotEntityNumbers_t *eNums,
+                                     int budget) {
+    entityDistance_t distances[MAX_SNAPSHOT_ENTITIES];
+    sharedEntity_t *ent;
+    vec3_t center;
+    int i;
+
+    for (i = 0; i < eNums->numSnapshotEntities; i++) {
+        ent = SV_GentityNum(eNums->snapshotEntities[i]);
+        distances[i].number = eNums->snapshotEntities[i];
+
+        if (ent->s.eType >= ET_EVENTS || (ent->r.svFlags & SVF_BROADCAST)) {
+            distances[i].distance = -1;
+            continue;
+        }
+
+        // brush models have no origin of their own
+        VectorAdd(ent->r.absmin, ent->r.absmax, center);
+        VectorScale(center, 0.5f, center);
+        distances[i].distance = DistanceSquared(center, org);
+    }
+
+    qsort(distances, eNums->numSnapshotEntities, sizeof(distances[0]),
+          SV_QsortEntityDistances);
+
+    for (i = 0; i < budget; i++) {
+        eNums->snapshotEntities[i] = distances[i].number;
+    }
+    eNums->numSnapshotEntities = budget;
+}
+
 /*
 =============
-SV_BuildClientSnapshot
+SV_GatherSnapshotEntities
 
 Decides which entities are going to be visible to the client, and
 copies off the playerstate and areabits.
@@ -521,28 +1024,27 @@ currently doesn't.
 
 For viewing through other player's eyes, clent can be something other than
 client->gentity
+
+Only the client's own frame is written, so this can run for several clients
+at once. Returns qfalse if there is nothing to store.
 =============
 */
-static void SV_BuildClientSnapshot(client_t *client) {
+static qboolean SV_GatherSnapshotEntities(client_t *client,
+                                          snapshotEntityNumbers_t *eNums) {
     vec3_t org;
     clientSnapshot_t *frame;
-    snapshotEntityNumbers_t entityNumbers;
     int i;
-    sharedEntity_t *ent;
-    entityState_t *state;
-    svEntity_t *svEnt;
     sharedEntity_t *clent;
     int clientNum;
     playerState_t *ps;
 
-    // bump the counter used to prevent double adding
-    sv.snapshotCounter++;
-
     // this is the frame we are creating
     frame = &client->frames[client->netchan.outgoingSequence & PACKET_MASK];
 
     // clear everything in this snapshot
-    entityNumbers.numSnapshotEntities = 0;
+    eNums->numSnapshotEntities = 0;
+    eNums->error = NULL;
+    Com_Memset(eNums->added, 0, sizeof(eNums->added));
     Com_Memset(frame->areabits, 0, sizeof(frame->areabits));
 
     // https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=62
@@ -550,7 +1052,7 @@ static void SV_BuildClientSnapshot(client_t *client) {
 
     clent = client->gentity;
     if (!clent || client->state == CS_ZOMBIE) {
-        return;
+        return qfalse;
     }
 
     // grab the current playerState_t
@@ -561,11 +1063,10 @@ static void SV_BuildClientSnapshot(client_t *client) {
     // be regenerated from the playerstate
     clientNum = frame->ps.clientNum;
     if (clientNum < 0 || clientNum >= MAX_GENTITIES) {
-        Com_Error(ERR_DROP, "SV_SvEntityForGentity: bad gEnt");
+        eNums->error = "SV_SvEntityForGentity: bad gEnt";
+        return qfalse;
     }
-    svEnt = &sv.svEntities[clientNum];
-
-    svEnt->snapshotCounter = sv.snapshotCounter;
+    eNums->added[clientNum >> 3] |= 1 << (clientNum & 7);
 
     // find the client's viewpoint
     VectorCopy(ps->origin, org);
@@ -573,14 +1074,21 @@ static void SV_BuildClientSnapshot(client_t *client) {
 
     // add all the entities directly visible to the eye, which
     // may include portal entities that merge other viewpoints
-    SV_AddEntitiesVisibleFromPoint(org, frame, &entityNumbers, qfalse);
+    SV_AddEntitiesVisibleFromPoint(org, frame, eNums, qfalse);
+
+    // more than the client's link can take, see SV_UpdateRateControl
+    client->rateControl.visibleEntities = eNums->numSnapshotEntities;
+    if (sv_adaptiveRate->integer && client->rateControl.entityBudget &&
+        eNums->numSnapshotEntities > client->rateControl.entityBudget) {
+        SV_LimitSnapshotEntities(org, eNums,
+                                 client->rateControl.entityBudget);
+    }
 
     // if there were portals visible, there may be out of order entities
     // in the list which will need to be resorted for the delta compression
-    // to work correctly.  This also catches the error condition
-    // of an entity being included twice.
-    qsort(entityNumbers.snapshotEntities, entityNumbers.numSnapshotEntities,
-          sizeof(entityNumbers.snapshotEntities[0]), SV_QsortEntityNumbers);
+    // to work correctly.
+    qsort(eNums->snapshotEntities, eNums->numSnapshotEntities,
+          sizeof(eNums->snapshotEntities[0]), SV_QsortEntityNumbers);
 
     // now that all viewpoint's areabits have been OR'd together, invert
     // all of them to make it a mask vector, which is what the renderer wants
@@ -588,11 +1096,30 @@ static void SV_BuildClientSnapshot(client_t *client) {
         ((int *)frame->areabits)[i] = ((int *)frame->areabits)[i] ^ -1;
     }
 
+    return qtrue;
+}
+
+/*
+=============
+SV_StoreSnapshotEntities
+
+Copies the gathered entity states into the circular snapshot buffer
+=============
+*/
+static void SV_StoreSnapshotEntities(client_t *client,
+                                     snapshotEntityNumbers_t *eNums) {
+    clientSnapshot_t *frame;
+    sharedEntity_t *ent;
+    entityState_t *state;
+    int i;
+
+    frame = &client->frames[client->netchan.outgoingSequence & PACKET_MASK];
+
     // copy the entity states out
     frame->num_entities = 0;
     frame->first_entity = svs.nextSnapshotEntities;
-    for (i = 0; i < entityNumbers.numSnapshotEntities; i++) {
-        ent = SV_GentityNum(entityNumbers.snapshotEntities[i]);
+    for (i = 0; i < eNums->numSnapshotEntities; i++) {
+        ent = SV_GentityNum(eNums->snapshotEntities[i]);
         state = &svs.snapshotEntities[svs.nextSnapshotEntities %
                                       svs.numSnapshotEntities];
         *state = ent->s;
@@ -606,6 +1133,28 @@ static void SV_BuildClientSnapshot(client_t *client) {
     }
 }
 
+/*
+=============
+SV_BuildClientSnapshot
+=============
+*/
+static void SV_BuildClientSnapshot(client_t *client) {
+    snapshotEntityNumbers_t entityNumbers;
+    qboolean gathered;
+
+    SV_UpdatePlayerVisibility();
+
+    gathered = SV_GatherSnapshotEntities(client, &entityNumbers);
+
+    if (entityNumbers.error) {
+        Com_Error(ERR_DROP, "%s", entityNumbers.error);
+    }
+
+    if (gathered) {
+        SV_StoreSnapshotEntities(client, &entityNumbers);
+    }
+}
+
 #ifdef USE_VOIP
 /*
 ==================
@@ -670,6 +1219,38 @@ void SV_SendMessageToClient(msg_t *msg, client_t *client) {
     SV_Netchan_Transmit(client, msg);
 }
 
+/*
+=======================
+SV_FinishClientSnapshot
+
+Records the demo frame and hands the encoded snapshot to the netchan
+=======================
+*/
+static void SV_FinishClientSnapshot(client_t *client, msg_t *msg,
+                                    msg_t *msg_demo, int headerBytes) {
+    playerState_t *ps;
+
+    if (client->demorecording && !client->demowaiting) {
+        SVCL_WriteDemoMessage(client, msg_demo, headerBytes);
+        ps = SV_GameClientNum(client - svs.clients);
+        if (ps->pm_type == PM_INTERMISSION) {
+            CL_StopRecord(client);
+        }
+    }
+
+#ifdef USE_VOIP
+    SV_WriteVoipToClient(client, msg);
+#endif
+
+    // check for overflow
+    if (msg->overflowed) {
+        Com_Printf("WARNING: msg overflowed for %s\n", client->name);
+        MSG_Clear(msg);
+    }
+
+    SV_SendMessageToClient(msg, client);
+}
+
 /*
 =======================
 SV_SendClientSnapshot
@@ -685,7 +1266,11 @@ void SV_SendClientSnapshot(client_t *client) {
     byte msg_buf_demo[MAX_MSGLEN];
     msg_t msg_demo;
     int headerBytes;
-    playerState_t *ps;
+    clientSnapshot_t *oldframe;
+    int lastframe;
+    const char *reason;
+
+    SV_FlushConfigstrings();
 
     // build the snapshot
     SV_BuildClientSnapshot(client);
@@ -713,39 +1298,219 @@ void SV_SendClientSnapshot(client_t *client) {
 
     // send over all the relevant entityState_t
     // and the playerState_t
-    SV_WriteSnapshotToClient(client, &msg, &msg_demo);
+    oldframe = SV_SnapshotDeltaFrame(client, svs.nextSnapshotEntities,
+                                     &lastframe, &reason);
+    if (reason) {
+        Com_DPrintf("%s: %s\n", client->name, reason);
+    }
+    SV_WriteSnapshotToClient(client, oldframe, lastframe, &msg, &msg_demo);
 
-    if (client->demorecording && !client->demowaiting) {
-        SVCL_WriteDemoMessage(client, &msg_demo, headerBytes);
-        ps = SV_GameClientNum(client - svs.clients);
-        if (ps->pm_type == PM_INTERMISSION) {
-            CL_StopRecord(client);
+    SV_FinishClientSnapshot(client, &msg, &msg_demo, headerBytes);
+}
+
+/*
+=============================================================================
+
+Parallel snapshots
+
+With sv_threads set, the snapshots of all clients due this frame are built
+and encoded on the worker threads. Everything touching shared state (the
+entity ring, demo files, the netchan) stays on the main thread and runs in
+client order, so the packets are the same as the serial path would send.
+
+=============================================================================
+*/
+
+typedef struct {
+    client_t *client;
+    qboolean gathered;
+    snapshotEntityNumbers_t entityNumbers;
+    clientSnapshot_t *oldframe;
+    int lastframe;
+    msg_t msg;
+    msg_t msg_demo;
+    byte msgBuf[MAX_MSGLEN];
+    byte msgBufDemo[MAX_MSGLEN];
+} snapshotJob_t;
+
+static snapshotJob_t *snapshotJobs;
+static int numSnapshotJobs;
+
+/*
+=======================
+SV_BuildSnapshotJob
+=======================
+*/
+static void SV_BuildSnapshotJob(void *data, int index) {
+    snapshotJob_t *job = (snapshotJob_t *)data + index;
+
+    job->gathered = SV_GatherSnapshotEntities(job->client, &job->entityNumbers);
+}
+
+/*
+=======================
+SV_EncodeSnapshotJob
+=======================
+*/
+static void SV_EncodeSnapshotJob(void *data, int index) {
+    snapshotJob_t *job = (snapshotJob_t *)data + index;
+    client_t *client = job->client;
+
+    if (client->gentity && client->gentity->r.svFlags & SVF_BOT) {
+        return;
+    }
+
+    MSG_Init(&job->msg, job->msgBuf, sizeof(job->msgBuf));
+    MSG_Init(&job->msg_demo, job->msgBufDemo, sizeof(job->msgBufDemo));
+    job->msg.allowoverflow = qtrue;
+    job->msg_demo.allowoverflow = qtrue;
+
+    MSG_WriteLong(&job->msg, client->lastClientCommand);
+    MSG_WriteLong(&job->msg_demo, client->lastClientCommand);
+
+    SV_UpdateServerCommandsToClient(client, &job->msg, &job->msg_demo);
+
+    SV_WriteSnapshotToClient(client, job->oldframe, job->lastframe, &job->msg,
+                             &job->msg_demo);
+}
+
+/*
+=======================
+SV_FreeSnapshotJobs
+=======================
+*/
+void SV_FreeSnapshotJobs(void) {
+    if (snapshotJobs) {
+        Z_Free(snapshotJobs);
+        snapshotJobs = NULL;
+    }
+    numSnapshotJobs = 0;
+}
+
+/*
+=======================
+SV_SendClientSnapshotsParallel
+
+Returns qfalse without sending anything if this frame has to go through the
+serial path
+=======================
+*/
+static qboolean SV_SendClientSnapshotsParallel(client_t **clients,
+                                               int numClients) {
+    snapshotJob_t *job;
+    sharedEntity_t *ent;
+    const char *reason[MAX_CLIENTS];
+    int nextSnapshotEntities;
+    int i;
+
+    if (numClients > numSnapshotJobs) {
+        SV_FreeSnapshotJobs();
+        snapshotJobs = Z_Malloc(sv_maxclients->integer * sizeof(*snapshotJobs));
+        numSnapshotJobs = sv_maxclients->integer;
+    }
+
+    // SV_AddEntitiesVisibleFromPoint repairs entity numbers as it goes, do it
+    // up front so that the workers only ever read the entities
+    for (i = 0; i < sv.num_entities; i++) {
+        ent = SV_GentityNum(i);
+        if (ent->r.linked && ent->s.number != i) {
+            Com_DPrintf("FIXING ENT->S.NUMBER!!!\n");
+            ent->s.number = i;
         }
     }
 
-#ifdef USE_VOIP
-    SV_WriteVoipToClient(client, &msg);
-#endif
+    for (i = 0; i < numClients; i++) {
+        snapshotJobs[i].client = clients[i];
+    }
 
-    // check for overflow
-    if (msg.overflowed) {
-        Com_Printf("WARNING: msg overflowed for %s\n", client->name);
-        MSG_Clear(&msg);
+    SV_UpdatePlayerVisibility();
+
+    Sys_RunJobs(SV_BuildSnapshotJob, snapshotJobs, numClients);
+
+    for (i = 0, job = snapshotJobs; i < numClients; i++, job++) {
+        if (job->entityNumbers.error) {
+            Com_Error(ERR_DROP, "%s", job->entityNumbers.error);
+        }
     }
 
-    SV_SendMessageToClient(&msg, client);
+    // pick the delta frames against the ring position each client would
+    // have seen in the serial path
+    nextSnapshotEntities = svs.nextSnapshotEntities;
+    for (i = 0, job = snapshotJobs; i < numClients; i++, job++) {
+        if (job->gathered) {
+            nextSnapshotEntities += job->entityNumbers.numSnapshotEntities;
+        }
+        job->oldframe = SV_SnapshotDeltaFrame(
+            job->client, nextSnapshotEntities, &job->lastframe, &reason[i]);
+    }
+
+    // storing every frame first must not overwrite entities a delta source
+    // still needs, leave those rare frames to the serial path
+    nextSnapshotEntities -= svs.numSnapshotEntities;
+    for (i = 0, job = snapshotJobs; i < numClients; i++, job++) {
+        if (job->oldframe &&
+            job->oldframe->first_entity <= nextSnapshotEntities) {
+            return qfalse;
+        }
+        if (job->client->demorecording && !job->client->demowaiting &&
+            job->client->olddemoframe &&
+            job->client->olddemoframe->first_entity <= nextSnapshotEntities) {
+            return qfalse;
+        }
+    }
+
+    for (i = 0, job = snapshotJobs; i < numClients; i++, job++) {
+        if (reason[i]) {
+            Com_DPrintf("%s: %s\n", job->client->name, reason[i]);
+        }
+        if (job->gathered) {
+            SV_StoreSnapshotEntities(job->client, &job->entityNumbers);
+        }
+    }
+
+    Sys_RunJobs(SV_EncodeSnapshotJob, snapshotJobs, numClients);
+
+    for (i = 0, job = snapshotJobs; i < numClients; i++, job++) {
+        if (job->client->gentity &&
+            job->client->gentity->r.svFlags & SVF_BOT) {
+            continue;
+        }
+        SV_FinishClientSnapshot(job->client, &job->msg, &job->msg_demo, 0);
+    }
+
+    return qtrue;
 }
 
 /*
 =======================
 SV_SendClientMessages
+
+Snapshots are built on snapshot frames only. Between them, clients that are
+owed one anyway (a new gamestate, a snapshot held back by rate or a full
+packet queue) get it on the next game frame instead of waiting a full
+snapshot interval.
 =======================
 */
-void SV_SendClientMessages(void) {
+void SV_SendClientMessages(qboolean snapshotFrame) {
     int i;
     client_t *c;
+    client_t *due[MAX_CLIENTS];
+    int numDue = 0;
+    int snapshotMsec;
+
+    if (sv_threads->modified) {
+        Sys_SetWorkerThreads(sv_threads->integer);
+        sv_threads->modified = qfalse;
+    }
+
+    // configstring commands go into the messages built below
+    SV_FlushConfigstrings();
 
-    // send a message to each connected client
+    // queue the snapshots and hand them to the kernel in one go
+    NET_BeginSendBatch();
+    SV_BeginDeltaCache();
+
+    // find the clients a message has to be sent to
     for (i = 0; i < sv_maxclients->integer; i++) {
         c = &svs.clients[i];
 
@@ -755,6 +1520,9 @@ void SV_SendClientMessages(void) {
         if (*c->downloadName)
             continue; // Client is downloading, don't send snapshots
 
+        if (!snapshotFrame && !c->rateDelayed && c->lastSnapshotTime)
+            continue; // Wait for the next snapshot frame
+
         if (c->netchan.unsentFragments || c->netchan_start_queue) {
             c->rateDelayed = qtrue;
             continue; // Drop this snapshot if the packet queue is still full or
@@ -766,8 +1534,13 @@ void SV_SendClientMessages(void) {
                Sys_IsLANAddress(c->netchan.remoteAddress)))) {
             // rate control for clients not on LAN
 
+            // game frames are 1000 / sv_fps rounded down, take that off the
+            // interval or 20 snaps at 60 fps would wait four 16 msec frames
+            snapshotMsec = SV_SnapshotMsec(c);
+            snapshotMsec -= snapshotMsec * (1000 % sv_fps->integer) / 1000;
+
             if (svs.time - c->lastSnapshotTime <
-                c->snapshotMsec * com_timescale->value)
+                snapshotMsec * com_timescale->value)
                 continue; // It's not time yet
 
             if (SV_RateMsec(c) > 0) {
@@ -777,9 +1550,163 @@ void SV_SendClientMessages(void) {
             }
         }
 
-        // generate and send a new message
-        SV_SendClientSnapshot(c);
-        c->lastSnapshotTime = svs.time;
-        c->rateDelayed = qfalse;
+        due[numDue++] = c;
+    }
+
+    // generate and send the new messages
+    if (numDue) {
+        SV_BuildEntityIndex();
+    }
+    if (!Sys_WorkerThreads() || numDue < 2 ||
+        !SV_SendClientSnapshotsParallel(due, numDue)) {
+        for (i = 0; i < numDue; i++) {
+            SV_SendClientSnapshot(due[i]);
+        }
+    }
+    SV_InvalidateEntityIndex();
+
+    for (i = 0; i < numDue; i++) {
+        due[i]->lastSnapshotTime = svs.time;
+        due[i]->rateDelayed = qfalse;
+    }
+
+    SV_EndDeltaCache();
+    NET_FlushSendBatch();
+}
+
+/*
+==================
+SV_SnapshotBench_f
+
+snapbench [seconds]
+
+Runs the game for the given number of seconds at 20 fps with 20 snapshots a
+second, at 60 with 60 and at 60 with 20. On every snapshot frame a snapshot is
+built and encoded for each bot as if its link acked all of them, and the CPU
+time and snapshot bandwidth of each setting are printed. Game time moves on
+while it runs, so only bots may be connected.
+==================
+*/
+void SV_SnapshotBench_f(void) {
+    static const int rates[][2] = {{20, 20}, {60, 60}, {60, 20}};
+    byte msg_buf[MAX_MSGLEN];
+    byte msg_buf_demo[MAX_MSGLEN];
+    msg_t msg, msg_demo;
+    char fps[MAX_CVAR_VALUE_STRING], snapshotFps[MAX_CVAR_VALUE_STRING];
+    int sequences[MAX_CLIENTS], deltas[MAX_CLIENTS];
+    client_t *cl;
+    clientSnapshot_t *oldframe;
+    const char *reason;
+    int seconds, bots, i, j, tick, ticks, frameMsec, snapshotTicks;
+    int lastframe, start, gameMsec, snapshotMsec, snapshots;
+    long long bytes;
+
+    if (!com_sv_running->integer) {
+        Com_Printf("Server is not running.\n");
+        return;
+    }
+
+    seconds = 10;
+    if (Cmd_Argc() > 1) {
+        seconds = atoi(Cmd_Argv(1));
+    }
+    if (seconds <= 0) {
+        return;
+    }
+
+    bots = 0;
+    for (i = 0, cl = svs.clients; i < sv_maxclients->integer; i++, cl++) {
+        if (!cl->state) {
+            continue;
+        }
+        if (cl->netchan.remoteAddress.type != NA_BOT) {
+            Com_Printf("snapbench: only bots may be connected\n");
+            return;
+        }
+        sequences[i] = cl->netchan.outgoingSequence;
+        deltas[i] = cl->deltaMessage;
+        bots++;
+    }
+
+    Q_strncpyz(fps, sv_fps->string, sizeof(fps));
+    Q_strncpyz(snapshotFps, sv_snapshotFps->string, sizeof(snapshotFps));
+
+    Com_Printf("%i bots, %i seconds per setting\n", bots, seconds);
+    Com_Printf("fps snaps  game ms/s  snap ms/s  cpu %%  snaps/s  bytes/snap  "
+               "KB/s/client\n");
+
+    for (i = 0; i < ARRAY_LEN(rates); i++) {
+        Cvar_Set("sv_fps", va("%i", rates[i][0]));
+        Cvar_Set("sv_snapshotFps", va("%i", rates[i][1]));
+        frameMsec = 1000 / sv_fps->integer;
+        snapshotTicks = SV_SnapshotTicks();
+        ticks = seconds * 1000 / frameMsec;
+
+        gameMsec = snapshotMsec = snapshots = 0;
+        bytes = 0;
+
+        for (tick = 1; tick <= ticks; tick++) {
+            start = Sys_Milliseconds();
+            SV_BotFrame(sv.time);
+            svs.time += frameMsec;
+            sv.time += frameMsec;
+            VM_Call(gvm, GAME_RUN_FRAME, sv.time);
+            gameMsec += Sys_Milliseconds() - start;
+
+            if (tick % snapshotTicks) {
+                continue;
+            }
+
+            start = Sys_Milliseconds();
+            SV_BuildEntityIndex();
+            for (j = 0, cl = svs.clients; j < sv_maxclients->integer;
+                 j++, cl++) {
+                if (cl->state != CS_ACTIVE) {
+                    continue;
+                }
+
+                SV_BuildClientSnapshot(cl);
+
+                MSG_Init(&msg, msg_buf, sizeof(msg_buf));
+                MSG_Init(&msg_demo, msg_buf_demo, sizeof(msg_buf_demo));
+                msg.allowoverflow = qtrue;
+                msg_demo.allowoverflow = qtrue;
+
+                MSG_WriteLong(&msg, cl->lastClientCommand);
+                MSG_WriteLong(&msg_demo, cl->lastClientCommand);
+                oldframe = SV_SnapshotDeltaFrame(cl, svs.nextSnapshotEntities,
+                                                 &lastframe, &reason);
+                SV_WriteSnapshotToClient(cl, oldframe, lastframe, &msg,
+                                         &msg_demo);
+                bytes += msg.cursize;
+                snapshots++;
+
+                // the next snapshot deltas from this one
+                cl->deltaMessage = cl->netchan.outgoingSequence++;
+            }
+            SV_InvalidateEntityIndex();
+            snapshotMsec += Sys_Milliseconds() - start;
+        }
+
+        Com_Printf("%3i %5i  %9.1f  %9.1f  %5.1f  %7.1f  %10i  %11.2f\n",
+                   rates[i][0], rates[i][1], (float)gameMsec / seconds,
+                   (float)snapshotMsec / seconds,
+                   (gameMsec + snapshotMsec) / (seconds * 10.0f),
+                   (float)(ticks / snapshotTicks) / seconds,
+                   snapshots ? (int)(bytes / snapshots) : 0,
+                   bots ? bytes / (bots * seconds * 1024.0f) : 0.0f);
+    }
+
+    Cvar_Set("sv_fps", fps);
+    Cvar_Set("sv_snapshotFps", snapshotFps);
+
+    // give the bots back the sequences they had and a current snapshot
+    for (i = 0, cl = svs.clients; i < sv_maxclients->integer; i++, cl++) {
+        if (!cl->state) {
+            continue;
+        }
+        cl->netchan.outgoingSequence = sequences[i];
+        cl->deltaMessage = deltas[i];
+        SV_BuildClientSnapshot(cl);
     }
 }
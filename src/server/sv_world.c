@@ -33,17 +33,29 @@ be returned, otherwise a custom box tree will be constructed.
 ================
 */
 clipHandle_t SV_ClipHandleForEntity(const sharedEntity_t *ent) {
+    return SV_ClipHandleForEntitySlot(ent, 0);
+}
+
+/*
+================
+SV_ClipHandleForEntitySlot
+
+Same as SV_ClipHandleForEntity, but builds box and capsule hulls in the
+given temporary box slot so several threads can clip at once.
+================
+*/
+clipHandle_t SV_ClipHandleForEntitySlot(const sharedEntity_t *ent, int slot) {
     if (ent->r.bmodel) {
         // explicit hulls in the BSP model
         return CM_InlineModel(ent->s.modelindex);
     }
     if (ent->r.svFlags & SVF_CAPSULE) {
         // create a temp capsule from bounding box sizes
-        return CM_TempBoxModel(ent->r.mins, ent->r.maxs, qtrue);
+        return CM_TempBoxModelSlot(ent->r.mins, ent->r.maxs, qtrue, slot);
     }
 
     // create a temp tree from bounding box sizes
-    return CM_TempBoxModel(ent->r.mins, ent->r.maxs, qfalse);
+    return CM_TempBoxModelSlot(ent->r.mins, ent->r.maxs, qfalse, slot);
 }
 
 /*
@@ -52,110 +64,477 @@ clipHandle_t SV_ClipHandleForEntity(const sharedEntity_t *ent) {
 ENTITY CHECKING
 
 To avoid linearly searching through lists of entities during environment
-testing, the world is carved up with an evenly spaced, axially aligned bsp tree.
-Entities are kept in chains either at the final leafs, or at the first node that
-splits them, which prevents having to deal with multiple fragments of a single
-entity.
+testing, linked entities are kept in a dynamic bounding volume tree. Every
+entity is a leaf, every inner node holds the union of its children, and the
+tree is kept height balanced with rotations as leafs come and go.
+
+Leafs are fattened by WORLD_NODE_MARGIN, so an entity that moves a little
+stays where it is in the tree, only its real box is updated.
 
 ===============================================================================
 */
 
-typedef struct worldSector_s {
-    int axis; // -1 = leaf node
-    float dist;
-    struct worldSector_s *children[2];
-    svEntity_t *entities;
-} worldSector_t;
+#define MAX_WORLD_NODES (MAX_GENTITIES * 2)
+#define WORLD_NODE_MARGIN 16
+#define MAX_WORLD_STACK 128
+
+typedef struct worldNode_s {
+    vec3_t mins, maxs;          // fattened for leafs
+    struct worldNode_s *parent; // next free node if unused
+    struct worldNode_s *children[2]; // NULL for leafs
+    int height;                      // 0 for leafs
 
-#define AREA_DEPTH 4
-#define AREA_NODES 64
+    // leafs only
+    vec3_t absmin, absmax; // the entity's real box
+    int entityNum;
+} worldNode_t;
+
+typedef struct {
+    worldNode_t *root;
+    worldNode_t *freeNodes;
+    int numNodes;
+    worldNode_t nodes[MAX_WORLD_NODES];
+} worldTree_t;
 
-worldSector_t sv_worldSectors[AREA_NODES];
-int sv_numworldSectors;
+static worldTree_t sv_worldTree;
 
 /*
 ===============
-SV_SectorList_f
+SV_ClearWorldTree
 ===============
 */
-void SV_SectorList_f(void) {
-    int i, c;
-    worldSector_t *sec;
-    svEntity_t *ent;
+static void SV_ClearWorldTree(worldTree_t *tree) {
+    int i;
 
-    for (i = 0; i < AREA_NODES; i++) {
-        sec = &sv_worldSectors[i];
+    tree->root = NULL;
+    tree->freeNodes = NULL;
+    tree->numNodes = 0;
 
-        c = 0;
-        for (ent = sec->entities; ent; ent = ent->nextEntityInWorldSector) {
-            c++;
-        }
-        Com_Printf("sector %i: %i entities\n", i, c);
+    for (i = MAX_WORLD_NODES - 1; i >= 0; i--) {
+        tree->nodes[i].parent = tree->freeNodes;
+        tree->freeNodes = &tree->nodes[i];
+    }
+}
+
+/*
+===============
+SV_AllocWorldNode
+===============
+*/
+static worldNode_t *SV_AllocWorldNode(worldTree_t *tree) {
+    worldNode_t *node;
+
+    node = tree->freeNodes;
+    if (!node) {
+        // every entity needs at most two nodes, so this can't happen
+        Com_Error(ERR_DROP, "SV_AllocWorldNode: no free nodes");
+    }
+    tree->freeNodes = node->parent;
+    tree->numNodes++;
+
+    Com_Memset(node, 0, sizeof(*node));
+    return node;
+}
+
+/*
+===============
+SV_FreeWorldNode
+===============
+*/
+static void SV_FreeWorldNode(worldTree_t *tree, worldNode_t *node) {
+    node->parent = tree->freeNodes;
+    tree->freeNodes = node;
+    tree->numNodes--;
+}
+
+/*
+===============
+SV_NodeArea
+
+Half the surface area of a box, the cost of a node is the chance that a
+query has to look into it
+===============
+*/
+static float SV_NodeArea(const vec3_t mins, const vec3_t maxs) {
+    float x, y, z;
+
+    x = maxs[0] - mins[0];
+    y = maxs[1] - mins[1];
+    z = maxs[2] - mins[2];
+
+    return x * y + y * z + z * x;
+}
+
+/*
+===============
+SV_UnionArea
+===============
+*/
+static float SV_UnionArea(const worldNode_t *a, const worldNode_t *b) {
+    vec3_t mins, maxs;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        mins[i] = MIN(a->mins[i], b->mins[i]);
+        maxs[i] = MAX(a->maxs[i], b->maxs[i]);
     }
+
+    return SV_NodeArea(mins, maxs);
 }
 
 /*
 ===============
-SV_CreateworldSector
+SV_RefitWorldNode
 
-Builds a uniformly subdivided tree for the given world size
+Recomputes the box and height of an inner node from its children
 ===============
 */
-static worldSector_t *SV_CreateworldSector(int depth, vec3_t mins,
-                                           vec3_t maxs) {
-    worldSector_t *anode;
-    vec3_t size;
-    vec3_t mins1, maxs1, mins2, maxs2;
+static void SV_RefitWorldNode(worldNode_t *node) {
+    worldNode_t *a, *b;
+    int i;
 
-    anode = &sv_worldSectors[sv_numworldSectors];
-    sv_numworldSectors++;
+    a = node->children[0];
+    b = node->children[1];
 
-    if (depth == AREA_DEPTH) {
-        anode->axis = -1;
-        anode->children[0] = anode->children[1] = NULL;
-        return anode;
+    for (i = 0; i < 3; i++) {
+        node->mins[i] = MIN(a->mins[i], b->mins[i]);
+        node->maxs[i] = MAX(a->maxs[i], b->maxs[i]);
     }
+    node->height = 1 + MAX(a->height, b->height);
+}
 
-    VectorSubtract(maxs, mins, size);
-    if (size[0] > size[1]) {
-        anode->axis = 0;
+/*
+===============
+SV_RotateWorldNode
+
+Moves child c of node a up into a's place, keeping the taller of c's
+children and handing the other one down to a
+===============
+*/
+static worldNode_t *SV_RotateWorldNode(worldTree_t *tree, worldNode_t *a,
+                                       int c) {
+    worldNode_t *up, *keep, *give;
+
+    up = a->children[c];
+    if (up->children[0]->height > up->children[1]->height) {
+        keep = up->children[0];
+        give = up->children[1];
+    } else {
+        keep = up->children[1];
+        give = up->children[0];
+    }
+
+    // up takes a's place
+    up->parent = a->parent;
+    if (!up->parent) {
+        tree->root = up;
+    } else if (up->parent->children[0] == a) {
+        up->parent->children[0] = up;
     } else {
-        anode->axis = 1;
+        up->parent->children[1] = up;
     }
 
-    anode->dist = 0.5 * (maxs[anode->axis] + mins[anode->axis]);
-    VectorCopy(mins, mins1);
-    VectorCopy(mins, mins2);
-    VectorCopy(maxs, maxs1);
-    VectorCopy(maxs, maxs2);
+    up->children[0] = a;
+    up->children[1] = keep;
+    a->parent = up;
 
-    maxs1[anode->axis] = mins2[anode->axis] = anode->dist;
+    a->children[c] = give;
+    give->parent = a;
 
-    anode->children[0] = SV_CreateworldSector(depth + 1, mins2, maxs2);
-    anode->children[1] = SV_CreateworldSector(depth + 1, mins1, maxs1);
+    SV_RefitWorldNode(a);
+    SV_RefitWorldNode(up);
 
-    return anode;
+    return up;
 }
 
 /*
 ===============
-SV_ClearWorld
+SV_BalanceWorldNode
 
+Returns the node that ends up in the position of node
 ===============
 */
-void SV_ClearWorld(void) {
-    clipHandle_t h;
-    vec3_t mins, maxs;
+static worldNode_t *SV_BalanceWorldNode(worldTree_t *tree,
+                                        worldNode_t *node) {
+    int balance;
+
+    if (node->height < 2) {
+        return node;
+    }
+
+    balance = node->children[1]->height - node->children[0]->height;
+    if (balance > 1) {
+        return SV_RotateWorldNode(tree, node, 1);
+    }
+    if (balance < -1) {
+        return SV_RotateWorldNode(tree, node, 0);
+    }
+
+    return node;
+}
+
+/*
+===============
+SV_RefitWorldTree
+
+Walks from node up to the root fixing boxes and heights
+===============
+*/
+static void SV_RefitWorldTree(worldTree_t *tree, worldNode_t *node) {
+    while (node) {
+        node = SV_BalanceWorldNode(tree, node);
+        SV_RefitWorldNode(node);
+        node = node->parent;
+    }
+}
+
+/*
+===============
+SV_InsertWorldLeaf
+
+Pairs the leaf with the node that grows the tree's total area the least
+===============
+*/
+static void SV_InsertWorldLeaf(worldTree_t *tree, worldNode_t *leaf) {
+    worldNode_t *sibling, *parent, *child;
+    float area, combined, cost, inherit, childCost[2];
+    int i;
+
+    if (!tree->root) {
+        tree->root = leaf;
+        leaf->parent = NULL;
+        return;
+    }
+
+    sibling = tree->root;
+    while (sibling->children[0]) {
+        area = SV_NodeArea(sibling->mins, sibling->maxs);
+        combined = SV_UnionArea(sibling, leaf);
+
+        // cost of pairing the leaf with this node
+        cost = 2 * combined;
+
+        // every node below grows by this much too
+        inherit = 2 * (combined - area);
+
+        for (i = 0; i < 2; i++) {
+            child = sibling->children[i];
+            childCost[i] = SV_UnionArea(child, leaf) + inherit;
+            if (child->children[0]) {
+                childCost[i] -= SV_NodeArea(child->mins, child->maxs);
+            }
+        }
+
+        if (cost < childCost[0] && cost < childCost[1]) {
+            break;
+        }
+        sibling = sibling->children[childCost[1] < childCost[0]];
+    }
+
+    parent = SV_AllocWorldNode(tree);
+    parent->parent = sibling->parent;
+    if (!parent->parent) {
+        tree->root = parent;
+    } else if (parent->parent->children[0] == sibling) {
+        parent->parent->children[0] = parent;
+    } else {
+        parent->parent->children[1] = parent;
+    }
+
+    parent->children[0] = sibling;
+    parent->children[1] = leaf;
+    sibling->parent = parent;
+    leaf->parent = parent;
+
+    SV_RefitWorldTree(tree, parent);
+}
+
+/*
+===============
+SV_RemoveWorldLeaf
+
+The leaf's parent is freed and its sibling takes the parent's place
+===============
+*/
+static void SV_RemoveWorldLeaf(worldTree_t *tree, worldNode_t *leaf) {
+    worldNode_t *parent, *grandParent, *sibling;
+
+    if (leaf == tree->root) {
+        tree->root = NULL;
+        return;
+    }
+
+    parent = leaf->parent;
+    grandParent = parent->parent;
+    sibling = parent->children[parent->children[0] == leaf];
+
+    sibling->parent = grandParent;
+    if (!grandParent) {
+        tree->root = sibling;
+    } else if (grandParent->children[0] == parent) {
+        grandParent->children[0] = sibling;
+    } else {
+        grandParent->children[1] = sibling;
+    }
+    SV_FreeWorldNode(tree, parent);
+
+    SV_RefitWorldTree(tree, grandParent);
+}
+
+/*
+===============
+SV_PlaceWorldLeaf
+
+Inserts a new leaf for the box, or updates an existing one. The leaf is
+only moved in the tree when the box leaves its fattened bounds.
+===============
+*/
+static worldNode_t *SV_PlaceWorldLeaf(worldTree_t *tree, worldNode_t *leaf,
+                                      const vec3_t absmin,
+                                      const vec3_t absmax, int entityNum) {
+    int i;
+
+    if (leaf && leaf->mins[0] <= absmin[0] && leaf->mins[1] <= absmin[1] &&
+        leaf->mins[2] <= absmin[2] && leaf->maxs[0] >= absmax[0] &&
+        leaf->maxs[1] >= absmax[1] && leaf->maxs[2] >= absmax[2]) {
+        VectorCopy(absmin, leaf->absmin);
+        VectorCopy(absmax, leaf->absmax);
+        return leaf;
+    }
+
+    if (leaf) {
+        SV_RemoveWorldLeaf(tree, leaf);
+    } else {
+        leaf = SV_AllocWorldNode(tree);
+        leaf->entityNum = entityNum;
+    }
+
+    for (i = 0; i < 3; i++) {
+        leaf->mins[i] = absmin[i] - WORLD_NODE_MARGIN;
+        leaf->maxs[i] = absmax[i] + WORLD_NODE_MARGIN;
+    }
+    VectorCopy(absmin, leaf->absmin);
+    VectorCopy(absmax, leaf->absmax);
+
+    SV_InsertWorldLeaf(tree, leaf);
+
+    return leaf;
+}
 
-    Com_Memset(sv_worldSectors, 0, sizeof(sv_worldSectors));
-    sv_numworldSectors = 0;
+/*
+===============
+SV_QueryWorldTree
+
+Fills list with the numbers of the leafs whose real box intersects the
+given bounds
+===============
+*/
+static int SV_QueryWorldTree(const worldTree_t *tree, const vec3_t mins,
+                             const vec3_t maxs, int *list, int maxcount) {
+    const worldNode_t *stack[MAX_WORLD_STACK];
+    const worldNode_t *node;
+    int sp, count;
+
+    if (!tree->root) {
+        return 0;
+    }
+
+    count = 0;
+    sp = 0;
+    stack[sp++] = tree->root;
+
+    while (sp) {
+        node = stack[--sp];
+
+        if (node->children[0]) {
+            if (node->mins[0] > maxs[0] || node->mins[1] > maxs[1] ||
+                node->mins[2] > maxs[2] || node->maxs[0] < mins[0] ||
+                node->maxs[1] < mins[1] || node->maxs[2] < mins[2]) {
+                continue;
+            }
+
+            // a balanced tree of MAX_WORLD_NODES is far below this
+            if (sp + 2 > MAX_WORLD_STACK) {
+                Com_Error(ERR_DROP, "SV_QueryWorldTree: stack overflow");
+            }
+            stack[sp++] = node->children[1];
+            stack[sp++] = node->children[0];
+            continue;
+        }
 
-    // get world map bounds
-    h = CM_InlineModel(0);
-    CM_ModelBounds(h, mins, maxs);
-    SV_CreateworldSector(0, mins, maxs);
+        if (node->absmin[0] > maxs[0] || node->absmin[1] > maxs[1] ||
+            node->absmin[2] > maxs[2] || node->absmax[0] < mins[0] ||
+            node->absmax[1] < mins[1] || node->absmax[2] < mins[2]) {
+            continue;
+        }
+
+        if (count == maxcount) {
+            Com_Printf("SV_AreaEntities: MAXCOUNT\n");
+            break;
+        }
+
+        list[count++] = node->entityNum;
+    }
+
+    return count;
 }
 
+/*
+===============
+SV_SectorList_f
+===============
+*/
+void SV_SectorList_f(void) {
+    int depths[MAX_WORLD_STACK];
+    const worldNode_t *stack[MAX_WORLD_STACK];
+    const worldNode_t *node;
+    int sp, depth, maxDepth, leafs, i;
+
+    if (!sv_worldTree.root) {
+        Com_Printf("world tree is empty\n");
+        return;
+    }
+
+    Com_Memset(depths, 0, sizeof(depths));
+    maxDepth = leafs = 0;
+
+    // the height of an inner node tells how deep its subtree goes, the
+    // parent pointers give the depth of each leaf
+    sp = 0;
+    stack[sp++] = sv_worldTree.root;
+    while (sp) {
+        node = stack[--sp];
+        if (node->children[0]) {
+            stack[sp++] = node->children[1];
+            stack[sp++] = node->children[0];
+            continue;
+        }
+
+        for (depth = 0; node->parent; node = node->parent) {
+            depth++;
+        }
+        depths[depth]++;
+        maxDepth = MAX(maxDepth, depth);
+        leafs++;
+    }
+
+    Com_Printf("world tree: %i entities, %i nodes, height %i\n", leafs,
+               sv_worldTree.numNodes, sv_worldTree.root->height);
+    for (i = 0; i <= maxDepth; i++) {
+        if (depths[i]) {
+            Com_Printf("depth %i: %i entities\n", i, depths[i]);
+        }
+    }
+}
+
+/*
+===============
+SV_ClearWorld
+
+===============
+*/
+void SV_ClearWorld(void) { SV_ClearWorldTree(&sv_worldTree); }
+
 /*
 ===============
 SV_UnlinkEntity
@@ -164,32 +543,72 @@ SV_UnlinkEntity
 */
 void SV_UnlinkEntity(sharedEntity_t *gEnt) {
     svEntity_t *ent;
-    svEntity_t *scan;
-    worldSector_t *ws;
 
     ent = SV_SvEntityForGentity(gEnt);
 
     gEnt->r.linked = qfalse;
 
-    ws = ent->worldSector;
-    if (!ws) {
+    if (!ent->worldNode) {
         return; // not linked in anywhere
     }
-    ent->worldSector = NULL;
 
-    if (ws->entities == ent) {
-        ws->entities = ent->nextEntityInWorldSector;
+    SV_RemoveWorldLeaf(&sv_worldTree, ent->worldNode);
+    SV_FreeWorldNode(&sv_worldTree, ent->worldNode);
+    ent->worldNode = NULL;
+}
+
+/*
+===============
+SV_LinkStatsFrame
+
+===============
+*/
+static struct {
+    int frames;
+    int links, skipped;           // since the last reset
+    int frameLinks, frameSkipped; // in the current game frame
+    int lastLinks, lastSkipped;   // in the last game frame
+    int maxLinks;                 // relinks actually done in one frame
+} linkStats;
+
+void SV_LinkStatsFrame(void) {
+    linkStats.frames++;
+    linkStats.lastLinks = linkStats.frameLinks;
+    linkStats.lastSkipped = linkStats.frameSkipped;
+    if (linkStats.frameLinks - linkStats.frameSkipped > linkStats.maxLinks)
+        linkStats.maxLinks = linkStats.frameLinks - linkStats.frameSkipped;
+    linkStats.frameLinks = linkStats.frameSkipped = 0;
+}
+
+/*
+===============
+SV_LinkStats_f
+
+linkstats [reset]
+===============
+*/
+void SV_LinkStats_f(void) {
+    if (!Q_stricmp(Cmd_Argv(1), "reset")) {
+        Com_Memset(&linkStats, 0, sizeof(linkStats));
         return;
     }
 
-    for (scan = ws->entities; scan; scan = scan->nextEntityInWorldSector) {
-        if (scan->nextEntityInWorldSector == ent) {
-            scan->nextEntityInWorldSector = ent->nextEntityInWorldSector;
-            return;
-        }
+    if (!linkStats.frames) {
+        Com_Printf("No game frames recorded.\n");
+        return;
     }
 
-    Com_Printf("WARNING: SV_UnlinkEntity: not found in worldSector\n");
+    Com_Printf("sv_linkCache %i, %i game frames\n", sv_linkCache->integer,
+               linkStats.frames);
+    Com_Printf("last frame: %i links, %i skipped\n", linkStats.lastLinks,
+               linkStats.lastSkipped);
+    Com_Printf("per frame:  %.1f links, %.1f skipped (%.1f%%), "
+               "at most %i relinked\n",
+               (float)linkStats.links / linkStats.frames,
+               (float)linkStats.skipped / linkStats.frames,
+               linkStats.links ? 100.0f * linkStats.skipped / linkStats.links
+                               : 0.0f,
+               linkStats.maxLinks);
 }
 
 /*
@@ -200,7 +619,6 @@ SV_LinkEntity
 */
 #define MAX_TOTAL_ENT_LEAFS 128
 void SV_LinkEntity(sharedEntity_t *gEnt) {
-    worldSector_t *node;
     int leafs[MAX_TOTAL_ENT_LEAFS];
     int cluster;
     int num_leafs;
@@ -212,10 +630,6 @@ void SV_LinkEntity(sharedEntity_t *gEnt) {
 
     ent = SV_SvEntityForGentity(gEnt);
 
-    if (ent->worldSector) {
-        SV_UnlinkEntity(gEnt); // unlink from old position
-    }
-
     // encode the size into the entityState_t for client prediction
     if (gEnt->r.bmodel) {
         gEnt->s.solid =
@@ -276,6 +690,19 @@ void SV_LinkEntity(sharedEntity_t *gEnt) {
     gEnt->r.absmax[1] += 1;
     gEnt->r.absmax[2] += 1;
 
+    linkStats.links++;
+    linkStats.frameLinks++;
+
+    // the leafs, clusters, areas and world sector only depend on the
+    // absolute box, so an entity that did not move keeps its link
+    if (ent->worldNode && gEnt->r.linked && sv_linkCache->integer &&
+        VectorCompare(gEnt->r.absmin, ent->linkAbsmin) &&
+        VectorCompare(gEnt->r.absmax, ent->linkAbsmax)) {
+        linkStats.skipped++;
+        linkStats.frameSkipped++;
+        return;
+    }
+
     // link to PVS leafs
     ent->numClusters = 0;
     ent->lastCluster = 0;
@@ -289,6 +716,7 @@ void SV_LinkEntity(sharedEntity_t *gEnt) {
     // if none of the leafs were inside the map, the
     // entity is outside the world and can be considered unlinked
     if (!num_leafs) {
+        SV_UnlinkEntity(gEnt);
         return;
     }
 
@@ -331,23 +759,12 @@ void SV_LinkEntity(sharedEntity_t *gEnt) {
 
     gEnt->r.linkcount++;
 
-    // find the first world sector node that the ent's box crosses
-    node = sv_worldSectors;
-    while (1) {
-        if (node->axis == -1)
-            break;
-        if (gEnt->r.absmin[node->axis] > node->dist)
-            node = node->children[0];
-        else if (gEnt->r.absmax[node->axis] < node->dist)
-            node = node->children[1];
-        else
-            break; // crosses the node
-    }
-
-    // link it in
-    ent->worldSector = node;
-    ent->nextEntityInWorldSector = node->entities;
-    node->entities = ent;
+    // link it in, the tree leaf only moves if the box left its margin
+    ent->worldNode =
+        SV_PlaceWorldLeaf(&sv_worldTree, ent->worldNode, gEnt->r.absmin,
+                          gEnt->r.absmax, ent - sv.svEntities);
+    VectorCopy(gEnt->r.absmin, ent->linkAbsmin);
+    VectorCopy(gEnt->r.absmax, ent->linkAbsmax);
 
     gEnt->r.linked = qtrue;
 }
@@ -362,77 +779,173 @@ bounds.  This does NOT mean that they actually touch in the case of bmodels.
 ============================================================================
 */
 
-typedef struct {
-    const float *mins;
-    const float *maxs;
-    int *list;
-    int count, maxcount;
-} areaParms_t;
+/*
+================
+SV_AreaEntities
+================
+*/
+int SV_AreaEntities(const vec3_t mins, const vec3_t maxs, int *entityList,
+                    int maxcount) {
+    return SV_QueryWorldTree(&sv_worldTree, mins, maxs, entityList,
+                             maxcount);
+}
 
 /*
-====================
-SV_AreaEntities_r
+================
+SV_AreaBench_f
 
-====================
-*/
-static void SV_AreaEntities_r(worldSector_t *node, areaParms_t *ap) {
-    svEntity_t *check, *next;
-    sharedEntity_t *gcheck;
+areabench [entities] [frames]
 
-    for (check = node->entities; check; check = next) {
-        next = check->nextEntityInWorldSector;
+Links the given number of player sized boxes into a private world tree, most
+of them crowded around a few spots like players in a busy part of a big map,
+and moves a third of them a little every frame. Each frame every box runs a
+trace sized area query. The tree is timed against a linear scan of all boxes,
+which is what a crowded node of a fixed sector tree comes down to, and both
+must return the same entities.
+================
+*/
+#define AREA_BENCH_SPOTS 4
+
+void SV_AreaBench_f(void) {
+    worldTree_t *tree;
+    worldNode_t **leafs;
+    vec3_t *absmin, *absmax;
+    vec3_t worldMins, worldMaxs, spots[AREA_BENCH_SPOTS];
+    vec3_t mins, maxs, org, size;
+    int list[MAX_GENTITIES];
+    byte found[MAX_GENTITIES];
+    int entities, frames, seed, i, j, f, count, hits, mismatches;
+    long long start, updateTime, treeTime, scanTime;
+    float move;
+
+    entities = 512;
+    if (Cmd_Argc() > 1) {
+        entities = atoi(Cmd_Argv(1));
+    }
+    entities = MIN(MAX(entities, 1), MAX_GENTITIES);
 
-        gcheck = SV_GEntityForSvEntity(check);
+    frames = 200;
+    if (Cmd_Argc() > 2) {
+        frames = atoi(Cmd_Argv(2));
+    }
+    frames = MAX(frames, 1);
 
-        if (gcheck->r.absmin[0] > ap->maxs[0] ||
-            gcheck->r.absmin[1] > ap->maxs[1] ||
-            gcheck->r.absmin[2] > ap->maxs[2] ||
-            gcheck->r.absmax[0] < ap->mins[0] ||
-            gcheck->r.absmax[1] < ap->mins[1] ||
-            gcheck->r.absmax[2] < ap->mins[2]) {
-            continue;
+    if (sv.state) {
+        CM_ModelBounds(CM_InlineModel(0), worldMins, worldMaxs);
+    } else {
+        VectorSet(worldMins, -4096, -4096, -4096);
+        VectorSet(worldMaxs, 4096, 4096, 4096);
+    }
+    VectorSubtract(worldMaxs, worldMins, size);
+
+    tree = Z_Malloc(sizeof(*tree));
+    leafs = Z_Malloc(entities * sizeof(*leafs));
+    absmin = Z_Malloc(entities * sizeof(*absmin));
+    absmax = Z_Malloc(entities * sizeof(*absmax));
+    SV_ClearWorldTree(tree);
+
+    seed = 1;
+    for (i = 0; i < AREA_BENCH_SPOTS; i++) {
+        for (j = 0; j < 3; j++) {
+            spots[i][j] = worldMins[j] + Q_random(&seed) * size[j];
         }
+    }
 
-        if (ap->count == ap->maxcount) {
-            Com_Printf("SV_AreaEntities: MAXCOUNT\n");
-            return;
+    // seven in ten are crowded around a spot, one in fifty is a long mover
+    for (i = 0; i < entities; i++) {
+        for (j = 0; j < 3; j++) {
+            if (i % 10 < 7) {
+                org[j] = spots[i % AREA_BENCH_SPOTS][j] +
+                         Q_crandom(&seed) * (j == 2 ? 128 : 640);
+            } else {
+                org[j] = worldMins[j] + Q_random(&seed) * size[j];
+            }
         }
-
-        ap->list[ap->count] = check - sv.svEntities;
-        ap->count++;
+        if (i % 50 == 0) {
+            VectorSet(mins, -320, -24, -24);
+            VectorSet(maxs, 320, 24, 192);
+        } else {
+            VectorSet(mins, -15, -15, -24);
+            VectorSet(maxs, 15, 15, 32);
+        }
+        VectorAdd(org, mins, absmin[i]);
+        VectorAdd(org, maxs, absmax[i]);
     }
 
-    if (node->axis == -1) {
-        return; // terminal node
-    }
+    updateTime = treeTime = scanTime = 0;
+    hits = mismatches = 0;
+
+    for (f = 0; f < frames; f++) {
+        start = Sys_Nanoseconds();
+        for (i = 0; i < entities; i++) {
+            if (f && i % 3 == 0) {
+                for (j = 0; j < 2; j++) {
+                    move = Q_crandom(&seed) * 12;
+                    absmin[i][j] += move;
+                    absmax[i][j] += move;
+                }
+            }
+            leafs[i] =
+                SV_PlaceWorldLeaf(tree, leafs[i], absmin[i], absmax[i], i);
+        }
+        updateTime += Sys_Nanoseconds() - start;
+
+        for (i = 0; i < entities; i++) {
+            // a player box swept up to 400 units along one axis
+            VectorCopy(absmin[i], mins);
+            VectorCopy(absmax[i], maxs);
+            j = (int)(Q_random(&seed) * 3);
+            move = Q_crandom(&seed) * 400;
+            if (move < 0) {
+                mins[j] += move;
+            } else {
+                maxs[j] += move;
+            }
 
-    // recurse down both sides
-    if (ap->maxs[node->axis] > node->dist) {
-        SV_AreaEntities_r(node->children[0], ap);
-    }
-    if (ap->mins[node->axis] < node->dist) {
-        SV_AreaEntities_r(node->children[1], ap);
-    }
-}
+            start = Sys_Nanoseconds();
+            count = SV_QueryWorldTree(tree, mins, maxs, list, MAX_GENTITIES);
+            treeTime += Sys_Nanoseconds() - start;
 
-/*
-================
-SV_AreaEntities
-================
-*/
-int SV_AreaEntities(const vec3_t mins, const vec3_t maxs, int *entityList,
-                    int maxcount) {
-    areaParms_t ap;
+            Com_Memset(found, 0, entities);
+            for (j = 0; j < count; j++) {
+                found[list[j]] = 1;
+            }
 
-    ap.mins = mins;
-    ap.maxs = maxs;
-    ap.list = entityList;
-    ap.count = 0;
-    ap.maxcount = maxcount;
+            start = Sys_Nanoseconds();
+            for (j = 0; j < entities; j++) {
+                if (absmin[j][0] > maxs[0] || absmin[j][1] > maxs[1] ||
+                    absmin[j][2] > maxs[2] || absmax[j][0] < mins[0] ||
+                    absmax[j][1] < mins[1] || absmax[j][2] < mins[2]) {
+                    found[j] |= 2;
+                } else {
+                    found[j] |= 4;
+                }
+            }
+            scanTime += Sys_Nanoseconds() - start;
 
-    SV_AreaEntities_r(sv_worldSectors, &ap);
+            // in the tree list exactly when the scan found it
+            for (j = 0; j < entities; j++) {
+                if (found[j] != 2 && found[j] != 5) {
+                    mismatches++;
+                }
+            }
+            hits += count;
+        }
+    }
 
-    return ap.count;
+    Com_Printf("%i entities, %i frames, tree height %i, %i nodes\n", entities,
+               frames, tree->root->height, tree->numNodes);
+    Com_Printf("update %.2f usec/frame, %.1f hits/query, %i mismatches\n",
+               updateTime / 1000.0 / frames,
+               (float)hits / (entities * frames), mismatches);
+    Com_Printf("query: tree %.3f usec, linear scan %.3f usec\n",
+               treeTime / 1000.0 / (entities * frames),
+               scanTime / 1000.0 / (entities * frames));
+
+    Z_Free(absmax);
+    Z_Free(absmin);
+    Z_Free(leafs);
+    Z_Free(tree);
 }
 
 //===========================================================================
@@ -447,6 +960,7 @@ typedef struct {
     int passEntityNum;
     int contentmask;
     int capsule;
+    int boxSlot; // temporary box slot for entity hulls
 } moveclip_t;
 
 /*
@@ -545,7 +1059,7 @@ static void SV_ClipMoveToEntities(moveclip_t *clip) {
         }
 
         // might intersect, so do an exact clip
-        clipHandle = SV_ClipHandleForEntity(touch);
+        clipHandle = SV_ClipHandleForEntitySlot(touch, clip->boxSlot);
 
         origin = touch->r.currentOrigin;
         angles = touch->r.currentAngles;
@@ -582,15 +1096,15 @@ static void SV_ClipMoveToEntities(moveclip_t *clip) {
 
 /*
 ==================
-SV_Trace
+SV_TraceSlot
 
-Moves the given mins/maxs volume through the world from start to end.
-passEntityNum and entities owned by passEntityNum are explicitly not checked.
+SV_Trace with entity hulls built in the given temporary box slot.
 ==================
 */
-void SV_Trace(trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs,
-              const vec3_t end, int passEntityNum, int contentmask,
-              int capsule) {
+static void SV_TraceSlot(trace_t *results, const vec3_t start,
+                         const vec3_t mins, const vec3_t maxs,
+                         const vec3_t end, int passEntityNum, int contentmask,
+                         int capsule, int boxSlot) {
     moveclip_t clip;
     int i;
 
@@ -604,7 +1118,8 @@ void SV_Trace(trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs,
     Com_Memset(&clip, 0, sizeof(moveclip_t));
 
     // clip to world
-    CM_BoxTrace(&clip.trace, start, end, mins, maxs, 0, contentmask, capsule);
+    CM_BoxTrace(&clip.trace, start, end, (float *)mins, (float *)maxs, 0,
+                contentmask, capsule);
     clip.trace.entityNum =
         clip.trace.fraction != 1.0 ? ENTITYNUM_WORLD : ENTITYNUM_NONE;
     if (clip.trace.fraction == 0) {
@@ -620,6 +1135,7 @@ void SV_Trace(trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs,
     clip.maxs = maxs;
     clip.passEntityNum = passEntityNum;
     clip.capsule = capsule;
+    clip.boxSlot = boxSlot;
 
     // create the bounding box of the entire move
     // we can limit it to the part of the move not
@@ -641,6 +1157,407 @@ void SV_Trace(trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs,
     *results = clip.trace;
 }
 
+/*
+==================
+SV_Trace
+
+Moves the given mins/maxs volume through the world from start to end.
+passEntityNum and entities owned by passEntityNum are explicitly not checked.
+==================
+*/
+void SV_Trace(trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs,
+              const vec3_t end, int passEntityNum, int contentmask,
+              int capsule) {
+    SV_TraceSlot(results, start, mins, maxs, end, passEntityNum, contentmask,
+                 capsule, 0);
+}
+
+/*
+===============================================================================
+
+TRACE BATCHES
+
+The game hands over a whole array of independent traces in one system call.
+Big batches are spread over the sv_threads workers, every job clips entity
+boxes in its own temporary box slot, the world and inline models are only
+read. The results are the same as running SV_Trace on each request in order.
+
+===============================================================================
+*/
+
+// a worker job should have enough traces to be worth waking a thread for
+#define TRACE_BATCH_JOB_TRACES 8
+
+typedef struct {
+    trace_t *results;
+    const traceRequest_t *requests;
+    int count;
+    int numJobs;
+} traceBatch_t;
+
+/*
+==================
+SV_TraceBatchJob
+==================
+*/
+static void SV_TraceBatchJob(void *data, int job) {
+    traceBatch_t *batch = data;
+    const traceRequest_t *req;
+    int i;
+
+    // interleave the requests, neighbouring pellets cost about the same
+    for (i = job; i < batch->count; i += batch->numJobs) {
+        req = &batch->requests[i];
+        // slot 0 belongs to the main thread outside of batches
+        SV_TraceSlot(&batch->results[i], req->start, req->mins, req->maxs,
+                     req->end, req->passEntityNum, req->contentmask,
+                     req->capsule, job + 1);
+    }
+}
+
+/*
+==================
+SV_TraceBatch
+
+Runs count traces, results[i] is what SV_Trace returns for requests[i].
+==================
+*/
+void SV_TraceBatch(trace_t *results, const traceRequest_t *requests,
+                   int count) {
+    traceBatch_t batch;
+    int numJobs;
+
+    if (count <= 0) {
+        return;
+    }
+
+    numJobs = count / TRACE_BATCH_JOB_TRACES;
+    if (numJobs > Sys_WorkerThreads() + 1) {
+        numJobs = Sys_WorkerThreads() + 1;
+    }
+    if (numJobs > CM_BOX_SLOTS - 1) {
+        numJobs = CM_BOX_SLOTS - 1;
+    }
+    if (numJobs < 1) {
+        numJobs = 1;
+    }
+
+    batch.results = results;
+    batch.requests = requests;
+    batch.count = count;
+    batch.numJobs = numJobs;
+    Sys_RunJobs(SV_TraceBatchJob, &batch, numJobs);
+}
+
+/*
+==================
+SV_SameTrace
+==================
+*/
+static qboolean SV_SameTrace(const trace_t *a, const trace_t *b) {
+    return a->allsolid == b->allsolid && a->startsolid == b->startsolid &&
+           a->fraction == b->fraction && VectorCompare(a->endpos, b->endpos) &&
+           VectorCompare(a->plane.normal, b->plane.normal) &&
+           a->plane.dist == b->plane.dist &&
+           a->surfaceFlags == b->surfaceFlags && a->contents == b->contents &&
+           a->entityNum == b->entityNum;
+}
+
+/*
+==================
+SV_TraceBench_f
+
+tracebench [traces] [rounds]
+
+Runs a batch of shot sized traces across the current map, half of them aimed
+at linked entities and one in four swept with a player box, once through
+SV_Trace one at a time and once through SV_TraceBatch with the current
+sv_threads. Both must give the same results. This only times the engine side,
+the game VM call per trace that a batch saves comes on top.
+==================
+*/
+void SV_TraceBench_f(void) {
+    traceRequest_t *requests;
+    trace_t *single, *batched;
+    traceRequest_t *req;
+    sharedEntity_t *gEnt;
+    int linked[MAX_GENTITIES];
+    vec3_t worldMins, worldMaxs, size;
+    int traces, rounds, numLinked, seed, i, j, r, mismatches;
+    long long start, singleTime, batchTime;
+
+    if (!sv.state) {
+        Com_Printf("Server is not running.\n");
+        return;
+    }
+
+    traces = 64;
+    if (Cmd_Argc() > 1) {
+        traces = atoi(Cmd_Argv(1));
+    }
+    traces = MIN(MAX(traces, 1), MAX_TRACE_BATCH);
+
+    rounds = 1000;
+    if (Cmd_Argc() > 2) {
+        rounds = atoi(Cmd_Argv(2));
+    }
+    rounds = MAX(rounds, 1);
+
+    if (sv_threads->modified) {
+        Sys_SetWorkerThreads(sv_threads->integer);
+        sv_threads->modified = qfalse;
+    }
+
+    numLinked = 0;
+    for (i = 0; i < sv.num_entities; i++) {
+        gEnt = SV_GentityNum(i);
+        if (gEnt->r.linked && gEnt->r.contents) {
+            linked[numLinked++] = i;
+        }
+    }
+
+    CM_ModelBounds(CM_InlineModel(0), worldMins, worldMaxs);
+    VectorSubtract(worldMaxs, worldMins, size);
+
+    requests = Z_Malloc(traces * sizeof(*requests));
+    single = Z_Malloc(traces * sizeof(*single));
+    batched = Z_Malloc(traces * sizeof(*batched));
+
+    seed = 1;
+    for (i = 0; i < traces; i++) {
+        req = &requests[i];
+        for (j = 0; j < 3; j++) {
+            req->start[j] = worldMins[j] + Q_random(&seed) * size[j];
+            req->end[j] = worldMins[j] + Q_random(&seed) * size[j];
+        }
+        if (numLinked && (i & 1)) {
+            gEnt = SV_GentityNum(linked[(int)(Q_random(&seed) * numLinked) %
+                                        numLinked]);
+            VectorAdd(gEnt->r.absmin, gEnt->r.absmax, req->end);
+            VectorScale(req->end, 0.5f, req->end);
+        }
+        if (i % 4 == 3) {
+            VectorSet(req->mins, -15, -15, -24);
+            VectorSet(req->maxs, 15, 15, 32);
+        } else {
+            VectorClear(req->mins);
+            VectorClear(req->maxs);
+        }
+        req->passEntityNum = ENTITYNUM_NONE;
+        req->contentmask = CONTENTS_SOLID | CONTENTS_BODY | CONTENTS_CORPSE;
+        req->capsule = qfalse;
+    }
+
+    singleTime = batchTime = 0;
+    mismatches = 0;
+    for (r = 0; r < rounds; r++) {
+        start = Sys_Nanoseconds();
+        for (i = 0; i < traces; i++) {
+            req = &requests[i];
+            SV_Trace(&single[i], req->start, req->mins, req->maxs, req->end,
+                     req->passEntityNum, req->contentmask, req->capsule);
+        }
+        singleTime += Sys_Nanoseconds() - start;
+
+        start = Sys_Nanoseconds();
+        SV_TraceBatch(batched, requests, traces);
+        batchTime += Sys_Nanoseconds() - start;
+
+        for (i = 0; i < traces; i++) {
+            if (!SV_SameTrace(&single[i], &batched[i])) {
+                mismatches++;
+            }
+        }
+    }
+
+    Com_Printf("%i traces x %i rounds, %i linked entities, %i worker "
+               "threads\n",
+               traces, rounds, numLinked, Sys_WorkerThreads());
+    Com_Printf("one by one %.3f usec/trace, batch %.3f usec/trace, "
+               "%i mismatches\n",
+               singleTime / 1000.0 / ((double)traces * rounds),
+               batchTime / 1000.0 / ((double)traces * rounds), mismatches);
+
+    Z_Free(batched);
+    Z_Free(single);
+    Z_Free(requests);
+}
+
+/*
+==================
+SV_SegmentHitsBox
+
+Slab test of the segment start-end against an axial box. Sets *enter to the
+fraction where the segment enters the box, 0 if it starts inside.
+==================
+*/
+static qboolean SV_SegmentHitsBox(const vec3_t start, const vec3_t end,
+                                  const vec3_t mins, const vec3_t maxs,
+                                  float *enter) {
+    float leave, d, f1, f2, t;
+    int i;
+
+    *enter = 0;
+    leave = 1;
+    for (i = 0; i < 3; i++) {
+        d = end[i] - start[i];
+        if (d == 0) {
+            if (start[i] < mins[i] || start[i] > maxs[i]) {
+                return qfalse;
+            }
+            continue;
+        }
+        f1 = (mins[i] - start[i]) / d;
+        f2 = (maxs[i] - start[i]) / d;
+        if (f1 > f2) {
+            t = f1;
+            f1 = f2;
+            f2 = t;
+        }
+        if (f1 > *enter) {
+            *enter = f1;
+        }
+        if (f2 < leave) {
+            leave = f2;
+        }
+        if (*enter > leave) {
+            return qfalse;
+        }
+    }
+    return qtrue;
+}
+
+/*
+==================
+SV_EntitySegmentFraction
+
+Where the segment start-end first hits an entity, 1 if it misses
+==================
+*/
+static float SV_EntitySegmentFraction(sharedEntity_t *touch,
+                                      const vec3_t start, const vec3_t end,
+                                      int contentmask) {
+    trace_t trace;
+    vec3_t mins, maxs;
+    float enter;
+
+    if (touch->r.bmodel) {
+        CM_TransformedBoxTrace(&trace, start, end, (float *)vec3_origin,
+                               (float *)vec3_origin,
+                               CM_InlineModel(touch->s.modelindex),
+                               contentmask, touch->r.currentOrigin,
+                               touch->r.currentAngles, qfalse);
+        return trace.fraction;
+    }
+
+    VectorAdd(touch->r.currentOrigin, touch->r.mins, mins);
+    VectorAdd(touch->r.currentOrigin, touch->r.maxs, maxs);
+    if (!SV_SegmentHitsBox(start, end, mins, maxs, &enter)) {
+        return 1;
+    }
+    return enter;
+}
+
+/*
+==================
+SV_LineIgnores
+
+The same entities SV_ClipMoveToEntities ignores
+==================
+*/
+static qboolean SV_LineIgnores(const sharedEntity_t *touch, int num,
+                               int passEntityNum, int passOwnerNum) {
+    if (passEntityNum == ENTITYNUM_NONE) {
+        return qfalse;
+    }
+    return num == passEntityNum || touch->r.ownerNum == passEntityNum ||
+           touch->r.ownerNum == passOwnerNum;
+}
+
+/*
+==================
+SV_LineOfSight
+
+Returns qtrue if a point trace from start to end would not be stopped by
+anything in contentmask before reaching goalEntityNum, the same as SV_Trace
+returning a fraction of 1 or hitting goalEntityNum first.
+
+Unlike SV_Trace this is safe to call from worker threads: entities that are
+not bmodels are tested as plain boxes instead of going through
+CM_TempBoxModel, which uses global state.
+==================
+*/
+qboolean SV_LineOfSight(const vec3_t start, const vec3_t end,
+                        int passEntityNum, int goalEntityNum,
+                        int contentmask) {
+    int touchlist[MAX_GENTITIES];
+    sharedEntity_t *touch;
+    int passOwnerNum;
+    trace_t trace;
+    vec3_t stop, boxmins, boxmaxs;
+    float goal;
+    int i, num;
+
+    passOwnerNum = -1;
+    if (passEntityNum != ENTITYNUM_NONE) {
+        passOwnerNum = (SV_GentityNum(passEntityNum))->r.ownerNum;
+        if (passOwnerNum == ENTITYNUM_NONE) {
+            passOwnerNum = -1;
+        }
+    }
+
+    // only what is in front of the goal can block the line
+    goal = 1;
+    if (goalEntityNum >= 0 && goalEntityNum < sv.num_entities) {
+        touch = SV_GentityNum(goalEntityNum);
+        if (touch->r.linked && (contentmask & touch->r.contents) &&
+            !SV_LineIgnores(touch, goalEntityNum, passEntityNum,
+                            passOwnerNum)) {
+            goal = SV_EntitySegmentFraction(touch, start, end, contentmask);
+        }
+    }
+    for (i = 0; i < 3; i++) {
+        stop[i] = start[i] + goal * (end[i] - start[i]);
+    }
+
+    // check the world first, it is what blocks most lines
+    CM_BoxTrace(&trace, start, stop, (float *)vec3_origin,
+                (float *)vec3_origin, 0, contentmask, qfalse);
+    if (trace.fraction != 1.0) {
+        return qfalse;
+    }
+
+    for (i = 0; i < 3; i++) {
+        if (stop[i] > start[i]) {
+            boxmins[i] = start[i] - 1;
+            boxmaxs[i] = stop[i] + 1;
+        } else {
+            boxmins[i] = stop[i] - 1;
+            boxmaxs[i] = start[i] + 1;
+        }
+    }
+
+    num = SV_AreaEntities(boxmins, boxmaxs, touchlist, MAX_GENTITIES);
+
+    for (i = 0; i < num; i++) {
+        touch = SV_GentityNum(touchlist[i]);
+
+        if (touchlist[i] == goalEntityNum ||
+            SV_LineIgnores(touch, touchlist[i], passEntityNum, passOwnerNum)) {
+            continue;
+        }
+        if (!(contentmask & touch->r.contents)) {
+            continue;
+        }
+
+        if (SV_EntitySegmentFraction(touch, start, stop, contentmask) < 1) {
+            return qfalse;
+        }
+    }
+
+    return qtrue;
+}
+
 /*
 =============
 SV_PointContents
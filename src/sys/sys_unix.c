@@ -33,11 +33,16 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include <unistd.h>
 #include <sys/mman.h>
 #include <sys/time.h>
+#include <time.h>
 #include <pwd.h>
 #include <libgen.h>
 #include <fcntl.h>
 #include <fenv.h>
 #include <sys/wait.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
 
 qboolean stdinIsATTY;
 
@@ -187,35 +192,76 @@ const char *Sys_GetSystemInstallPath(const char *path) {
 
 /*
 ================
-Sys_Milliseconds
+Sys_Nanoseconds
+
+Monotonic, so it doesn't jump when the wall clock is set. Counts from the
+start of the second it was first called in, which keeps
+Sys_Nanoseconds() / 1000000 equal to Sys_Milliseconds() and millisecond
+boundaries on both clocks the same instants.
 ================
 */
-/* base time in seconds, that's our origin
-   timeval:tv_sec is an int:
-   assuming this wraps every 0x7fffffff - ~68 years since the Epoch (1970) -
-   we're safe till 2038 */
+/* base time in seconds, that's our origin */
 unsigned long sys_timeBase = 0;
 /* current time in ms, using sys_timeBase as origin
-   NOTE: sys_timeBase*1000 + curtime -> ms since the Epoch
-     0x7fffffff ms - ~24 days
-   although timeval:tv_usec is an int, I'm not sure wether it is actually used
-   as an unsigned int (which would affect the wrap period) */
+     0x7fffffff ms - ~24 days */
 int curtime;
-int Sys_Milliseconds(void) {
-    struct timeval tp;
+long long Sys_Nanoseconds(void) {
+    static qboolean initialized = qfalse;
+    struct timespec ts;
 
-    gettimeofday(&tp, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
 
-    if (!sys_timeBase) {
-        sys_timeBase = tp.tv_sec;
-        return tp.tv_usec / 1000;
+    if (!initialized) {
+        sys_timeBase = ts.tv_sec;
+        initialized = qtrue;
     }
 
-    curtime = (tp.tv_sec - sys_timeBase) * 1000 + tp.tv_usec / 1000;
+    return (long long)(ts.tv_sec - sys_timeBase) * 1000000000 + ts.tv_nsec;
+}
+
+/*
+================
+Sys_Milliseconds
+================
+*/
+int Sys_Milliseconds(void) {
+    curtime = Sys_Nanoseconds() / 1000000;
 
     return curtime;
 }
 
+/*
+================
+Sys_SleepUntil
+
+Sleeps until Sys_Nanoseconds() reaches nsec
+================
+*/
+void Sys_SleepUntil(long long nsec) {
+    struct timespec ts;
+
+#ifdef __APPLE__
+    // no clock_nanosleep, the relative sleep is late by the call overhead
+    nsec -= Sys_Nanoseconds();
+    if (nsec <= 0)
+        return;
+
+    ts.tv_sec = nsec / 1000000000;
+    ts.tv_nsec = nsec % 1000000000;
+    nanosleep(&ts, NULL);
+#else
+    Sys_Nanoseconds(); // sets sys_timeBase
+
+    nsec += (long long)sys_timeBase * 1000000000;
+    ts.tv_sec = nsec / 1000000000;
+    ts.tv_nsec = nsec % 1000000000;
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+           EINTR)
+        ;
+#endif
+}
+
 /*
 ==================
 Sys_RandomBytes
@@ -333,6 +379,52 @@ FILE *Sys_FOpen(const char *ospath, const char *mode) {
 #endif
 }
 
+/*
+==============
+Sys_MapFile
+
+Maps a whole file read-only and shared, so every user of the same file
+reads the same pages. The mapping stays valid after f is closed.
+==============
+*/
+void *Sys_MapFile(FILE *f, int *length) {
+    struct stat buf;
+    void *data;
+
+    if (fstat(fileno(f), &buf) || buf.st_size <= 0 || buf.st_size > INT_MAX)
+        return NULL;
+
+    data = mmap(NULL, buf.st_size, PROT_READ, MAP_SHARED, fileno(f), 0);
+    if (data == MAP_FAILED)
+        return NULL;
+
+    *length = buf.st_size;
+    return data;
+}
+
+/*
+==============
+Sys_UnmapFile
+==============
+*/
+void Sys_UnmapFile(void *data, int length) { munmap(data, length); }
+
+/*
+==============
+Sys_FileModifiedTime
+
+-1 if it can't be read
+==============
+*/
+int Sys_FileModifiedTime(FILE *f) {
+    struct stat buf;
+
+    if (fstat(fileno(f), &buf))
+        return -1;
+
+    return buf.st_mtime;
+}
+
 /*
 ==================
 Sys_Mkdir
@@ -611,6 +703,187 @@ void Sys_Sleep(int msec) {
     }
 }
 
+/*
+==============================================================================
+
+WORKER THREADS
+
+A fixed set of threads that, together with the calling thread, run the
+indexes of a job in parallel. Sys_RunJobs blocks until every index is done.
+
+==============================================================================
+*/
+
+static pthread_t workerThreads[MAX_WORKER_THREADS];
+static int numWorkerThreads;
+
+static pthread_mutex_t jobMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobStart = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t jobDone = PTHREAD_COND_INITIALIZER;
+
+static void (*jobFunc)(void *data, int index);
+static void *jobData;
+static int jobCount;
+static volatile int jobNext;
+static int jobGeneration;
+static int jobBusy; // workers still inside the current job
+static qboolean jobQuit;
+
+/*
+==================
+Sys_RunJobIndexes
+==================
+*/
+static void Sys_RunJobIndexes(void) {
+    int index;
+
+    while ((index = Sys_AtomicAdd(&jobNext, 1)) < jobCount)
+        jobFunc(jobData, index);
+}
+
+/*
+==================
+Sys_WorkerThread
+==================
+*/
+static void *Sys_WorkerThread(void *arg) {
+    // the batch that was current when the thread was created, a worker
+    // started after jobs have run must wait for the next one
+    int generation = (int)(intptr_t)arg;
+
+    pthread_mutex_lock(&jobMutex);
+    for (;;) {
+        while (!jobQuit && generation == jobGeneration)
+            pthread_cond_wait(&jobStart, &jobMutex);
+
+        if (jobQuit)
+            break;
+
+        generation = jobGeneration;
+        pthread_mutex_unlock(&jobMutex);
+
+        Sys_RunJobIndexes();
+
+        pthread_mutex_lock(&jobMutex);
+        if (--jobBusy == 0)
+            pthread_cond_signal(&jobDone);
+    }
+    pthread_mutex_unlock(&jobMutex);
+
+    return NULL;
+}
+
+/*
+==================
+Sys_SetWorkerThreads
+
+0 runs every job on the calling thread
+==================
+*/
+void Sys_SetWorkerThreads(int count) {
+    int i;
+
+    if (count < 0)
+        count = 0;
+    else if (count > MAX_WORKER_THREADS)
+        count = MAX_WORKER_THREADS;
+
+    if (count == numWorkerThreads)
+        return;
+
+    if (numWorkerThreads) {
+        pthread_mutex_lock(&jobMutex);
+        jobQuit = qtrue;
+        pthread_cond_broadcast(&jobStart);
+        pthread_mutex_unlock(&jobMutex);
+
+        for (i = 0; i < numWorkerThreads; i++)
+            pthread_join(workerThreads[i], NULL);
+
+        numWorkerThreads = 0;
+        jobQuit = qfalse;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (pthread_create(&workerThreads[i], NULL, Sys_WorkerThread,
+                           (void *)(intptr_t)jobGeneration)) {
+            Com_Printf("WARNING: Sys_SetWorkerThreads: pthread_create: %s\n",
+                       strerror(errno));
+            break;
+        }
+        numWorkerThreads++;
+    }
+}
+
+/*
+==================
+Sys_WorkerThreads
+==================
+*/
+int Sys_WorkerThreads(void) { return numWorkerThreads; }
+
+/*
+==================
+Sys_RunJobs
+
+Calls func(data, index) for every index in [0, count)
+==================
+*/
+void Sys_RunJobs(void (*func)(void *data, int index), void *data, int count) {
+    int i;
+
+    if (!numWorkerThreads || count < 2) {
+        for (i = 0; i < count; i++)
+            func(data, i);
+        return;
+    }
+
+    pthread_mutex_lock(&jobMutex);
+    jobFunc = func;
+    jobData = data;
+    jobCount = count;
+    jobNext = 0;
+    jobBusy = numWorkerThreads;
+    jobGeneration++;
+    pthread_cond_broadcast(&jobStart);
+    pthread_mutex_unlock(&jobMutex);
+
+    Sys_RunJobIndexes();
+
+    pthread_mutex_lock(&jobMutex);
+    while (jobBusy)
+        pthread_cond_wait(&jobDone, &jobMutex);
+    pthread_mutex_unlock(&jobMutex);
+}
+
+/*
+==================
+Sys_AtomicAdd
+==================
+*/
+int Sys_AtomicAdd(volatile int *value, int add) {
+    return __sync_fetch_and_add(value, add);
+}
+
+/*
+==================
+Sys_AtomicAdd64
+==================
+*/
+int64_t Sys_AtomicAdd64(volatile int64_t *value, int64_t add) {
+    return __sync_fetch_and_add(value, add);
+}
+
+/*
+==================
+Sys_AtomicSwapPointer
+==================
+*/
+qboolean Sys_AtomicSwapPointer(void *volatile *pointer, void *compare,
+                               void *exchange) {
+    return __sync_bool_compare_and_swap(pointer, compare, exchange);
+}
+
 /*
 ==============
 Sys_ErrorDialog
@@ -957,6 +1230,12 @@ void Sys_PlatformInit(void) {
 
     stdinIsATTY = isatty(STDIN_FILENO) &&
                   !(term && (!strcmp(term, "raw") || !strcmp(term, "dumb")));
+
+#if defined(DEDICATED) && defined(__linux__)
+    // the kernel may otherwise batch the frame timer's wakeup with others up
+    // to 50 usec later
+    prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+#endif
 }
 
 /*
@@ -33,6 +33,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include <stdio.h>
 #include <direct.h>
 #include <io.h>
+#include <sys/stat.h>
 #include <conio.h>
 #include <wincrypt.h>
 #include <shlobj.h>
@@ -125,23 +126,54 @@ Sys_GetSystemInstallPath
 */
 const char *Sys_GetSystemInstallPath(const char *path) { return path; }
 
+/*
+================
+Sys_Nanoseconds
+
+Counts from the first call, Sys_Milliseconds is derived from it so the two
+clocks agree
+================
+*/
+static LARGE_INTEGER sys_timeBase;
+static LARGE_INTEGER sys_timeFrequency;
+long long Sys_Nanoseconds(void) {
+    LARGE_INTEGER now;
+    long long ticks, frequency;
+
+    if (!sys_timeFrequency.QuadPart) {
+        QueryPerformanceFrequency(&sys_timeFrequency);
+        QueryPerformanceCounter(&sys_timeBase);
+    }
+
+    QueryPerformanceCounter(&now);
+    ticks = now.QuadPart - sys_timeBase.QuadPart;
+    frequency = sys_timeFrequency.QuadPart;
+
+    // split up so ticks * 1000000000 can't overflow
+    return ticks / frequency * 1000000000 +
+           ticks % frequency * 1000000000 / frequency;
+}
+
 /*
 ================
 Sys_Milliseconds
 ================
 */
-int sys_timeBase;
-int Sys_Milliseconds(void) {
-    int sys_curtime;
-    static qboolean initialized = qfalse;
+int Sys_Milliseconds(void) { return Sys_Nanoseconds() / 1000000; }
 
-    if (!initialized) {
-        sys_timeBase = timeGetTime();
-        initialized = qtrue;
-    }
-    sys_curtime = timeGetTime() - sys_timeBase;
+/*
+================
+Sys_SleepUntil
 
-    return sys_curtime;
+Sleeps until Sys_Nanoseconds() reaches nsec, with Sleep()'s granularity
+================
+*/
+void Sys_SleepUntil(long long nsec) {
+    long long msec;
+
+    msec = (nsec - Sys_Nanoseconds() + 999999) / 1000000;
+    if (msec > 0)
+        Sleep(msec);
 }
 
 /*
@@ -282,6 +314,60 @@ FILE *Sys_FOpen(const char *ospath, const char *mode) {
     return fopen(ospath, mode);
 }
 
+/*
+==============
+Sys_MapFile
+
+Maps a whole file read-only, the mapping stays valid after f is closed
+==============
+*/
+void *Sys_MapFile(FILE *f, int *length) {
+    HANDLE file, mapping;
+    LARGE_INTEGER size;
+    void *data;
+
+    file = (HANDLE)_get_osfhandle(_fileno(f));
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size) ||
+        size.QuadPart <= 0 || size.QuadPart > INT_MAX)
+        return NULL;
+
+    mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping)
+        return NULL;
+
+    data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    // the view keeps the mapping alive
+    CloseHandle(mapping);
+    if (!data)
+        return NULL;
+
+    *length = (int)size.QuadPart;
+    return data;
+}
+
+/*
+==============
+Sys_UnmapFile
+==============
+*/
+void Sys_UnmapFile(void *data, int length) { UnmapViewOfFile(data); }
+
+/*
+==============
+Sys_FileModifiedTime
+
+-1 if it can't be read
+==============
+*/
+int Sys_FileModifiedTime(FILE *f) {
+    struct _stat buf;
+
+    if (_fstat(_fileno(f), &buf))
+        return -1;
+
+    return buf.st_mtime;
+}
+
 /*
 ==============
 Sys_Mkdir
@@ -556,6 +642,184 @@ void Sys_Sleep(int msec) {
 #endif
 }
 
+/*
+==============================================================================
+
+WORKER THREADS
+
+Same job model as sys_unix.c. Each batch releases the start semaphore once
+per worker and the last worker out of the batch sets the done event.
+
+==============================================================================
+*/
+
+static HANDLE workerThreads[MAX_WORKER_THREADS];
+static int numWorkerThreads;
+
+static HANDLE jobStart; // semaphore, one count per worker and batch
+static HANDLE jobDone;  // auto-reset event
+
+static void (*jobFunc)(void *data, int index);
+static void *jobData;
+static int jobCount;
+static volatile LONG jobNext;
+static volatile LONG jobBusy; // counts of the current batch still running
+static volatile LONG jobQuit;
+
+/*
+==================
+Sys_RunJobIndexes
+==================
+*/
+static void Sys_RunJobIndexes(void) {
+    int index;
+
+    while ((index = InterlockedIncrement(&jobNext) - 1) < jobCount)
+        jobFunc(jobData, index);
+}
+
+/*
+==================
+Sys_WorkerThread
+
+A worker that takes a second count of the same batch finds no index left,
+so jobBusy still only reaches 0 once the whole batch is done
+==================
+*/
+static DWORD WINAPI Sys_WorkerThread(LPVOID arg) {
+    for (;;) {
+        WaitForSingleObject(jobStart, INFINITE);
+
+        if (jobQuit)
+            break;
+
+        Sys_RunJobIndexes();
+
+        if (InterlockedDecrement(&jobBusy) == 0)
+            SetEvent(jobDone);
+    }
+
+    return 0;
+}
+
+/*
+==================
+Sys_SetWorkerThreads
+
+0 runs every job on the calling thread
+==================
+*/
+void Sys_SetWorkerThreads(int count) {
+    int i;
+
+    if (count < 0)
+        count = 0;
+    else if (count > MAX_WORKER_THREADS)
+        count = MAX_WORKER_THREADS;
+
+    if (count == numWorkerThreads)
+        return;
+
+    if (numWorkerThreads) {
+        InterlockedExchange(&jobQuit, 1);
+        ReleaseSemaphore(jobStart, numWorkerThreads, NULL);
+        WaitForMultipleObjects(numWorkerThreads, workerThreads, TRUE,
+                               INFINITE);
+
+        for (i = 0; i < numWorkerThreads; i++)
+            CloseHandle(workerThreads[i]);
+
+        numWorkerThreads = 0;
+        InterlockedExchange(&jobQuit, 0);
+    }
+
+    if (!jobStart) {
+        jobStart = CreateSemaphore(NULL, 0, MAX_WORKER_THREADS, NULL);
+        jobDone = CreateEvent(NULL, FALSE, FALSE, NULL);
+        if (!jobStart || !jobDone) {
+            Com_Printf("WARNING: Sys_SetWorkerThreads: couldn't create the "
+                       "job objects\n");
+            return;
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        workerThreads[i] =
+            CreateThread(NULL, 0, Sys_WorkerThread, NULL, 0, NULL);
+        if (!workerThreads[i]) {
+            Com_Printf("WARNING: Sys_SetWorkerThreads: CreateThread failed "
+                       "(%lu)\n",
+                       GetLastError());
+            break;
+        }
+        numWorkerThreads++;
+    }
+}
+
+/*
+==================
+Sys_WorkerThreads
+==================
+*/
+int Sys_WorkerThreads(void) { return numWorkerThreads; }
+
+/*
+==================
+Sys_RunJobs
+
+Calls func(data, index) for every index in [0, count)
+==================
+*/
+void Sys_RunJobs(void (*func)(void *data, int index), void *data, int count) {
+    int i;
+
+    if (!numWorkerThreads || count < 2) {
+        for (i = 0; i < count; i++)
+            func(data, i);
+        return;
+    }
+
+    jobFunc = func;
+    jobData = data;
+    jobCount = count;
+    jobNext = 0;
+    jobBusy = numWorkerThreads;
+    ReleaseSemaphore(jobStart, numWorkerThreads, NULL);
+
+    Sys_RunJobIndexes();
+
+    WaitForSingleObject(jobDone, INFINITE);
+}
+
+/*
+==================
+Sys_AtomicAdd
+==================
+*/
+int Sys_AtomicAdd(volatile int *value, int add) {
+    return InterlockedExchangeAdd((volatile LONG *)value, add);
+}
+
+/*
+==================
+Sys_AtomicAdd64
+==================
+*/
+int64_t Sys_AtomicAdd64(volatile int64_t *value, int64_t add) {
+    return InterlockedExchangeAdd64((volatile LONGLONG *)value, add);
+}
+
+/*
+==================
+Sys_AtomicSwapPointer
+==================
+*/
+qboolean Sys_AtomicSwapPointer(void *volatile *pointer, void *compare,
+                               void *exchange) {
+    return InterlockedCompareExchangePointer(pointer, exchange, compare) ==
+           compare;
+}
+
 /*
 ==============
 Sys_ErrorDialog